@@ -33,6 +33,20 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)logWithSource:(NSString *)source message:(NSString *)message;
 - (void)logFormat:(NSString *)format, ... NS_FORMAT_FUNCTION(1,2);
 
+// Framed protocol: prefixes each datagram with a random per-instance sender
+// ID and an incrementing sequence number so the server can report loss,
+// duplicates and reordering. Off by default (plain "SOURCE|MESSAGE").
+// In framed mode, messages too long for one datagram are sent as fragments
+// and reassembled by the server instead of being truncated.
+@property (nonatomic, assign) BOOL useFramedProtocol;
+@property (nonatomic, readonly) uint32_t senderID;
+
+// Batching (framed protocol only): log lines are coalesced into one datagram
+// for up to batchInterval seconds or until batchMaxBytes are pending, and the
+// server keeps each line's own logging time. 0 disables batching (default).
+@property (nonatomic, assign) NSTimeInterval batchInterval;
+@property (nonatomic, assign) NSUInteger batchMaxBytes;  // Default 1400
+
 // Connection management
 @property (nonatomic, readonly) BOOL isConnected;
 - (void)connect;
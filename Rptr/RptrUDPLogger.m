@@ -12,15 +12,43 @@
 #import <arpa/inet.h>
 #import <ifaddrs.h>
 #import <net/if.h>
+#import <sys/time.h>
 #import <UIKit/UIKit.h>
 
 #define DEFAULT_UDP_PORT 9999
 #define MAX_MESSAGE_SIZE 4000  // Leave room for headers
 
+// Framed protocol header, see UDPLogServer/log_protocol.h
+#define FRAME_HEADER_SIZE 12
+#define FRAME_MAGIC_0 0xFE
+#define FRAME_MAGIC_1 'L'
+#define FRAME_VERSION 1
+#define FRAME_TYPE_LINE 1
+#define FRAME_TYPE_FRAGMENT 2
+#define FRAME_TYPE_BATCH 3
+#define BATCH_HEADER_SIZE 8
+#define BATCH_ENTRY_HEADER_SIZE 6
+#define MAX_BATCH_RECORDS ((MAX_DATAGRAM_SIZE - FRAME_HEADER_SIZE - BATCH_HEADER_SIZE) / BATCH_ENTRY_HEADER_SIZE)
+#define DEFAULT_BATCH_MAX_BYTES 1400  // One Wi-Fi frame, no IP fragmentation
+#define FRAGMENT_HEADER_SIZE 8
+#define MAX_DATAGRAM_SIZE 4000
+#define MAX_FRAGMENT_PAYLOAD (MAX_DATAGRAM_SIZE - FRAME_HEADER_SIZE - FRAGMENT_HEADER_SIZE)
+#define MAX_FRAGMENTS 1024
+#define MAX_FRAGMENTED_MESSAGE_SIZE (MAX_FRAGMENTS * MAX_FRAGMENT_PAYLOAD)
+
 @interface RptrUDPLogger () {
     int _socketFD;
     struct sockaddr_in _serverAddr;
     dispatch_queue_t _sendQueue;
+    uint32_t _sequenceNumber;  // Only touched on _sendQueue
+    uint32_t _messageID;       // Only touched on _sendQueue
+    
+    // Pending Batch frame and the offset/logging time of each entry (_sendQueue only)
+    NSMutableData *_batch;
+    NSUInteger _batchCount;
+    size_t _batchOffsets[MAX_BATCH_RECORDS];
+    uint64_t _batchLoggedAt[MAX_BATCH_RECORDS];
+    uint64_t _batchGeneration;  // Invalidates flush timers of already-sent batches
 }
 
 @property (nonatomic, strong) NSString *serverHost;
@@ -31,9 +59,33 @@
 @property (nonatomic, assign) NSUInteger messagesDropped;
 @property (nonatomic, strong) NSString *discoveredServerIP;
 @property (nonatomic, assign) BOOL autoDiscoveryEnabled;
+@property (nonatomic, assign) uint32_t senderID;
 
 @end
 
+// Wall-clock microseconds since the Unix epoch, as used by Batch frames
+static uint64_t RptrNowMicroseconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec;
+}
+
+// Longest prefix of a UTF-8 string that fits in limit bytes without
+// splitting a multi-byte character
+static size_t RptrUTF8PrefixLength(const char *utf8, size_t length, size_t limit) {
+    if (length <= limit) return length;
+    size_t end = limit;
+    while (end > 0 && ((uint8_t)utf8[end] & 0xC0) == 0x80) {
+        end--;  // utf8[end] continues the character that starts before it
+    }
+    return end;
+}
+
+static void RptrWriteUInt32(uint8_t *out, uint32_t value) {
+    uint32_t bigEndian = htonl(value);
+    memcpy(out, &bigEndian, sizeof(bigEndian));
+}
+
 @implementation RptrUDPLogger
 
 + (instancetype)sharedLogger {
@@ -70,6 +122,12 @@
         _messagesSent = 0;
         _bytesSent = 0;
         _messagesDropped = 0;
+        _useFramedProtocol = NO;
+        _senderID = arc4random();
+        _sequenceNumber = 0;
+        _messageID = 0;
+        _batchInterval = 0;
+        _batchMaxBytes = DEFAULT_BATCH_MAX_BYTES;
     }
     return self;
 }
@@ -140,6 +198,7 @@
     [self logWithSource:@"iOS" message:@"==== iOS App Disconnected ===="];
     
     dispatch_sync(_sendQueue, ^{
+        [self flushBatch];
         if (self->_socketFD >= 0) {
             close(self->_socketFD);
             self->_socketFD = -1;
@@ -185,33 +244,156 @@
         return;
     }
     
+    uint64_t loggedAt = RptrNowMicroseconds();
     dispatch_async(_sendQueue, ^{
-        // Truncate if too long
-        NSString *finalMessage = message;
-        if (message.length > MAX_MESSAGE_SIZE) {
-            finalMessage = [message substringToIndex:MAX_MESSAGE_SIZE];
+        if (!self.useFramedProtocol) {
+            // Plain datagrams: truncate if too long
+            NSString *finalMessage = message;
+            if (message.length > MAX_MESSAGE_SIZE) {
+                finalMessage = [message substringToIndex:MAX_MESSAGE_SIZE];
+            }
+            const char *utf8Message = [finalMessage UTF8String];
+            [self sendDatagram:utf8Message length:strlen(utf8Message) messages:1];
+            return;
         }
         
-        const char *utf8Message = [finalMessage UTF8String];
-        size_t messageLength = strlen(utf8Message);
+        // Framed: coalesced into a Batch frame, one Line frame, or Fragment
+        // frames for records too large for a single datagram (diagnostic
+        // dumps, reports)
+        const char *utf8Message = [message UTF8String];
+        size_t messageLength = RptrUTF8PrefixLength(utf8Message, strlen(utf8Message),
+                                                    (size_t)MAX_FRAGMENTED_MESSAGE_SIZE);
         
-        // Send via UDP (non-blocking)
-        ssize_t sent = sendto(self->_socketFD, utf8Message, messageLength, 0,
-                             (struct sockaddr *)&self->_serverAddr, sizeof(self->_serverAddr));
+        if (self.batchInterval > 0 &&
+            messageLength <= MAX_DATAGRAM_SIZE - FRAME_HEADER_SIZE - BATCH_HEADER_SIZE - BATCH_ENTRY_HEADER_SIZE) {
+            [self addToBatch:utf8Message length:messageLength loggedAt:loggedAt];
+            return;
+        }
+        [self flushBatch];  // Keep stream order
+        
+        if (messageLength <= MAX_DATAGRAM_SIZE - FRAME_HEADER_SIZE) {
+            NSMutableData *datagram = [NSMutableData dataWithLength:FRAME_HEADER_SIZE];
+            [self writeFrameHeader:datagram.mutableBytes type:FRAME_TYPE_LINE];
+            [datagram appendBytes:utf8Message length:messageLength];
+            [self sendDatagram:datagram.bytes length:datagram.length messages:1];
+            return;
+        }
         
-        if (sent > 0) {
-            self.messagesSent++;
-            self.bytesSent += sent;
-        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
-            // Only log real errors, not non-blocking would-block
-            if (self.messagesDropped % 100 == 0) {  // Rate limit error logging
-                NSLog(@"[RptrUDPLogger] Send failed: %s", strerror(errno));
+        uint16_t count = (uint16_t)((messageLength + MAX_FRAGMENT_PAYLOAD - 1) / MAX_FRAGMENT_PAYLOAD);
+        uint32_t messageID = htonl(self->_messageID++);
+        uint8_t datagram[MAX_DATAGRAM_SIZE];
+        for (uint16_t index = 0; index < count; index++) {
+            size_t offset = (size_t)index * MAX_FRAGMENT_PAYLOAD;
+            size_t slice = MIN((size_t)MAX_FRAGMENT_PAYLOAD, messageLength - offset);
+            
+            // Fragment header: message ID, index, count (network byte order)
+            [self writeFrameHeader:datagram type:FRAME_TYPE_FRAGMENT];
+            uint16_t fragmentIndex = htons(index);
+            uint16_t fragmentCount = htons(count);
+            memcpy(datagram + FRAME_HEADER_SIZE, &messageID, sizeof(messageID));
+            memcpy(datagram + FRAME_HEADER_SIZE + 4, &fragmentIndex, sizeof(fragmentIndex));
+            memcpy(datagram + FRAME_HEADER_SIZE + 6, &fragmentCount, sizeof(fragmentCount));
+            memcpy(datagram + FRAME_HEADER_SIZE + FRAGMENT_HEADER_SIZE, utf8Message + offset, slice);
+            
+            NSUInteger completes = (index == count - 1) ? 1 : 0;
+            if (![self sendDatagram:datagram length:FRAME_HEADER_SIZE + FRAGMENT_HEADER_SIZE + slice
+                           messages:completes]) {
+                break;  // The server would discard the incomplete record anyway
             }
-            self.messagesDropped++;
         }
     });
 }
 
+// Appends a record to the pending Batch frame, starting a new frame (and its
+// flush timer) if needed. Session commands go out immediately. Called on _sendQueue.
+- (void)addToBatch:(const char *)record length:(size_t)length loggedAt:(uint64_t)loggedAt {
+    if (_batch && _batch.length + BATCH_ENTRY_HEADER_SIZE + length > MAX_DATAGRAM_SIZE) {
+        [self flushBatch];
+    }
+    if (!_batch) {
+        _batch = [NSMutableData dataWithLength:FRAME_HEADER_SIZE + BATCH_HEADER_SIZE];
+        uint64_t generation = ++_batchGeneration;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.batchInterval * NSEC_PER_SEC)),
+                       _sendQueue, ^{
+            if (self->_batchGeneration == generation) {
+                [self flushBatch];
+            }
+        });
+    }
+    
+    // Entry: age (filled in at send time), record length, record
+    uint8_t entryHeader[BATCH_ENTRY_HEADER_SIZE] = {0};
+    uint16_t recordLength = htons((uint16_t)length);
+    memcpy(entryHeader + 4, &recordLength, sizeof(recordLength));
+    _batchOffsets[_batchCount] = _batch.length;
+    _batchLoggedAt[_batchCount] = loggedAt;
+    _batchCount++;
+    [_batch appendBytes:entryHeader length:sizeof(entryHeader)];
+    [_batch appendBytes:record length:length];
+    
+    BOOL isCommand = length >= 4 && memcmp(record, "CMD|", 4) == 0;
+    if (isCommand || _batch.length >= MIN(self.batchMaxBytes, (NSUInteger)MAX_DATAGRAM_SIZE)) {
+        [self flushBatch];
+    }
+}
+
+// Sends the pending Batch frame, stamping each record's age relative to now.
+// Called on _sendQueue.
+- (void)flushBatch {
+    if (!_batch) {
+        return;
+    }
+    
+    uint8_t *bytes = _batch.mutableBytes;
+    uint64_t sendTime = RptrNowMicroseconds();
+    for (NSUInteger i = 0; i < _batchCount; i++) {
+        uint64_t age = sendTime > _batchLoggedAt[i] ? sendTime - _batchLoggedAt[i] : 0;
+        RptrWriteUInt32(bytes + _batchOffsets[i], (uint32_t)MIN(age, (uint64_t)UINT32_MAX));
+    }
+    [self writeFrameHeader:bytes type:FRAME_TYPE_BATCH];
+    RptrWriteUInt32(bytes + FRAME_HEADER_SIZE, (uint32_t)(sendTime >> 32));
+    RptrWriteUInt32(bytes + FRAME_HEADER_SIZE + 4, (uint32_t)sendTime);
+    
+    [self sendDatagram:bytes length:_batch.length messages:_batchCount];
+    _batch = nil;
+    _batchCount = 0;
+    _batchGeneration++;
+}
+
+// Header: magic, version, type, sender ID, sequence (network byte order).
+// Must be called on _sendQueue; every datagram takes the next sequence number.
+- (void)writeFrameHeader:(uint8_t *)header type:(uint8_t)type {
+    header[0] = FRAME_MAGIC_0;
+    header[1] = FRAME_MAGIC_1;
+    header[2] = FRAME_VERSION;
+    header[3] = type;
+    uint32_t senderID = htonl(self.senderID);
+    uint32_t sequence = htonl(_sequenceNumber++);
+    memcpy(header + 4, &senderID, sizeof(senderID));
+    memcpy(header + 8, &sequence, sizeof(sequence));
+}
+
+// Sends one datagram (non-blocking) carrying `messages` complete log
+// messages and updates the stats; called on _sendQueue
+- (BOOL)sendDatagram:(const void *)datagram length:(size_t)length messages:(NSUInteger)messages {
+    ssize_t sent = sendto(_socketFD, datagram, length, 0,
+                         (struct sockaddr *)&_serverAddr, sizeof(_serverAddr));
+    
+    if (sent > 0) {
+        self.messagesSent += messages;
+        self.bytesSent += sent;
+        return YES;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        // Only log real errors, not non-blocking would-block
+        if (self.messagesDropped % 100 == 0) {  // Rate limit error logging
+            NSLog(@"[RptrUDPLogger] Send failed: %s", strerror(errno));
+        }
+        self.messagesDropped += MAX(messages, (NSUInteger)1);
+    }
+    return NO;
+}
+
 #pragma mark - WiFi IP Discovery
 
 - (nullable NSString *)getLocalWiFiIPAddress {
@@ -0,0 +1,143 @@
+#!/bin/bash
+
+# Find the highest message rate udp_log_server ingests without loss, as a
+# regression gate for ingest changes
+#
+# One server is started on a scratch port and log directory. udp_log_loadgen
+# then runs once per rate, each run in a session of its own, and joins its
+# messages against that session log (every part of it, compressed or not,
+# when BENCH_SERVER_ARGS enables rotation): loss, end-to-end latency percentiles
+# (from each message's scheduled send time to its line timestamp) and the
+# server's CPU time per message. The rate doubles until loss exceeds
+# BENCH_MAX_LOSS, then is bisected between the last passing and the first
+# failing rate.
+#
+# Exits non-zero if the highest passing rate is below BENCH_MIN_RATE, or its
+# p99 latency is above BENCH_MAX_P99_US, so it can gate a change.
+#
+# Environment overrides:
+#   BENCH_PORT        UDP port (default 19996)
+#   BENCH_SENDERS     Load generator sender threads (default 4)
+#   BENCH_DURATION    Seconds per run (default 3)
+#   BENCH_SIZE        Message size: BYTES, MIN-MAX or exp:MEAN (default 120)
+#   BENCH_MMSG        Datagrams per sendmmsg() call (default 1)
+#   BENCH_START_RATE  First rate, messages per second per sender (default 5000)
+#   BENCH_MAX_RATE    Stop doubling here (default 1000000)
+#   BENCH_REFINE      Bisection steps after the first failing rate (default 3)
+#   BENCH_MAX_LOSS    Loss allowed at a passing rate, percent (default 0)
+#   BENCH_MIN_RATE    Fail below this total rate, messages per second (default 0 = no gate)
+#   BENCH_MAX_P99_US  Fail above this p99 latency at the passing rate (default 0 = no gate)
+#   BENCH_SERVER_ARGS Extra udp_log_server options (e.g. "--io-engine io_uring",
+#                     "--rotate-size 1000000 --compress on")
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+SERVER_DIR="$SCRIPT_DIR/../UDPLogServer"
+SERVER="$SERVER_DIR/udp_log_server"
+LOADGEN="$SERVER_DIR/udp_log_loadgen"
+
+PORT=${BENCH_PORT:-19996}
+SENDERS=${BENCH_SENDERS:-4}
+DURATION=${BENCH_DURATION:-3}
+SIZE=${BENCH_SIZE:-120}
+MMSG=${BENCH_MMSG:-1}
+START_RATE=${BENCH_START_RATE:-5000}
+MAX_RATE=${BENCH_MAX_RATE:-1000000}
+REFINE=${BENCH_REFINE:-3}
+MAX_LOSS=${BENCH_MAX_LOSS:-0}
+MIN_RATE=${BENCH_MIN_RATE:-0}
+MAX_P99_US=${BENCH_MAX_P99_US:-0}
+
+if [ ! -x "$SERVER" ] || [ ! -x "$LOADGEN" ]; then
+    echo "Build first: make -C $SERVER_DIR"
+    exit 1
+fi
+
+WORK_DIR=$(mktemp -d)
+LOG_DIR="$WORK_DIR/logs"
+cd "$WORK_DIR" || exit 1
+"$SERVER" --port "$PORT" --log-dir "$LOG_DIR" $BENCH_SERVER_ARGS > "$WORK_DIR/server.txt" 2>&1 &
+SERVER_PID=$!
+trap 'kill -INT $SERVER_PID 2>/dev/null; wait $SERVER_PID 2>/dev/null; rm -rf "$WORK_DIR"' EXIT
+sleep 1
+if ! kill -0 $SERVER_PID 2>/dev/null; then
+    echo "Server failed to start:"
+    cat "$WORK_DIR/server.txt"
+    exit 1
+fi
+
+echo "============================================"
+echo "UDP Log Server Ingest Gate"
+echo "============================================"
+echo "senders: $SENDERS  duration: ${DURATION}s  size: $SIZE  mmsg: $MMSG  max loss: $MAX_LOSS%"
+echo ""
+printf "%12s %12s %8s %10s %10s %10s %10s %12s\n" \
+    "offered/s" "achieved/s" "loss" "p50 us" "p99 us" "p99.9 us" "max us" "server us/msg"
+
+# run RATE: prints "PASS|FAIL achieved loss p50 p99 p999 max cpu" for one run
+run() {
+    OUTPUT=$("$LOADGEN" --port "$PORT" --senders "$SENDERS" --duration "$DURATION" --size "$SIZE" \
+        --mmsg "$MMSG" --rate "$1" --new-session --join "$LOG_DIR" --server-pid "$SERVER_PID")
+    ACHIEVED=$(echo "$OUTPUT" | sed -n 's/^sent=.* rate=\([0-9]*\).*/\1/p')
+    JOIN=$(echo "$OUTPUT" | grep '^join ')
+    field() { echo "$JOIN" | sed -n "s/.* $1=\([0-9.]*\).*/\1/p"; }
+    LOSS=$(field loss)
+    LOSS=${LOSS:-100}
+    awk -v offered=$(($1 * SENDERS)) -v achieved="${ACHIEVED:-0}" -v loss="$LOSS" -v max="$MAX_LOSS" \
+        -v p50="$(field p50_us)" -v p99="$(field p99_us)" -v p999="$(field p999_us)" -v top="$(field max_us)" \
+        -v cpu="$(field server_cpu_us)" 'BEGIN {
+        printf "%12d %12d %7.3f%% %10d %10d %10d %10d %12.2f\n", offered, achieved, loss, p50, p99, p999, top, cpu > "/dev/stderr"
+        printf "%s %d %s %d %d %d %d %s\n", (loss <= max && achieved >= offered * 0.95) ? "PASS" : "FAIL",
+            achieved, loss, p50, p99, p999, top, cpu
+    }'
+}
+
+GOOD=0
+GOOD_RESULT=""
+BAD=0
+RATE=$START_RATE
+while [ "$RATE" -le "$MAX_RATE" ]; do
+    RESULT=$(run "$RATE")
+    if [ "${RESULT%% *}" != "PASS" ]; then
+        BAD=$RATE
+        break
+    fi
+    GOOD=$RATE
+    GOOD_RESULT=$RESULT
+    RATE=$((RATE * 2))
+done
+
+STEP=0
+while [ "$BAD" -gt 0 ] && [ "$STEP" -lt "$REFINE" ] && [ $((BAD - GOOD)) -gt 1 ]; do
+    RATE=$(((GOOD + BAD) / 2))
+    RESULT=$(run "$RATE")
+    if [ "${RESULT%% *}" = "PASS" ]; then
+        GOOD=$RATE
+        GOOD_RESULT=$RESULT
+    else
+        BAD=$RATE
+    fi
+    STEP=$((STEP + 1))
+done
+
+echo ""
+STATUS=0
+if [ "$GOOD" -eq 0 ]; then
+    echo "No rate passed (starting at $START_RATE msg/s per sender)"
+    STATUS=1
+else
+    set -- $GOOD_RESULT
+    echo "Max sustainable rate: $((GOOD * SENDERS)) msg/s offered, $2 msg/s achieved" \
+        "(p50 $4 us, p99 $5 us, server $8 us CPU per message)"
+    if [ "$BAD" -eq 0 ]; then
+        echo "  (no loss up to BENCH_MAX_RATE; the real ceiling is higher)"
+    fi
+    if [ "$MIN_RATE" -gt 0 ] && [ $((GOOD * SENDERS)) -lt "$MIN_RATE" ]; then
+        echo "FAIL: below BENCH_MIN_RATE=$MIN_RATE msg/s"
+        STATUS=1
+    fi
+    if [ "$MAX_P99_US" -gt 0 ] && [ "$5" -gt "$MAX_P99_US" ]; then
+        echo "FAIL: p99 latency above BENCH_MAX_P99_US=$MAX_P99_US us"
+        STATUS=1
+    fi
+fi
+exit $STATUS
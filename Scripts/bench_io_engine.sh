@@ -0,0 +1,73 @@
+#!/bin/bash
+
+# Compare the syscall and io_uring I/O engines at one message rate
+#
+# For each engine the server is started on a scratch port and log
+# directory, fed by udp_log_loadgen at the same per-sender rate, then
+# stopped with SIGINT. The server's "Syscalls per 10k messages" statistic
+# shows what receiving and writing cost with each engine; a run that fell
+# back from io_uring reports itself as "syscalls".
+#
+# Environment overrides:
+#   BENCH_PORT       UDP port (default 19997)
+#   BENCH_SENDERS    Load generator sender threads (default 4)
+#   BENCH_DURATION   Seconds per run (default 5)
+#   BENCH_SIZE       Message body size in bytes (default 120)
+#   BENCH_RATE       Messages per second per sender, 0 = unthrottled (default 20000)
+#   BENCH_ENGINES    Engines to test (default "syscalls io_uring")
+#   BENCH_FLUSH      Server --flush policy (default immediate)
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+SERVER_DIR="$SCRIPT_DIR/../UDPLogServer"
+SERVER="$SERVER_DIR/udp_log_server"
+LOADGEN="$SERVER_DIR/udp_log_loadgen"
+
+PORT=${BENCH_PORT:-19997}
+SENDERS=${BENCH_SENDERS:-4}
+DURATION=${BENCH_DURATION:-5}
+SIZE=${BENCH_SIZE:-120}
+RATE=${BENCH_RATE:-20000}
+ENGINES=${BENCH_ENGINES:-"syscalls io_uring"}
+FLUSH=${BENCH_FLUSH:-immediate}
+
+if [ ! -x "$SERVER" ] || [ ! -x "$LOADGEN" ]; then
+    echo "Build first: make -C $SERVER_DIR"
+    exit 1
+fi
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+echo "============================================"
+echo "UDP Log Server I/O Engine Benchmark"
+echo "============================================"
+echo "senders: $SENDERS  rate: $RATE msg/s each  duration: ${DURATION}s  size: ${SIZE}B  flush: $FLUSH"
+echo ""
+printf "%-10s %-10s %12s %12s %8s %16s %16s\n" "requested" "engine" "sent" "received" "loss" "recv/10k msgs" "write/10k msgs"
+
+for engine in $ENGINES; do
+    LOG_DIR="$WORK_DIR/logs_$engine"
+    (cd "$WORK_DIR" && "$SERVER" --port "$PORT" --log-dir "$LOG_DIR" --io-engine "$engine" \
+        --flush "$FLUSH" > "$WORK_DIR/server_$engine.txt" 2>&1) &
+    SERVER_PID=$!
+    sleep 1
+
+    LOAD=$("$LOADGEN" --port "$PORT" --senders "$SENDERS" --duration "$DURATION" --size "$SIZE" \
+        --rate "$RATE" | head -1)
+    sleep 1
+
+    pkill -INT -f "udp_log_server --port $PORT" 2>/dev/null
+    wait $SERVER_PID 2>/dev/null
+
+    SENT=$(echo "$LOAD" | sed -n 's/.*sent=\([0-9]*\).*/\1/p')
+    RECEIVED=$(sed -n 's/.*Messages received: \([0-9]*\).*/\1/p' "$WORK_DIR/server_$engine.txt")
+    COSTS=$(sed -n 's/.*Syscalls per 10k messages (\([a-z_]*\)): \([0-9.]*\) receive, \([0-9.]*\) write.*/\1 \2 \3/p' \
+        "$WORK_DIR/server_$engine.txt")
+    RECEIVED=${RECEIVED:-0}
+    set -- ${COSTS:-"- 0 0"}
+
+    awk -v req="$engine" -v used="$1" -v s="$SENT" -v r="$RECEIVED" -v rc="$2" -v wc="$3" 'BEGIN {
+        loss = (s > 0) ? 100.0 * (s - r) / s : 0
+        printf "%-10s %-10s %12d %12d %7.1f%% %16.1f %16.1f\n", req, used, s, r, loss, rc, wc
+    }'
+done
@@ -0,0 +1,71 @@
+#!/bin/bash
+
+# Compare unbatched and batched (framed Batch frames) ingest at one message rate
+#
+# For each batch size the server is started on a scratch port and log
+# directory, fed by udp_log_loadgen --batch N at the same per-sender rate,
+# then stopped with SIGINT. Datagrams sent, messages received and the
+# server's receive calls show how much packet and syscall load batching
+# removes for the same number of log lines.
+#
+# Environment overrides:
+#   BENCH_PORT       UDP port (default 19998)
+#   BENCH_SENDERS    Load generator sender threads (default 4)
+#   BENCH_DURATION   Seconds per run (default 5)
+#   BENCH_SIZE       Message body size in bytes (default 120)
+#   BENCH_RATE       Messages per second per sender, 0 = unthrottled (default 20000)
+#   BENCH_BATCHES    Records per datagram to test (default "1 4 16 32")
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+SERVER_DIR="$SCRIPT_DIR/../UDPLogServer"
+SERVER="$SERVER_DIR/udp_log_server"
+LOADGEN="$SERVER_DIR/udp_log_loadgen"
+
+PORT=${BENCH_PORT:-19998}
+SENDERS=${BENCH_SENDERS:-4}
+DURATION=${BENCH_DURATION:-5}
+SIZE=${BENCH_SIZE:-120}
+RATE=${BENCH_RATE:-20000}
+BATCHES=${BENCH_BATCHES:-"1 4 16 32"}
+
+if [ ! -x "$SERVER" ] || [ ! -x "$LOADGEN" ]; then
+    echo "Build first: make -C $SERVER_DIR"
+    exit 1
+fi
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+echo "============================================"
+echo "UDP Log Server Batching Benchmark"
+echo "============================================"
+echo "senders: $SENDERS  rate: $RATE msg/s each  duration: ${DURATION}s  size: ${SIZE}B"
+echo ""
+printf "%-8s %12s %12s %12s %12s %8s\n" "batch" "sent" "datagrams" "received" "recv calls" "loss"
+
+for n in $BATCHES; do
+    LOG_DIR="$WORK_DIR/logs_$n"
+    (cd "$WORK_DIR" && "$SERVER" --port "$PORT" --log-dir "$LOG_DIR" \
+        > "$WORK_DIR/server_$n.txt" 2>&1) &
+    SERVER_PID=$!
+    sleep 1
+
+    LOAD=$("$LOADGEN" --port "$PORT" --senders "$SENDERS" --duration "$DURATION" --size "$SIZE" \
+        --rate "$RATE" --framed --batch "$n" | head -1)
+    sleep 1
+
+    pkill -INT -f "udp_log_server --port $PORT" 2>/dev/null
+    wait $SERVER_PID 2>/dev/null
+
+    SENT=$(echo "$LOAD" | sed -n 's/.*sent=\([0-9]*\).*/\1/p')
+    DATAGRAMS=$(echo "$LOAD" | sed -n 's/.*datagrams=\([0-9]*\).*/\1/p')
+    RECEIVED=$(sed -n 's/.*Messages received: \([0-9]*\).*/\1/p' "$WORK_DIR/server_$n.txt")
+    CALLS=$(sed -n 's/.*Receive calls: \([0-9]*\).*/\1/p' "$WORK_DIR/server_$n.txt")
+    RECEIVED=${RECEIVED:-0}
+    CALLS=${CALLS:-0}
+
+    awk -v n="$n" -v s="$SENT" -v d="$DATAGRAMS" -v r="$RECEIVED" -v c="$CALLS" 'BEGIN {
+        loss = (s > 0) ? 100.0 * (s - r) / s : 0
+        printf "%-8s %12d %12d %12d %12d %7.1f%%\n", n, s, d, r, c, loss
+    }'
+done
@@ -0,0 +1,64 @@
+#!/bin/bash
+
+# Benchmark UDP log server ingest throughput with 1..8 SO_REUSEPORT receivers
+#
+# For each receiver count the server is started on a scratch port and log
+# directory, flooded by udp_log_loadgen, then stopped with SIGINT. The
+# "Messages received" statistic printed on shutdown is compared with the
+# number of datagrams the load generator sent.
+#
+# Environment overrides:
+#   BENCH_PORT       UDP port (default 19999)
+#   BENCH_SENDERS    Load generator sender threads (default 8)
+#   BENCH_DURATION   Seconds per run (default 5)
+#   BENCH_SIZE       Message body size in bytes (default 120)
+#   BENCH_RECEIVERS  Receiver counts to test (default "1 2 4 8")
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+SERVER_DIR="$SCRIPT_DIR/../UDPLogServer"
+SERVER="$SERVER_DIR/udp_log_server"
+LOADGEN="$SERVER_DIR/udp_log_loadgen"
+
+PORT=${BENCH_PORT:-19999}
+SENDERS=${BENCH_SENDERS:-8}
+DURATION=${BENCH_DURATION:-5}
+SIZE=${BENCH_SIZE:-120}
+RECEIVERS=${BENCH_RECEIVERS:-"1 2 4 8"}
+
+if [ ! -x "$SERVER" ] || [ ! -x "$LOADGEN" ]; then
+    echo "Build first: make -C $SERVER_DIR"
+    exit 1
+fi
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+echo "============================================"
+echo "UDP Log Server Receiver Scaling Benchmark"
+echo "============================================"
+echo "CPUs: $(getconf _NPROCESSORS_ONLN)  senders: $SENDERS  duration: ${DURATION}s  size: ${SIZE}B"
+echo ""
+printf "%-10s %12s %12s %12s %8s\n" "receivers" "sent" "received" "recv msg/s" "loss"
+
+for n in $RECEIVERS; do
+    LOG_DIR="$WORK_DIR/logs_$n"
+    (cd "$WORK_DIR" && "$SERVER" --port "$PORT" --log-dir "$LOG_DIR" --receivers "$n" \
+        > "$WORK_DIR/server_$n.txt" 2>&1) &
+    SERVER_PID=$!
+    sleep 1
+
+    LOAD=$("$LOADGEN" --port "$PORT" --senders "$SENDERS" --duration "$DURATION" --size "$SIZE" | head -1)
+    sleep 1
+
+    pkill -INT -f "udp_log_server --port $PORT" 2>/dev/null
+    wait $SERVER_PID 2>/dev/null
+
+    SENT=$(echo "$LOAD" | sed -n 's/.*sent=\([0-9]*\).*/\1/p')
+    RECEIVED=$(sed -n 's/.*Messages received: \([0-9]*\).*/\1/p' "$WORK_DIR/server_$n.txt")
+    RECEIVED=${RECEIVED:-0}
+
+    awk -v n="$n" -v s="$SENT" -v r="$RECEIVED" -v d="$DURATION" 'BEGIN {
+        loss = (s > 0) ? 100.0 * (s - r) / s : 0
+        printf "%-10s %12d %12d %12.0f %7.1f%%\n", n, s, r, r / d, loss
+    }'
+done
@@ -0,0 +1,583 @@
+/**
+ * Session Log Analyzer
+ *
+ * Offline reports over many udp_log_server session logs at once. Every log
+ * is memory-mapped and cut into line-aligned chunks (--chunk MiB each),
+ * which a pool of threads (--threads, default one per core) analyzes
+ * independently; the per-chunk results are then merged in file order. The
+ * report covers:
+ *
+ *   - lines per source over time, in --bucket second buckets,
+ *   - the most frequent message templates (tokens containing digits
+ *     replaced with "#"),
+ *   - gaps between consecutive lines of a log longer than --gap ms,
+ *   - "[AUTO-VALIDATE] Segment N: VALID/INVALID - reason" results, with the
+ *     most common reasons,
+ *   - "[DIY-HLS] Finalized segment N: D.DDDs, F frames, B bytes" lines,
+ *     with segment duration and size statistics.
+ *
+ * Log lines only carry a time of day. Each chunk dates its lines from the
+ * nearest preceding entry of the log's time index (log_index.h), or from
+ * the session start in the header when there is no index; see
+ * TimeOfDayClock for how midnight is crossed.
+ *
+ * Usage:
+ *   log_analyze [--dir DIR]... [--file LOG]... [options]
+ *
+ * With neither --dir nor --file, the session logs in the current directory
+ * are analyzed. Compressed logs (FILE.ulz, log_compress.h) are read in
+ * place: each thread decompresses only the blocks of its own chunks.
+ */
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log_compress.h"
+#include "log_index.h"
+#include "log_terms.h"
+#include "log_tools.h"
+
+constexpr size_t MAX_TEMPLATE_LENGTH = 160;
+constexpr size_t RATE_COLUMNS = 8;  // Sources shown in the rate table; the rest are summed as "other"
+
+constexpr std::string_view AUTO_VALIDATE_TAG = "[AUTO-VALIDATE]";
+constexpr std::string_view INVALID_REASON = "INVALID - ";
+constexpr std::string_view FINALIZED_SEGMENT = "[DIY-HLS] Finalized segment ";
+
+struct AnalyzeConfig {
+    std::vector<std::string> dirs;
+    std::vector<std::string> files;
+    unsigned int threads = 0;               // 0 = one per core
+    size_t chunk_bytes = 16 * 1024 * 1024;
+    int64_t gap_us = 1000 * 1000;
+    int64_t bucket_us = 10 * 1000000LL;
+    size_t top = 20;
+};
+
+struct SessionLog {
+    std::string path;
+    LogFile log;
+    MappedFile index;
+    int64_t start_us{0};
+    const char* entries{nullptr};  // Time index entries (nullptr without a usable index)
+    size_t entry_count{0};
+};
+
+struct Chunk {
+    size_t log;
+    size_t start;
+    size_t end;
+    int64_t reference_us;  // A time close to the chunk's first line
+};
+
+struct Gap {
+    size_t log;
+    uint64_t line;  // Line after the gap; chunk-relative until merged
+    int64_t from_us;
+    int64_t to_us;
+};
+
+struct Segment {
+    uint32_t number;
+    double seconds;
+    uint64_t frames;
+    uint64_t bytes;
+};
+
+struct SourceCounts {
+    uint64_t lines{0};
+    std::unordered_map<int64_t, uint64_t> buckets;
+};
+
+struct ChunkResult {
+    uint64_t lines{0};
+    uint64_t records{0};  // Timestamped lines
+    uint64_t first_record_line{0};
+    int64_t first_us{0};
+    int64_t last_us{0};
+    std::unordered_map<std::string, SourceCounts> sources;
+    std::unordered_map<std::string, uint64_t> templates;
+    std::vector<Gap> gaps;
+    uint64_t segments_valid{0};
+    uint64_t segments_invalid{0};
+    std::unordered_map<std::string, uint64_t> invalid_reasons;
+    std::vector<Segment> segments;
+};
+
+static bool open_session_log(const std::string& path, SessionLog& session) {
+    session.path = path;
+    if (!session.log.open(path)) {
+        std::cerr << "Cannot open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    const MappedFile& index = session.index;
+    if (session.index.open(uncompressed_log_path(path) + LOG_INDEX_SUFFIX, true) && index.length >= LOG_INDEX_HEADER_SIZE &&
+        memcmp(index.data, LOG_INDEX_MAGIC, sizeof(LOG_INDEX_MAGIC)) == 0 &&
+        static_cast<uint8_t>(index.data[6]) == LOG_INDEX_VERSION) {
+        session.start_us = static_cast<int64_t>(read_u64(index.data + 16));
+        session.entries = index.data + LOG_INDEX_HEADER_SIZE;
+        session.entry_count = (index.length - LOG_INDEX_HEADER_SIZE) / LOG_INDEX_ENTRY_SIZE;
+    } else if (!session.log.load(0, 4096) ||
+               !parse_header_time(session.log.data, session.log.length, session.start_us)) {
+        session.start_us = static_cast<int64_t>(session.log.modified) * 1000000;
+    }
+    return true;
+}
+
+// The time of the last index entry at or before offset, else the session start
+static int64_t reference_time(const SessionLog& session, size_t offset) {
+    size_t low = 0;
+    size_t high = session.entry_count;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (read_index_entry(session.entries + middle * LOG_INDEX_ENTRY_SIZE).offset <= offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == 0) return session.start_us;
+    return read_index_entry(session.entries + (low - 1) * LOG_INDEX_ENTRY_SIZE).time_us;
+}
+
+static void split_into_chunks(const std::vector<std::unique_ptr<SessionLog>>& logs, size_t chunk_bytes, std::vector<Chunk>& chunks) {
+    for (size_t l = 0; l < logs.size(); l++) {
+        const LogFile& log = logs[l]->log;
+        size_t start = 0;
+        while (start < log.length) {
+            size_t end = std::min(log.length, start + chunk_bytes);
+            if (end < log.length) {
+                end = std::min(log.length, log.find_newline(end, log.length) + 1);
+            }
+            chunks.push_back(Chunk{l, start, end, reference_time(*logs[l], start)});
+            start = end;
+        }
+    }
+}
+
+// Appends the message with every token that contains a digit replaced by
+// "#"; returns true if the message contains a '['
+static bool make_template(std::string_view message, std::string& out) {
+    out.clear();
+    bool bracket = false;
+    size_t i = 0;
+    while (i < message.size() && out.size() < MAX_TEMPLATE_LENGTH) {
+        char c = message[i];
+        if (!is_token_char(c)) {
+            bracket = bracket || c == '[';
+            out.push_back(c);
+            i++;
+            continue;
+        }
+        size_t start = i;
+        bool digit = false;
+        while (i < message.size() && is_token_char(message[i])) {
+            digit = digit || (message[i] >= '0' && message[i] <= '9');
+            i++;
+        }
+        if (digit) {
+            out.push_back('#');
+        } else {
+            out.append(message.data() + start, i - start);
+        }
+    }
+    if (i < message.size()) {
+        out.resize(MAX_TEMPLATE_LENGTH);
+        out += "...";
+        bracket = bracket || message.find('[', i) != std::string_view::npos;
+    }
+    return bracket;
+}
+
+// The AUTO-VALIDATE and DIY-HLS lines, only looked for in messages with a '['
+static void analyze_tagged(std::string_view message, ChunkResult& result, std::string& scratch) {
+    size_t tag = message.find(AUTO_VALIDATE_TAG);
+    if (tag != std::string_view::npos) {
+        std::string_view rest = message.substr(tag + AUTO_VALIDATE_TAG.size());
+        size_t invalid = rest.find(INVALID_REASON);
+        if (invalid != std::string_view::npos) {
+            result.segments_invalid++;
+            make_template(rest.substr(invalid + INVALID_REASON.size()), scratch);
+            result.invalid_reasons[scratch]++;
+        } else if (rest.find(": VALID") != std::string_view::npos) {
+            result.segments_valid++;
+        }
+        return;
+    }
+
+    size_t finalized = message.find(FINALIZED_SEGMENT);
+    if (finalized != std::string_view::npos) {
+        char text[128];
+        std::string_view rest = message.substr(finalized + FINALIZED_SEGMENT.size());
+        size_t length = std::min(rest.size(), sizeof(text) - 1);
+        memcpy(text, rest.data(), length);
+        text[length] = '\0';
+        Segment segment{};
+        unsigned long long frames = 0;
+        unsigned long long bytes = 0;
+        if (sscanf(text, "%u: %lfs, %llu frames, %llu bytes", &segment.number, &segment.seconds, &frames, &bytes) == 4) {
+            segment.frames = frames;
+            segment.bytes = bytes;
+            result.segments.push_back(segment);
+        }
+    }
+}
+
+static void analyze_chunk(const SessionLog& session, const Chunk& chunk, const AnalyzeConfig& config,
+                          ChunkResult& result) {
+    session.log.load(chunk.start, chunk.end);
+    const char* data = session.log.data;
+    TimeOfDayClock clock(chunk.reference_us);
+    std::string key;
+    std::string scratch;
+    SourceCounts* source = nullptr;
+    std::string source_name;
+    bool have_time = false;
+    int64_t previous_us = 0;
+
+    for (size_t offset = chunk.start; offset < chunk.end; ) {
+        const void* newline = memchr(data + offset, '\n', chunk.end - offset);
+        size_t next = newline ? static_cast<const char*>(newline) - data : chunk.end;
+        const char* text = data + offset;
+        size_t length = next - offset;
+        offset = next + 1;
+        result.lines++;
+
+        int64_t time_of_day;
+        if (!parse_time_of_day(text, length, time_of_day)) continue;
+        int64_t time = clock.resolve(time_of_day);
+        result.records++;
+        if (!have_time) {
+            result.first_record_line = result.lines;
+            result.first_us = time;
+            have_time = true;
+        } else if (time - previous_us > config.gap_us) {
+            result.gaps.push_back(Gap{chunk.log, result.lines, previous_us, time});
+        }
+        previous_us = time;
+
+        LogLineColumns line = split_log_line(text, length);
+        if (!line.columns) continue;
+
+        // Consecutive lines usually come from the same source
+        if (!source || line.source != source_name) {
+            source_name.assign(line.source.data(), line.source.size());
+            source = &result.sources[source_name];
+        }
+        source->lines++;
+        source->buckets[time / config.bucket_us]++;
+
+        if (make_template(line.message, key)) {
+            analyze_tagged(line.message, result, scratch);
+        }
+        result.templates[key]++;
+    }
+    result.last_us = previous_us;
+}
+
+template <typename Map>
+static std::vector<std::pair<std::string, uint64_t>> top_entries(const Map& counts, size_t limit) {
+    std::vector<std::pair<std::string, uint64_t>> sorted(counts.begin(), counts.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    if (sorted.size() > limit) sorted.resize(limit);
+    return sorted;
+}
+
+template <typename T>
+static T percentile(std::vector<T> values, double fraction) {
+    if (values.empty()) return T{};
+    size_t rank = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank];
+}
+
+static void print_report(const std::vector<std::unique_ptr<SessionLog>>& logs, const std::vector<ChunkResult>& results,
+                         std::vector<Gap>& gaps, const AnalyzeConfig& config) {
+    uint64_t lines = 0;
+    uint64_t records = 0;
+    std::unordered_map<std::string, SourceCounts> sources;
+    std::unordered_map<std::string, uint64_t> templates;
+    std::unordered_map<std::string, uint64_t> invalid_reasons;
+    uint64_t segments_valid = 0;
+    uint64_t segments_invalid = 0;
+    std::vector<Segment> segments;
+    for (const auto& result : results) {
+        lines += result.lines;
+        records += result.records;
+        for (const auto& entry : result.sources) {
+            SourceCounts& merged = sources[entry.first];
+            merged.lines += entry.second.lines;
+            for (const auto& bucket : entry.second.buckets) {
+                merged.buckets[bucket.first] += bucket.second;
+            }
+        }
+        for (const auto& entry : result.templates) {
+            templates[entry.first] += entry.second;
+        }
+        for (const auto& entry : result.invalid_reasons) {
+            invalid_reasons[entry.first] += entry.second;
+        }
+        segments_valid += result.segments_valid;
+        segments_invalid += result.segments_invalid;
+        segments.insert(segments.end(), result.segments.begin(), result.segments.end());
+    }
+
+    printf("Logs: %zu, lines: %llu (%llu timestamped)\n", logs.size(),
+           static_cast<unsigned long long>(lines), static_cast<unsigned long long>(records));
+
+    // Rate per source: the busiest sources get a column each
+    std::unordered_map<std::string, uint64_t> source_lines;
+    for (const auto& entry : sources) {
+        source_lines[entry.first] = entry.second.lines;
+    }
+    std::vector<std::pair<std::string, uint64_t>> columns = top_entries(source_lines, RATE_COLUMNS);
+    std::vector<int64_t> buckets;
+    for (const auto& entry : sources) {
+        for (const auto& bucket : entry.second.buckets) {
+            buckets.push_back(bucket.first);
+        }
+    }
+    std::sort(buckets.begin(), buckets.end());
+    buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+
+    printf("\nSources: %zu\n", sources.size());
+    for (const auto& entry : top_entries(source_lines, source_lines.size())) {
+        printf("  %-16s %12llu lines\n", entry.first.c_str(), static_cast<unsigned long long>(entry.second));
+    }
+
+    printf("\nLines per %lld s\n  %-23s %10s", static_cast<long long>(config.bucket_us / 1000000), "time", "total");
+    for (const auto& column : columns) {
+        printf(" %10.10s", column.first.c_str());
+    }
+    if (sources.size() > columns.size()) printf(" %10s", "other");
+    printf("\n");
+    for (int64_t bucket : buckets) {
+        uint64_t total = 0;
+        for (const auto& entry : sources) {
+            auto count = entry.second.buckets.find(bucket);
+            if (count != entry.second.buckets.end()) total += count->second;
+        }
+        printf("  %-23s %10llu", format_time(bucket * config.bucket_us, 3).c_str(), static_cast<unsigned long long>(total));
+        uint64_t shown = 0;
+        for (const auto& column : columns) {
+            const auto& counts = sources[column.first].buckets;
+            auto count = counts.find(bucket);
+            uint64_t value = count != counts.end() ? count->second : 0;
+            shown += value;
+            printf(" %10llu", static_cast<unsigned long long>(value));
+        }
+        if (sources.size() > columns.size()) printf(" %10llu", static_cast<unsigned long long>(total - shown));
+        printf("\n");
+    }
+
+    printf("\nTop message templates (%zu distinct)\n", templates.size());
+    for (const auto& entry : top_entries(templates, config.top)) {
+        printf("  %10llu  %s\n", static_cast<unsigned long long>(entry.second), entry.first.c_str());
+    }
+
+    std::sort(gaps.begin(), gaps.end(), [](const Gap& a, const Gap& b) {
+        return a.to_us - a.from_us > b.to_us - b.from_us;
+    });
+    printf("\nGaps over %lld ms: %zu\n", static_cast<long long>(config.gap_us / 1000), gaps.size());
+    for (size_t i = 0; i < gaps.size() && i < config.top; i++) {
+        const Gap& gap = gaps[i];
+        printf("  %10.3f s  from %s  %s:%llu\n", (gap.to_us - gap.from_us) / 1e6, format_time(gap.from_us, 3).c_str(),
+               logs[gap.log]->path.c_str(), static_cast<unsigned long long>(gap.line));
+    }
+
+    printf("\nAUTO-VALIDATE: %llu valid, %llu invalid\n", static_cast<unsigned long long>(segments_valid),
+           static_cast<unsigned long long>(segments_invalid));
+    for (const auto& entry : top_entries(invalid_reasons, config.top)) {
+        printf("  %10llu  %s\n", static_cast<unsigned long long>(entry.second), entry.first.c_str());
+    }
+
+    printf("\nDIY-HLS finalized segments: %zu\n", segments.size());
+    if (!segments.empty()) {
+        std::vector<double> seconds;
+        std::vector<uint64_t> bytes;
+        double total_seconds = 0;
+        uint64_t total_bytes = 0;
+        uint64_t total_frames = 0;
+        for (const auto& segment : segments) {
+            seconds.push_back(segment.seconds);
+            bytes.push_back(segment.bytes);
+            total_seconds += segment.seconds;
+            total_bytes += segment.bytes;
+            total_frames += segment.frames;
+        }
+        printf("  duration s  min %.3f  p50 %.3f  p95 %.3f  max %.3f  mean %.3f\n",
+               *std::min_element(seconds.begin(), seconds.end()), percentile(seconds, 0.5),
+               percentile(seconds, 0.95), *std::max_element(seconds.begin(), seconds.end()),
+               total_seconds / segments.size());
+        printf("  bytes       min %llu  p50 %llu  p95 %llu  max %llu  mean %llu\n",
+               static_cast<unsigned long long>(*std::min_element(bytes.begin(), bytes.end())),
+               static_cast<unsigned long long>(percentile(bytes, 0.5)),
+               static_cast<unsigned long long>(percentile(bytes, 0.95)),
+               static_cast<unsigned long long>(*std::max_element(bytes.begin(), bytes.end())),
+               static_cast<unsigned long long>(total_bytes / segments.size()));
+        printf("  %llu frames, %.1f fps, %.0f kbit/s\n", static_cast<unsigned long long>(total_frames),
+               total_seconds > 0 ? total_frames / total_seconds : 0.0,
+               total_seconds > 0 ? total_bytes * 8 / total_seconds / 1000 : 0.0);
+    }
+}
+
+static void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]" << std::endl;
+    std::cout << "  --dir DIR        Analyze the session_*.log[.ulz] files in DIR (default: current directory)" << std::endl;
+    std::cout << "  --file LOG       Analyze one log file" << std::endl;
+    std::cout << "  --threads N      Worker threads (default: one per core)" << std::endl;
+    std::cout << "  --chunk MIB      Bytes of log per work item (default 16)" << std::endl;
+    std::cout << "  --gap MS         Report gaps between lines longer than this (default 1000)" << std::endl;
+    std::cout << "  --bucket SEC     Width of the lines-per-source buckets (default 10)" << std::endl;
+    std::cout << "  --top N          Templates, gaps and reasons listed (default 20)" << std::endl;
+}
+
+static bool parse_args(int argc, char* argv[], AnalyzeConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            exit(0);
+        }
+
+        if (i + 1 >= argc) {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (arg == "--dir") {
+            config.dirs.push_back(value);
+        } else if (arg == "--file") {
+            config.files.push_back(value);
+        } else if (arg == "--threads") {
+            config.threads = static_cast<unsigned int>(std::max(0, atoi(value.c_str())));
+        } else if (arg == "--chunk") {
+            config.chunk_bytes = static_cast<size_t>(std::max(1, atoi(value.c_str()))) * 1024 * 1024;
+        } else if (arg == "--gap") {
+            config.gap_us = static_cast<int64_t>(std::max(0.0, atof(value.c_str())) * 1000);
+        } else if (arg == "--bucket") {
+            config.bucket_us = std::max<int64_t>(1, static_cast<int64_t>(atof(value.c_str()) * 1000000));
+        } else if (arg == "--top") {
+            config.top = static_cast<size_t>(std::max(1, atoi(value.c_str())));
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    if (config.dirs.empty() && config.files.empty()) {
+        config.dirs.push_back(".");
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    AnalyzeConfig config;
+    if (!parse_args(argc, argv, config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> paths = config.files;
+    for (const auto& dir : config.dirs) {
+        std::vector<std::string> found;
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(dir, error)) {
+            std::string name = entry.path().filename().string();
+            if (is_session_log_name(name)) {
+                found.push_back(entry.path().string());
+            }
+        }
+        if (error) {
+            std::cerr << "Cannot list " << dir << ": " << error.message() << std::endl;
+        }
+        drop_compressed_duplicates(found);
+        std::sort(found.begin(), found.end());
+        paths.insert(paths.end(), found.begin(), found.end());
+    }
+
+    std::vector<std::unique_ptr<SessionLog>> logs;
+    for (const auto& path : paths) {
+        std::unique_ptr<SessionLog> session(new SessionLog());
+        if (open_session_log(path, *session)) logs.push_back(std::move(session));
+    }
+
+    std::vector<Chunk> chunks;
+    split_into_chunks(logs, config.chunk_bytes, chunks);
+    std::vector<ChunkResult> results(chunks.size());
+
+    unsigned int threads = config.threads > 0 ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned int>(std::min<size_t>(threads, std::max<size_t>(chunks.size(), 1)));
+    std::atomic<size_t> next_chunk{0};
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threads; t++) {
+        workers.emplace_back([&]() {
+            for (size_t c = next_chunk.fetch_add(1); c < chunks.size(); c = next_chunk.fetch_add(1)) {
+                analyze_chunk(*logs[chunks[c].log], chunks[c], config, results[c]);
+                logs[chunks[c].log]->log.release(chunks[c].start, chunks[c].end);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // Chunks of a log are consecutive: number their lines and find the gaps
+    // that span chunk boundaries
+    std::vector<Gap> gaps;
+    uint64_t bytes = 0;
+    uint64_t line_base = 0;
+    bool have_previous = false;
+    int64_t previous_us = 0;
+    for (size_t c = 0; c < chunks.size(); c++) {
+        if (c == 0 || chunks[c].log != chunks[c - 1].log) {
+            line_base = 0;
+            have_previous = false;
+        }
+        ChunkResult& result = results[c];
+        bytes += chunks[c].end - chunks[c].start;
+        if (result.records > 0) {
+            if (have_previous && result.first_us - previous_us > config.gap_us) {
+                gaps.push_back(Gap{chunks[c].log, line_base + result.first_record_line, previous_us, result.first_us});
+            }
+            previous_us = result.last_us;
+            have_previous = true;
+        }
+        for (Gap gap : result.gaps) {
+            gap.line += line_base;
+            gaps.push_back(gap);
+        }
+        line_base += result.lines;
+    }
+    double analyze_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    print_report(logs, results, gaps, config);
+    fflush(stdout);
+    fprintf(stderr, "%zu logs, %.1f MiB in %zu chunks on %u threads: %.3f s (%.0f MiB/s)\n", logs.size(),
+            bytes / 1048576.0, chunks.size(), threads, analyze_seconds,
+            analyze_seconds > 0 ? bytes / 1048576.0 / analyze_seconds : 0.0);
+    return 0;
+}
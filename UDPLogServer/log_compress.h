@@ -0,0 +1,634 @@
+/**
+ * Block-Compressed Session Logs
+ *
+ * Closed session files and rotated current.log files can be compressed by
+ * the server (--compress) into FILE.ulz, next to their uncompressed .idx
+ * and .terms sidecars. The offline tools read either form through LogFile.
+ *
+ * The file is cut into LOG_COMPRESS_BLOCK_SIZE blocks of the original,
+ * each compressed on its own with a small LZ77 coder (LZ4-style sequences:
+ * a token with literal and match lengths, the literals, a 16-bit offset).
+ * A table of the blocks' stored sizes sits at the end, so byte N of the
+ * original is in block N / block size, and a reader decompresses only the
+ * blocks it touches: the index and term-index offsets still work.
+ *
+ * Layout, integers big-endian like the wire protocol (log_protocol.h):
+ *
+ *   header   "ULOGLZ", version, 0, u32 block size, u32 0  (16 bytes)
+ *   blocks   stored back to back
+ *   table    u32 per block: stored size, high bit set if stored raw
+ *   trailer  u64 original length, u64 table offset, u32 block count,
+ *            "ULZT"                                         (24 bytes)
+ *
+ * LogCompressor is the server's background thread. It runs at idle CPU
+ * and I/O priority where the OS has one and only ever takes a mutex to pop
+ * the next path, so compression cannot hold up receiving or writing.
+ */
+
+#ifndef LOG_COMPRESS_H
+#define LOG_COMPRESS_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+#include "log_protocol.h"
+
+constexpr const char* LOG_COMPRESSED_SUFFIX = ".ulz";
+constexpr char LOG_COMPRESS_MAGIC[6] = {'U', 'L', 'O', 'G', 'L', 'Z'};
+constexpr char LOG_COMPRESS_TRAILER_MAGIC[4] = {'U', 'L', 'Z', 'T'};
+constexpr uint8_t LOG_COMPRESS_VERSION = 1;
+constexpr size_t LOG_COMPRESS_HEADER_SIZE = 16;
+constexpr size_t LOG_COMPRESS_TRAILER_SIZE = 24;
+constexpr size_t LOG_COMPRESS_BLOCK_SIZE = 64 * 1024;
+constexpr uint32_t LOG_COMPRESS_RAW_BLOCK = 0x80000000u;
+
+// LZ77 parameters: matches of at least LZ_MIN_MATCH bytes within the
+// previous 64 KB; the last LZ_LAST_LITERALS bytes of a block are always
+// literals, and no match starts in the last LZ_MATCH_LIMIT bytes
+constexpr size_t LZ_MIN_MATCH = 4;
+constexpr size_t LZ_LAST_LITERALS = 5;
+constexpr size_t LZ_MATCH_LIMIT = 12;
+constexpr size_t LZ_MAX_OFFSET = 65535;
+constexpr unsigned int LZ_HASH_BITS = 13;
+
+inline size_t lz_compress_bound(size_t length) {
+    return length + length / 255 + 16;
+}
+
+inline uint32_t lz_read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint32_t lz_hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// 15 in the token, then 255s and a final byte below 255
+inline uint8_t* lz_write_length(uint8_t* out, size_t length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = static_cast<uint8_t>(length);
+    return out;
+}
+
+inline uint8_t* lz_write_sequence(uint8_t* out, const uint8_t* literals, size_t literal_length, size_t offset,
+                                  size_t match_length) {
+    uint8_t* token = out++;
+    *token = static_cast<uint8_t>(std::min<size_t>(literal_length, 15) << 4);
+    if (literal_length >= 15) out = lz_write_length(out, literal_length - 15);
+    memcpy(out, literals, literal_length);
+    out += literal_length;
+    if (match_length == 0) return out;  // The last sequence has no match
+
+    *out++ = static_cast<uint8_t>(offset);
+    *out++ = static_cast<uint8_t>(offset >> 8);
+    size_t extra = match_length - LZ_MIN_MATCH;
+    *token |= static_cast<uint8_t>(std::min<size_t>(extra, 15));
+    if (extra >= 15) out = lz_write_length(out, extra - 15);
+    return out;
+}
+
+/**
+ * Compresses length bytes of input into out, which must hold
+ * lz_compress_bound(length). table is scratch space of 1 << LZ_HASH_BITS
+ * entries. Returns the compressed size.
+ */
+inline size_t lz_compress(const char* input, size_t length, char* out, uint32_t* table) {
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(input);
+    const uint8_t* end = base + length;
+    const uint8_t* anchor = base;
+    uint8_t* op = reinterpret_cast<uint8_t*>(out);
+    if (length > LZ_MATCH_LIMIT) {
+        memset(table, 0, sizeof(uint32_t) << LZ_HASH_BITS);
+        const uint8_t* match_limit = end - LZ_MATCH_LIMIT;
+        const uint8_t* ip = base + 1;
+        while (ip < match_limit) {
+            uint32_t sequence = lz_read32(ip);
+            uint32_t& slot = table[lz_hash(sequence)];
+            const uint8_t* candidate = base + slot;
+            slot = static_cast<uint32_t>(ip - base);
+            if (candidate >= ip || static_cast<size_t>(ip - candidate) > LZ_MAX_OFFSET ||
+                lz_read32(candidate) != sequence) {
+                // Step faster through input that keeps missing
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            const uint8_t* match_end = ip + LZ_MIN_MATCH;
+            const uint8_t* ref = candidate + LZ_MIN_MATCH;
+            while (match_end < end - LZ_LAST_LITERALS && *match_end == *ref) {
+                match_end++;
+                ref++;
+            }
+            op = lz_write_sequence(op, anchor, ip - anchor, ip - candidate, match_end - ip);
+            ip = match_end;
+            anchor = ip;
+        }
+    }
+    op = lz_write_sequence(op, anchor, end - anchor, 0, 0);
+    return static_cast<size_t>(op - reinterpret_cast<uint8_t*>(out));
+}
+
+inline bool lz_read_length(const uint8_t*& ip, const uint8_t* end, size_t& length) {
+    uint8_t byte;
+    do {
+        if (ip >= end) return false;
+        byte = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Decompresses into exactly length bytes of out; false if input is corrupt
+inline bool lz_decompress(const char* input, size_t input_length, char* out, size_t length) {
+    const uint8_t* ip = reinterpret_cast<const uint8_t*>(input);
+    const uint8_t* input_end = ip + input_length;
+    uint8_t* op = reinterpret_cast<uint8_t*>(out);
+    uint8_t* out_start = op;
+    uint8_t* out_end = op + length;
+    while (ip < input_end) {
+        uint8_t token = *ip++;
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !lz_read_length(ip, input_end, literal_length)) return false;
+        if (literal_length > static_cast<size_t>(input_end - ip) ||
+            literal_length > static_cast<size_t>(out_end - op)) {
+            return false;
+        }
+        memcpy(op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+        if (ip == input_end) return op == out_end;
+
+        if (input_end - ip < 2) return false;
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        size_t match_length = token & 15;
+        if (match_length == 15 && !lz_read_length(ip, input_end, match_length)) return false;
+        match_length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(op - out_start) ||
+            match_length > static_cast<size_t>(out_end - op)) {
+            return false;
+        }
+        const uint8_t* ref = op - offset;
+        if (offset >= match_length) {
+            memcpy(op, ref, match_length);
+            op += match_length;
+        } else {
+            // Overlapping copy repeats the last offset bytes
+            for (size_t i = 0; i < match_length; i++) {
+                *op++ = ref[i];
+            }
+        }
+    }
+    return false;
+}
+
+struct CompressResult {
+    uint64_t bytes_in{0};
+    uint64_t bytes_out{0};
+    std::string error;
+};
+
+/**
+ * Writes a block-compressed copy of the file at input to output. Reads
+ * and writes a block at a time, so memory stays at a few blocks however
+ * large the log is.
+ */
+inline bool compress_log_file(const std::string& input, const std::string& output, CompressResult& result) {
+    int in = open(input.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        result.error = input + ": " + strerror(errno);
+        return false;
+    }
+    int out = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        result.error = output + ": " + strerror(errno);
+        close(in);
+        return false;
+    }
+
+    auto write_out = [&](const char* data, size_t length) {
+        while (length > 0) {
+            ssize_t n = write(out, data, length);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += n;
+            length -= static_cast<size_t>(n);
+            result.bytes_out += static_cast<uint64_t>(n);
+        }
+        return true;
+    };
+
+    std::vector<char> block(LOG_COMPRESS_BLOCK_SIZE);
+    std::vector<char> packed(lz_compress_bound(LOG_COMPRESS_BLOCK_SIZE));
+    std::unique_ptr<uint32_t[]> table(new uint32_t[1u << LZ_HASH_BITS]);
+    std::vector<char> sizes;
+
+    char header[LOG_COMPRESS_HEADER_SIZE] = {};
+    memcpy(header, LOG_COMPRESS_MAGIC, sizeof(LOG_COMPRESS_MAGIC));
+    header[6] = static_cast<char>(LOG_COMPRESS_VERSION);
+    write_u32(header + 8, static_cast<uint32_t>(LOG_COMPRESS_BLOCK_SIZE));
+    bool ok = write_out(header, sizeof(header));
+    while (ok) {
+        size_t filled = 0;
+        while (filled < block.size()) {
+            ssize_t n = read(in, block.data() + filled, block.size() - filled);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) ok = false;
+            if (n <= 0) break;
+            filled += static_cast<size_t>(n);
+        }
+        if (!ok || filled == 0) break;
+        result.bytes_in += filled;
+
+        size_t packed_length = lz_compress(block.data(), filled, packed.data(), table.get());
+        bool raw = packed_length >= filled;
+        char size[4];
+        write_u32(size, static_cast<uint32_t>(raw ? filled : packed_length) | (raw ? LOG_COMPRESS_RAW_BLOCK : 0));
+        sizes.insert(sizes.end(), size, size + sizeof(size));
+        ok = raw ? write_out(block.data(), filled) : write_out(packed.data(), packed_length);
+        if (filled < block.size()) break;
+    }
+
+    if (ok) {
+        char trailer[LOG_COMPRESS_TRAILER_SIZE];
+        write_u64(trailer, result.bytes_in);
+        write_u64(trailer + 8, result.bytes_out);  // The table starts where the blocks end
+        write_u32(trailer + 16, static_cast<uint32_t>(sizes.size() / 4));
+        memcpy(trailer + 20, LOG_COMPRESS_TRAILER_MAGIC, sizeof(LOG_COMPRESS_TRAILER_MAGIC));
+        ok = write_out(sizes.data(), sizes.size()) && write_out(trailer, sizeof(trailer));
+    }
+    if (!ok) {
+        result.error = std::string("compressing ") + input + ": " + strerror(errno);
+    }
+    close(in);
+    if (close(out) != 0 && ok) {
+        result.error = output + ": " + strerror(errno);
+        ok = false;
+    }
+    return ok;
+}
+
+// The uncompressed name of a log: FILE for FILE.ulz, path itself otherwise.
+// Sidecar indexes are named after it.
+inline std::string uncompressed_log_path(const std::string& path) {
+    size_t suffix = strlen(LOG_COMPRESSED_SUFFIX);
+    if (path.size() > suffix && path.compare(path.size() - suffix, suffix, LOG_COMPRESSED_SUFFIX) == 0) {
+        return path.substr(0, path.size() - suffix);
+    }
+    return path;
+}
+
+// session_*.log, compressed or not
+inline bool is_session_log_name(const std::string& name) {
+    if (name.compare(0, 8, "session_") != 0) return false;
+    std::string plain = uncompressed_log_path(name);
+    return plain.size() > 4 && plain.compare(plain.size() - 4, 4, ".log") == 0;
+}
+
+// Drops FILE.ulz when FILE is listed too: the listing caught the
+// compressor between its rename and the unlink of FILE
+inline void drop_compressed_duplicates(std::vector<std::string>& paths) {
+    std::vector<std::string> plain;
+    for (const auto& path : paths) {
+        if (uncompressed_log_path(path) == path) plain.push_back(path);
+    }
+    std::sort(plain.begin(), plain.end());
+    paths.erase(std::remove_if(paths.begin(), paths.end(),
+                               [&](const std::string& path) {
+                                   std::string original = uncompressed_log_path(path);
+                                   return original != path &&
+                                          std::binary_search(plain.begin(), plain.end(), original);
+                               }),
+                paths.end());
+}
+
+/**
+ * Read-only view of a log, plain or block-compressed. A plain file is
+ * memory-mapped and load() does nothing. A compressed file gets a
+ * reserved anonymous mapping of its original size; load(begin, end)
+ * decompresses the blocks covering that range into place, so data can be
+ * indexed with the original offsets. Pages of blocks never loaded are
+ * never allocated. load() may be called from several threads at once.
+ */
+class LogFile {
+public:
+    LogFile() = default;
+    LogFile(const LogFile&) = delete;
+    LogFile& operator=(const LogFile&) = delete;
+
+    ~LogFile() {
+        if (data) munmap(const_cast<char*>(data), length);
+        if (file) munmap(const_cast<char*>(file), file_length);
+    }
+
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) < 0) {
+            close(fd);
+            return false;
+        }
+        file_length = static_cast<size_t>(info.st_size);
+        modified = info.st_mtime;
+        if (file_length > 0) {
+            void* mapping = mmap(nullptr, file_length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                close(fd);
+                return false;
+            }
+            file = static_cast<const char*>(mapping);
+        }
+        close(fd);
+
+        if (file_length < LOG_COMPRESS_HEADER_SIZE + LOG_COMPRESS_TRAILER_SIZE ||
+            memcmp(file, LOG_COMPRESS_MAGIC, sizeof(LOG_COMPRESS_MAGIC)) != 0) {
+            data = file;
+            length = file_length;
+            file = nullptr;
+            return true;
+        }
+        if (!open_compressed()) {
+            errno = EINVAL;
+            return false;
+        }
+        return true;
+    }
+
+    bool compressed() const { return file != nullptr; }
+    size_t stored_length() const { return file ? file_length : length; }
+    size_t block_length() const { return block_size; }
+
+    // Makes data[begin, end) readable; false if a block in it is corrupt
+    bool load(size_t begin, size_t end) const {
+        if (!file || begin >= end) return true;
+        end = std::min(end, length);
+        bool ok = true;
+        for (size_t b = begin / block_size; b * block_size < end; b++) {
+            ok = load_block(b) && ok;
+        }
+        return ok;
+    }
+
+    // Gives back the memory of the blocks wholly inside [begin, end); a
+    // later load() decompresses them again. No other thread may be reading
+    // those blocks.
+    void release(size_t begin, size_t end) const {
+        if (!file) return;
+        end = std::min(end, length);
+        size_t first = (begin + block_size - 1) / block_size;
+        size_t last = end == length ? blocks : end / block_size;
+        for (size_t b = first; b < last; b++) {
+            if (state[b].load(std::memory_order_acquire) != BLOCK_READY) continue;
+            madvise(const_cast<char*>(data) + b * block_size, std::min(block_size, length - b * block_size),
+                    MADV_DONTNEED);
+            state[b].store(BLOCK_EMPTY, std::memory_order_release);
+        }
+    }
+
+    // Position of the first '\n' in [offset, end), or end; loads as it goes
+    size_t find_newline(size_t offset, size_t end) const {
+        while (offset < end) {
+            size_t step = file ? std::min(end, (offset / block_size + 1) * block_size) : end;
+            load(offset, step);
+            const void* newline = memchr(data + offset, '\n', step - offset);
+            if (newline) return static_cast<const char*>(newline) - data;
+            offset = step;
+        }
+        return end;
+    }
+
+    // Position just past the last '\n' in [begin, end), or begin; loads as
+    // it goes back
+    size_t find_line_start(size_t begin, size_t end) const {
+        while (end > begin) {
+            size_t step = file ? std::max(begin, (end - 1) / block_size * block_size) : begin;
+            load(step, end);
+            for (size_t i = end; i > step; i--) {
+                if (data[i - 1] == '\n') return i;
+            }
+            end = step;
+        }
+        return begin;
+    }
+
+    const char* data{nullptr};
+    size_t length{0};
+    time_t modified{0};
+
+private:
+    bool open_compressed() {
+        const char* trailer = file + file_length - LOG_COMPRESS_TRAILER_SIZE;
+        if (static_cast<uint8_t>(file[6]) != LOG_COMPRESS_VERSION ||
+            memcmp(trailer + 20, LOG_COMPRESS_TRAILER_MAGIC, sizeof(LOG_COMPRESS_TRAILER_MAGIC)) != 0) {
+            return false;
+        }
+        block_size = read_u32(file + 8);
+        uint64_t original = read_u64(trailer);
+        uint64_t table = read_u64(trailer + 8);
+        blocks = read_u32(trailer + 16);
+        if (block_size == 0 || table < LOG_COMPRESS_HEADER_SIZE ||
+            table + static_cast<uint64_t>(blocks) * 4 + LOG_COMPRESS_TRAILER_SIZE != file_length ||
+            (original + block_size - 1) / block_size != blocks) {
+            return false;
+        }
+
+        offsets.resize(blocks + 1);
+        raw.resize(blocks);
+        offsets[0] = LOG_COMPRESS_HEADER_SIZE;
+        for (size_t b = 0; b < blocks; b++) {
+            uint32_t stored = read_u32(file + table + b * 4);
+            raw[b] = (stored & LOG_COMPRESS_RAW_BLOCK) != 0;
+            offsets[b + 1] = offsets[b] + (stored & ~LOG_COMPRESS_RAW_BLOCK);
+        }
+        if (offsets[blocks] != table) return false;
+
+        length = static_cast<size_t>(original);
+        if (length > 0) {
+            void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                 -1, 0);
+            if (mapping == MAP_FAILED) return false;
+            data = static_cast<const char*>(mapping);
+        }
+        state.reset(new std::atomic<uint8_t>[blocks]);
+        for (size_t b = 0; b < blocks; b++) {
+            state[b].store(BLOCK_EMPTY, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    bool load_block(size_t b) const {
+        uint8_t expected = BLOCK_EMPTY;
+        if (!state[b].compare_exchange_strong(expected, BLOCK_LOADING, std::memory_order_acquire)) {
+            while (expected == BLOCK_LOADING) {
+                std::this_thread::yield();
+                expected = state[b].load(std::memory_order_acquire);
+            }
+            return expected == BLOCK_READY;
+        }
+
+        char* out = const_cast<char*>(data) + b * block_size;
+        size_t out_length = std::min(block_size, length - b * block_size);
+        const char* in = file + offsets[b];
+        size_t in_length = offsets[b + 1] - offsets[b];
+        bool ok;
+        if (raw[b]) {
+            ok = in_length == out_length;
+            if (ok) memcpy(out, in, out_length);
+        } else {
+            ok = lz_decompress(in, in_length, out, out_length);
+        }
+        if (!ok) {
+            fprintf(stderr, "Corrupt compressed block %zu (bytes %zu-%zu); it reads as zeros\n", b,
+                    b * block_size, b * block_size + out_length);
+            memset(out, 0, out_length);
+        }
+        state[b].store(ok ? BLOCK_READY : BLOCK_CORRUPT, std::memory_order_release);
+        return ok;
+    }
+
+    static constexpr uint8_t BLOCK_EMPTY = 0;
+    static constexpr uint8_t BLOCK_LOADING = 1;
+    static constexpr uint8_t BLOCK_READY = 2;
+    static constexpr uint8_t BLOCK_CORRUPT = 3;
+
+    const char* file{nullptr};  // The compressed file (compressed logs only)
+    size_t file_length{0};
+    size_t block_size{LOG_COMPRESS_BLOCK_SIZE};
+    size_t blocks{0};
+    std::vector<uint64_t> offsets;  // Of each block in file, plus the table's
+    std::vector<bool> raw;
+    std::unique_ptr<std::atomic<uint8_t>[]> state;
+};
+
+/**
+ * Background compression of closed logs. enqueue() hands over a path and
+ * returns at once; the thread replaces FILE with FILE.ulz (written as
+ * FILE.ulz.tmp and renamed, so a reader never sees half a file) and
+ * leaves FILE in place if anything fails.
+ */
+class LogCompressor {
+public:
+    ~LogCompressor() { stop(); }
+
+    void start() {
+        thread = std::thread([this]() { run(); });
+    }
+
+    void enqueue(const std::string& path) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(path);
+            queued.store(queue.size(), std::memory_order_relaxed);
+        }
+        wake.notify_one();
+    }
+
+    // Finishes the queued files, then joins
+    void stop() {
+        if (!thread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+    std::atomic<uint64_t> files{0};
+    std::atomic<uint64_t> failures{0};
+    std::atomic<uint64_t> bytes_in{0};
+    std::atomic<uint64_t> bytes_out{0};
+    std::atomic<uint64_t> queued{0};
+
+private:
+    void run() {
+        lower_priority();
+        while (true) {
+            std::string path;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+                path = std::move(queue.front());
+                queue.pop_front();
+            }
+            compress(path);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queued.store(queue.size(), std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void compress(const std::string& path) {
+        std::string output = path + LOG_COMPRESSED_SUFFIX;
+        std::string temporary = output + ".tmp";
+        CompressResult result;
+        if (!compress_log_file(path, temporary, result) || rename(temporary.c_str(), output.c_str()) != 0) {
+            if (result.error.empty()) result.error = output + ": " + strerror(errno);
+            fprintf(stderr, "Compression failed, keeping %s: %s\n", path.c_str(), result.error.c_str());
+            unlink(temporary.c_str());
+            failures.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        unlink(path.c_str());
+        files.fetch_add(1, std::memory_order_relaxed);
+        bytes_in.fetch_add(result.bytes_in, std::memory_order_relaxed);
+        bytes_out.fetch_add(result.bytes_out, std::memory_order_relaxed);
+    }
+
+    // Idle scheduling class and idle I/O priority on Linux, background
+    // priority on macOS
+    static void lower_priority() {
+#if defined(__linux__)
+        struct sched_param param{};
+        if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0) {
+            setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+        }
+#if defined(SYS_ioprio_set)
+        constexpr int IOPRIO_WHO_PROCESS = 1;
+        constexpr int IOPRIO_CLASS_IDLE = 3;
+        constexpr int IOPRIO_CLASS_SHIFT = 13;
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+#elif defined(PRIO_DARWIN_THREAD)
+        setpriority(PRIO_DARWIN_THREAD, 0, PRIO_DARWIN_BG);
+#endif
+    }
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::string> queue;
+    bool stopping{false};
+};
+
+#endif // LOG_COMPRESS_H
@@ -0,0 +1,314 @@
+/**
+ * Session Log Converter
+ *
+ * Turns binary session logs (udp_log_server --format binary, see
+ * log_encoding.h) back into the server's text lines, or into JSON Lines.
+ * Records are decoded straight out of a read buffer without copying, so
+ * the converter also works on a log that is still being written (a partial
+ * record at the end is left for later) and on a pipe.
+ *
+ * Text output is "HH:MM:SS.uuuuuu [SOURCE] [ip] message" in local time,
+ * like current.log. The session header and footer come out as [SERVER]
+ * [local] lines, one per line of the original text, without the rules.
+ *
+ * Usage:
+ *   log_convert [--to text|jsonl] [--check] [SESSION_LOG]...
+ *
+ * With no SESSION_LOG, a binary log is read from stdin. --check decodes
+ * and counts the records without printing them. A compressed log
+ * (SESSION_LOG.ulz, log_compress.h) is decompressed a block at a time as
+ * it is read.
+ */
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "log_compress.h"
+#include "log_encoding.h"
+#include "log_timestamp.h"
+
+constexpr size_t READ_BUFFER_SIZE = 1024 * 1024;
+constexpr size_t OUTPUT_BUFFER_SIZE = 1024 * 1024;
+constexpr size_t SOURCE_COLUMN_WIDTH = 6;  // As in udp_log_server's text lines
+
+enum class OutputFormat {
+    Text,
+    JsonLines,
+    None
+};
+
+struct ConvertConfig {
+    std::vector<std::string> files;
+    OutputFormat output = OutputFormat::Text;
+};
+
+struct ConvertTotals {
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+};
+
+// Batches output into large fwrite() calls
+class Output {
+public:
+    Output() { buffer.reserve(OUTPUT_BUFFER_SIZE); }
+    ~Output() { flush(); }
+
+    // Room for at least count more bytes at the end of the buffer
+    char* reserve(size_t count) {
+        if (buffer.size() + count > OUTPUT_BUFFER_SIZE) flush();
+        size_t used = buffer.size();
+        buffer.resize(used + count);
+        return buffer.data() + used;
+    }
+
+    // Drops the unused part of the last reserve()
+    void commit(char* end) { buffer.resize(end - buffer.data()); }
+
+    void flush() {
+        if (!buffer.empty()) fwrite(buffer.data(), 1, buffer.size(), stdout);
+        buffer.clear();
+    }
+
+private:
+    std::vector<char> buffer;
+};
+
+static void write_text_line(const LogRecord& record, TimestampCache& timestamps, Output& out) {
+    char* p = out.reserve(TIMESTAMP_LENGTH + record.source.size() + record.message.size() + 32);
+    timestamps.format(p, std::chrono::system_clock::time_point(std::chrono::duration_cast<
+        std::chrono::system_clock::duration>(std::chrono::nanoseconds(record.time_ns))));
+    p += TIMESTAMP_LENGTH;
+    memcpy(p, " [", 2);
+    p += 2;
+    memcpy(p, record.source.data(), record.source.size());
+    p += record.source.size();
+    for (size_t i = record.source.size(); i < SOURCE_COLUMN_WIDTH; i++) {
+        *p++ = ' ';
+    }
+    memcpy(p, "] [", 3);
+    p += 3;
+    p += format_ipv4(record.client_addr, p);
+    memcpy(p, "] ", 2);
+    p += 2;
+    memcpy(p, record.message.data(), record.message.size());
+    p += record.message.size();
+    *p++ = '\n';
+    out.commit(p);
+}
+
+static void write_json_line(const LogRecord& record, Output& out) {
+    char* p = out.reserve(json_line_capacity(record) + 1);
+    p += encode_json_line(record, p);
+    *p++ = '\n';
+    out.commit(p);
+}
+
+// A binary log being read: a file or stdin through read(), or a compressed
+// log whose blocks are decompressed as they are reached and dropped once
+// copied out
+class Input {
+public:
+    explicit Input(int descriptor) : fd(descriptor) {}
+    explicit Input(const LogFile& file) : log(&file) {}
+
+    // Like read(2)
+    ssize_t read(char* out, size_t count) {
+        if (!log) return ::read(fd, out, count);
+        count = std::min(count, log->length - position);
+        if (!log->load(position, position + count)) {
+            errno = EIO;
+            return -1;
+        }
+        memcpy(out, log->data + position, count);
+        position += count;
+        log->release(released, position);
+        released = position - position % log->block_length();
+        return static_cast<ssize_t>(count);
+    }
+
+private:
+    int fd{-1};
+    const LogFile* log{nullptr};
+    size_t position{0};
+    size_t released{0};  // Blocks before this have been dropped
+};
+
+// Converts one binary log; returns false if it is not one or is corrupt
+static bool convert(Input& input, const std::string& name, const ConvertConfig& config, TimestampCache& timestamps,
+                    Output& out, ConvertTotals& totals) {
+    std::vector<char> buffer(READ_BUFFER_SIZE);
+    size_t filled = 0;
+    size_t offset = 0;
+    bool header_checked = false;
+    std::string session;
+    bool at_end = false;
+    uint64_t file_offset = 0;  // Of buffer[0]
+
+    while (true) {
+        if (!at_end) {
+            ssize_t n = input.read(buffer.data() + filled, buffer.size() - filled);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << name << ": " << strerror(errno) << std::endl;
+                return false;
+            }
+            filled += static_cast<size_t>(n);
+            at_end = n == 0;
+        }
+
+        if (!header_checked) {
+            std::string_view header_session;
+            BinaryDecodeStatus status = read_binary_log_header(buffer.data(), filled, header_session, offset);
+            if (status == BinaryDecodeStatus::Incomplete && !at_end) continue;
+            if (status != BinaryDecodeStatus::Ok) {
+                std::cerr << name << ": not a binary session log" << std::endl;
+                return false;
+            }
+            session = header_session;
+            header_checked = true;
+        }
+
+        while (true) {
+            LogRecord record;
+            record.session = session;
+            size_t consumed = 0;
+            BinaryDecodeStatus status = decode_binary_record(buffer.data() + offset, filled - offset, record, consumed);
+            if (status == BinaryDecodeStatus::Corrupt) {
+                std::cerr << name << ": corrupt record at offset " << file_offset + offset << std::endl;
+                return false;
+            }
+            if (status == BinaryDecodeStatus::Incomplete) break;
+            if (config.output == OutputFormat::Text) {
+                write_text_line(record, timestamps, out);
+            } else if (config.output == OutputFormat::JsonLines) {
+                write_json_line(record, out);
+            }
+            offset += consumed;
+            totals.records++;
+        }
+
+        if (at_end) {
+            if (offset < filled) {
+                std::cerr << name << ": " << filled - offset << " bytes of an unfinished record at the end"
+                          << std::endl;
+            }
+            totals.bytes += file_offset + filled;
+            return true;
+        }
+
+        // Keep the partial record, growing the buffer if a record is larger
+        // than what is left of it
+        memmove(buffer.data(), buffer.data() + offset, filled - offset);
+        file_offset += offset;
+        filled -= offset;
+        offset = 0;
+        if (filled >= 4) {
+            size_t needed = 4 + static_cast<size_t>(read_u32(buffer.data()));
+            if (needed > buffer.size()) buffer.resize(needed);
+        }
+    }
+}
+
+static void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options] [SESSION_LOG]..." << std::endl;
+    std::cout << "  --to FORMAT      text (default, like current.log) or jsonl" << std::endl;
+    std::cout << "  --check          Only decode and count the records" << std::endl;
+    std::cout << "Reads a binary session log (udp_log_server --format binary) from stdin when no" << std::endl;
+    std::cout << "SESSION_LOG is given." << std::endl;
+}
+
+static bool parse_args(int argc, char* argv[], ConvertConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            exit(0);
+        }
+        if (arg == "--check") {
+            config.output = OutputFormat::None;
+            continue;
+        }
+        if (arg.compare(0, 2, "--") != 0) {
+            config.files.push_back(arg);
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (arg == "--to") {
+            LogFormat format;
+            if (!parse_log_format(value, format) || format == LogFormat::Binary) {
+                std::cerr << "--to must be text or jsonl" << std::endl;
+                return false;
+            }
+            config.output = format == LogFormat::Text ? OutputFormat::Text : OutputFormat::JsonLines;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    ConvertConfig config;
+    if (!parse_args(argc, argv, config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    TimestampCache timestamps;
+    Output out;
+    ConvertTotals totals;
+    bool ok = true;
+    auto start = std::chrono::steady_clock::now();
+    if (config.files.empty()) {
+        Input input(STDIN_FILENO);
+        ok = convert(input, "stdin", config, timestamps, out, totals);
+    }
+    for (const auto& path : config.files) {
+        if (uncompressed_log_path(path) != path) {
+            LogFile log;
+            if (!log.open(path)) {
+                std::cerr << "Cannot open " << path << ": " << strerror(errno) << std::endl;
+                ok = false;
+                continue;
+            }
+            Input input(log);
+            ok = convert(input, path, config, timestamps, out, totals) && ok;
+            continue;
+        }
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            std::cerr << "Cannot open " << path << ": " << strerror(errno) << std::endl;
+            ok = false;
+            continue;
+        }
+        Input input(fd);
+        ok = convert(input, path, config, timestamps, out, totals) && ok;
+        close(fd);
+    }
+    out.flush();
+
+    if (config.output == OutputFormat::None) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%llu records, %llu bytes in %.3f s (%.0f MB/s)\n", static_cast<unsigned long long>(totals.records),
+               static_cast<unsigned long long>(totals.bytes), seconds,
+               seconds > 0 ? totals.bytes / seconds / 1e6 : 0.0);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,267 @@
+/**
+ * Session Log Encodings
+ *
+ * Session files are written in one of three encodings (--format):
+ *
+ *   text    "HH:MM:SS.uuuuuu [SOURCE] [ip] message" lines (session_*.log),
+ *           the only encoding with .idx and .terms sidecars
+ *   jsonl   one JSON object per line (session_*.jsonl):
+ *           {"ts_ns":1760000000123456000,"source":"iOS","ip":"10.0.0.5",
+ *            "session":"<guid>","record":1,"msg":"..."}
+ *   binary  length-prefixed records after a file header (session_*.ulb)
+ *
+ * The fields are the same in both structured encodings, except that binary
+ * keeps the session ID once, in the file header. ts_ns is the line time in
+ * nanoseconds since the Unix epoch, record numbers the session's records
+ * from 1 in the order the server wrote them (it is not a framed sender's
+ * sequence number, and the server's own lines are numbered too), and ip
+ * is "local" for the server's own lines (session header and footer,
+ * overload summaries). Nothing is padded or re-parsed: the writer
+ * encodes straight from the fields the receivers stored with each line,
+ * picking the encoder with a switch on the configured format rather than a
+ * virtual call per line. current.log and the --sink outputs stay text.
+ *
+ * Binary layout, integers big-endian like the wire protocol (log_protocol.h):
+ *
+ *   file header  "ULOGBIN", a version byte, u16 session ID length and
+ *                the session ID
+ *   record       u32  length of the rest of the record
+ *                u64  ts_ns
+ *                u64  record number
+ *                u32  IPv4 address, network order (0 = local)
+ *                u16  source length
+ *                     source and message bytes
+ *
+ * log_convert turns binary logs back into text (or JSON Lines).
+ */
+
+#ifndef LOG_ENCODING_H
+#define LOG_ENCODING_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "log_protocol.h"
+
+enum class LogFormat {
+    Text,
+    JsonLines,
+    Binary
+};
+
+inline const char* log_format_name(LogFormat format) {
+    switch (format) {
+        case LogFormat::Text: return "text";
+        case LogFormat::JsonLines: return "jsonl";
+        case LogFormat::Binary: return "binary";
+    }
+    return "unknown";
+}
+
+inline bool parse_log_format(const std::string& name, LogFormat& format) {
+    if (name == "text") {
+        format = LogFormat::Text;
+    } else if (name == "jsonl" || name == "json") {
+        format = LogFormat::JsonLines;
+    } else if (name == "binary") {
+        format = LogFormat::Binary;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Session file name suffix for each encoding
+inline const char* log_format_extension(LogFormat format) {
+    switch (format) {
+        case LogFormat::Text: return ".log";
+        case LogFormat::JsonLines: return ".jsonl";
+        case LogFormat::Binary: return ".ulb";
+    }
+    return ".log";
+}
+
+struct LogRecord {
+    int64_t time_ns{0};
+    uint64_t number{0};  // "record": position in the session file, from 1
+    uint32_t client_addr{0};  // IPv4, network byte order; 0 = local
+    std::string_view source;
+    std::string_view session;
+    std::string_view message;
+};
+
+constexpr char BINARY_LOG_MAGIC[7] = {'U', 'L', 'O', 'G', 'B', 'I', 'N'};
+constexpr uint8_t BINARY_LOG_VERSION = 1;
+constexpr size_t BINARY_LOG_HEADER_FIXED_SIZE = 10;  // Magic, version and session ID length
+constexpr size_t BINARY_RECORD_FIXED_SIZE = 26;  // Length prefix through source length
+constexpr size_t BINARY_FIELD_MAX = 0xFFFF;  // Longest session ID or source
+
+enum class BinaryDecodeStatus {
+    Ok,
+    Incomplete,  // Needs more bytes than available
+    Corrupt
+};
+
+inline size_t binary_log_header_size(std::string_view session) {
+    return BINARY_LOG_HEADER_FIXED_SIZE + std::min(session.size(), BINARY_FIELD_MAX);
+}
+
+// Writes binary_log_header_size(session) bytes
+inline size_t write_binary_log_header(std::string_view session, char* out) {
+    size_t session_length = std::min(session.size(), BINARY_FIELD_MAX);
+    memcpy(out, BINARY_LOG_MAGIC, sizeof(BINARY_LOG_MAGIC));
+    out[7] = static_cast<char>(BINARY_LOG_VERSION);
+    write_u16(out + 8, static_cast<uint16_t>(session_length));
+    memcpy(out + BINARY_LOG_HEADER_FIXED_SIZE, session.data(), session_length);
+    return BINARY_LOG_HEADER_FIXED_SIZE + session_length;
+}
+
+// Checks the file header and finds the session ID (a view into data) and
+// where the first record starts
+inline BinaryDecodeStatus read_binary_log_header(const char* data, size_t available, std::string_view& session,
+                                                 size_t& header_size) {
+    size_t magic = std::min(available, sizeof(BINARY_LOG_MAGIC));
+    if (memcmp(data, BINARY_LOG_MAGIC, magic) != 0) return BinaryDecodeStatus::Corrupt;
+    if (available < BINARY_LOG_HEADER_FIXED_SIZE) return BinaryDecodeStatus::Incomplete;
+    if (static_cast<uint8_t>(data[7]) != BINARY_LOG_VERSION) return BinaryDecodeStatus::Corrupt;
+    header_size = BINARY_LOG_HEADER_FIXED_SIZE + read_u16(data + 8);
+    if (available < header_size) return BinaryDecodeStatus::Incomplete;
+    session = std::string_view(data + BINARY_LOG_HEADER_FIXED_SIZE, header_size - BINARY_LOG_HEADER_FIXED_SIZE);
+    return BinaryDecodeStatus::Ok;
+}
+
+inline size_t binary_record_size(const LogRecord& record) {
+    return BINARY_RECORD_FIXED_SIZE + std::min(record.source.size(), BINARY_FIELD_MAX) + record.message.size();
+}
+
+// Writes binary_record_size(record) bytes; the session ID is in the file header
+inline size_t encode_binary_record(const LogRecord& record, char* out) {
+    size_t source_length = std::min(record.source.size(), BINARY_FIELD_MAX);
+    size_t size = BINARY_RECORD_FIXED_SIZE + source_length + record.message.size();
+    write_u32(out, static_cast<uint32_t>(size - 4));
+    write_u64(out + 4, static_cast<uint64_t>(record.time_ns));
+    write_u64(out + 12, record.number);
+    memcpy(out + 20, &record.client_addr, 4);
+    write_u16(out + 24, static_cast<uint16_t>(source_length));
+    memcpy(out + BINARY_RECORD_FIXED_SIZE, record.source.data(), source_length);
+    memcpy(out + BINARY_RECORD_FIXED_SIZE + source_length, record.message.data(), record.message.size());
+    return size;
+}
+
+// Decodes the record at data into everything but record.session; the views
+// point into data. consumed is set on Ok.
+inline BinaryDecodeStatus decode_binary_record(const char* data, size_t available, LogRecord& record,
+                                               size_t& consumed) {
+    if (available < 4) return BinaryDecodeStatus::Incomplete;
+    size_t size = 4 + static_cast<size_t>(read_u32(data));
+    if (size < BINARY_RECORD_FIXED_SIZE) return BinaryDecodeStatus::Corrupt;
+    if (available < size) return BinaryDecodeStatus::Incomplete;
+    size_t source_length = read_u16(data + 24);
+    if (BINARY_RECORD_FIXED_SIZE + source_length > size) return BinaryDecodeStatus::Corrupt;
+
+    record.time_ns = static_cast<int64_t>(read_u64(data + 4));
+    record.number = read_u64(data + 12);
+    memcpy(&record.client_addr, data + 20, 4);
+    record.source = std::string_view(data + BINARY_RECORD_FIXED_SIZE, source_length);
+    size_t message_offset = BINARY_RECORD_FIXED_SIZE + source_length;
+    record.message = std::string_view(data + message_offset, size - message_offset);
+    consumed = size;
+    return BinaryDecodeStatus::Ok;
+}
+
+// "a.b.c.d", or "local" for 0; returns the length (at most 15)
+inline size_t format_ipv4(uint32_t client_addr, char* out) {
+    if (client_addr == 0) {
+        memcpy(out, "local", 5);
+        return 5;
+    }
+    const unsigned char* octets = reinterpret_cast<const unsigned char*>(&client_addr);
+    size_t length = 0;
+    for (int i = 0; i < 4; i++) {
+        if (i > 0) out[length++] = '.';
+        unsigned int octet = octets[i];
+        if (octet >= 100) out[length++] = static_cast<char>('0' + octet / 100);
+        if (octet >= 10) out[length++] = static_cast<char>('0' + octet / 10 % 10);
+        out[length++] = static_cast<char>('0' + octet % 10);
+    }
+    return length;
+}
+
+// Upper bound for encode_json_line(): every byte may become a \u00XX escape
+inline size_t json_line_capacity(const LogRecord& record) {
+    return 128 + 6 * (record.source.size() + record.session.size() + record.message.size());
+}
+
+// Appends text as the body of a JSON string. Bytes from 0x80 up are copied
+// as they are, so UTF-8 passes through.
+inline char* append_json_string(char* out, std::string_view text) {
+    static const char hex[] = "0123456789abcdef";
+    const char* run = text.data();
+    const char* end = text.data() + text.size();
+    for (const char* p = run; p < end; p++) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        memcpy(out, run, p - run);
+        out += p - run;
+        run = p + 1;
+        *out++ = '\\';
+        switch (c) {
+            case '"': *out++ = '"'; break;
+            case '\\': *out++ = '\\'; break;
+            case '\n': *out++ = 'n'; break;
+            case '\r': *out++ = 'r'; break;
+            case '\t': *out++ = 't'; break;
+            default:
+                *out++ = 'u';
+                *out++ = '0';
+                *out++ = '0';
+                *out++ = hex[c >> 4];
+                *out++ = hex[c & 0xF];
+        }
+    }
+    memcpy(out, run, end - run);
+    return out + (end - run);
+}
+
+inline char* append_json_number(char* out, uint64_t value, bool negative = false) {
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    if (negative) *out++ = '-';
+    while (count > 0) {
+        *out++ = digits[--count];
+    }
+    return out;
+}
+
+// One JSON object without the newline; out needs json_line_capacity(record) bytes
+inline size_t encode_json_line(const LogRecord& record, char* out) {
+    char* p = out;
+    memcpy(p, "{\"ts_ns\":", 9);
+    p += 9;
+    uint64_t magnitude = record.time_ns < 0 ? 0 - static_cast<uint64_t>(record.time_ns)
+                                            : static_cast<uint64_t>(record.time_ns);
+    p = append_json_number(p, magnitude, record.time_ns < 0);
+    memcpy(p, ",\"source\":\"", 11);
+    p = append_json_string(p + 11, record.source);
+    memcpy(p, "\",\"ip\":\"", 8);
+    p += 8;
+    p += format_ipv4(record.client_addr, p);
+    memcpy(p, "\",\"session\":\"", 13);
+    p = append_json_string(p + 13, record.session);
+    memcpy(p, "\",\"record\":", 11);
+    p = append_json_number(p + 11, record.number);
+    memcpy(p, ",\"msg\":\"", 8);
+    p = append_json_string(p + 8, record.message);
+    memcpy(p, "\"}", 2);
+    return static_cast<size_t>(p + 2 - out);
+}
+
+#endif // LOG_ENCODING_H
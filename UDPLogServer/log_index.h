@@ -0,0 +1,232 @@
+/**
+ * Session Log Index
+ *
+ * Next to every session_*.log the server writes session_*.log.idx, a sparse
+ * index of the log: one entry every --index-lines lines or --index-ms of
+ * line time, whichever comes first. The writer already knows each line's
+ * byte offset and number when it queues it, so the index costs one entry
+ * per interval and one extra write per commit.
+ *
+ * Layout (all integers big-endian, like the wire protocol):
+ *
+ *   header  offset  size  field
+ *           0       6     magic "LOGIDX"
+ *           6       1     version (LOG_INDEX_VERSION)
+ *           7       1     reserved
+ *           8       4     lines per entry (0 = no line interval)
+ *           12      4     milliseconds per entry (0 = no time interval)
+ *           16      8     session start, microseconds since the epoch
+ *           24      8     reserved
+ *
+ *   entry   offset  size  field
+ *           0       8     line time, microseconds since the epoch
+ *           8       8     byte offset of the line in the session log
+ *           16      8     line number (1-based, counting the session header)
+ *
+ * Line numbers count physical lines, as a reader of the file sees them: a
+ * message with newlines of its own (a stack trace, a multi-line console
+ * message) takes several.
+ *
+ * Log lines only carry "HH:MM:SS.uuuuuu", so the date is inferred: each
+ * line's time of day resolves to the instant closest to the previous one,
+ * which follows a session across midnight. Entry times never decrease,
+ * even when line times do (kernel or client clocks, reassembled records),
+ * so the index can be binary searched by time as well as by line.
+ *
+ * log_index_query uses the index to pull a time range or the last lines
+ * out of a session log without reading all of it.
+ */
+
+#ifndef LOG_INDEX_H
+#define LOG_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+#include "log_protocol.h"
+#include "log_timestamp.h"
+
+constexpr char LOG_INDEX_MAGIC[6] = {'L', 'O', 'G', 'I', 'D', 'X'};
+constexpr uint8_t LOG_INDEX_VERSION = 1;
+constexpr size_t LOG_INDEX_HEADER_SIZE = 32;
+constexpr size_t LOG_INDEX_ENTRY_SIZE = 24;
+constexpr const char* LOG_INDEX_SUFFIX = ".idx";
+
+constexpr int64_t MICROS_PER_DAY = 86400LL * 1000000;
+
+struct LogIndexEntry {
+    int64_t time_us;
+    uint64_t offset;
+    uint64_t line;
+};
+
+inline void write_index_entry(char* out, const LogIndexEntry& entry) {
+    write_u64(out, static_cast<uint64_t>(entry.time_us));
+    write_u64(out + 8, entry.offset);
+    write_u64(out + 16, entry.line);
+}
+
+inline LogIndexEntry read_index_entry(const char* in) {
+    return LogIndexEntry{static_cast<int64_t>(read_u64(in)), read_u64(in + 8), read_u64(in + 16)};
+}
+
+// Physical lines a log line of length bytes adds to its file, counting the
+// newline that ends it
+inline uint64_t physical_lines(const char* text, size_t length) {
+    uint64_t lines = 1;
+    const char* end = text + length;
+    for (const char* p = text; (p = static_cast<const char*>(memchr(p, '\n', end - p))) != nullptr; p++) {
+        lines++;
+    }
+    return lines;
+}
+
+// Parses the "HH:MM:SS.uuuuuu" a log line starts with into microseconds
+// since midnight; false if the line does not start with a timestamp
+inline bool parse_time_of_day(const char* line, size_t length, int64_t& micros) {
+    if (length < TIMESTAMP_LENGTH || line[2] != ':' || line[5] != ':' || line[8] != '.') {
+        return false;
+    }
+    static const int fields[4][2] = {{0, 2}, {3, 2}, {6, 2}, {9, 6}};
+    int64_t values[4];
+    for (int f = 0; f < 4; f++) {
+        int64_t value = 0;
+        for (int i = 0; i < fields[f][1]; i++) {
+            char c = line[fields[f][0] + i];
+            if (c < '0' || c > '9') return false;
+            value = value * 10 + (c - '0');
+        }
+        values[f] = value;
+    }
+    if (values[0] > 23 || values[1] > 59 || values[2] > 60) return false;
+    micros = ((values[0] * 60 + values[1]) * 60 + values[2]) * 1000000 + values[3];
+    return true;
+}
+
+// Microseconds since the epoch of local midnight on the day of time_us
+inline int64_t local_midnight(int64_t time_us) {
+    time_t seconds = static_cast<time_t>(time_us / 1000000);
+    struct tm day;
+    localtime_r(&seconds, &day);
+    day.tm_hour = 0;
+    day.tm_min = 0;
+    day.tm_sec = 0;
+    day.tm_isdst = -1;
+    return static_cast<int64_t>(mktime(&day)) * 1000000;
+}
+
+/**
+ * Turns times of day into absolute times: each one resolves to the instant
+ * closest to the previous result (initially the reference time), within
+ * half a day. Local midnight is recomputed only when a day boundary is
+ * crossed.
+ */
+class TimeOfDayClock {
+public:
+    explicit TimeOfDayClock(int64_t reference_us)
+        : reference(reference_us), midnight(local_midnight(reference_us)) {}
+
+    int64_t resolve(int64_t time_of_day_us) {
+        int64_t time = midnight + time_of_day_us;
+        if (time - reference > MICROS_PER_DAY / 2) {
+            time -= MICROS_PER_DAY;
+        } else if (reference - time > MICROS_PER_DAY / 2) {
+            time += MICROS_PER_DAY;
+        }
+        if (time < midnight || time >= midnight + MICROS_PER_DAY) {
+            midnight = local_midnight(time);
+        }
+        reference = time;
+        return time;
+    }
+
+private:
+    int64_t reference;
+    int64_t midnight;
+};
+
+/**
+ * Writer side: follows a session log as lines are queued for it and
+ * produces the index entries. add_line() must see every line, in order,
+ * before it is written.
+ */
+class LogIndexBuilder {
+public:
+    LogIndexBuilder() : clock(0) {}
+
+    // Fills header (LOG_INDEX_HEADER_SIZE bytes) for a session started at start_us
+    void start(int64_t start_us, uint32_t every_lines, uint32_t every_ms, char* header) {
+        clock = TimeOfDayClock(start_us);
+        lines_per_entry = every_lines;
+        micros_per_entry = static_cast<int64_t>(every_ms) * 1000;
+        offset = 0;
+        line = 1;
+        lines_since_entry = 0;
+        last_entry_time = start_us;
+        have_entry = false;
+
+        memset(header, 0, LOG_INDEX_HEADER_SIZE);
+        memcpy(header, LOG_INDEX_MAGIC, sizeof(LOG_INDEX_MAGIC));
+        header[6] = static_cast<char>(LOG_INDEX_VERSION);
+        write_u32(header + 8, every_lines);
+        write_u32(header + 12, every_ms);
+        write_u64(header + 16, static_cast<uint64_t>(start_us));
+    }
+
+    // Text written before the first line (the session header)
+    void skip(size_t bytes, size_t lines) {
+        offset += bytes;
+        line += lines;
+    }
+
+    // Accounts for one line (without its newline) about to be appended.
+    // Returns true and fills entry (LOG_INDEX_ENTRY_SIZE bytes) when the
+    // line starts a new index interval.
+    bool add_line(const char* text, size_t length, char* entry) {
+        uint64_t line_offset = offset;
+        uint64_t line_number = line;
+        offset += length + 1;
+        line += physical_lines(text, length);
+        lines_since_entry++;
+
+        bool due = !have_entry || (lines_per_entry > 0 && lines_since_entry >= lines_per_entry);
+        int64_t time_of_day;
+        if (!parse_time_of_day(text, length, time_of_day)) {
+            return false;  // Entries always point at a timestamped line
+        }
+        int64_t time = clock.resolve(time_of_day);
+        if (!due && (micros_per_entry == 0 || time - last_entry_time < micros_per_entry)) {
+            return false;
+        }
+
+        if (time < last_entry_time) time = last_entry_time;
+        write_index_entry(entry, LogIndexEntry{time, line_offset, line_number});
+        last_entry_time = time;
+        lines_since_entry = 0;
+        have_entry = true;
+        return true;
+    }
+
+    uint64_t next_line() const { return line; }
+
+    // After a failed write: the file ends at file_offset, and the next line
+    // written will be line next_line
+    void resync(uint64_t file_offset, uint64_t next) {
+        offset = file_offset;
+        line = next;
+    }
+
+private:
+    TimeOfDayClock clock;
+    uint32_t lines_per_entry{0};
+    int64_t micros_per_entry{0};
+    uint64_t offset{0};
+    uint64_t line{1};
+    uint32_t lines_since_entry{0};
+    int64_t last_entry_time{0};
+    bool have_entry{false};
+};
+
+#endif // LOG_INDEX_H
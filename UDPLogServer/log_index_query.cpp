@@ -0,0 +1,401 @@
+/**
+ * Session Log Index Query
+ *
+ * Pulls lines out of a udp_log_server session log by time or by position,
+ * using the sidecar index the server writes next to it (log_index.h). The
+ * log and its index are memory-mapped; a query binary searches the index
+ * and then reads only the lines it prints, plus at most one index interval
+ * to find where they start.
+ *
+ * Without an index (sessions written with --index-lines 0 --index-ms 0, or
+ * by an older server) the same queries fall back to scanning the log.
+ *
+ * A compressed log (SESSION_LOG.ulz, log_compress.h) is queried with the
+ * index of the uncompressed name; only the blocks holding the lines a
+ * query reads are decompressed.
+ *
+ * A time range ends at the first line later than --to, so lines that are
+ * out of time order (kernel or client clocks) are only found near the
+ * boundaries to within one index interval.
+ *
+ * Usage:
+ *   log_index_query SESSION_LOG --from TIME [--to TIME]
+ *   log_index_query SESSION_LOG --last K
+ *   log_index_query SESSION_LOG --info
+ *
+ * TIME is HH:MM:SS[.uuuuuu], taken on the day nearest the session start,
+ * or "YYYY-MM-DD HH:MM:SS[.uuuuuu]".
+ */
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log_compress.h"
+#include "log_index.h"
+#include "log_tools.h"
+
+// The session footer the server appends when a session ends, or when it
+// continues in the next part after a rotation
+constexpr const char* FOOTER_RULE = "========================================\n";
+constexpr const char* FOOTER_TITLES[] = {"Session Ended\n", "Session Continued\n"};
+constexpr size_t FOOTER_SEARCH_BYTES = 256 * 1024;
+
+struct QueryConfig {
+    std::string log_path;
+    bool info = false;
+    bool have_from = false;
+    bool have_to = false;
+    std::string from;
+    std::string to;
+    long long last = -1;
+};
+
+struct SessionLog {
+    const LogFile* file{nullptr};
+    const char* data{nullptr};
+    size_t body_start{0};  // First line after the session header
+    size_t body_end{0};    // Just past the last line, before the footer if there is one
+    int64_t start_us{0};
+
+    // Index entries (nullptr/0 without a usable index)
+    const char* entries{nullptr};
+    size_t entry_count{0};
+    uint32_t every_lines{0};
+    uint32_t every_ms{0};
+
+    LogIndexEntry entry(size_t i) const {
+        return read_index_entry(entries + i * LOG_INDEX_ENTRY_SIZE);
+    }
+};
+
+static size_t line_end(const SessionLog& log, size_t offset) {
+    size_t newline = log.file->find_newline(offset, log.body_end);
+    return newline < log.body_end ? newline + 1 : log.body_end;
+}
+
+// "YYYY-MM-DD HH:MM:SS[.uuuuuu]" or a time of day resolved near the session start
+static bool parse_time_argument(const std::string& value, int64_t session_start_us, int64_t& time_us) {
+    int64_t micros = 0;
+    std::string clock = value;
+    struct tm date{};
+    bool dated = value.size() > 11 && value[4] == '-' && value[10] == ' ';
+    if (dated) {
+        if (!strptime(value.c_str(), "%Y-%m-%d", &date)) return false;
+        clock = value.substr(11);
+    }
+
+    // Accept HH:MM:SS with an optional fraction of any precision
+    if (clock.size() < 8) return false;
+    std::string padded = clock.substr(0, 8) + ".";
+    std::string fraction = clock.size() > 9 && clock[8] == '.' ? clock.substr(9) : "";
+    if (clock.size() > 8 && clock[8] != '.') return false;
+    padded += (fraction + "000000").substr(0, 6);
+    if (!parse_time_of_day(padded.c_str(), padded.size(), micros)) return false;
+
+    if (!dated) {
+        time_us = TimeOfDayClock(session_start_us).resolve(micros);
+        return true;
+    }
+    date.tm_hour = 0;
+    date.tm_min = 0;
+    date.tm_sec = 0;
+    date.tm_isdst = -1;
+    time_us = static_cast<int64_t>(mktime(&date)) * 1000000 + micros;
+    return true;
+}
+
+// Where the footer of an ended (or continued) session starts, or the end
+// of the file
+static size_t find_body_end(const LogFile& file) {
+    const char* data = file.data;
+    size_t length = file.length;
+    size_t rule = strlen(FOOTER_RULE);
+    size_t lowest = length > FOOTER_SEARCH_BYTES ? length - FOOTER_SEARCH_BYTES : 0;
+    file.load(lowest, length);
+    for (const char* title_text : FOOTER_TITLES) {
+        size_t title = strlen(title_text);
+        for (size_t i = length >= title ? length - title : 0; i > lowest + rule; i--) {
+            if (data[i - 1] != '\n' || memcmp(data + i, title_text, title) != 0) continue;
+            size_t footer = i - rule;
+            if (memcmp(data + footer, FOOTER_RULE, rule) == 0 && footer >= 1 && data[footer - 1] == '\n') {
+                return footer - 1;  // The footer starts with an empty line
+            }
+        }
+    }
+    return length;
+}
+
+// First timestamped line: the header is short, so a scan is fine
+static size_t find_body_start(const LogFile& file, size_t end) {
+    int64_t ignored;
+    for (size_t offset = 0; offset < end; ) {
+        size_t newline = file.find_newline(offset, end);
+        size_t next = newline < end ? newline + 1 : end;
+        if (parse_time_of_day(file.data + offset, next - offset, ignored)) return offset;
+        offset = next;
+    }
+    return end;
+}
+
+static bool load_index(const MappedFile& index, const LogFile& file, SessionLog& log) {
+    if (index.length < LOG_INDEX_HEADER_SIZE ||
+        memcmp(index.data, LOG_INDEX_MAGIC, sizeof(LOG_INDEX_MAGIC)) != 0 ||
+        static_cast<uint8_t>(index.data[6]) != LOG_INDEX_VERSION) {
+        return false;
+    }
+    log.every_lines = read_u32(index.data + 8);
+    log.every_ms = read_u32(index.data + 12);
+    log.start_us = static_cast<int64_t>(read_u64(index.data + 16));
+    log.entries = index.data + LOG_INDEX_HEADER_SIZE;
+    log.entry_count = (index.length - LOG_INDEX_HEADER_SIZE) / LOG_INDEX_ENTRY_SIZE;
+
+    // Entries can be ahead of a log that is still being written
+    while (log.entry_count > 0 && log.entry(log.entry_count - 1).offset >= file.length) {
+        log.entry_count--;
+    }
+    return true;
+}
+
+// Copies [begin, end) of the log to stdout
+static void print_range(const SessionLog& log, size_t begin, size_t end) {
+    if (end <= begin) return;
+    log.file->load(begin, end);
+    fwrite(log.data + begin, 1, end - begin, stdout);
+}
+
+static void query_time_range(const SessionLog& log, int64_t from, bool have_to, int64_t to) {
+    // Last entry before the range: nothing in front of it can match
+    size_t offset = log.body_start;
+    int64_t reference = log.start_us;
+    if (log.entry_count > 0) {
+        size_t low = 0;
+        size_t high = log.entry_count;
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            if (log.entry(middle).time_us < from) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        LogIndexEntry start = log.entry(low > 0 ? low - 1 : 0);
+        offset = start.offset;
+        reference = start.time_us;
+    }
+
+    TimeOfDayClock clock(reference);
+    size_t run_start = offset;
+    size_t run_end = offset;
+    bool in_range = false;
+    while (offset < log.body_end) {
+        size_t next = line_end(log, offset);
+        int64_t time_of_day;
+        if (parse_time_of_day(log.data + offset, next - offset, time_of_day)) {
+            int64_t time = clock.resolve(time_of_day);
+            if (have_to && time > to) break;
+            in_range = time >= from;
+        }
+        // Lines without a timestamp continue the previous line's message
+        if (in_range) {
+            if (offset != run_end) {
+                print_range(log, run_start, run_end);
+                run_start = offset;
+            }
+            run_end = next;
+        }
+        offset = next;
+    }
+    print_range(log, run_start, run_end);
+}
+
+static void query_last_lines(const SessionLog& log, unsigned long long count) {
+    if (count == 0) return;
+    if (log.entry_count == 0) {
+        // No index: walk back line by line from the end
+        size_t offset = log.body_end;
+        for (unsigned long long line = 0; line < count && offset > log.body_start; line++) {
+            offset--;  // The newline ending this line
+            offset = log.file->find_line_start(log.body_start, offset);
+        }
+        print_range(log, offset, log.body_end);
+        return;
+    }
+
+    // Number the lines after the last entry to find the last line number
+    LogIndexEntry last = log.entry(log.entry_count - 1);
+    uint64_t last_line = last.line;
+    for (size_t offset = line_end(log, last.offset); offset < log.body_end; offset = line_end(log, offset)) {
+        last_line++;
+    }
+    LogIndexEntry first = log.entry(0);
+    if (last_line + 1 <= first.line + count) {
+        print_range(log, log.body_start, log.body_end);
+        return;
+    }
+    uint64_t target = last_line + 1 - count;
+
+    // Last entry at or before the target line, then step forward to it
+    size_t low = 0;
+    size_t high = log.entry_count;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (log.entry(middle).line <= target) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    LogIndexEntry start = log.entry(low);
+    size_t offset = start.offset;
+    for (uint64_t line = start.line; line < target && offset < log.body_end; line++) {
+        offset = line_end(log, offset);
+    }
+    print_range(log, offset, log.body_end);
+}
+
+static void print_info(const SessionLog& log, const QueryConfig& config) {
+    std::cout << "Log: " << config.log_path << " (" << log.file->length << " bytes, body "
+              << log.body_end - log.body_start << " bytes";
+    if (log.file->compressed()) {
+        std::cout << ", compressed to " << log.file->stored_length() << " bytes";
+    }
+    std::cout << ")" << std::endl;
+    std::cout << "Session start: " << format_time(log.start_us) << std::endl;
+    if (!log.entries) {
+        std::cout << "Index: none (queries scan the log)" << std::endl;
+        return;
+    }
+    std::cout << "Index: " << log.entry_count << " entries, one every " << log.every_lines << " lines or "
+              << log.every_ms << " ms (0 = off)" << std::endl;
+    if (log.entry_count > 0) {
+        LogIndexEntry first = log.entry(0);
+        LogIndexEntry last = log.entry(log.entry_count - 1);
+        std::cout << "Indexed lines: " << first.line << " - " << last.line << std::endl;
+        std::cout << "Indexed times: " << format_time(first.time_us) << " - " << format_time(last.time_us)
+                  << std::endl;
+    }
+}
+
+static void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " SESSION_LOG [options]" << std::endl;
+    std::cout << "  --from TIME      Print lines from TIME on (HH:MM:SS[.uuuuuu] or" << std::endl;
+    std::cout << "                   \"YYYY-MM-DD HH:MM:SS[.uuuuuu]\")" << std::endl;
+    std::cout << "  --to TIME        Stop after TIME (default: end of the log)" << std::endl;
+    std::cout << "  --last K         Print the last K lines" << std::endl;
+    std::cout << "  --info           Describe the log and its index" << std::endl;
+}
+
+static bool parse_args(int argc, char* argv[], QueryConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            exit(0);
+        }
+        if (arg == "--info") {
+            config.info = true;
+            continue;
+        }
+        if (arg.compare(0, 2, "--") != 0) {
+            if (!config.log_path.empty()) {
+                std::cerr << "Only one session log per query" << std::endl;
+                return false;
+            }
+            config.log_path = arg;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (arg == "--from") {
+            config.from = value;
+            config.have_from = true;
+        } else if (arg == "--to") {
+            config.to = value;
+            config.have_to = true;
+        } else if (arg == "--last") {
+            config.last = atoll(value.c_str());
+            if (config.last < 0) {
+                std::cerr << "--last must not be negative" << std::endl;
+                return false;
+            }
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    if (config.log_path.empty()) {
+        std::cerr << "No session log given" << std::endl;
+        return false;
+    }
+    if (!config.info && !config.have_from && !config.have_to && config.last < 0) {
+        std::cerr << "Nothing to do: give --from/--to, --last or --info" << std::endl;
+        return false;
+    }
+    if (config.last >= 0 && (config.have_from || config.have_to)) {
+        std::cerr << "--last cannot be combined with --from/--to" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    QueryConfig config;
+    if (!parse_args(argc, argv, config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    LogFile file;
+    if (!file.open(config.log_path)) {
+        std::cerr << "Cannot open " << config.log_path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    MappedFile index;
+    SessionLog log;
+    log.file = &file;
+    log.data = file.data;
+    std::string index_path = uncompressed_log_path(config.log_path) + LOG_INDEX_SUFFIX;
+    if (index.open(index_path) && !load_index(index, file, log)) {
+        std::cerr << "Ignoring " << index_path << ": not a session index" << std::endl;
+    }
+    if (!log.entries && (!file.load(0, 4096) || !parse_header_time(file.data, file.length, log.start_us))) {
+        log.start_us = static_cast<int64_t>(file.modified) * 1000000;
+    }
+    log.body_end = find_body_end(file);
+    log.body_start = log.entry_count > 0 ? std::min(static_cast<size_t>(log.entry(0).offset), log.body_end)
+                                         : find_body_start(file, log.body_end);
+
+    if (config.info) {
+        print_info(log, config);
+    }
+    if (config.last >= 0) {
+        query_last_lines(log, static_cast<unsigned long long>(config.last));
+    } else if (config.have_from || config.have_to) {
+        int64_t from = INT64_MIN;
+        int64_t to = INT64_MAX;
+        if ((config.have_from && !parse_time_argument(config.from, log.start_us, from)) ||
+            (config.have_to && !parse_time_argument(config.to, log.start_us, to))) {
+            std::cerr << "Times must be HH:MM:SS[.uuuuuu] or \"YYYY-MM-DD HH:MM:SS[.uuuuuu]\"" << std::endl;
+            return 1;
+        }
+        query_time_range(log, from, config.have_to, to);
+    }
+    fflush(stdout);
+    return 0;
+}
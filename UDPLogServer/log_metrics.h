@@ -0,0 +1,215 @@
+/**
+ * Log Server Metrics
+ *
+ * HDR-style histograms for the server's stage latencies and batch sizes,
+ * and the Prometheus text format the metrics endpoint serves them in.
+ *
+ * A histogram has log-linear buckets: every power of two is split into
+ * HISTOGRAM_SUB_BUCKETS equal parts, so any recorded value is known to
+ * within 1/16 (about 6%) from a nanosecond up to HISTOGRAM_MAX_VALUE,
+ * in under 5 KB of counters. Each histogram has exactly one thread
+ * recording into it (a receiver, or the writer): record() is a relaxed
+ * load and store per counter with no read-modify-write, so it never
+ * contends. Any other thread may take a snapshot at any time; a snapshot
+ * taken mid-record() may miss that one value, never more.
+ */
+
+#ifndef LOG_METRICS_H
+#define LOG_METRICS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+constexpr unsigned int HISTOGRAM_SUB_BUCKET_BITS = 4;
+constexpr uint64_t HISTOGRAM_SUB_BUCKETS = 1u << HISTOGRAM_SUB_BUCKET_BITS;
+constexpr unsigned int HISTOGRAM_MAX_MAGNITUDE = 41;  // Highest power of two tracked
+constexpr uint64_t HISTOGRAM_MAX_VALUE = (2ull << HISTOGRAM_MAX_MAGNITUDE) - 1;  // About 73 minutes in ns
+constexpr size_t HISTOGRAM_BUCKETS =
+    HISTOGRAM_SUB_BUCKETS * (HISTOGRAM_MAX_MAGNITUDE - HISTOGRAM_SUB_BUCKET_BITS + 2);
+
+// Values below HISTOGRAM_SUB_BUCKETS get a bucket each; above that, bucket
+// m * 16 + s holds the 16ths of [2^(m+3), 2^(m+4))
+inline size_t histogram_bucket(uint64_t value) {
+    value = std::min(value, HISTOGRAM_MAX_VALUE);
+    if (value < HISTOGRAM_SUB_BUCKETS) return static_cast<size_t>(value);
+    unsigned int magnitude = 63 - static_cast<unsigned int>(__builtin_clzll(value));
+    unsigned int shift = magnitude - HISTOGRAM_SUB_BUCKET_BITS;
+    return static_cast<size_t>((shift + 1) * HISTOGRAM_SUB_BUCKETS + ((value >> shift) - HISTOGRAM_SUB_BUCKETS));
+}
+
+// Largest value that falls into bucket
+inline uint64_t histogram_bucket_max(size_t bucket) {
+    if (bucket < HISTOGRAM_SUB_BUCKETS) return bucket;
+    uint64_t shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t sub = bucket % HISTOGRAM_SUB_BUCKETS;
+    return ((HISTOGRAM_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+class HdrHistogram {
+public:
+    // Single recording thread only
+    void record(uint64_t value, uint64_t count = 1) {
+        std::atomic<uint64_t>& bucket = counts[histogram_bucket(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+        sum.store(sum.load(std::memory_order_relaxed) + value * count, std::memory_order_relaxed);
+    }
+
+private:
+    friend struct HistogramSnapshot;
+    std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> counts{};
+    std::atomic<uint64_t> sum{0};
+};
+
+// Plain copy of one or more histograms, merged
+struct HistogramSnapshot {
+    std::array<uint64_t, HISTOGRAM_BUCKETS> counts{};
+    uint64_t count{0};
+    uint64_t sum{0};
+
+    void add(const HdrHistogram& histogram) {
+        for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            uint64_t n = histogram.counts[b].load(std::memory_order_relaxed);
+            counts[b] += n;
+            count += n;
+        }
+        sum += histogram.sum.load(std::memory_order_relaxed);
+    }
+
+    // What was recorded after earlier was taken
+    HistogramSnapshot since(const HistogramSnapshot& earlier) const {
+        HistogramSnapshot delta;
+        for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            delta.counts[b] = counts[b] - earlier.counts[b];
+        }
+        delta.count = count - earlier.count;
+        delta.sum = sum - earlier.sum;
+        return delta;
+    }
+
+    // Upper bound of the value at fraction (0-1) of the recorded values
+    uint64_t percentile(double fraction) const {
+        if (count == 0) return 0;
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * count + 0.5));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            seen += counts[b];
+            if (seen >= rank) return histogram_bucket_max(b);
+        }
+        return HISTOGRAM_MAX_VALUE;
+    }
+
+    uint64_t max() const {
+        for (size_t b = HISTOGRAM_BUCKETS; b > 0; b--) {
+            if (counts[b - 1] > 0) return histogram_bucket_max(b - 1);
+        }
+        return 0;
+    }
+};
+
+// Prometheus "le" bounds for latencies, in seconds
+constexpr double LATENCY_BOUNDS[] = {
+    0.000001, 0.0000025, 0.000005, 0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005,
+    0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+
+// Prometheus "le" bounds for batch sizes
+constexpr double BATCH_SIZE_BOUNDS[] = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 4096, 16384, 65536};
+
+/**
+ * Appends a histogram in the Prometheus text format. Values are divided
+ * by scale (1e9 for nanoseconds to seconds). A bucket counts toward the
+ * first bound its largest value fits under, so with bounds that do not
+ * line up with the log-linear buckets a value can land one bound high.
+ * labels is empty or like "stage=\"write\"".
+ */
+template <size_t N>
+inline void append_prometheus_histogram(std::string& out, const char* name, const std::string& labels,
+                                        const HistogramSnapshot& snapshot, const double (&bounds)[N], double scale) {
+    char line[256];
+    const char* separator = labels.empty() ? "" : ",";
+    uint64_t cumulative = 0;
+    size_t bucket = 0;
+    for (double bound : bounds) {
+        while (bucket < HISTOGRAM_BUCKETS && histogram_bucket_max(bucket) / scale <= bound) {
+            cumulative += snapshot.counts[bucket++];
+        }
+        snprintf(line, sizeof(line), "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels.c_str(), separator, bound,
+                 static_cast<unsigned long long>(cumulative));
+        out += line;
+    }
+    snprintf(line, sizeof(line), "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels.c_str(), separator,
+             static_cast<unsigned long long>(snapshot.count));
+    out += line;
+    const char* braces_open = labels.empty() ? "" : "{";
+    const char* braces_close = labels.empty() ? "" : "}";
+    snprintf(line, sizeof(line), "%s_sum%s%s%s %.9g\n", name, braces_open, labels.c_str(), braces_close,
+             snapshot.sum / scale);
+    out += line;
+    snprintf(line, sizeof(line), "%s_count%s%s%s %llu\n", name, braces_open, labels.c_str(), braces_close,
+             static_cast<unsigned long long>(snapshot.count));
+    out += line;
+}
+
+// "# HELP" and "# TYPE" lines for a metric family
+inline void append_prometheus_header(std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+// name="value" with the label value escaped
+inline std::string prometheus_label(const char* name, const std::string& value) {
+    std::string label = name;
+    label += "=\"";
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            label += '\\';
+            label += c;
+        } else if (c == '\n') {
+            label += "\\n";
+        } else {
+            label += c;
+        }
+    }
+    label += '"';
+    return label;
+}
+
+// One sample: name{labels} value
+inline void append_prometheus_value(std::string& out, const char* name, const std::string& labels, double value) {
+    char line[256];
+    if (labels.empty()) {
+        snprintf(line, sizeof(line), "%s %.17g\n", name, value);
+    } else {
+        snprintf(line, sizeof(line), "%s{%s} %.17g\n", name, labels.c_str(), value);
+    }
+    out += line;
+}
+
+// "850ns", "12us", "3.4ms", "1.2s": durations for summary lines
+inline std::string format_duration_ns(uint64_t ns) {
+    char text[32];
+    if (ns < 1000) {
+        snprintf(text, sizeof(text), "%lluns", static_cast<unsigned long long>(ns));
+    } else if (ns < 1000000) {
+        snprintf(text, sizeof(text), "%.0fus", ns / 1e3);
+    } else if (ns < 1000000000) {
+        snprintf(text, sizeof(text), "%.1fms", ns / 1e6);
+    } else {
+        snprintf(text, sizeof(text), "%.1fs", ns / 1e9);
+    }
+    return text;
+}
+
+#endif // LOG_METRICS_H
@@ -0,0 +1,253 @@
+/**
+ * UDP Log Wire Protocol
+ *
+ * The server accepts two datagram formats on the same port:
+ *
+ *   Plain   "SOURCE|MESSAGE" UTF-8 text, as sent by the original clients.
+ *
+ *   Framed  A 12-byte header followed by a type-specific payload:
+ *
+ *             offset  size  field
+ *             0       1     magic 0xFE (never valid in UTF-8 text)
+ *             1       1     magic 'L'
+ *             2       1     version (FRAME_VERSION)
+ *             3       1     frame type (FrameType)
+ *             4       4     sender ID, network byte order
+ *             8       4     sequence number, network byte order
+ *
+ *           The sender ID is chosen randomly by each client instance and
+ *           the sequence number increases by one for every datagram it
+ *           sends, which lets the server detect loss, duplication and
+ *           reordering per sender.
+ *
+ * Frame types:
+ *   Line      payload is one plain "SOURCE|MESSAGE" record
+ *
+ *   Fragment  one slice of a record too large for a single datagram. The
+ *             payload starts with an 8-byte fragment header:
+ *
+ *               offset  size  field
+ *               12      4     message ID, network byte order (per sender)
+ *               16      2     fragment index, network byte order
+ *               18      2     fragment count, network byte order
+ *
+ *             followed by the slice. The server concatenates the slices in
+ *             index order once all count fragments have arrived; each
+ *             fragment still takes its own datagram sequence number.
+ *
+ *   Batch     several records coalesced into one datagram. The payload
+ *             starts with the client's send time:
+ *
+ *               offset  size  field
+ *               12      8     send time, microseconds since the Unix
+ *                             epoch (client clock), network byte order
+ *
+ *             followed by one entry per record until the end of the
+ *             datagram:
+ *
+ *               size  field
+ *               4     age: microseconds from logging the record to
+ *                     sending the batch, network byte order
+ *               2     record length, network byte order
+ *               N     plain "SOURCE|MESSAGE" record
+ *
+ *             The whole batch takes one sequence number.
+ */
+
+#ifndef LOG_PROTOCOL_H
+#define LOG_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+constexpr uint8_t FRAME_MAGIC_0 = 0xFE;
+constexpr uint8_t FRAME_MAGIC_1 = 'L';
+constexpr uint8_t FRAME_VERSION = 1;
+constexpr size_t FRAME_HEADER_SIZE = 12;
+constexpr size_t FRAGMENT_HEADER_SIZE = 8;
+constexpr uint16_t MAX_FRAGMENTS = 1024;
+constexpr size_t BATCH_HEADER_SIZE = 8;
+constexpr size_t BATCH_ENTRY_HEADER_SIZE = 6;
+
+// Largest datagram clients should send; the server receives up to 4095 bytes
+constexpr size_t MAX_DATAGRAM_SIZE = 4000;
+constexpr size_t MAX_FRAGMENT_PAYLOAD = MAX_DATAGRAM_SIZE - FRAME_HEADER_SIZE - FRAGMENT_HEADER_SIZE;
+
+enum class FrameType : uint8_t {
+    Line = 1,
+    Fragment = 2,
+    Batch = 3
+};
+
+struct FrameHeader {
+    FrameType type;
+    uint32_t sender_id;
+    uint32_t sequence;
+};
+
+struct BatchRecord {
+    uint32_t age_us;
+    uint16_t length;
+    const char* data;
+};
+
+struct FragmentHeader {
+    uint32_t message_id;
+    uint16_t index;
+    uint16_t count;
+};
+
+inline uint32_t read_u32(const char* p) {
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    return (static_cast<uint32_t>(b[0]) << 24) | (static_cast<uint32_t>(b[1]) << 16) |
+           (static_cast<uint32_t>(b[2]) << 8) | static_cast<uint32_t>(b[3]);
+}
+
+inline uint16_t read_u16(const char* p) {
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint16_t>((b[0] << 8) | b[1]);
+}
+
+inline void write_u16(char* p, uint16_t value) {
+    p[0] = static_cast<char>(value >> 8);
+    p[1] = static_cast<char>(value);
+}
+
+inline uint64_t read_u64(const char* p) {
+    return (static_cast<uint64_t>(read_u32(p)) << 32) | read_u32(p + 4);
+}
+
+inline void write_u32(char* p, uint32_t value) {
+    p[0] = static_cast<char>(value >> 24);
+    p[1] = static_cast<char>(value >> 16);
+    p[2] = static_cast<char>(value >> 8);
+    p[3] = static_cast<char>(value);
+}
+
+inline void write_u64(char* p, uint64_t value) {
+    write_u32(p, static_cast<uint32_t>(value >> 32));
+    write_u32(p + 4, static_cast<uint32_t>(value));
+}
+
+// True if the datagram carries the framed-protocol magic
+inline bool is_framed(const char* data, size_t length) {
+    return length >= 2 &&
+           static_cast<uint8_t>(data[0]) == FRAME_MAGIC_0 &&
+           static_cast<uint8_t>(data[1]) == FRAME_MAGIC_1;
+}
+
+// Parses the common header; false for truncated or unsupported frames
+inline bool parse_frame_header(const char* data, size_t length, FrameHeader& header) {
+    if (length < FRAME_HEADER_SIZE || !is_framed(data, length)) {
+        return false;
+    }
+    if (static_cast<uint8_t>(data[2]) != FRAME_VERSION) {
+        return false;
+    }
+    header.type = static_cast<FrameType>(data[3]);
+    header.sender_id = read_u32(data + 4);
+    header.sequence = read_u32(data + 8);
+    return header.type == FrameType::Line || header.type == FrameType::Fragment ||
+           header.type == FrameType::Batch;
+}
+
+// Parses the fragment header that follows the common header of a Fragment
+// frame; false if truncated or the index/count are out of range
+inline bool parse_fragment_header(const char* data, size_t length, FragmentHeader& fragment) {
+    if (length < FRAME_HEADER_SIZE + FRAGMENT_HEADER_SIZE) {
+        return false;
+    }
+    const char* p = data + FRAME_HEADER_SIZE;
+    fragment.message_id = read_u32(p);
+    fragment.index = read_u16(p + 4);
+    fragment.count = read_u16(p + 6);
+    return fragment.count >= 1 && fragment.count <= MAX_FRAGMENTS && fragment.index < fragment.count;
+}
+
+// Writes the common header into out (FRAME_HEADER_SIZE bytes)
+inline size_t write_frame_header(char* out, FrameType type, uint32_t sender_id, uint32_t sequence) {
+    out[0] = static_cast<char>(FRAME_MAGIC_0);
+    out[1] = static_cast<char>(FRAME_MAGIC_1);
+    out[2] = static_cast<char>(FRAME_VERSION);
+    out[3] = static_cast<char>(type);
+    write_u32(out + 4, sender_id);
+    write_u32(out + 8, sequence);
+    return FRAME_HEADER_SIZE;
+}
+
+/**
+ * Walks the records of a Batch frame in place:
+ *
+ *   BatchReader reader(data, length);
+ *   BatchRecord record;
+ *   while (reader.next(record)) { ... }
+ *   if (reader.truncated()) { ... }
+ */
+class BatchReader {
+public:
+    BatchReader(const char* data, size_t length) : data(data), length(length) {
+        if (length >= FRAME_HEADER_SIZE + BATCH_HEADER_SIZE) {
+            send_time = read_u64(data + FRAME_HEADER_SIZE);
+            offset = FRAME_HEADER_SIZE + BATCH_HEADER_SIZE;
+        } else {
+            offset = length;
+            bad = true;
+        }
+    }
+    
+    bool next(BatchRecord& record) {
+        if (offset == length) return false;
+        if (length - offset < BATCH_ENTRY_HEADER_SIZE) {
+            bad = true;
+            return false;
+        }
+        record.age_us = read_u32(data + offset);
+        record.length = read_u16(data + offset + 4);
+        offset += BATCH_ENTRY_HEADER_SIZE;
+        if (length - offset < record.length) {
+            bad = true;
+            return false;
+        }
+        record.data = data + offset;
+        offset += record.length;
+        return true;
+    }
+    
+    // Client send time, microseconds since the Unix epoch
+    uint64_t send_time_us() const { return send_time; }
+    
+    // True if the batch header or an entry ran past the end of the datagram
+    bool truncated() const { return bad; }
+    
+private:
+    const char* data;
+    size_t length;
+    size_t offset{0};
+    uint64_t send_time{0};
+    bool bad{false};
+};
+
+// Writes the batch header after the common header (BATCH_HEADER_SIZE bytes)
+inline size_t write_batch_header(char* out, uint64_t send_time_us) {
+    write_u64(out, send_time_us);
+    return BATCH_HEADER_SIZE;
+}
+
+// Appends one batch entry; the caller checks it fits (BATCH_ENTRY_HEADER_SIZE + length)
+inline size_t write_batch_entry(char* out, uint32_t age_us, const char* record, uint16_t length) {
+    write_u32(out, age_us);
+    write_u16(out + 4, length);
+    memcpy(out + BATCH_ENTRY_HEADER_SIZE, record, length);
+    return BATCH_ENTRY_HEADER_SIZE + length;
+}
+
+// Writes the fragment header after the common header (FRAGMENT_HEADER_SIZE bytes)
+inline size_t write_fragment_header(char* out, uint32_t message_id, uint16_t index, uint16_t count) {
+    write_u32(out, message_id);
+    write_u16(out + 4, index);
+    write_u16(out + 6, count);
+    return FRAGMENT_HEADER_SIZE;
+}
+
+#endif // LOG_PROTOCOL_H
@@ -0,0 +1,433 @@
+/**
+ * Session Log Search
+ *
+ * Finds lines in udp_log_server session logs, using the term index the
+ * server writes next to each log (log_terms.h) to avoid reading what cannot
+ * match. A search gives one or more terms, and a line must contain all of
+ * them:
+ *
+ *   source:NAME   the [SOURCE] column is NAME
+ *   ip:ADDRESS    the [client_ip] column is ADDRESS
+ *   [TAG]         the message contains "[TAG]"
+ *   TEXT          the message contains TEXT, starting and ending on token
+ *                 boundaries (see log_terms.h for what a token is)
+ *
+ * For every log, the posting lists of an ended session rule out the whole
+ * file, or all but a few blocks, for source:, ip: and [TAG] terms. The
+ * per-block Bloom filters then drop blocks that lack any term's tokens, and
+ * only the remaining blocks are read (memory-mapped) and checked line by
+ * line. Logs without a term index are scanned in full, as are the lines of
+ * a live session that follow its last finished block.
+ *
+ * Usage:
+ *   log_search [--dir DIR]... [--file LOG]... [--count] [--stats] TERM...
+ *
+ * With neither --dir nor --file, the session logs in the current directory
+ * are searched. Matches print as "LOG:LINE:text". A compressed log
+ * (FILE.ulz, log_compress.h) uses FILE's term index, and only the blocks
+ * holding the ranges to read are decompressed.
+ */
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log_compress.h"
+#include "log_terms.h"
+#include "log_tools.h"
+
+struct SearchTerm {
+    TermKind kind;
+    std::string text;
+    std::string pattern;              // Tag and Word terms: what the message must contain
+    std::vector<uint64_t> hashes;     // Bloom filter keys; all must be present in a block
+    std::vector<std::string> tokens;  // Word terms only
+    bool indexed{true};               // False if the server would not have recorded it
+};
+
+struct SearchConfig {
+    std::vector<std::string> dirs;
+    std::vector<std::string> files;
+    std::vector<SearchTerm> terms;
+    bool count_only = false;
+    bool stats = false;
+};
+
+struct SearchStats {
+    uint64_t files{0};
+    uint64_t files_indexed{0};
+    uint64_t files_ruled_out{0};  // By posting lists alone
+    uint64_t blocks{0};
+    uint64_t blocks_read{0};
+    uint64_t bytes{0};
+    uint64_t bytes_read{0};
+    uint64_t matches{0};
+};
+
+struct TermBlock {
+    uint64_t start;
+    uint64_t end;
+    uint64_t first_line;
+    uint32_t lines;
+    const uint8_t* bloom;
+    uint64_t bloom_mask;
+    unsigned int hashes;
+};
+
+static SearchTerm parse_term(const std::string& arg) {
+    SearchTerm term;
+    if (arg.compare(0, 7, "source:") == 0) {
+        term.kind = TermKind::Source;
+        term.text = arg.substr(7);
+    } else if (arg.compare(0, 3, "ip:") == 0) {
+        term.kind = TermKind::Ip;
+        term.text = arg.substr(3);
+    } else if (arg.size() > 2 && arg.front() == '[' && arg.back() == ']') {
+        term.kind = TermKind::Tag;
+        term.text = arg.substr(1, arg.size() - 2);
+        term.pattern = arg;
+        term.indexed = std::all_of(term.text.begin(), term.text.end(), is_token_char);
+    } else {
+        term.kind = TermKind::Word;
+        term.text = arg;
+        term.pattern = arg;
+        for_each_token(term.text, [&term](const char* token, size_t length) {
+            term.tokens.emplace_back(token, length);
+            term.hashes.push_back(term_hash(TermKind::Word, token, length));
+        });
+        return term;
+    }
+    term.indexed = term.indexed && term.text.size() <= MAX_TERM_LENGTH;
+    if (term.indexed) {
+        term.hashes.push_back(term_hash(term.kind, term.text.data(), term.text.size()));
+    }
+    return term;
+}
+
+static bool has_token(std::string_view message, const std::string& wanted) {
+    bool found = false;
+    for_each_token(message, [&](const char* token, size_t length) {
+        if (!found && length == wanted.size() && memcmp(token, wanted.data(), length) == 0) found = true;
+    });
+    return found;
+}
+
+static bool line_matches(const char* text, size_t length, const std::vector<SearchTerm>& terms) {
+    LogLineColumns line = split_log_line(text, length);
+    for (const auto& term : terms) {
+        switch (term.kind) {
+            case TermKind::Source:
+                if (!line.columns || line.source != term.text) return false;
+                break;
+            case TermKind::Ip:
+                if (!line.columns || line.ip != term.text) return false;
+                break;
+            case TermKind::Tag:
+                if (line.message.find(term.pattern) == std::string_view::npos) return false;
+                break;
+            case TermKind::Word:
+                // Whole tokens only, as the Bloom filters hold nothing smaller
+                if (line.message.find(term.pattern) == std::string_view::npos) return false;
+                for (const auto& token : term.tokens) {
+                    if (!has_token(line.message, token)) return false;
+                }
+                break;
+        }
+    }
+    return true;
+}
+
+// Checks the lines in [start, end), numbered from first_line
+static void scan_range(const std::string& path, const LogFile& log, uint64_t start, uint64_t end,
+                       uint64_t first_line, const SearchConfig& config, SearchStats& stats) {
+    end = std::min<uint64_t>(end, log.length);
+    if (start >= end) return;
+    stats.bytes_read += end - start;
+    log.load(start, end);
+
+    uint64_t line = first_line;
+    for (uint64_t offset = start; offset < end; line++) {
+        const void* newline = memchr(log.data + offset, '\n', end - offset);
+        uint64_t next = newline ? static_cast<const char*>(newline) - log.data : end;
+        if (line_matches(log.data + offset, next - offset, config.terms)) {
+            stats.matches++;
+            if (!config.count_only) {
+                printf("%s:%llu:", path.c_str(), static_cast<unsigned long long>(line));
+                fwrite(log.data + offset, 1, next - offset, stdout);
+                fputc('\n', stdout);
+            }
+        }
+        offset = next + 1;
+    }
+    log.release(start, end);
+}
+
+// Parses the term index; false if it is missing or not a term index.
+// postings receives the lists of the queried posted terms, and is left
+// empty (with have_postings false) for a live session.
+static bool load_terms(const MappedFile& index, std::vector<TermBlock>& blocks,
+                       const std::vector<SearchTerm>& terms, std::map<std::string, std::vector<uint32_t>>& postings,
+                       bool& have_postings, bool& postings_truncated) {
+    if (index.length < LOG_TERMS_HEADER_SIZE || memcmp(index.data, LOG_TERMS_MAGIC, sizeof(LOG_TERMS_MAGIC)) != 0 ||
+        static_cast<uint8_t>(index.data[6]) != LOG_TERMS_VERSION) {
+        return false;
+    }
+
+    const char* p = index.data + LOG_TERMS_HEADER_SIZE;
+    const char* end = index.data + index.length;
+    while (p < end) {
+        if (*p == 'B' && end - p >= static_cast<ptrdiff_t>(LOG_TERMS_BLOCK_HEADER_SIZE)) {
+            uint32_t bloom_bytes = read_u32(p + 4);
+            if (static_cast<size_t>(end - p) < LOG_TERMS_BLOCK_HEADER_SIZE + bloom_bytes ||
+                bloom_bytes == 0 || (bloom_bytes & (bloom_bytes - 1)) != 0) {
+                break;  // Record still being written
+            }
+            TermBlock block;
+            block.hashes = static_cast<uint8_t>(p[1]);
+            block.start = read_u64(p + 8);
+            block.end = read_u64(p + 16);
+            block.first_line = read_u64(p + 24);
+            block.lines = read_u32(p + 32);
+            block.bloom = reinterpret_cast<const uint8_t*>(p + LOG_TERMS_BLOCK_HEADER_SIZE);
+            block.bloom_mask = static_cast<uint64_t>(bloom_bytes) * 8 - 1;
+            blocks.push_back(block);
+            p += LOG_TERMS_BLOCK_HEADER_SIZE + bloom_bytes;
+        } else if (*p == 'P' && end - p >= static_cast<ptrdiff_t>(LOG_TERMS_POSTINGS_HEADER_SIZE)) {
+            uint64_t bytes = read_u64(p + 8);
+            if (static_cast<uint64_t>(end - p) < LOG_TERMS_POSTINGS_HEADER_SIZE + bytes) break;
+            postings_truncated = p[1] & LOG_TERMS_POSTINGS_TRUNCATED;
+            uint32_t count = read_u32(p + 4);
+            const char* entry = p + LOG_TERMS_POSTINGS_HEADER_SIZE;
+            const char* entries_end = entry + bytes;
+            for (uint32_t i = 0; i < count && entries_end - entry >= 6; i++) {
+                uint8_t length = static_cast<uint8_t>(entry[1]);
+                if (entries_end - entry < 6 + length) break;
+                std::string key(entry, 1);
+                key.append(entry + 2, length);
+                uint32_t block_count = read_u32(entry + 2 + length);
+                entry += 6 + length;
+
+                bool wanted = false;
+                for (const auto& term : terms) {
+                    if (term.kind != TermKind::Word && key[0] == static_cast<char>(term.kind) &&
+                        key.compare(1, std::string::npos, term.text) == 0) {
+                        wanted = true;
+                    }
+                }
+                std::vector<uint32_t> list;
+                uint32_t block_number = 0;
+                for (uint32_t b = 0; b < block_count; b++) {
+                    uint32_t delta;
+                    if (!read_varint(entry, entries_end, delta)) break;
+                    block_number += delta;
+                    if (wanted) list.push_back(block_number);
+                }
+                if (wanted) postings[key] = std::move(list);
+            }
+            have_postings = true;
+            p += LOG_TERMS_POSTINGS_HEADER_SIZE + bytes;
+        } else {
+            break;
+        }
+    }
+    return true;
+}
+
+static void search_log(const std::string& path, const SearchConfig& config, SearchStats& stats) {
+    LogFile log;
+    if (!log.open(path)) {
+        std::cerr << "Cannot open " << path << ": " << strerror(errno) << std::endl;
+        return;
+    }
+    stats.files++;
+    stats.bytes += log.length;
+
+    MappedFile index;
+    std::vector<TermBlock> blocks;
+    std::map<std::string, std::vector<uint32_t>> postings;
+    bool have_postings = false;
+    bool postings_truncated = false;
+    if (!index.open(uncompressed_log_path(path) + LOG_TERMS_SUFFIX) ||
+        !load_terms(index, blocks, config.terms, postings, have_postings, postings_truncated)) {
+        scan_range(path, log, 0, log.length, 1, config, stats);
+        return;
+    }
+    stats.files_indexed++;
+    stats.blocks += blocks.size();
+
+    // Posting lists: a posted term missing from them rules out the session
+    std::vector<bool> candidate(blocks.size(), true);
+    if (have_postings) {
+        for (const auto& term : config.terms) {
+            if (term.kind == TermKind::Word || !term.indexed) continue;
+            std::string key(1, static_cast<char>(term.kind));
+            key += term.text;
+            auto posting = postings.find(key);
+            if (posting == postings.end()) {
+                if (postings_truncated) continue;
+                stats.files_ruled_out++;
+                return;
+            }
+            std::vector<bool> listed(blocks.size(), false);
+            for (uint32_t block : posting->second) {
+                if (block < listed.size()) listed[block] = true;
+            }
+            for (size_t b = 0; b < blocks.size(); b++) {
+                candidate[b] = candidate[b] && listed[b];
+            }
+        }
+    }
+
+    // Bloom filters, then read each run of surviving blocks in one pass
+    for (size_t b = 0; b < blocks.size(); b++) {
+        if (!candidate[b]) continue;
+        const TermBlock& block = blocks[b];
+        for (const auto& term : config.terms) {
+            for (uint64_t hash : term.hashes) {
+                if (!bloom_test(block.bloom, block.bloom_mask, hash, block.hashes)) {
+                    candidate[b] = false;
+                }
+            }
+        }
+    }
+    for (size_t b = 0; b < blocks.size(); ) {
+        if (!candidate[b]) {
+            b++;
+            continue;
+        }
+        size_t run_end = b;
+        while (run_end + 1 < blocks.size() && candidate[run_end + 1] &&
+               blocks[run_end + 1].start == blocks[run_end].end) {
+            run_end++;
+        }
+        stats.blocks_read += run_end - b + 1;
+        scan_range(path, log, blocks[b].start, blocks[run_end].end, blocks[b].first_line, config, stats);
+        b = run_end + 1;
+    }
+
+    // A live session's newest lines are not in a finished block yet
+    if (!have_postings) {
+        uint64_t tail = blocks.empty() ? 0 : blocks.back().end;
+        uint64_t tail_line = blocks.empty() ? 1 : blocks.back().first_line + blocks.back().lines;
+        scan_range(path, log, tail, log.length, tail_line, config, stats);
+    }
+}
+
+static void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options] TERM..." << std::endl;
+    std::cout << "  --dir DIR        Search the session_*.log[.ulz] files in DIR (default: current directory)" << std::endl;
+    std::cout << "  --file LOG       Search one log file" << std::endl;
+    std::cout << "  --count          Print only the number of matching lines" << std::endl;
+    std::cout << "  --stats          Report files and blocks skipped, bytes read and time taken" << std::endl;
+    std::cout << "Terms (all must match): source:NAME, ip:ADDRESS, [TAG], or TEXT" << std::endl;
+}
+
+static bool parse_args(int argc, char* argv[], SearchConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            exit(0);
+        }
+        if (arg == "--count") {
+            config.count_only = true;
+            continue;
+        }
+        if (arg == "--stats") {
+            config.stats = true;
+            continue;
+        }
+        if (arg == "--dir" || arg == "--file") {
+            if (i + 1 >= argc) {
+                std::cerr << "Incomplete option: " << arg << std::endl;
+                return false;
+            }
+            (arg == "--dir" ? config.dirs : config.files).push_back(argv[++i]);
+            continue;
+        }
+        if (arg.compare(0, 2, "--") == 0) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+
+        SearchTerm term = parse_term(arg);
+        if (term.text.empty()) {
+            std::cerr << "Empty search term: " << arg << std::endl;
+            return false;
+        }
+        config.terms.push_back(std::move(term));
+    }
+    if (config.terms.empty()) {
+        std::cerr << "No search terms given" << std::endl;
+        return false;
+    }
+    if (config.dirs.empty() && config.files.empty()) {
+        config.dirs.push_back(".");
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    SearchConfig config;
+    if (!parse_args(argc, argv, config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> logs = config.files;
+    for (const auto& dir : config.dirs) {
+        std::vector<std::string> found;
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(dir, error)) {
+            std::string name = entry.path().filename().string();
+            if (is_session_log_name(name)) {
+                found.push_back(entry.path().string());
+            }
+        }
+        if (error) {
+            std::cerr << "Cannot list " << dir << ": " << error.message() << std::endl;
+        }
+        drop_compressed_duplicates(found);
+        std::sort(found.begin(), found.end());
+        logs.insert(logs.end(), found.begin(), found.end());
+    }
+
+    SearchStats stats;
+    for (const auto& log : logs) {
+        search_log(log, config, stats);
+    }
+    if (config.count_only) {
+        printf("%llu\n", static_cast<unsigned long long>(stats.matches));
+    }
+    fflush(stdout);
+
+    if (config.stats) {
+        double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        fprintf(stderr, "%llu logs (%llu indexed, %llu ruled out by postings), %llu of %llu blocks read, "
+                "%llu of %llu bytes read, %llu matches, %.2f ms\n",
+                static_cast<unsigned long long>(stats.files),
+                static_cast<unsigned long long>(stats.files_indexed),
+                static_cast<unsigned long long>(stats.files_ruled_out),
+                static_cast<unsigned long long>(stats.blocks_read),
+                static_cast<unsigned long long>(stats.blocks),
+                static_cast<unsigned long long>(stats.bytes_read),
+                static_cast<unsigned long long>(stats.bytes),
+                static_cast<unsigned long long>(stats.matches), elapsed_ms);
+    }
+    return 0;
+}
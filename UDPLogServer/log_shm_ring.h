@@ -0,0 +1,269 @@
+/**
+ * Shared-Memory Log Ring
+ *
+ * Lets producers on the same machine as udp_log_server hand it datagrams
+ * without going through a socket. The server creates a POSIX shared-memory
+ * object (--shm NAME); producers map it and copy each datagram into a
+ * fixed-size slot. A slot carries exactly what would otherwise be one UDP
+ * datagram (plain "SOURCE|MESSAGE" text or any frame from log_protocol.h),
+ * and the server handles it the same way.
+ *
+ * Layout: a ShmRingHeader followed by capacity ShmSlots. The ring works like
+ * the server's internal queue: a producer claims a slot with a CAS on tail,
+ * fills it and publishes it by advancing the slot's sequence; the server
+ * consumes slots in claim order. When the ring is full the new datagram is
+ * dropped and counted in the header, like a full socket buffer.
+ *
+ * Wakeups: the server parks on a futex (consumer_parked) once the ring has
+ * been empty for a while, and a producer only makes a syscall when it finds
+ * the server parked. A busy ring costs producers no syscalls; a burst after
+ * an idle period costs one. Without a shared futex (non-Linux) the parked
+ * server polls every SHM_POLL_INTERVAL_MS instead.
+ *
+ * A producer that dies between claiming and publishing a slot would stall
+ * the ring, so the server abandons a slot left unpublished for
+ * SHM_STALL_TIMEOUT_MS. A producer that was only slow must not then copy
+ * into the slot under whoever claims it next, so each slot counts the
+ * producers inside it: a producer registers, and copies only if the slot
+ * still carries its claim and nobody else is registered. A stale producer
+ * that registers late sees the new claim and backs out; one still copying
+ * makes the next claimant publish an empty slot, which the server skips.
+ * The server reads a published slot only once nobody is registered in it,
+ * and skips it (forgetting the registrations) if that takes longer than
+ * SHM_STALL_TIMEOUT_MS. A slow producer's datagram may be dropped this
+ * way, but the server never reads a slot while it is being written.
+ *
+ * One server owns a ring name at a time: the header records its pid, and a
+ * server that finds the name held by a live process refuses to start
+ * instead of taking the ring over. A ring left behind by a dead server (or
+ * an older layout) is replaced.
+ *
+ * Producer usage:
+ *
+ *   ShmLogProducer log;
+ *   if (log.open("/udp_log")) {
+ *       log.log("TEST", "hello");   // "TEST|hello"
+ *   }
+ */
+
+#ifndef LOG_SHM_RING_H
+#define LOG_SHM_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <chrono>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "log_protocol.h"
+
+constexpr uint32_t SHM_RING_MAGIC = 0x4c4f4752;  // "LOGR"
+constexpr uint32_t SHM_RING_VERSION = 2;
+constexpr size_t SHM_SLOT_DATA_SIZE = MAX_DATAGRAM_SIZE;
+constexpr int SHM_POLL_INTERVAL_MS = 1;
+constexpr int SHM_STALL_TIMEOUT_MS = 1000;
+
+// Atomics in the mapping are shared between processes
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared ring needs lock-free 64-bit atomics");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared ring needs lock-free 32-bit atomics");
+
+struct alignas(64) ShmSlot {
+    std::atomic<uint64_t> sequence;
+    uint32_t length;
+    std::atomic<uint32_t> writers;  // Producers between registering and publishing
+    char data[SHM_SLOT_DATA_SIZE];
+};
+
+// magic is stored last by the server, so producers never see a half-built ring
+struct ShmRingHeader {
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t capacity;  // Power of two
+    int32_t owner_pid;  // Server that created the ring
+
+    alignas(64) std::atomic<uint64_t> tail;  // Next slot to claim (producers)
+    alignas(64) std::atomic<uint64_t> head;  // Next slot to consume (server)
+
+    // Producer-side counters and the server's park flag (futex word)
+    alignas(64) std::atomic<uint32_t> consumer_parked;
+    std::atomic<uint64_t> dropped;  // Datagrams that found the ring full or their slot abandoned
+    std::atomic<uint64_t> wakeups;  // Wake syscalls made by producers
+};
+
+inline size_t shm_ring_size(uint32_t capacity) {
+    return sizeof(ShmRingHeader) + static_cast<size_t>(capacity) * sizeof(ShmSlot);
+}
+
+inline ShmSlot* shm_ring_slots(ShmRingHeader* header) {
+    return reinterpret_cast<ShmSlot*>(reinterpret_cast<char*>(header) + sizeof(ShmRingHeader));
+}
+
+// Server: sleep until a producer clears consumer_parked or timeout_ms passes
+inline void shm_ring_wait(ShmRingHeader* header, int timeout_ms) {
+#if defined(__linux__)
+    struct timespec timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header->consumer_parked), FUTEX_WAIT, 1, &timeout,
+            nullptr, 0);
+#else
+    (void)header;
+    std::this_thread::sleep_for(std::chrono::milliseconds(std::min(timeout_ms, SHM_POLL_INTERVAL_MS)));
+#endif
+}
+
+// Producer: wake the server if it is parked. The fence pairs with the one
+// the server issues after setting consumer_parked: either the server sees
+// the published slot, or this thread sees the flag.
+inline void shm_ring_notify(ShmRingHeader* header) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (header->consumer_parked.load(std::memory_order_relaxed) != 0 &&
+        header->consumer_parked.exchange(0, std::memory_order_acq_rel) != 0) {
+#if defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header->consumer_parked), FUTEX_WAKE, 1, nullptr,
+                nullptr, 0);
+#endif
+        header->wakeups.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Producer side of the ring: maps a ring the server has created and writes
+ * datagrams into it. Safe to share between threads of one process.
+ */
+class ShmLogProducer {
+public:
+    ShmLogProducer() = default;
+    ~ShmLogProducer() { close(); }
+    ShmLogProducer(const ShmLogProducer&) = delete;
+    ShmLogProducer& operator=(const ShmLogProducer&) = delete;
+
+    // Maps the ring created by "udp_log_server --shm name"; false if it does
+    // not exist (yet) or was built with a different layout
+    bool open(const char* name) {
+        close();
+        int fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0) return false;
+
+        struct stat info;
+        if (fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < sizeof(ShmRingHeader)) {
+            ::close(fd);
+            return false;
+        }
+        void* mapping = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) return false;
+
+        auto* ring = static_cast<ShmRingHeader*>(mapping);
+        if (ring->magic.load(std::memory_order_acquire) != SHM_RING_MAGIC ||
+            ring->version != SHM_RING_VERSION || ring->slot_size != sizeof(ShmSlot) ||
+            shm_ring_size(ring->capacity) > static_cast<size_t>(info.st_size)) {
+            munmap(mapping, info.st_size);
+            return false;
+        }
+        header = ring;
+        slots = shm_ring_slots(ring);
+        mask = ring->capacity - 1;
+        mapped_size = info.st_size;
+        return true;
+    }
+
+    void close() {
+        if (header) {
+            munmap(header, mapped_size);
+            header = nullptr;
+            slots = nullptr;
+        }
+    }
+
+    bool is_open() const { return header != nullptr; }
+
+    // Copies one datagram into the ring; false if it is too large, the ring
+    // is full, or the server gave up on the slot
+    bool write(const char* datagram, size_t length) {
+        if (!header || length > SHM_SLOT_DATA_SIZE) return false;
+
+        uint64_t pos = header->tail.load(std::memory_order_relaxed);
+        ShmSlot* slot;
+        while (true) {
+            slot = &slots[pos & mask];
+            uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+            int64_t diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+            if (diff == 0) {
+                if (header->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                header->dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = header->tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        // Register before checking the claim: pairs with the server's
+        // abandoning CAS, so either this thread sees the slot abandoned or
+        // the next claimant sees it registered
+        uint32_t others = slot->writers.fetch_add(1, std::memory_order_seq_cst);
+        if (slot->sequence.load(std::memory_order_seq_cst) != pos) {
+            leave(slot);
+            header->dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        
+        // A stale producer still copying: publish the slot empty
+        bool copied = others == 0;
+        if (copied) {
+            memcpy(slot->data, datagram, length);
+        }
+        slot->length = copied ? static_cast<uint32_t>(length) : 0;
+        leave(slot);
+        
+        uint64_t expected = pos;
+        if (!slot->sequence.compare_exchange_strong(expected, pos + 1, std::memory_order_release,
+                                                    std::memory_order_relaxed) || !copied) {
+            header->dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        shm_ring_notify(header);
+        return true;
+    }
+
+    // Writes a plain "SOURCE|MESSAGE" record, truncated to one slot
+    bool log(std::string_view source, std::string_view message) {
+        char record[SHM_SLOT_DATA_SIZE];
+        size_t length = std::min(source.size(), SHM_SLOT_DATA_SIZE - 1);
+        memcpy(record, source.data(), length);
+        record[length++] = '|';
+        size_t body = std::min(message.size(), SHM_SLOT_DATA_SIZE - length);
+        memcpy(record + length, message.data(), body);
+        return write(record, length + body);
+    }
+
+private:
+    // The server resets writers on a slot it gave up waiting for, so never
+    // take the count below zero
+    static void leave(ShmSlot* slot) {
+        uint32_t writers = slot->writers.load(std::memory_order_relaxed);
+        while (writers > 0 && !slot->writers.compare_exchange_weak(writers, writers - 1, std::memory_order_release,
+                                                                   std::memory_order_relaxed)) {
+        }
+    }
+
+    ShmRingHeader* header{nullptr};
+    ShmSlot* slots{nullptr};
+    uint64_t mask{0};
+    size_t mapped_size{0};
+};
+
+#endif // LOG_SHM_RING_H
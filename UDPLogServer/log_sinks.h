@@ -0,0 +1,577 @@
+/**
+ * Log Server Output Sinks
+ *
+ * Extra destinations for the unified stream, i.e. everything written to
+ * current.log (--sink):
+ *
+ *   file:PATH                  append to PATH
+ *   stdout                     write to standard output
+ *   tcp:HOST:PORT              forward over TCP, reconnecting as needed
+ *   rotate:PATH:BYTES[:KEEP]   append to PATH; once it would pass BYTES,
+ *                              shift it to PATH.1 ... PATH.KEEP (default 5)
+ *
+ * Each sink has its own thread behind its own bounded queue, so a slow or
+ * unreachable sink never holds up current.log, the session files or any
+ * other sink. The writer copies every group commit into each sink's queue
+ * with one memcpy; when a sink's queue cannot take a commit, that commit
+ * is dropped for that sink only and counted.
+ *
+ * SinkQueue is a single-producer, single-consumer byte ring. The writer
+ * publishes whole commits, so a sink only ever sees complete lines.
+ * Sink<Output> is the sink thread. Output is one of the sink types below
+ * and is fixed at compile time, so the per-commit path has no virtual
+ * calls; only starting, stopping and reading counters go through the
+ * SinkRunner base.
+ */
+
+#ifndef LOG_SINKS_H
+#define LOG_SINKS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+constexpr size_t DEFAULT_SINK_QUEUE_BYTES = 8 * 1024 * 1024;
+constexpr unsigned int DEFAULT_ROTATE_KEEP = 5;
+constexpr int SINK_IDLE_WAIT_MS = 100;
+constexpr int SINK_RETRY_MS = 1000;        // Between attempts to (re)open a failed sink
+constexpr int TCP_CONNECT_TIMEOUT_MS = 1000;
+constexpr int TCP_SEND_TIMEOUT_MS = 1000;
+constexpr unsigned int TCP_SEND_TIMEOUTS = 5;  // Consecutive send timeouts before reconnecting
+
+class SinkQueue {
+public:
+    explicit SinkQueue(size_t capacity) : buffer(new char[capacity]), capacity(capacity) {}
+
+    // Producer: queues all of iov, or nothing if it does not fit
+    bool push(const struct iovec* iov, int count, size_t bytes) {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        if (capacity - (t - head.load(std::memory_order_acquire)) < bytes) {
+            return false;
+        }
+        for (int i = 0; i < count; i++) {
+            copy_in(t, static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+            t += iov[i].iov_len;
+        }
+        tail.store(t, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: everything queued as one or two iovecs (the ring may wrap);
+    // returns the iovec count, 0 when empty
+    int peek(struct iovec (&iov)[2], size_t& bytes) const {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        bytes = static_cast<size_t>(tail.load(std::memory_order_acquire) - h);
+        if (bytes == 0) return 0;
+        size_t start = static_cast<size_t>(h % capacity);
+        size_t first = std::min(bytes, capacity - start);
+        iov[0] = {buffer.get() + start, first};
+        if (first == bytes) return 1;
+        iov[1] = {buffer.get(), bytes - first};
+        return 2;
+    }
+
+    // Consumer: frees bytes taken with peek()
+    void consume(size_t bytes) {
+        head.store(head.load(std::memory_order_relaxed) + bytes, std::memory_order_release);
+    }
+
+    bool empty() const { return size() == 0; }
+
+    size_t size() const {
+        return static_cast<size_t>(tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire));
+    }
+
+private:
+    void copy_in(uint64_t position, const char* data, size_t length) {
+        size_t start = static_cast<size_t>(position % capacity);
+        size_t first = std::min(length, capacity - start);
+        memcpy(buffer.get() + start, data, first);
+        memcpy(buffer.get(), data + first, length - first);
+    }
+
+    alignas(64) std::atomic<uint64_t> tail{0};
+    alignas(64) std::atomic<uint64_t> head{0};
+    std::unique_ptr<char[]> buffer;
+    size_t capacity;
+};
+
+// Writes the whole iovec array, retrying after short writes and EINTR.
+// EAGAIN only comes from a send timeout; up to timeouts of them in a row
+// are waited out, none once stopping is set.
+inline bool sink_writev(int fd, struct iovec* iov, int count, unsigned int timeouts = 0,
+                        const std::atomic<bool>* stopping = nullptr) {
+    unsigned int waited = 0;
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, std::min(count, IOV_MAX));
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && ++waited <= timeouts &&
+                !(stopping && stopping->load(std::memory_order_relaxed))) {
+                continue;
+            }
+            return false;
+        }
+        waited = 0;
+        size_t left = static_cast<size_t>(written);
+        while (count > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+/**
+ * Sink types. Each provides:
+ *
+ *   bool open(std::string& error)       Called before the first write and
+ *                                       again after a failure
+ *   bool write(struct iovec* iov, int count, size_t bytes, const std::atomic<bool>& stopping)
+ *                                       False on failure; the sink is then
+ *                                       closed and reopened. Should give
+ *                                       up waiting once stopping is set.
+ *   void close()
+ *   std::string name() const            The --sink spec, for statistics
+ *   static constexpr bool RECONNECTS    Whether failing to open at startup
+ *                                       is tolerated (retried in the thread)
+ */
+class FileOutput {
+public:
+    static constexpr bool RECONNECTS = false;
+
+    explicit FileOutput(std::string path) : path(std::move(path)) {}
+    ~FileOutput() { close(); }
+
+    bool open(std::string& error) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            error = "cannot open " + path + ": " + strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    bool write(struct iovec* iov, int count, size_t, const std::atomic<bool>&) {
+        return sink_writev(fd, iov, count);
+    }
+
+    void close() {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    std::string name() const { return "file:" + path; }
+
+private:
+    std::string path;
+    int fd{-1};
+};
+
+class StdoutOutput {
+public:
+    static constexpr bool RECONNECTS = false;
+
+    bool open(std::string&) { return true; }
+    bool write(struct iovec* iov, int count, size_t, const std::atomic<bool>&) {
+        return sink_writev(STDOUT_FILENO, iov, count);
+    }
+    void close() {}
+    std::string name() const { return "stdout"; }
+};
+
+class TcpOutput {
+public:
+    static constexpr bool RECONNECTS = true;
+
+    TcpOutput(std::string host, std::string port) : host(std::move(host)), port(std::move(port)) {}
+    ~TcpOutput() { close(); }
+
+    // Tries every address of host in turn, each with a connect timeout
+    bool open(std::string& error) {
+        struct addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* addresses = nullptr;
+        int status = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+        if (status != 0) {
+            error = "cannot resolve " + host + ": " + gai_strerror(status);
+            return false;
+        }
+        for (struct addrinfo* address = addresses; address && fd < 0; address = address->ai_next) {
+            fd = connect_with_timeout(address);
+        }
+        int saved = errno;
+        freeaddrinfo(addresses);
+        if (fd < 0) {
+            error = "cannot connect to " + host + ":" + port + ": " + strerror(saved);
+            return false;
+        }
+        return true;
+    }
+
+    bool write(struct iovec* iov, int count, size_t, const std::atomic<bool>& stopping) {
+        return sink_writev(fd, iov, count, TCP_SEND_TIMEOUTS, &stopping);
+    }
+
+    void close() {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    std::string name() const { return "tcp:" + host + ":" + port; }
+
+private:
+    static int connect_with_timeout(const struct addrinfo* address) {
+        int socket_fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (socket_fd < 0) return -1;
+        fcntl(socket_fd, F_SETFD, FD_CLOEXEC);
+        int flags = fcntl(socket_fd, F_GETFL);
+        fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK);
+        int result = connect(socket_fd, address->ai_addr, address->ai_addrlen);
+        if (result < 0 && errno == EINPROGRESS) {
+            struct pollfd pfd{socket_fd, POLLOUT, 0};
+            int error = ETIMEDOUT;
+            socklen_t length = sizeof(error);
+            if (poll(&pfd, 1, TCP_CONNECT_TIMEOUT_MS) > 0) {
+                getsockopt(socket_fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            }
+            errno = error;
+            result = error == 0 ? 0 : -1;
+        }
+        if (result < 0) {
+            int saved = errno;
+            ::close(socket_fd);
+            errno = saved;
+            return -1;
+        }
+
+        // Blocking sends with a timeout, so a stalled peer is noticed
+        fcntl(socket_fd, F_SETFL, flags);
+        struct timeval timeout{TCP_SEND_TIMEOUT_MS / 1000, (TCP_SEND_TIMEOUT_MS % 1000) * 1000};
+        setsockopt(socket_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(socket_fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        return socket_fd;
+    }
+
+    std::string host;
+    std::string port;
+    int fd{-1};
+};
+
+// Rotates between commits, so every file holds whole lines; a single commit
+// larger than max_bytes still goes into one file
+class RotatingFileOutput {
+public:
+    static constexpr bool RECONNECTS = false;
+
+    RotatingFileOutput(std::string path, uint64_t max_bytes, unsigned int keep)
+        : path(std::move(path)), max_bytes(max_bytes), keep(keep) {}
+    ~RotatingFileOutput() { close(); }
+
+    bool open(std::string& error) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            error = "cannot open " + path + ": " + strerror(errno);
+            return false;
+        }
+        struct stat info;
+        size = fstat(fd, &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+        return true;
+    }
+
+    bool write(struct iovec* iov, int count, size_t bytes, const std::atomic<bool>&) {
+        if (size > 0 && size + bytes > max_bytes) {
+            std::string error;
+            close();
+            rotate();
+            if (!open(error)) return false;
+        }
+        size += bytes;
+        return sink_writev(fd, iov, count);
+    }
+
+    void close() {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    std::string name() const {
+        return "rotate:" + path + ":" + std::to_string(max_bytes) + ":" + std::to_string(keep);
+    }
+
+private:
+    // PATH.KEEP falls off the end; PATH.N becomes PATH.N+1, PATH becomes PATH.1
+    void rotate() {
+        for (unsigned int n = keep; n > 1; n--) {
+            rename((path + "." + std::to_string(n - 1)).c_str(), (path + "." + std::to_string(n)).c_str());
+        }
+        rename(path.c_str(), (path + ".1").c_str());
+    }
+
+    std::string path;
+    uint64_t max_bytes;
+    unsigned int keep;
+    uint64_t size{0};
+    int fd{-1};
+};
+
+// The writer's view of a sink: its queue and counters, plus start/stop
+class SinkRunner {
+public:
+    explicit SinkRunner(size_t queue_bytes) : queue(queue_bytes) {}
+    virtual ~SinkRunner() = default;
+
+    // Opens the sink and starts its thread. False (with error set) if it
+    // cannot be opened and is not one that reconnects; a reconnecting sink
+    // that is down starts anyway and reports why in error.
+    virtual bool start(std::string& error) = 0;
+
+    // Writes out what is queued, as far as the sink accepts it, and joins
+    virtual void stop() = 0;
+
+    virtual std::string name() const = 0;
+
+    // Writer thread: queues one commit (lines complete lines, bytes in iov)
+    void push(const struct iovec* iov, int count, uint64_t lines) {
+        size_t bytes = 0;
+        for (int i = 0; i < count; i++) {
+            bytes += iov[i].iov_len;
+        }
+        if (!queue.push(iov, count, bytes)) {
+            dropped_lines.fetch_add(lines, std::memory_order_relaxed);
+            dropped_bytes.fetch_add(bytes, std::memory_order_relaxed);
+            return;
+        }
+        queued_lines.fetch_add(lines, std::memory_order_relaxed);
+
+        // Same handshake as the writer's doorbell: either the sink thread
+        // sees the new bytes, or this thread sees it parked
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (parked.load(std::memory_order_relaxed) && parked.exchange(false, std::memory_order_acq_rel)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            wakeup.notify_one();
+        }
+    }
+
+    size_t queued_bytes() const { return queue.size(); }
+
+    std::atomic<uint64_t> queued_lines{0};
+    std::atomic<uint64_t> dropped_lines{0};   // Queue full
+    std::atomic<uint64_t> dropped_bytes{0};
+    std::atomic<uint64_t> written_bytes{0};
+    std::atomic<uint64_t> lost_bytes{0};      // Failed writes, or still queued when a down sink stopped
+    std::atomic<uint64_t> write_errors{0};
+    std::atomic<uint64_t> reopens{0};
+
+protected:
+    SinkQueue queue;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::atomic<bool> parked{false};
+    std::atomic<bool> stopping{false};
+};
+
+template <typename Output>
+class Sink : public SinkRunner {
+public:
+    Sink(Output output, size_t queue_bytes) : SinkRunner(queue_bytes), output(std::move(output)) {}
+    ~Sink() override { stop(); }
+
+    bool start(std::string& error) override {
+        ready = output.open(error);
+        if (!ready && !Output::RECONNECTS) return false;
+        thread = std::thread(&Sink::run, this);
+        return true;
+    }
+
+    void stop() override {
+        if (!thread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            wakeup.notify_one();
+        }
+        thread.join();
+        output.close();
+    }
+
+    std::string name() const override { return output.name(); }
+
+private:
+    void run() {
+        while (true) {
+            struct iovec iov[2];
+            size_t bytes = 0;
+            int count = queue.peek(iov, bytes);
+            if (count == 0) {
+                if (stopping) return;
+                park();
+                continue;
+            }
+
+            // A sink that is down when the server stops is not retried:
+            // what it still has queued is lost
+            if (!ready) {
+                if (stopping) {
+                    lost_bytes.fetch_add(bytes, std::memory_order_relaxed);
+                    queue.consume(bytes);
+                    return;
+                }
+                std::string error;
+                ready = output.open(error);
+                if (!ready) {
+                    wait(SINK_RETRY_MS);
+                    continue;
+                }
+                reopens.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            if (output.write(iov, count, bytes, stopping)) {
+                written_bytes.fetch_add(bytes, std::memory_order_relaxed);
+            } else {
+                write_errors.fetch_add(1, std::memory_order_relaxed);
+                lost_bytes.fetch_add(bytes, std::memory_order_relaxed);
+                output.close();
+                ready = false;
+            }
+            queue.consume(bytes);
+        }
+    }
+
+    void park() {
+        std::unique_lock<std::mutex> lock(mutex);
+        parked.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (queue.empty() && !stopping) {
+            wakeup.wait_for(lock, std::chrono::milliseconds(SINK_IDLE_WAIT_MS));
+        }
+        parked.store(false, std::memory_order_relaxed);
+    }
+
+    void wait(int timeout_ms) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!stopping) {
+            wakeup.wait_for(lock, std::chrono::milliseconds(timeout_ms));
+        }
+    }
+
+    Output output;
+    bool ready{false};
+    std::thread thread;
+};
+
+struct SinkSpec {
+    enum class Type { File, Stdout, Tcp, Rotate } type{Type::File};
+    std::string path;  // File, Rotate
+    std::string host;  // Tcp
+    std::string port;
+    uint64_t max_bytes{0};  // Rotate
+    unsigned int keep{DEFAULT_ROTATE_KEEP};
+};
+
+// Parses one --sink value (see the top of this file)
+inline bool parse_sink_spec(const std::string& value, SinkSpec& spec, std::string& error) {
+    if (value == "stdout") {
+        spec.type = SinkSpec::Type::Stdout;
+        return true;
+    }
+    size_t colon = value.find(':');
+    std::string kind = value.substr(0, colon);
+    std::string rest = colon == std::string::npos ? "" : value.substr(colon + 1);
+    if (kind == "file" && !rest.empty()) {
+        spec.type = SinkSpec::Type::File;
+        spec.path = rest;
+        return true;
+    }
+    if (kind == "tcp") {
+        size_t port_colon = rest.rfind(':');
+        if (port_colon == std::string::npos || port_colon == 0 || port_colon + 1 == rest.size()) {
+            error = "expected tcp:HOST:PORT";
+            return false;
+        }
+        spec.type = SinkSpec::Type::Tcp;
+        spec.host = rest.substr(0, port_colon);
+        spec.port = rest.substr(port_colon + 1);
+        if (spec.host.size() > 2 && spec.host.front() == '[' && spec.host.back() == ']') {
+            spec.host = spec.host.substr(1, spec.host.size() - 2);  // [IPv6]
+        }
+        return true;
+    }
+    if (kind == "rotate") {
+        // PATH:BYTES or PATH:BYTES:KEEP, numbers taken from the right
+        auto number = [](const std::string& text, unsigned long long& out) {
+            char* end = nullptr;
+            out = strtoull(text.c_str(), &end, 10);
+            return !text.empty() && *end == '\0';
+        };
+        size_t last = rest.rfind(':');
+        unsigned long long right = 0;
+        if (last == std::string::npos || !number(rest.substr(last + 1), right)) {
+            error = "expected rotate:PATH:BYTES[:KEEP]";
+            return false;
+        }
+        std::string path = rest.substr(0, last);
+        size_t middle = path.rfind(':');
+        unsigned long long bytes = 0;
+        if (middle != std::string::npos && number(path.substr(middle + 1), bytes)) {
+            spec.max_bytes = bytes;
+            spec.keep = static_cast<unsigned int>(std::min<unsigned long long>(right, 1000));
+            path = path.substr(0, middle);
+        } else {
+            spec.max_bytes = right;
+        }
+        if (path.empty() || spec.max_bytes == 0 || spec.keep == 0) {
+            error = "expected rotate:PATH:BYTES[:KEEP] with BYTES and KEEP above 0";
+            return false;
+        }
+        spec.type = SinkSpec::Type::Rotate;
+        spec.path = path;
+        return true;
+    }
+    error = "unknown sink (expected file:PATH, stdout, tcp:HOST:PORT or rotate:PATH:BYTES[:KEEP])";
+    return false;
+}
+
+inline std::unique_ptr<SinkRunner> make_sink(const SinkSpec& spec, size_t queue_bytes) {
+    switch (spec.type) {
+        case SinkSpec::Type::File:
+            return std::make_unique<Sink<FileOutput>>(FileOutput(spec.path), queue_bytes);
+        case SinkSpec::Type::Stdout:
+            return std::make_unique<Sink<StdoutOutput>>(StdoutOutput(), queue_bytes);
+        case SinkSpec::Type::Tcp:
+            return std::make_unique<Sink<TcpOutput>>(TcpOutput(spec.host, spec.port), queue_bytes);
+        case SinkSpec::Type::Rotate:
+            return std::make_unique<Sink<RotatingFileOutput>>(
+                RotatingFileOutput(spec.path, spec.max_bytes, spec.keep), queue_bytes);
+    }
+    return nullptr;
+}
+
+#endif // LOG_SINKS_H
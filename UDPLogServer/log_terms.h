@@ -0,0 +1,393 @@
+/**
+ * Session Log Term Index
+ *
+ * Next to every session_*.log the server writes session_*.log.terms, which
+ * lets log_search skip the parts of a log (and whole logs) that cannot
+ * contain what it is looking for. The log is cut into blocks of
+ * --term-block lines. For each block the index holds a Bloom filter of every
+ * term in it. At session end it adds posting lists: for each value of the
+ * [SOURCE] and [client_ip] columns and each "[TAG]" token in a message
+ * (like [AUTO-VALIDATE]), the blocks it occurs in.
+ *
+ * Terms (case-sensitive):
+ *   Source  the [SOURCE] column, without its padding
+ *   Ip      the [client_ip] column
+ *   Tag     TAG for every "[TAG]" in the message, TAG being token characters
+ *   Word    every token of the message: a run of letters, digits and
+ *           "_-.:/@", without trailing ".:-/"
+ *
+ * Layout (all integers big-endian, like the wire protocol):
+ *
+ *   header   offset  size  field
+ *            0       6     magic "LOGTRM"
+ *            6       1     version (LOG_TERMS_VERSION)
+ *            7       1     reserved
+ *            8       4     lines per block
+ *            12      4     reserved
+ *
+ *   block    0       1     'B'
+ *            1       1     Bloom hash count k
+ *            2       2     reserved
+ *            4       4     Bloom filter bytes (a power of two)
+ *            8       8     byte offset of the block's first line
+ *            16      8     byte offset just past its last line
+ *            24      8     line number of its first line (1-based, physical
+ *                          lines as in log_index.h)
+ *            32      4     physical lines in the block
+ *            36      4     distinct terms in the block
+ *            40      ...   Bloom filter
+ *
+ *   postings 0       1     'P' (written once, when the session ends)
+ *            1       1     flags (LOG_TERMS_POSTINGS_TRUNCATED)
+ *            2       2     reserved
+ *            4       4     number of terms
+ *            8       8     bytes of term entries that follow
+ *            16      ...   term entries sorted by (kind, term):
+ *                          kind u8, length u8, term bytes, block count u32,
+ *                          block numbers as LEB128 deltas
+ *
+ * Block records are appended as blocks fill, so a live session's index
+ * covers everything but its last partial block. Filters are sized when a
+ * block closes, at 10-20 bits per distinct term with 7 hashes (under 1%
+ * false positives).
+ */
+
+#ifndef LOG_TERMS_H
+#define LOG_TERMS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "log_index.h"
+#include "log_protocol.h"
+#include "log_timestamp.h"
+
+constexpr char LOG_TERMS_MAGIC[6] = {'L', 'O', 'G', 'T', 'R', 'M'};
+constexpr uint8_t LOG_TERMS_VERSION = 1;
+constexpr size_t LOG_TERMS_HEADER_SIZE = 16;
+constexpr size_t LOG_TERMS_BLOCK_HEADER_SIZE = 40;
+constexpr size_t LOG_TERMS_POSTINGS_HEADER_SIZE = 16;
+constexpr const char* LOG_TERMS_SUFFIX = ".terms";
+
+constexpr uint8_t LOG_TERMS_POSTINGS_TRUNCATED = 1;  // Posted terms capped: absence proves nothing
+constexpr size_t MAX_POSTED_TERMS = 4096;             // Per session
+constexpr size_t MAX_TERM_LENGTH = 64;
+constexpr unsigned int BLOOM_HASHES = 7;
+constexpr size_t BLOOM_BITS_PER_TERM = 10;
+
+enum class TermKind : uint8_t {
+    Word = 0,
+    Source = 1,
+    Ip = 2,
+    Tag = 3
+};
+
+// FNV-1a over the kind and the term, so equal text in different columns differs
+inline uint64_t term_hash(TermKind kind, const char* data, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    hash = (hash ^ static_cast<uint8_t>(kind)) * 1099511628211ull;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * 1099511628211ull;
+    }
+    return hash;
+}
+
+inline void bloom_add(uint8_t* bits, uint64_t bit_mask, uint64_t hash) {
+    uint64_t h1 = hash;
+    uint64_t h2 = (hash >> 32) | 1;
+    for (unsigned int i = 0; i < BLOOM_HASHES; i++) {
+        uint64_t bit = (h1 + i * h2) & bit_mask;
+        bits[bit >> 3] |= static_cast<uint8_t>(1u << (bit & 7));
+    }
+}
+
+inline bool bloom_test(const uint8_t* bits, uint64_t bit_mask, uint64_t hash, unsigned int hashes) {
+    uint64_t h1 = hash;
+    uint64_t h2 = (hash >> 32) | 1;
+    for (unsigned int i = 0; i < hashes; i++) {
+        uint64_t bit = (h1 + i * h2) & bit_mask;
+        if (!(bits[bit >> 3] & (1u << (bit & 7)))) return false;
+    }
+    return true;
+}
+
+inline void write_varint(std::vector<char>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// Returns false on a truncated or overlong varint
+inline bool read_varint(const char*& p, const char* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*p++);
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+inline bool is_token_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_' || c == '-' || c == '.' || c == ':' || c == '/' || c == '@';
+}
+
+// Calls fn(data, length) for every Word token of text
+template <typename Fn>
+inline void for_each_token(std::string_view text, Fn&& fn) {
+    size_t i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && !is_token_char(text[i])) i++;
+        size_t start = i;
+        while (i < text.size() && is_token_char(text[i])) i++;
+        size_t end = i;
+        while (end > start && (text[end - 1] == '.' || text[end - 1] == ':' || text[end - 1] == '-' ||
+                               text[end - 1] == '/')) {
+            end--;
+        }
+        if (end > start && end - start <= MAX_TERM_LENGTH) {
+            fn(text.data() + start, end - start);
+        }
+    }
+}
+
+// Calls fn(data, length) for the TAG of every "[TAG]" in text
+template <typename Fn>
+inline void for_each_tag(std::string_view text, Fn&& fn) {
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] != '[') continue;
+        size_t end = i + 1;
+        while (end < text.size() && end - i <= MAX_TERM_LENGTH && is_token_char(text[end])) end++;
+        if (end < text.size() && text[end] == ']' && end > i + 1) {
+            fn(text.data() + i + 1, end - i - 1);
+            i = end;
+        }
+    }
+}
+
+/**
+ * The columns of a server log line:
+ * "HH:MM:SS.uuuuuu [SOURCE] [client_ip] message". Lines in another shape
+ * (continuations of a multi-line message) are all message.
+ */
+struct LogLineColumns {
+    std::string_view source;
+    std::string_view ip;
+    std::string_view message;
+    bool columns{false};
+};
+
+inline LogLineColumns split_log_line(const char* text, size_t length) {
+    LogLineColumns line;
+    line.message = std::string_view(text, length);
+    size_t p = TIMESTAMP_LENGTH;
+    if (length < p + 2 || text[2] != ':' || text[8] != '.' || text[p] != ' ' || text[p + 1] != '[') {
+        return line;
+    }
+    const char* source_end = static_cast<const char*>(memchr(text + p + 2, ']', length - p - 2));
+    if (!source_end) return line;
+    size_t source_start = p + 2;
+    size_t source_length = source_end - text - source_start;
+    while (source_length > 0 && text[source_start + source_length - 1] == ' ') source_length--;
+
+    size_t ip_start = source_end - text + 3;  // "] ["
+    if (ip_start > length || text[ip_start - 2] != ' ' || text[ip_start - 1] != '[') return line;
+    const char* ip_end = static_cast<const char*>(memchr(text + ip_start, ']', length - ip_start));
+    if (!ip_end) return line;
+
+    size_t message_start = std::min(length, static_cast<size_t>(ip_end - text) + 2);
+    line.source = std::string_view(text + source_start, source_length);
+    line.ip = std::string_view(text + ip_start, ip_end - text - ip_start);
+    line.message = std::string_view(text + message_start, length - message_start);
+    line.columns = true;
+    return line;
+}
+
+/**
+ * Writer side: follows a session log as lines are queued for it and
+ * appends block records (and finally the postings) to output(), which
+ * the caller writes out and clears. add_line() must see every line, in
+ * order, before it is written.
+ */
+class LogTermIndexBuilder {
+public:
+    // Appends the file header for blocks of block_lines lines
+    void start(uint32_t block_lines) {
+        lines_per_block = std::max<uint32_t>(block_lines, 1);
+        offset = 0;
+        line = 1;
+        block = 0;
+        block_line_count = 0;
+        hashes.clear();
+        hashes.reserve(static_cast<size_t>(lines_per_block) * 8);
+        block_terms.clear();
+        postings.clear();
+        postings_truncated = false;
+        out.clear();
+
+        char header[LOG_TERMS_HEADER_SIZE] = {};
+        memcpy(header, LOG_TERMS_MAGIC, sizeof(LOG_TERMS_MAGIC));
+        header[6] = static_cast<char>(LOG_TERMS_VERSION);
+        write_u32(header + 8, lines_per_block);
+        out.insert(out.end(), header, header + sizeof(header));
+    }
+
+    // Text written before the first line (the session header)
+    void skip(size_t bytes, size_t lines) {
+        offset += bytes;
+        line += lines;
+    }
+
+    // Accounts for one line (without its newline) about to be appended
+    void add_line(const char* text, size_t length) {
+        if (block_line_count == 0) {
+            block_start = offset;
+            block_first_line = line;
+        }
+        offset += length + 1;
+        line += physical_lines(text, length);
+        block_line_count++;
+
+        LogLineColumns columns = split_log_line(text, length);
+        if (columns.columns) {
+            add_posted(TermKind::Source, columns.source);
+            add_posted(TermKind::Ip, columns.ip);
+        }
+        for_each_tag(columns.message, [this](const char* tag, size_t tag_length) {
+            add_posted(TermKind::Tag, std::string_view(tag, tag_length));
+        });
+        for_each_token(columns.message, [this](const char* token, size_t token_length) {
+            hashes.push_back(term_hash(TermKind::Word, token, token_length));
+        });
+
+        if (block_line_count >= lines_per_block) {
+            close_block();
+        }
+    }
+
+    // Closes the last partial block and appends the postings
+    void finish() {
+        if (block_line_count > 0) {
+            close_block();
+        }
+
+        std::vector<char> entries;
+        for (const auto& posting : postings) {
+            entries.push_back(posting.first[0]);
+            entries.push_back(static_cast<char>(posting.first.size() - 1));
+            entries.insert(entries.end(), posting.first.begin() + 1, posting.first.end());
+            char count[4];
+            write_u32(count, static_cast<uint32_t>(posting.second.size()));
+            entries.insert(entries.end(), count, count + 4);
+            uint32_t previous = 0;
+            for (uint32_t block_number : posting.second) {
+                write_varint(entries, block_number - previous);
+                previous = block_number;
+            }
+        }
+
+        char header[LOG_TERMS_POSTINGS_HEADER_SIZE] = {};
+        header[0] = 'P';
+        header[1] = static_cast<char>(postings_truncated ? LOG_TERMS_POSTINGS_TRUNCATED : 0);
+        write_u32(header + 4, static_cast<uint32_t>(postings.size()));
+        write_u64(header + 8, entries.size());
+        out.insert(out.end(), header, header + sizeof(header));
+        out.insert(out.end(), entries.begin(), entries.end());
+    }
+
+    std::vector<char>& output() { return out; }
+    uint64_t blocks() const { return block; }
+    uint64_t next_line() const { return line; }
+
+    // After a failed write: the file ends at file_offset, and the next line
+    // written will be line next_line. An open block whose lines were lost
+    // restarts there.
+    void resync(uint64_t file_offset, uint64_t next) {
+        offset = file_offset;
+        line = next;
+        if (block_line_count > 0 && block_start > offset) {
+            block_start = offset;
+            block_first_line = line;
+        }
+    }
+
+private:
+    // Column values and tags go into the Bloom filter and the postings,
+    // once per block; a block of many distinct tags or clients stays linear
+    void add_posted(TermKind kind, std::string_view term) {
+        if (term.empty() || term.size() > MAX_TERM_LENGTH) return;
+        key.assign(1, static_cast<char>(kind));
+        key.append(term);
+        if (!block_terms.insert(key).second) return;
+        hashes.push_back(term_hash(kind, term.data(), term.size()));
+    }
+
+    void close_block() {
+        std::sort(hashes.begin(), hashes.end());
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+        size_t bits = 64;
+        while (bits < hashes.size() * BLOOM_BITS_PER_TERM) bits <<= 1;
+        size_t bytes = bits / 8;
+
+        char header[LOG_TERMS_BLOCK_HEADER_SIZE] = {};
+        header[0] = 'B';
+        header[1] = static_cast<char>(BLOOM_HASHES);
+        write_u32(header + 4, static_cast<uint32_t>(bytes));
+        write_u64(header + 8, block_start);
+        write_u64(header + 16, offset);
+        write_u64(header + 24, block_first_line);
+        write_u32(header + 32, static_cast<uint32_t>(line - block_first_line));
+        write_u32(header + 36, static_cast<uint32_t>(hashes.size()));
+        out.insert(out.end(), header, header + sizeof(header));
+
+        size_t filter = out.size();
+        out.resize(filter + bytes, 0);
+        uint8_t* filter_bits = reinterpret_cast<uint8_t*>(out.data() + filter);
+        for (uint64_t hash : hashes) {
+            bloom_add(filter_bits, bits - 1, hash);
+        }
+
+        for (const auto& term : block_terms) {
+            auto posting = postings.find(term);
+            if (posting != postings.end()) {
+                posting->second.push_back(static_cast<uint32_t>(block));
+            } else if (postings.size() < MAX_POSTED_TERMS) {
+                postings.emplace(term, std::vector<uint32_t>{static_cast<uint32_t>(block)});
+            } else {
+                postings_truncated = true;
+            }
+        }
+
+        block++;
+        block_line_count = 0;
+        hashes.clear();
+        block_terms.clear();
+    }
+
+    uint32_t lines_per_block{1};
+    uint64_t offset{0};
+    uint64_t line{1};
+    uint64_t block{0};
+    uint64_t block_start{0};
+    uint64_t block_first_line{0};
+    uint32_t block_line_count{0};
+    std::vector<uint64_t> hashes;                               // Term hashes in the open block
+    std::unordered_set<std::string> block_terms;                // Kind byte + column value or tag
+    std::string key;                                            // Scratch for add_posted()
+    std::map<std::string, std::vector<uint32_t>> postings;      // Same keys, sorted
+    bool postings_truncated{false};
+    std::vector<char> out;
+};
+
+#endif // LOG_TERMS_H
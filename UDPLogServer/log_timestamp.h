@@ -0,0 +1,122 @@
+/**
+ * Log Line Timestamp Formatting
+ *
+ * Formats "HH:MM:SS.uuuuuu" timestamps for the UDP log server without
+ * touching the heap and without calling localtime() for every message.
+ *
+ * TimestampCache keeps the formatted "HH:MM:SS" for the most recent epoch
+ * second. Formatting a timestamp inside that second only writes the six
+ * microsecond digits; the broken-down local time is computed once per
+ * second. Readers are lock-free (a seqlock keyed on the cached second), so
+ * any number of receiver threads can share one cache.
+ */
+
+#ifndef LOG_TIMESTAMP_H
+#define LOG_TIMESTAMP_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+constexpr size_t TIMESTAMP_LENGTH = 15;  // "HH:MM:SS.uuuuuu"
+constexpr size_t TIMESTAMP_SECONDS_LENGTH = 8;  // "HH:MM:SS"
+
+inline void write_digits(char* out, long value, int width) {
+    for (int i = width - 1; i >= 0; i--) {
+        out[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+}
+
+// Uncached formatter: localtime_r() on every call
+inline void format_timestamp(char* out, std::chrono::system_clock::time_point now) {
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+        now.time_since_epoch()).count();
+    time_t seconds = static_cast<time_t>(micros / 1000000);
+    long microseconds = static_cast<long>(micros % 1000000);
+
+    struct tm tm_info;
+    localtime_r(&seconds, &tm_info);
+
+    write_digits(out, tm_info.tm_hour, 2);
+    out[2] = ':';
+    write_digits(out + 3, tm_info.tm_min, 2);
+    out[5] = ':';
+    write_digits(out + 6, tm_info.tm_sec, 2);
+    out[8] = '.';
+    write_digits(out + 9, microseconds, 6);
+}
+
+class TimestampCache {
+public:
+    // Writes "HH:MM:SS.uuuuuu" into out (TIMESTAMP_LENGTH bytes)
+    void format(char* out, std::chrono::system_clock::time_point now) {
+        int64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(
+            now.time_since_epoch()).count();
+        int64_t second = micros / 1000000;
+        long microseconds = static_cast<long>(micros % 1000000);
+
+        if (!read_cached(second, out)) {
+            refresh(second, out);
+        }
+        out[8] = '.';
+        write_digits(out + 9, microseconds, 6);
+    }
+
+    uint64_t refreshes() const {
+        return refresh_count.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr int64_t INVALID_SECOND = -1;
+
+    // Seqlock read: the cached second doubles as the sequence, and is set to
+    // INVALID_SECOND while a refresh rewrites the text
+    bool read_cached(int64_t second, char* out) const {
+        if (cached_second.load(std::memory_order_acquire) != second) {
+            return false;
+        }
+        uint64_t text = cached_text.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (cached_second.load(std::memory_order_relaxed) != second) {
+            return false;
+        }
+        memcpy(out, &text, TIMESTAMP_SECONDS_LENGTH);
+        return true;
+    }
+
+    // Formats the new second and publishes it. Only one thread refreshes at
+    // a time; a thread that loses the race just uses its own formatting.
+    void refresh(int64_t second, char* out) {
+        time_t seconds = static_cast<time_t>(second);
+        struct tm tm_info;
+        localtime_r(&seconds, &tm_info);
+
+        write_digits(out, tm_info.tm_hour, 2);
+        out[2] = ':';
+        write_digits(out + 3, tm_info.tm_min, 2);
+        out[5] = ':';
+        write_digits(out + 6, tm_info.tm_sec, 2);
+
+        if (refreshing.test_and_set(std::memory_order_acquire)) {
+            return;
+        }
+        uint64_t text;
+        memcpy(&text, out, TIMESTAMP_SECONDS_LENGTH);
+        cached_second.store(INVALID_SECOND, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        cached_text.store(text, std::memory_order_relaxed);
+        cached_second.store(second, std::memory_order_release);
+        refreshing.clear(std::memory_order_release);
+        refresh_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::atomic<int64_t> cached_second{INVALID_SECOND};
+    std::atomic<uint64_t> cached_text{0};
+    std::atomic_flag refreshing = ATOMIC_FLAG_INIT;
+    std::atomic<uint64_t> refresh_count{0};
+};
+
+#endif // LOG_TIMESTAMP_H
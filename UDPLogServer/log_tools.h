@@ -0,0 +1,94 @@
+/**
+ * Offline Tool Helpers
+ *
+ * Pieces shared by log_index_query, log_search and log_analyze: a read-only
+ * file mapping for the .idx and .terms sidecars, and the session header's
+ * start time for logs without an index. Session logs themselves are read
+ * through LogFile (log_compress.h), which also handles compressed ones.
+ */
+
+#ifndef LOG_TOOLS_H
+#define LOG_TOOLS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only mapping of a whole file; empty files map to nothing
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (data) munmap(const_cast<char*>(data), length);
+    }
+
+    // sequential: the file will be read front to back (readahead hint)
+    bool open(const std::string& path, bool sequential = false) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) < 0) {
+            close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(info.st_size);
+        modified = info.st_mtime;
+        if (length > 0) {
+            void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                close(fd);
+                return false;
+            }
+            data = static_cast<const char*>(mapping);
+            if (sequential) madvise(mapping, length, MADV_SEQUENTIAL);
+        }
+        close(fd);
+        return true;
+    }
+
+    const char* data{nullptr};
+    size_t length{0};
+    time_t modified{0};
+};
+
+// "Time: YYYY-MM-DD HH:MM:SS" from the session header, for logs without an index
+inline bool parse_header_time(const char* data, size_t length, int64_t& time_us) {
+    const char* label = "\nTime: ";
+    size_t search = std::min(length, static_cast<size_t>(4096));
+    for (size_t i = 0; i + 26 <= search; i++) {
+        if (memcmp(data + i, label, 7) != 0) continue;
+        std::string value(data + i + 7, 19);
+        struct tm local{};
+        if (!strptime(value.c_str(), "%Y-%m-%d %H:%M:%S", &local)) return false;
+        local.tm_isdst = -1;
+        time_us = static_cast<int64_t>(mktime(&local)) * 1000000;
+        return true;
+    }
+    return false;
+}
+
+// Local "YYYY-MM-DD HH:MM:SS" with fraction_digits (0-6) of the second
+inline std::string format_time(int64_t time_us, int fraction_digits = 6) {
+    time_t seconds = static_cast<time_t>(time_us / 1000000);
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char text[40];
+    size_t length = strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+    if (fraction_digits > 0) {
+        snprintf(text + length, sizeof(text) - length, ".%06lld", static_cast<long long>(time_us % 1000000));
+        length += 1 + std::min(fraction_digits, 6);
+    }
+    return std::string(text, length);
+}
+
+#endif // LOG_TOOLS_H
@@ -0,0 +1,275 @@
+/**
+ * Minimal io_uring Wrapper
+ *
+ * Just enough of io_uring for the log server's optional I/O engine
+ * (--io-engine io_uring), talking to the kernel through the raw syscalls
+ * so no liburing is needed:
+ *
+ *   - one submission/completion ring pair per thread (IoUring),
+ *   - a provided-buffer ring (IORING_REGISTER_PBUF_RING) that multishot
+ *     receives pick their buffers from,
+ *   - io_uring_enter() with a timeout (IORING_ENTER_EXT_ARG), so one call
+ *     both submits new requests and waits for completions.
+ *
+ * HAVE_IO_URING is only defined on Linux with kernel headers new enough to
+ * describe multishot receives (6.0). Whether the running kernel supports
+ * them, or allows io_uring at all, is only known at run time: init()
+ * fails when the ring cannot be created or lacks a required feature, and
+ * callers fall back to plain syscalls.
+ *
+ * An IoUring is not thread-safe; each thread creates its own.
+ */
+
+#ifndef LOG_URING_H
+#define LOG_URING_H
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_FEAT_EXT_ARG)
+#define HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+class IoUring {
+public:
+    IoUring() = default;
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    ~IoUring() {
+        if (buffer_ring) {
+            struct io_uring_buf_reg reg{};
+            reg.bgid = buffer_group;
+            register_op(IORING_UNREGISTER_PBUF_RING, &reg, 1);
+            munmap(buffer_ring, buffer_ring_bytes);
+        }
+        if (sqes) munmap(sqes, sqes_bytes);
+        if (cq_ring && cq_ring != sq_ring) munmap(cq_ring, cq_ring_bytes);
+        if (sq_ring) munmap(sq_ring, sq_ring_bytes);
+        if (fd >= 0) close(fd);
+    }
+
+    // Creates the ring; false (with errno set) if io_uring is unavailable,
+    // disabled, or lacks the timeout-capable io_uring_enter()
+    bool init(unsigned entries) {
+        struct io_uring_params params{};
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) return false;
+        if (!(params.features & IORING_FEAT_EXT_ARG)) {
+            errno = ENOTSUP;
+            return false;
+        }
+
+        sq_ring_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_bytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_ring_bytes = cq_ring_bytes = std::max(sq_ring_bytes, cq_ring_bytes);
+        }
+        sq_ring = map(sq_ring_bytes, IORING_OFF_SQ_RING);
+        if (!sq_ring) return false;
+        cq_ring = single_mmap ? sq_ring : map(cq_ring_bytes, IORING_OFF_CQ_RING);
+        if (!cq_ring) return false;
+        sqes_bytes = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = static_cast<struct io_uring_sqe*>(map(sqes_bytes, IORING_OFF_SQES));
+        if (!sqes) return false;
+
+        char* sq = static_cast<char*>(sq_ring);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries = params.sq_entries;
+        unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < sq_entries; i++) {
+            array[i] = i;  // SQE i always sits in array slot i
+        }
+
+        char* cq = static_cast<char*>(cq_ring);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        sqe_tail = *sq_tail;
+        return true;
+    }
+
+    // True if the kernel implements every opcode in ops
+    bool supports(std::initializer_list<uint8_t> ops) {
+        size_t bytes = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+        std::unique_ptr<char[]> storage(new char[bytes]());
+        auto* probe = reinterpret_cast<struct io_uring_probe*>(storage.get());
+        if (register_op(IORING_REGISTER_PROBE, probe, 256) < 0) return false;
+        for (uint8_t op : ops) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+        }
+        return true;
+    }
+
+    // Registers count buffers of at least size bytes each as buffer group
+    // group; count must be a power of two. Sizes are rounded up to 64 bytes
+    // so every buffer is suitably aligned for the headers written into it.
+    bool setup_buffer_ring(uint16_t group, unsigned count, size_t size) {
+        buffer_ring_bytes = count * sizeof(struct io_uring_buf);
+        void* ring = mmap(nullptr, buffer_ring_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED) return false;
+
+        struct io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+        reg.ring_entries = count;
+        reg.bgid = group;
+        if (register_op(IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            munmap(ring, buffer_ring_bytes);
+            return false;
+        }
+        buffer_ring = static_cast<struct io_uring_buf_ring*>(ring);
+        buffer_group = group;
+        buffer_mask = count - 1;
+        buffer_size = (size + 63) & ~static_cast<size_t>(63);
+        buffers.reset(new char[count * buffer_size]);
+        for (unsigned i = 0; i < count; i++) {
+            recycle_buffer(static_cast<uint16_t>(i));
+        }
+        publish_buffers();
+        return true;
+    }
+
+    char* buffer(uint16_t id) { return buffers.get() + id * buffer_size; }
+    size_t buffer_capacity() const { return buffer_size; }
+    uint16_t group() const { return buffer_group; }
+
+    // Hands a consumed buffer back to the kernel (visible after publish_buffers())
+    void recycle_buffer(uint16_t id) {
+        // Indexed by hand: in C++ the header's flexible bufs[] member starts
+        // 8 bytes in, not at offset 0 where the kernel expects entry 0
+        struct io_uring_buf& entry = reinterpret_cast<struct io_uring_buf*>(buffer_ring)[buffer_tail & buffer_mask];
+        entry.addr = reinterpret_cast<uint64_t>(buffer(id));
+        entry.len = static_cast<uint32_t>(buffer_size);
+        entry.bid = id;
+        buffer_tail++;
+    }
+
+    void publish_buffers() {
+        __atomic_store_n(&buffer_ring->tail, buffer_tail, __ATOMIC_RELEASE);
+    }
+
+    // Next free submission entry, zeroed; nullptr if the queue is full
+    struct io_uring_sqe* get_sqe() {
+        unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if (sqe_tail - head >= sq_entries) return nullptr;
+        struct io_uring_sqe* sqe = &sqes[sqe_tail & sq_mask];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe_tail++;
+        return sqe;
+    }
+
+    // One io_uring_enter(): submits every queued entry the kernel has not
+    // consumed yet (so entries of a failed call go out with the next one)
+    // and waits up to timeout_ms for at least wait_for completions. Returns
+    // 0, also after a timeout, or the errno of the failed call (EINTR for
+    // a signal).
+    int submit_and_wait(unsigned wait_for, int timeout_ms) {
+        __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+        unsigned to_submit = sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+
+        struct __kernel_timespec timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000000LL};
+        struct io_uring_getevents_arg arg{};
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<uint64_t>(&timeout);
+        unsigned flags = wait_for > 0 ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0;
+        long result = syscall(__NR_io_uring_enter, fd, to_submit, wait_for, flags,
+                              wait_for > 0 ? &arg : nullptr, wait_for > 0 ? sizeof(arg) : 0);
+        enter_calls++;
+        return result >= 0 || errno == ETIME || errno == EBUSY ? 0 : errno;
+    }
+
+    // Takes back the queued entries the kernel has not consumed, calling
+    // handle(sqe) for each; entries it did consume stay in flight and still
+    // complete. Only io_uring_enter() consumes entries (no SQPOLL), so
+    // nothing races with this on the ring's own thread.
+    template <typename Handler>
+    unsigned withdraw_unsubmitted(Handler&& handle) {
+        unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        for (unsigned i = head; i != sqe_tail; i++, count++) {
+            handle(sqes[i & sq_mask]);
+        }
+        sqe_tail = head;
+        __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    // Calls handle(cqe) for every completion that has arrived; returns the count
+    template <typename Handler>
+    unsigned for_each_completion(Handler&& handle) {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        for (; head != tail; head++, count++) {
+            handle(cqes[head & cq_mask]);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    uint64_t syscalls() const { return enter_calls; }
+
+private:
+    void* map(size_t bytes, off_t offset) {
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    int register_op(unsigned opcode, void* arg, unsigned count) {
+        return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+    }
+
+    int fd{-1};
+    void* sq_ring{nullptr};
+    void* cq_ring{nullptr};
+    struct io_uring_sqe* sqes{nullptr};
+    size_t sq_ring_bytes{0};
+    size_t cq_ring_bytes{0};
+    size_t sqes_bytes{0};
+
+    unsigned* sq_head{nullptr};
+    unsigned* sq_tail{nullptr};
+    unsigned sq_mask{0};
+    unsigned sq_entries{0};
+    unsigned sqe_tail{0};
+
+    unsigned* cq_head{nullptr};
+    unsigned* cq_tail{nullptr};
+    unsigned cq_mask{0};
+    struct io_uring_cqe* cqes{nullptr};
+
+    struct io_uring_buf_ring* buffer_ring{nullptr};
+    size_t buffer_ring_bytes{0};
+    std::unique_ptr<char[]> buffers;
+    size_t buffer_size{0};
+    uint16_t buffer_group{0};
+    uint16_t buffer_mask{0};
+    uint16_t buffer_tail{0};
+
+    uint64_t enter_calls{0};
+};
+
+#endif // HAVE_IO_URING
+
+#endif // LOG_URING_H
@@ -0,0 +1,122 @@
+/**
+ * Timestamp Formatting Microbenchmark
+ *
+ * Compares the original per-message get_timestamp() (system_clock::now(),
+ * localtime(), put_time into an ostringstream) with the uncached
+ * format_timestamp() and the shared TimestampCache from log_timestamp.h,
+ * single-threaded and with several threads sharing one cache.
+ *
+ * Usage:
+ *   timestamp_bench [ITERATIONS] [THREADS]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <cstdio>
+
+#include "log_timestamp.h"
+
+// The server's formatter before the cache was introduced, kept verbatim
+static std::string legacy_get_timestamp() {
+    auto now = std::chrono::system_clock::now();
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+        now.time_since_epoch()).count();
+
+    auto microseconds = micros % 1000000;
+
+    auto time_t = std::chrono::system_clock::to_time_t(now);
+    struct tm* tm_info = std::localtime(&time_t);
+
+    std::ostringstream oss;
+    oss << std::put_time(tm_info, "%H:%M:%S");
+    oss << '.' << std::setfill('0') << std::setw(6) << microseconds;
+
+    return oss.str();
+}
+
+static std::atomic<uint64_t> g_sink{0};
+
+template <typename Fn>
+static double run_threads(unsigned int threads, uint64_t iterations, Fn fn) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+            uint64_t checksum = 0;
+            for (uint64_t i = 0; i < iterations; i++) {
+                checksum += fn();
+            }
+            g_sink.fetch_add(checksum, std::memory_order_relaxed);
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return elapsed * 1e9 / (static_cast<double>(iterations) * threads);
+}
+
+static void report(const char* name, unsigned int threads, double ns_per_call, double baseline) {
+    printf("  %-34s %2u thread%s %9.1f ns/call  %6.1fx\n",
+           name, threads, threads == 1 ? " " : "s", ns_per_call, baseline / ns_per_call);
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t iterations = argc > 1 ? strtoull(argv[1], nullptr, 10) : 2000000;
+    unsigned int threads = argc > 2 ? static_cast<unsigned int>(atoi(argv[2])) : 4;
+    if (threads == 0) threads = 1;
+
+    // Sanity check: all formatters agree on the layout
+    char cached[TIMESTAMP_LENGTH];
+    TimestampCache check_cache;
+    check_cache.format(cached, std::chrono::system_clock::now());
+    std::string legacy = legacy_get_timestamp();
+    printf("legacy: %s  cached: %.*s\n", legacy.c_str(), static_cast<int>(TIMESTAMP_LENGTH), cached);
+    printf("%llu iterations per thread\n\n", static_cast<unsigned long long>(iterations));
+
+    double legacy_ns = run_threads(1, iterations, [] {
+        return static_cast<uint64_t>(legacy_get_timestamp()[14]);
+    });
+    report("get_timestamp() (legacy)", 1, legacy_ns, legacy_ns);
+
+    double uncached_ns = run_threads(1, iterations, [] {
+        char out[TIMESTAMP_LENGTH];
+        format_timestamp(out, std::chrono::system_clock::now());
+        return static_cast<uint64_t>(out[14]);
+    });
+    report("format_timestamp() (localtime_r)", 1, uncached_ns, legacy_ns);
+
+    TimestampCache cache;
+    double cached_ns = run_threads(1, iterations, [&cache] {
+        char out[TIMESTAMP_LENGTH];
+        cache.format(out, std::chrono::system_clock::now());
+        return static_cast<uint64_t>(out[14]);
+    });
+    report("TimestampCache::format()", 1, cached_ns, legacy_ns);
+
+    if (threads > 1) {
+        double legacy_mt_ns = run_threads(threads, iterations, [] {
+            return static_cast<uint64_t>(legacy_get_timestamp()[14]);
+        });
+        report("get_timestamp() (legacy)", threads, legacy_mt_ns, legacy_ns);
+
+        TimestampCache shared_cache;
+        double cached_mt_ns = run_threads(threads, iterations, [&shared_cache] {
+            char out[TIMESTAMP_LENGTH];
+            shared_cache.format(out, std::chrono::system_clock::now());
+            return static_cast<uint64_t>(out[14]);
+        });
+        report("TimestampCache::format() shared", threads, cached_mt_ns, legacy_ns);
+        printf("\n  shared cache refreshes: %llu\n",
+               static_cast<unsigned long long>(shared_cache.refreshes()));
+    }
+
+    return g_sink.load() == 42 ? 1 : 0;
+}
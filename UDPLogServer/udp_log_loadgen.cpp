@@ -0,0 +1,843 @@
+/**
+ * UDP Log Load Generator
+ *
+ * Floods a udp_log_server instance with "SOURCE|MESSAGE" datagrams from
+ * several sender threads so ingest throughput can be measured.
+ *
+ * Each sender owns its own socket (and therefore its own source port), so
+ * a server running several SO_REUSEPORT receivers sees distinct flows that
+ * the kernel can spread across its sockets.
+ *
+ * With --framed every datagram carries the framed-protocol header from
+ * log_protocol.h (random sender ID, per-sender sequence number), so the
+ * server's per-sender loss report can be checked against what was sent.
+ * Framed messages larger than one datagram (--size above
+ * MAX_DATAGRAM_SIZE) are split into Fragment frames for the server to
+ * reassemble.
+ *
+ * --batch N coalesces up to N records into each Batch frame (as the client
+ * library does when batching is enabled), so batched and unbatched ingest
+ * can be compared at the same message rate.
+ *
+ * --unix PATH and --shm NAME send the same datagrams to a server's
+ * Unix-domain socket or shared-memory ring (udp_log_server --unix/--shm)
+ * instead of over UDP, to compare local ingest paths.
+ *
+ * --size takes a fixed size, a uniform MIN-MAX range, or exp:MEAN for
+ * exponentially distributed sizes. --mmsg N hands up to N datagrams to the
+ * kernel per sendmmsg() call.
+ *
+ * Rate control is open loop: each sender follows a fixed schedule (evenly
+ * spaced, or Poisson arrivals with --poisson) and never waits for the
+ * server. Every message carries its sender and sequence number, a run ID
+ * and the time it was scheduled to be sent:
+ *
+ *   "load message SENDER-SEQUENCE run=RUNID t=MICROS_SINCE_EPOCH xxx..."
+ *
+ * so --join can match the session log against what was sent: loss and
+ * duplicates per message, and end-to-end latency from the scheduled send
+ * time to the line's timestamp, which a sender that falls behind schedule
+ * cannot hide. A session the server rotated (--rotate-size/--rotate-age) is
+ * joined across all of its parts, following their "Previous part" and
+ * "Next part" links, and reading parts compressed to .ulz through LogFile.
+ * With --server-pid the server's CPU time per message is
+ * reported as well. Scripts/bench_ingest_gate.sh sweeps the rate to find
+ * the highest one the server sustains without loss.
+ *
+ * Usage:
+ *   udp_log_loadgen [--host IP] [--port N] [--senders N] [--duration SEC]
+ *                   [--rate MSG_PER_SEC_PER_SENDER] [--poisson]
+ *                   [--size BYTES | MIN-MAX | exp:MEAN] [--framed] [--batch N]
+ *                   [--mmsg N] [--unix PATH | --shm NAME] [--new-session]
+ *                   [--join LOG] [--settle SEC] [--server-pid PID]
+ */
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <random>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "log_protocol.h"
+#include "log_shm_ring.h"
+#include "log_index.h"
+#include "log_compress.h"
+
+constexpr int DEFAULT_PORT = 9999;
+constexpr int MAX_PAYLOAD = 4000;
+constexpr int MAX_FRAGMENTED_PAYLOAD = 1024 * 1024;  // --framed only
+constexpr int MIN_PAYLOAD = 32;
+constexpr unsigned int MAX_MMSG = 64;
+
+enum class SizeDistribution {
+    Fixed,
+    Uniform,
+    Exponential
+};
+
+struct LoadConfig {
+    std::string host = "127.0.0.1";
+    int port = DEFAULT_PORT;
+    unsigned int senders = 8;
+    double duration_seconds = 5.0;
+    unsigned int rate = 0;          // Messages per second per sender, 0 = unthrottled
+    bool poisson = false;            // Exponential gaps between scheduled sends
+    SizeDistribution size_distribution = SizeDistribution::Fixed;
+    unsigned int message_size = 120; // Payload bytes after "SOURCE|": the size, or the largest one
+    unsigned int min_message_size = 120;  // Uniform sizes only
+    double mean_message_size = 120;       // Exponential sizes only
+    bool framed = false;             // Prefix datagrams with the framed-protocol header
+    unsigned int batch = 1;          // Records per Batch frame (> 1 implies --framed)
+    unsigned int mmsg = 1;           // Datagrams per sendmmsg() call
+    std::string unix_path;           // Send to a Unix-domain socket instead of UDP
+    std::string shm_name;            // Write into a shared-memory ring instead of UDP
+    bool new_session = false;        // Send CMD|NEW_SESSION before the run
+    std::string join_path;           // Session log (or log directory) to check the run against
+    double settle_seconds = 1.0;     // Wait for the server to write before joining
+    int server_pid = 0;              // Server process whose CPU time is measured
+    uint32_t run_id = 0;
+};
+
+// Where datagrams go: a socket address, or a shared-memory ring
+struct Destination {
+    const sockaddr* addr = nullptr;
+    socklen_t addr_length = 0;
+    ShmLogProducer* shm = nullptr;
+};
+
+static ssize_t send_datagram(int fd, const Destination& destination, const char* data, size_t length) {
+    if (destination.shm) {
+        return destination.shm->write(data, length) ? static_cast<ssize_t>(length) : -1;
+    }
+    return sendto(fd, data, length, 0, destination.addr, destination.addr_length);
+}
+
+struct SenderStats {
+    uint64_t sent = 0;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+    uint64_t fragments = 0;
+    uint64_t datagrams = 0;
+    uint64_t send_calls = 0;
+    uint64_t messages = 0;  // Sequence numbers used, sent or not
+    double behind_ms = 0;   // How far the sender finished behind its schedule
+};
+
+static int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Records waiting to go out in one Batch frame
+struct PendingBatch {
+    char datagram[MAX_DATAGRAM_SIZE];
+    size_t length = FRAME_HEADER_SIZE + BATCH_HEADER_SIZE;
+    std::vector<std::pair<size_t, int64_t>> entries;  // Entry offset, time the record was logged
+
+    bool fits(size_t record_length) const {
+        return length + BATCH_ENTRY_HEADER_SIZE + record_length <= MAX_DATAGRAM_SIZE;
+    }
+
+    void add(const char* record, size_t record_length) {
+        entries.emplace_back(length, now_us());
+        length += write_batch_entry(datagram + length, 0, record, static_cast<uint16_t>(record_length));
+    }
+};
+
+// Stamps the ages and send time into the batch and sends it
+static void send_batch(int fd, const Destination& destination, uint32_t frame_sender_id, uint32_t& sequence,
+                       PendingBatch& batch, SenderStats& stats) {
+    if (batch.entries.empty()) return;
+
+    int64_t send_time = now_us();
+    for (const auto& entry : batch.entries) {
+        write_u32(batch.datagram + entry.first, static_cast<uint32_t>(send_time - entry.second));
+    }
+    write_frame_header(batch.datagram, FrameType::Batch, frame_sender_id, sequence++);
+    write_batch_header(batch.datagram + FRAME_HEADER_SIZE, static_cast<uint64_t>(send_time));
+
+    ssize_t sent = send_datagram(fd, destination, batch.datagram, batch.length);
+    if (sent < 0) {
+        stats.errors++;
+    } else {
+        stats.sent += batch.entries.size();
+        stats.bytes += sent;
+        stats.datagrams++;
+    }
+    stats.send_calls++;
+    batch.entries.clear();
+    batch.length = FRAME_HEADER_SIZE + BATCH_HEADER_SIZE;
+}
+
+// Sends one record as Fragment frames; returns false if any datagram failed
+static bool send_fragmented(int fd, const Destination& destination, uint32_t frame_sender_id,
+                            uint32_t& sequence, uint32_t message_id, const char* record, size_t length,
+                            SenderStats& stats) {
+    char datagram[MAX_DATAGRAM_SIZE];
+    uint16_t count = static_cast<uint16_t>((length + MAX_FRAGMENT_PAYLOAD - 1) / MAX_FRAGMENT_PAYLOAD);
+    bool ok = true;
+    for (uint16_t index = 0; index < count; index++) {
+        size_t offset = static_cast<size_t>(index) * MAX_FRAGMENT_PAYLOAD;
+        size_t slice = std::min(MAX_FRAGMENT_PAYLOAD, length - offset);
+        size_t header = write_frame_header(datagram, FrameType::Fragment, frame_sender_id, sequence++);
+        header += write_fragment_header(datagram + header, message_id, index, count);
+        memcpy(datagram + header, record + offset, slice);
+
+        ssize_t sent = send_datagram(fd, destination, datagram, header + slice);
+        stats.send_calls++;
+        if (sent < 0) {
+            ok = false;
+            continue;
+        }
+        stats.fragments++;
+        stats.datagrams++;
+        stats.bytes += sent;
+    }
+    return ok;
+}
+
+// Datagrams queued for one sendmmsg() call, each in its own slot buffer
+class MmsgQueue {
+public:
+    MmsgQueue(const Destination& destination, unsigned int capacity)
+        : destination(destination), capacity(capacity), messages(capacity), iovecs(capacity) {}
+
+    size_t size() const { return count; }
+    bool full() const { return count >= capacity; }
+
+    void add(char* data, size_t length) {
+        iovecs[count].iov_base = data;
+        iovecs[count].iov_len = length;
+        struct msghdr& header = messages[count].msg_hdr;
+        header = msghdr{};
+        header.msg_name = const_cast<sockaddr*>(destination.addr);
+        header.msg_namelen = destination.addr_length;
+        header.msg_iov = &iovecs[count];
+        header.msg_iovlen = 1;
+        count++;
+    }
+
+    void flush(int fd, SenderStats& stats) {
+        unsigned int done = 0;
+        while (done < count) {
+            int sent = sendmmsg(fd, &messages[done], count - done, 0);
+            stats.send_calls++;
+            if (sent <= 0) {
+                stats.errors += count - done;
+                break;
+            }
+            for (int i = 0; i < sent; i++) {
+                stats.sent++;
+                stats.bytes += messages[done + i].msg_len;
+                stats.datagrams++;
+            }
+            done += sent;
+        }
+        count = 0;
+    }
+
+private:
+    const Destination& destination;
+    unsigned int capacity;
+    unsigned int count{0};
+    std::vector<struct mmsghdr> messages;
+    std::vector<struct iovec> iovecs;
+};
+
+static unsigned int next_message_size(const LoadConfig& config, std::mt19937_64& random) {
+    switch (config.size_distribution) {
+        case SizeDistribution::Uniform:
+            return std::uniform_int_distribution<unsigned int>(config.min_message_size, config.message_size)(random);
+        case SizeDistribution::Exponential: {
+            double size = std::exponential_distribution<double>(1.0 / config.mean_message_size)(random);
+            return std::min(config.message_size, std::max(static_cast<unsigned int>(MIN_PAYLOAD),
+                                                          static_cast<unsigned int>(size)));
+        }
+        case SizeDistribution::Fixed:
+            break;
+    }
+    return config.message_size;
+}
+
+static void sender_loop(const LoadConfig& config, const Destination& destination,
+                        unsigned int sender_id, SenderStats& stats) {
+    int fd = -1;
+    if (!destination.shm) {
+        fd = socket(destination.addr->sa_family, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            std::cerr << "Sender " << sender_id << ": socket failed: " << strerror(errno) << std::endl;
+            return;
+        }
+
+        int sndbuf = 1 << 20;
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    }
+
+    // One slot per datagram a sendmmsg() call can carry, each starting with
+    // the same header and source prefix
+    size_t slot_size = config.message_size + 160;
+    std::vector<char> storage(slot_size * config.mmsg);
+    int header = 0;
+    uint32_t frame_sender_id = std::random_device()();
+    uint32_t sequence = 0;
+    int prefix = 0;
+    for (unsigned int slot = 0; slot < config.mmsg; slot++) {
+        char* buffer = storage.data() + slot * slot_size;
+        if (config.framed) {
+            header = static_cast<int>(write_frame_header(buffer, FrameType::Line, frame_sender_id, 0));
+        }
+        prefix = header + snprintf(buffer + header, slot_size - header, "LOAD%02u|", sender_id);
+    }
+    MmsgQueue queue(destination, config.mmsg);
+    uint64_t message_number = 0;
+    PendingBatch batch;
+    std::mt19937_64 random(std::random_device{}() ^ sender_id);
+
+    auto start = std::chrono::steady_clock::now();
+    int64_t start_us = now_us();
+    auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(config.duration_seconds));
+    double interval_seconds = config.rate > 0 ? 1.0 / config.rate : 0;
+    std::exponential_distribution<double> poisson_interval(config.rate > 0 ? config.rate : 1);
+    auto next_send = start;
+
+    while (true) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) break;
+
+        // Open loop: messages are stamped with the time they were due, so
+        // falling behind shows up as latency rather than a lower rate
+        int64_t send_time;
+        if (config.rate > 0) {
+            if (now < next_send) {
+                if (queue.size() > 0) queue.flush(fd, stats);
+                std::this_thread::sleep_until(next_send);
+            }
+            send_time = start_us + std::chrono::duration_cast<std::chrono::microseconds>(next_send - start).count();
+            next_send += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(config.poisson ? poisson_interval(random) : interval_seconds));
+        } else {
+            send_time = now_us();
+        }
+
+        // Message body: sequence number, run and send time, then filler up
+        // to the drawn size
+        char* buffer = storage.data() + queue.size() * slot_size;
+        int body = snprintf(buffer + prefix, slot_size - prefix,
+                            "load message %u-%010llu run=%08x t=%lld ", sender_id,
+                            static_cast<unsigned long long>(message_number++), config.run_id,
+                            static_cast<long long>(send_time));
+        int length = prefix + body;
+        int target = prefix + static_cast<int>(next_message_size(config, random));
+        while (length < target) {
+            buffer[length++] = 'x';
+        }
+
+        if (config.batch > 1 && batch.fits(length - header)) {
+            batch.add(buffer + header, length - header);
+            if (batch.entries.size() >= config.batch) {
+                send_batch(fd, destination, frame_sender_id, sequence, batch, stats);
+            }
+            continue;
+        }
+        send_batch(fd, destination, frame_sender_id, sequence, batch, stats);
+
+        if (config.framed && static_cast<size_t>(length) > MAX_DATAGRAM_SIZE) {
+            // Record without the Line header, split across Fragment frames
+            if (send_fragmented(fd, destination, frame_sender_id, sequence, static_cast<uint32_t>(stats.sent),
+                                buffer + header, length - header, stats)) {
+                stats.sent++;
+            } else {
+                stats.errors++;
+            }
+            continue;
+        }
+        if (config.framed) {
+            write_frame_header(buffer, FrameType::Line, frame_sender_id, sequence++);
+        }
+
+        if (config.mmsg > 1) {
+            queue.add(buffer, length);
+            if (queue.full()) queue.flush(fd, stats);
+            continue;
+        }
+        ssize_t sent = send_datagram(fd, destination, buffer, length);
+        stats.send_calls++;
+        if (sent < 0) {
+            stats.errors++;
+            continue;
+        }
+        stats.sent++;
+        stats.bytes += sent;
+        stats.datagrams++;
+    }
+    if (queue.size() > 0) queue.flush(fd, stats);
+    send_batch(fd, destination, frame_sender_id, sequence, batch, stats);
+    stats.messages = message_number;
+    if (config.rate > 0) {
+        stats.behind_ms = std::max(0.0, std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - next_send).count());
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+struct JoinReport {
+    std::string path;
+    size_t parts = 0;
+    uint64_t received = 0;
+    uint64_t duplicates = 0;
+    std::vector<int64_t> latencies_us;  // Line time minus scheduled send time
+};
+
+// The newest session log in a directory, or path itself if it is a file
+static std::string resolve_join_path(const std::string& path) {
+    std::error_code error;
+    if (!std::filesystem::is_directory(path, error)) return path;
+    std::string newest;
+    std::filesystem::file_time_type newest_time;
+    for (const auto& entry : std::filesystem::directory_iterator(path, error)) {
+        if (!is_session_log_name(entry.path().filename().string())) continue;
+        auto modified = entry.last_write_time(error);
+        if (newest.empty() || modified > newest_time) {
+            newest = entry.path().string();
+            newest_time = modified;
+        }
+    }
+    return newest;
+}
+
+// A part named in another part's header or footer: the file itself, or
+// its compressed copy once the server's compressor has replaced it
+static std::string find_part(const std::string& directory, const std::string& name) {
+    std::error_code error;
+    std::string path = (std::filesystem::path(directory) / name).string();
+    if (std::filesystem::exists(path, error)) return path;
+    path += LOG_COMPRESSED_SUFFIX;
+    return std::filesystem::exists(path, error) ? path : std::string();
+}
+
+// The part named by a "Previous part: " line in the header (the first
+// bytes of the log) or a "Next part: " line in the footer (the last ones)
+static std::string part_link(const std::string& path, bool next) {
+    constexpr size_t SCAN_BYTES = 4096;  // Headers and footers are far shorter
+    LogFile log;
+    if (!log.open(path)) return std::string();
+    size_t begin = next ? log.length - std::min(log.length, SCAN_BYTES) : 0;
+    size_t end = next ? log.length : std::min(log.length, SCAN_BYTES);
+    if (!log.load(begin, end)) return std::string();
+    std::string_view text(log.data + begin, end - begin);
+    const std::string key = next ? "\nNext part: " : "\nPrevious part: ";
+    size_t at = text.find(key);
+    if (at == std::string_view::npos) return std::string();
+    text.remove_prefix(at + key.size());
+    std::string name(text.substr(0, text.find('\n')));
+    return find_part(std::filesystem::path(path).parent_path().string(), name);
+}
+
+// Every part of the session log at path, first to last: rotation splits
+// a session into FILE.log, FILE.part002.log, ... and may compress the
+// closed parts to .ulz
+static std::vector<std::string> session_parts(const std::string& path) {
+    std::vector<std::string> parts{path};
+    for (std::string previous = part_link(path, false);
+         !previous.empty() && std::find(parts.begin(), parts.end(), previous) == parts.end();
+         previous = part_link(previous, false)) {
+        parts.insert(parts.begin(), previous);
+    }
+    for (std::string next = part_link(path, true);
+         !next.empty() && std::find(parts.begin(), parts.end(), next) == parts.end();
+         next = part_link(next, true)) {
+        parts.push_back(next);
+    }
+    return parts;
+}
+
+static bool parse_decimal(const char*& p, const char* end, uint64_t& value) {
+    const char* start = p;
+    value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + static_cast<uint64_t>(*p++ - '0');
+    }
+    return p > start;
+}
+
+// Finds this run's messages in the session log, across all of its parts:
+// which arrived (once or more) and how long after their scheduled send time
+static bool join_session_log(const LoadConfig& config, const std::vector<SenderStats>& stats, JoinReport& report) {
+    report.path = resolve_join_path(config.join_path);
+    if (report.path.empty()) {
+        std::cerr << "Cannot open session log in " << config.join_path << std::endl;
+        return false;
+    }
+
+    std::vector<std::vector<bool>> seen(stats.size());
+    for (size_t i = 0; i < stats.size(); i++) {
+        seen[i].resize(stats[i].messages);
+    }
+    char run[24];
+    size_t run_length = static_cast<size_t>(snprintf(run, sizeof(run), " run=%08x t=", config.run_id));
+    const std::string marker = "load message ";
+    TimeOfDayClock clock(now_us());
+    bool clock_set = false;
+
+    std::vector<std::string> parts = session_parts(report.path);
+    report.parts = parts.size();
+    for (const auto& part : parts) {
+        LogFile log;
+        if (!log.open(part)) {
+            std::cerr << "Cannot open " << part << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        size_t released = 0;
+        for (size_t offset = 0; offset < log.length; ) {
+            if (log.compressed() && offset - released >= log.block_length()) {
+                log.release(released, offset);  // Decompressed blocks already read
+                released = offset / log.block_length() * log.block_length();
+            }
+            size_t newline = log.find_newline(offset, log.length);
+            const char* line = log.data + offset;
+            const char* end = log.data + newline;
+            offset = newline + 1;
+
+            std::string_view text(line, end - line);
+            size_t at = text.find(marker);
+            if (at == std::string_view::npos) continue;
+            const char* p = line + at + marker.size();
+            uint64_t sender;
+            uint64_t sequence;
+            uint64_t send_time;
+            if (!parse_decimal(p, end, sender) || p >= end || *p++ != '-' || !parse_decimal(p, end, sequence)) continue;
+            if (static_cast<size_t>(end - p) < run_length || memcmp(p, run, run_length) != 0) continue;
+            p += run_length;
+            if (!parse_decimal(p, end, send_time)) continue;
+            if (sender >= seen.size() || sequence >= seen[sender].size()) continue;
+
+            if (seen[sender][sequence]) {
+                report.duplicates++;
+                continue;
+            }
+            seen[sender][sequence] = true;
+            report.received++;
+
+            int64_t time_of_day;
+            if (parse_time_of_day(line, end - line, time_of_day)) {
+                if (!clock_set) {
+                    clock = TimeOfDayClock(static_cast<int64_t>(send_time));
+                    clock_set = true;
+                }
+                report.latencies_us.push_back(clock.resolve(time_of_day) - static_cast<int64_t>(send_time));
+            }
+        }
+    }
+    return true;
+}
+
+// User plus system CPU time of a process, from /proc/PID/stat
+static bool process_cpu_us(int pid, int64_t& cpu_us) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE* file = fopen(path, "r");
+    if (!file) return false;
+    char text[1024];
+    size_t length = fread(text, 1, sizeof(text) - 1, file);
+    fclose(file);
+    text[length] = '\0';
+
+    // Fields after the command name, which may contain spaces: state is
+    // field 3, utime and stime are fields 14 and 15
+    const char* p = strrchr(text, ')');
+    unsigned long long utime = 0;
+    unsigned long long stime = 0;
+    if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2) {
+        return false;
+    }
+    cpu_us = static_cast<int64_t>((utime + stime) * 1000000 / sysconf(_SC_CLK_TCK));
+    return true;
+}
+
+static int64_t own_cpu_us() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static int64_t percentile(const std::vector<int64_t>& sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))];
+}
+
+static void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]" << std::endl;
+    std::cout << "  --host IP        Server address (default 127.0.0.1)" << std::endl;
+    std::cout << "  --port N         Server port (default " << DEFAULT_PORT << ")" << std::endl;
+    std::cout << "  --senders N      Sender threads, one socket each (default 8)" << std::endl;
+    std::cout << "  --duration SEC   Run time in seconds (default 5)" << std::endl;
+    std::cout << "  --rate N         Messages/second per sender, 0 = unthrottled (default 0)" << std::endl;
+    std::cout << "  --poisson        Poisson arrivals at --rate instead of evenly spaced sends" << std::endl;
+    std::cout << "  --size SIZE      Message body size: BYTES, MIN-MAX (uniform) or exp:MEAN" << std::endl;
+    std::cout << "                   (default 120, max " << MAX_PAYLOAD
+              << ", or " << MAX_FRAGMENTED_PAYLOAD << " fragmented with --framed)" << std::endl;
+    std::cout << "  --framed         Use the framed protocol (sender ID + sequence number)" << std::endl;
+    std::cout << "  --batch N        Coalesce up to N records per datagram (framed Batch frames)" << std::endl;
+    std::cout << "  --mmsg N         Send up to N datagrams per sendmmsg() call (max " << MAX_MMSG << ")" << std::endl;
+    std::cout << "  --unix PATH      Send to the server's Unix-domain socket instead of UDP" << std::endl;
+    std::cout << "  --shm NAME       Write into the server's shared-memory ring instead of UDP" << std::endl;
+    std::cout << "  --new-session    Send CMD|NEW_SESSION first, so the run gets a session log of its own" << std::endl;
+    std::cout << "  --join LOG       Afterwards, check the session log (or the newest one in a" << std::endl;
+    std::cout << "                   directory) for loss, duplicates and latency, reading all of its" << std::endl;
+    std::cout << "                   rotated parts, compressed or not" << std::endl;
+    std::cout << "  --settle SEC     Wait this long for the server to write before joining (default 1)" << std::endl;
+    std::cout << "  --server-pid PID Report the server's CPU time per message" << std::endl;
+}
+
+// BYTES, MIN-MAX or exp:MEAN
+static bool parse_size(const std::string& value, LoadConfig& config) {
+    if (value.compare(0, 4, "exp:") == 0) {
+        config.size_distribution = SizeDistribution::Exponential;
+        config.mean_message_size = std::max(static_cast<double>(MIN_PAYLOAD), atof(value.c_str() + 4));
+        // Clipped far enough out to keep the mean
+        config.message_size = static_cast<unsigned int>(config.mean_message_size * 8);
+        return true;
+    }
+    size_t dash = value.find('-');
+    if (dash != std::string::npos) {
+        config.size_distribution = SizeDistribution::Uniform;
+        config.min_message_size = std::max(MIN_PAYLOAD, atoi(value.c_str()));
+        config.message_size = std::max(static_cast<int>(config.min_message_size), atoi(value.c_str() + dash + 1));
+        return true;
+    }
+    config.size_distribution = SizeDistribution::Fixed;
+    config.message_size = std::max(MIN_PAYLOAD, atoi(value.c_str()));
+    return true;
+}
+
+static bool parse_args(int argc, char* argv[], LoadConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            exit(0);
+        }
+        if (arg == "--framed") {
+            config.framed = true;
+            continue;
+        }
+        if (arg == "--poisson") {
+            config.poisson = true;
+            continue;
+        }
+        if (arg == "--new-session") {
+            config.new_session = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (arg == "--host") {
+            config.host = value;
+        } else if (arg == "--port") {
+            config.port = atoi(value.c_str());
+        } else if (arg == "--senders") {
+            config.senders = std::max(1, atoi(value.c_str()));
+        } else if (arg == "--duration") {
+            config.duration_seconds = atof(value.c_str());
+        } else if (arg == "--rate") {
+            config.rate = std::max(0, atoi(value.c_str()));
+        } else if (arg == "--unix") {
+            config.unix_path = value;
+        } else if (arg == "--shm") {
+            config.shm_name = value;
+        } else if (arg == "--batch") {
+            config.batch = std::max(1, atoi(value.c_str()));
+        } else if (arg == "--size") {
+            parse_size(value, config);
+        } else if (arg == "--mmsg") {
+            config.mmsg = std::min(MAX_MMSG, static_cast<unsigned int>(std::max(1, atoi(value.c_str()))));
+        } else if (arg == "--join") {
+            config.join_path = value;
+        } else if (arg == "--settle") {
+            config.settle_seconds = std::max(0.0, atof(value.c_str()));
+        } else if (arg == "--server-pid") {
+            config.server_pid = atoi(value.c_str());
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    if (config.batch > 1) {
+        config.framed = true;
+    }
+    config.message_size = std::min(config.framed ? MAX_FRAGMENTED_PAYLOAD : MAX_PAYLOAD,
+                                   static_cast<int>(config.message_size));
+    config.min_message_size = std::min(config.min_message_size, config.message_size);
+    if (config.batch > 1 || !config.shm_name.empty()) {
+        config.mmsg = 1;  // Batch frames and ring writes go out one at a time
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    LoadConfig config;
+    if (!parse_args(argc, argv, config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    Destination destination;
+    struct sockaddr_in server_addr{};
+    struct sockaddr_un unix_addr{};
+    ShmLogProducer shm;
+    if (!config.shm_name.empty()) {
+        if (!shm.open(config.shm_name.c_str())) {
+            std::cerr << "Cannot map shared-memory ring " << config.shm_name
+                      << " (is udp_log_server running with --shm?)" << std::endl;
+            return 1;
+        }
+        destination.shm = &shm;
+    } else if (!config.unix_path.empty()) {
+        if (config.unix_path.size() >= sizeof(unix_addr.sun_path)) {
+            std::cerr << "Unix socket path too long: " << config.unix_path << std::endl;
+            return 1;
+        }
+        unix_addr.sun_family = AF_UNIX;
+        memcpy(unix_addr.sun_path, config.unix_path.c_str(), config.unix_path.size() + 1);
+        destination.addr = reinterpret_cast<const sockaddr*>(&unix_addr);
+        destination.addr_length = sizeof(unix_addr);
+    } else {
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_port = htons(config.port);
+        if (inet_pton(AF_INET, config.host.c_str(), &server_addr.sin_addr) <= 0) {
+            std::cerr << "Invalid address: " << config.host << std::endl;
+            return 1;
+        }
+        destination.addr = reinterpret_cast<const sockaddr*>(&server_addr);
+        destination.addr_length = sizeof(server_addr);
+    }
+
+    config.run_id = std::random_device()();
+    if (config.new_session) {
+        // From a socket of its own: the senders share its address, so their
+        // lines land in the session it starts
+        const char* command = "CMD|NEW_SESSION";
+        int fd = destination.shm ? -1 : socket(destination.addr->sa_family, SOCK_DGRAM, 0);
+        if (send_datagram(fd, destination, command, strlen(command)) < 0) {
+            std::cerr << "Cannot send NEW_SESSION: " << strerror(errno) << std::endl;
+        }
+        if (fd >= 0) close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+
+    int64_t server_cpu_start = 0;
+    bool server_cpu = config.server_pid > 0 && process_cpu_us(config.server_pid, server_cpu_start);
+    if (config.server_pid > 0 && !server_cpu) {
+        std::cerr << "Cannot read CPU time of process " << config.server_pid << std::endl;
+    }
+
+    std::vector<SenderStats> stats(config.senders);
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < config.senders; i++) {
+        threads.emplace_back(sender_loop, std::cref(config), std::cref(destination), i, std::ref(stats[i]));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    int64_t client_cpu = own_cpu_us();
+
+    SenderStats total;
+    double behind_ms = 0;
+    for (const auto& s : stats) {
+        total.sent += s.sent;
+        total.bytes += s.bytes;
+        total.errors += s.errors;
+        total.fragments += s.fragments;
+        total.datagrams += s.datagrams;
+        total.send_calls += s.send_calls;
+        behind_ms = std::max(behind_ms, s.behind_ms);
+    }
+
+    // Machine-readable summary line first, human-readable details after
+    printf("sent=%llu bytes=%llu errors=%llu elapsed=%.3f rate=%.0f datagrams=%llu\n",
+           static_cast<unsigned long long>(total.sent),
+           static_cast<unsigned long long>(total.bytes),
+           static_cast<unsigned long long>(total.errors),
+           elapsed, total.sent / elapsed,
+           static_cast<unsigned long long>(total.datagrams));
+    printf("  %u senders, %.0f msg/s, %.1f MB/s, %.1f datagrams per send call, %.2f us client CPU per message\n",
+           config.senders, total.sent / elapsed, total.bytes / elapsed / 1e6,
+           total.send_calls > 0 ? static_cast<double>(total.datagrams) / total.send_calls : 0.0,
+           total.sent > 0 ? static_cast<double>(client_cpu) / total.sent : 0.0);
+    if (total.fragments > 0) {
+        printf("  %llu fragment datagrams\n", static_cast<unsigned long long>(total.fragments));
+    }
+    if (behind_ms > 1) {
+        printf("  Senders fell up to %.1f ms behind schedule (the rate is more than they can send)\n", behind_ms);
+    }
+    fflush(stdout);
+
+    if (config.join_path.empty() && !server_cpu) return 0;
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.settle_seconds));
+
+    int64_t server_cpu_end = 0;
+    if (server_cpu && !process_cpu_us(config.server_pid, server_cpu_end)) {
+        server_cpu = false;
+    }
+    JoinReport report;
+    bool joined = !config.join_path.empty() && join_session_log(config, stats, report);
+    uint64_t messages = joined ? report.received : total.sent;
+    double server_cpu_per_message = server_cpu && messages > 0
+        ? static_cast<double>(server_cpu_end - server_cpu_start) / messages : 0.0;
+
+    if (joined) {
+        std::sort(report.latencies_us.begin(), report.latencies_us.end());
+        const auto& latencies = report.latencies_us;
+        uint64_t lost = total.sent > report.received ? total.sent - report.received : 0;
+        printf("join received=%llu lost=%llu loss=%.3f%% duplicates=%llu p50_us=%lld p90_us=%lld p99_us=%lld "
+               "p999_us=%lld max_us=%lld server_cpu_us=%.2f\n",
+               static_cast<unsigned long long>(report.received),
+               static_cast<unsigned long long>(lost),
+               total.sent > 0 ? 100.0 * lost / total.sent : 0.0,
+               static_cast<unsigned long long>(report.duplicates),
+               static_cast<long long>(percentile(latencies, 0.50)),
+               static_cast<long long>(percentile(latencies, 0.90)),
+               static_cast<long long>(percentile(latencies, 0.99)),
+               static_cast<long long>(percentile(latencies, 0.999)),
+               static_cast<long long>(latencies.empty() ? 0 : latencies.back()),
+               server_cpu_per_message);
+        if (report.parts > 1) {
+            printf("  %s (%zu parts)\n", report.path.c_str(), report.parts);
+        } else {
+            printf("  %s\n", report.path.c_str());
+        }
+    } else if (server_cpu) {
+        printf("  %.2f us server CPU per message sent\n", server_cpu_per_message);
+    }
+    return joined || config.join_path.empty() ? 0 : 1;
+}
@@ -8,484 +8,4442 @@
  * Features:
  * - Thread-safe concurrent logging
  * - Session management with GUIDs
+ * - Concurrent per-client sessions keyed by address and sender ID (or
+ *   source port, for plain datagrams), each
+ *   with its own file and counters, ended after an idle timeout
+ *   (--session-idle)
+ * - A sparse time/offset index next to every session log (--index-lines,
+ *   --index-ms; see log_index.h and log_index_query)
+ * - A term index with per-block Bloom filters and posting lists for the
+ *   source and client columns and [TAG]s (--term-block; see log_terms.h
+ *   and log_search)
  * - Special commands for new/end session
  * - Automatic file rotation
  * - Minimal latency UDP protocol
  * - Source identification (iOS/JS)
  * - Microsecond precision timestamps
+ * - Batched receive with recvmmsg() on Linux (--recv-batch)
+ * - Multiple SO_REUSEPORT receiver threads on Linux (--receivers)
+ * - Lock-free bounded ring between receivers and the writer thread
+ * - Group-commit writer: one writev() per file per batch (--flush)
+ * - Session switches handled by the writer in stream order, never
+ *   blocking the receive threads
+ * - Kernel drop accounting (SO_RXQ_OVFL) and adaptive SO_RCVBUF sizing
+ * - Optional kernel receive timestamps (SO_TIMESTAMPNS) for line times
+ *   (--timestamps kernel), with single or batched receive
+ * - Hard memory budget for queued lines (--queue-memory) with a choice of
+ *   overload policy: drop newest, drop oldest, or per-source sampling
+ *   (--overload, --sample); per-source drops are summarized in the log
+ * - Optional framed protocol with per-sender sequence numbers; loss,
+ *   duplicates and reordering are reported per sender at session end
+ * - Reassembly of records fragmented across several datagrams, with a
+ *   timeout and a memory cap (--reassembly-memory)
+ * - Batched datagrams carrying many records, each with its own client-side
+ *   logging time (--batch-clock)
+ * - Local ingest without the UDP stack: a Unix-domain datagram socket
+ *   (--unix) and a shared-memory ring for co-located producers (--shm,
+ *   see log_shm_ring.h)
+ * - Optional io_uring I/O engine on Linux (--io-engine io_uring): multishot
+ *   receives into provided buffer rings and group commits submitted as one
+ *   batch, with a fallback to plain syscalls
+ * - Latency histograms for each ingest stage (receive -> enqueue ->
+ *   write -> flush) with queue, batch and drop gauges, served in the
+ *   Prometheus text format on localhost (--metrics-port) and summarized
+ *   in server.log (--stats-interval; see log_metrics.h)
+ * - Extra outputs for the unified stream: files, stdout, a TCP forwarder
+ *   and size-rotated files, each with its own queue and thread so a slow
+ *   one never delays current.log (--sink; see log_sinks.h)
+ * - Session files as text, JSON Lines or compact length-prefixed binary
+ *   records (--format; see log_encoding.h and log_convert)
+ * - Rotation of current.log and session files by size or age
+ *   (--rotate-size, --rotate-age), with closed files block-compressed on
+ *   an idle-priority thread (--compress; see log_compress.h)
+ * 
+ * Wire formats are described in log_protocol.h.
  * 
  * Special Commands:
- * - "CMD|NEW_SESSION" - Start new session with new GUID and file
- * - "CMD|END_SESSION" - End current session
+ * - "CMD|NEW_SESSION" - Start a new session (GUID and file) for the sending
+ *   client, replacing that client's previous session
+ * - "CMD|END_SESSION" - End the sending client's session
+ *
+ * A plain-protocol client is its address and UDP source port; a framed one
+ * is its address and sender ID. Lines from a client without a session of
+ * its own go to the newest session started from the same address, so a
+ * client may log from several sockets (or processes, like `nc -u` in
+ * Scripts/test_full_logging.sh) into one session. Lines from an address
+ * with no session at all go to current.log only. END_SESSION ends the
+ * sender's own session; from a plain client that has none, it ends the
+ * newest session from its address. Unix-socket and shared-memory producers
+ * have no port: all plain ones on a transport share one identity, and
+ * producers that need sessions of their own use framed sender IDs.
  */
 
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <string_view>
 #include <thread>
-#include <mutex>
-#include <queue>
-#include <condition_variable>
 #include <atomic>
+#include <mutex>
 #include <chrono>
 #include <iomanip>
 #include <sstream>
 #include <cstring>
 #include <random>
 #include <filesystem>
+#include <vector>
+#include <array>
+#include <memory>
+#include <algorithm>
+#include <new>
+#include <cstdlib>
+#include <ctime>
+#include <climits>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "log_compress.h"
+#include "log_encoding.h"
+#include "log_index.h"
+#include "log_metrics.h"
+#include "log_protocol.h"
+#include "log_shm_ring.h"
+#include "log_sinks.h"
+#include "log_terms.h"
+#include "log_timestamp.h"
+#include "log_uring.h"
 
 constexpr int UDP_PORT = 9999;
 constexpr int BUFFER_SIZE = 4096;
 constexpr const char* LOG_DIR = "/Users/jessicahansberry/projects/Rptr/logs";
-constexpr const char* CURRENT_LOG = "/Users/jessicahansberry/projects/Rptr/logs/current.log";
-constexpr const char* SERVER_LOG = "/Users/jessicahansberry/projects/Rptr/logs/server.log";
+constexpr const char* CURRENT_LOG = "current.log";  // Relative to the log directory
+constexpr const char* SERVER_LOG = "server.log";
 
-class UDPLogServer {
+// recvmmsg() is Linux-only; elsewhere the server always receives one datagram per call
+#if defined(__linux__)
+#define HAVE_RECVMMSG 1
+#endif
+
+// Only Linux load-balances unicast datagrams across SO_REUSEPORT sockets;
+// BSD/macOS deliver every datagram to a single socket
+#if defined(__linux__) && defined(SO_REUSEPORT)
+#define HAVE_REUSEPORT_BALANCING 1
+#endif
+
+// Kernel receive timestamps arrive as ancillary data: nanosecond timespecs
+// via SO_TIMESTAMPNS on Linux, microsecond timevals via SO_TIMESTAMP elsewhere
+#if defined(SO_TIMESTAMPNS)
+#define HAVE_KERNEL_TIMESTAMPS 1
+#define KERNEL_TIMESTAMP_OPTION SO_TIMESTAMPNS
+#define KERNEL_TIMESTAMP_NAME "SO_TIMESTAMPNS"
+#elif defined(SO_TIMESTAMP)
+#define HAVE_KERNEL_TIMESTAMPS 1
+#define KERNEL_TIMESTAMP_OPTION SO_TIMESTAMP
+#define KERNEL_TIMESTAMP_NAME "SO_TIMESTAMP"
+#endif
+
+constexpr unsigned int MAX_RECEIVERS = 64;
+
+// Receive buffer sizing: each receiver tracks its busiest BURST_WINDOW and
+// grows SO_RCVBUF to hold two of them (or doubles it after kernel drops).
+// The buffer only ever grows, by at least RCVBUF_MIN_GROWTH_PERCENT, and
+// without kernel drops at most once per RCVBUF_GROWTH_COOLDOWN.
+constexpr int DEFAULT_RCVBUF_MIN = 256 * 1024;
+constexpr int DEFAULT_RCVBUF_MAX = 16 * 1024 * 1024;
+constexpr auto BURST_WINDOW = std::chrono::milliseconds(100);
+constexpr auto RCVBUF_ADJUST_INTERVAL = std::chrono::seconds(1);
+constexpr auto RCVBUF_GROWTH_COOLDOWN = std::chrono::seconds(10);
+constexpr uint64_t RCVBUF_MIN_GROWTH_PERCENT = 25;
+constexpr size_t RCVBUF_DATAGRAM_OVERHEAD = 768;  // Approximate skb truesize cost per datagram
+constexpr size_t CONTROL_BUFFER_SIZE = 128;  // Ancillary data per datagram
+
+// Per-sender sequence tracking for the framed protocol
+constexpr size_t SENDER_TABLE_CAPACITY = 1024;  // Power of two
+constexpr uint32_t SEQUENCE_WINDOW = 64;          // Reorder/duplicate detection window
+constexpr uint32_t SEQUENCE_RESET_JUMP = 1u << 20;  // Larger forward jumps mean the sender restarted
+
+// Writer handoff ring: fixed-size slots, each large enough for one formatted line
+constexpr size_t CACHE_LINE_SIZE = 64;
+constexpr size_t LINE_CAPACITY = BUFFER_SIZE + 128;  // Datagram plus timestamp/source/IP prefix
+constexpr size_t DEFAULT_QUEUE_SLOTS = 4096;
+constexpr size_t MAX_QUEUE_SLOTS = 1u << 20;
+constexpr size_t WRITER_BATCH = 256;  // Lines drained per writer pass
+constexpr size_t SOURCE_COLUMN_WIDTH = 6;
+constexpr size_t SOURCE_OFFSET = TIMESTAMP_LENGTH + 2;  // "HH:MM:SS.uuuuuu [" ahead of the source
+
+// Reassembly of fragmented records (writer thread)
+constexpr size_t DEFAULT_REASSEMBLY_MEMORY = 16 * 1024 * 1024;
+constexpr size_t MAX_PENDING_MESSAGES = 64;
+constexpr auto REASSEMBLY_TIMEOUT = std::chrono::seconds(5);
+
+// Overload handling: the ring is the entire budget for queued lines. Sources
+// are interned into a fixed table so drops can be counted per source.
+constexpr size_t SOURCE_TABLE_CAPACITY = 64;  // Power of two, plus one overflow entry
+constexpr size_t SOURCE_NAME_CAPACITY = 32;
+constexpr size_t SAMPLE_WATERMARK_PERCENT = 75;  // Ring fill at which sampling starts
+constexpr unsigned int DEFAULT_SAMPLE_KEEP_EVERY = 10;
+constexpr auto DROP_SUMMARY_INTERVAL = std::chrono::seconds(10);
+
+// Shared-memory ingest (--shm): slots in the ring, and empty polls before
+// the reader parks on the ring's futex
+constexpr uint32_t DEFAULT_SHM_SLOTS = 1024;
+constexpr uint32_t MAX_SHM_SLOTS = 1u << 16;
+constexpr unsigned int SHM_IDLE_SPINS = 64;
+constexpr int SHM_PARK_TIMEOUT_MS = 100;
+
+// Metrics: the server.log summary interval, the endpoint thread's poll
+// timeout and request buffer, and how many writer passes a commit tracks
+// separately for the write -> flush histogram (further passes are counted
+// with the last one)
+constexpr unsigned int DEFAULT_STATS_INTERVAL_SECONDS = 60;
+constexpr int METRICS_POLL_MS = 200;
+constexpr size_t METRICS_REQUEST_SIZE = 2048;
+constexpr size_t COMMIT_PASS_GROUPS = 64;
+
+enum class OverloadPolicy {
+    DropNewest,  // Discard the arriving line when the ring is full
+    DropOldest,  // Evict the oldest queued line to make room
+    Sample       // Above the watermark keep 1 in N lines per source; drop newest when full
+};
+
+inline const char* overload_policy_name(OverloadPolicy policy) {
+    switch (policy) {
+        case OverloadPolicy::DropNewest: return "drop-newest";
+        case OverloadPolicy::DropOldest: return "drop-oldest";
+        case OverloadPolicy::Sample: return "sample";
+    }
+    return "unknown";
+}
+
+// --sample SOURCE=N: keep 1 in N lines from SOURCE while sampling ("*" = any other source)
+struct SampleRule {
+    std::string source;
+    unsigned int keep_every;
+};
+
+// Group-commit buffers: lines are gathered into large chunks and written
+// with one writev() per file per commit
+constexpr size_t COMMIT_CHUNK_SIZE = 256 * 1024;
+constexpr size_t COMMIT_CHUNKS = 8;
+constexpr int MAX_FLUSH_DELAY_MS = 1000;  // Visibility bound for the bytes policy
+
+// Concurrent sessions, one per client (address + sender ID, or + source
+// port for plain datagrams). Each session file gets its own, smaller
+// group-commit buffer.
+constexpr size_t MAX_SESSIONS = 32;
+constexpr size_t SESSION_CHUNK_SIZE = 64 * 1024;
+constexpr size_t SESSION_CHUNKS = 4;
+constexpr unsigned int DEFAULT_SESSION_IDLE_SECONDS = 30 * 60;
+constexpr auto SESSION_REAP_INTERVAL = std::chrono::seconds(1);
+
+// Source "ports" of the local transports, outside the UDP range so that
+// their plain producers never share a session with a UDP client
+constexpr uint32_t UNIX_CLIENT_PORT = 0x10000;
+constexpr uint32_t SHM_CLIENT_PORT = 0x10001;
+
+// Session log index (log_index.h): default entry spacing, and index entries
+// a session buffers between commits
+constexpr unsigned int DEFAULT_INDEX_LINES = 1024;
+constexpr unsigned int DEFAULT_INDEX_MS = 1000;
+constexpr size_t INDEX_PENDING_ENTRIES = 256;
+constexpr unsigned int DEFAULT_TERM_BLOCK_LINES = 4096;
+
+// Without inotify, current.log's inode is compared with the open fd this often
+constexpr int LOG_FILE_CHECK_INTERVAL_MS = 1000;
+
+enum class TimestampSource {
+    User,   // Clock read in user space while the line is formatted
+    Kernel  // Time the kernel queued the datagram on the socket
+};
+
+// Clock behind the line times of batched records
+enum class BatchClock {
+    Server,  // Batch arrival time minus each record's client-side age
+    Client   // The client's own clock
+};
+
+enum class FlushMode {
+    Immediate,  // Commit after every drain of the ring
+    Interval,   // Commit when the oldest pending line is flush_value ms old
+    Bytes       // Commit once flush_value bytes are pending (or MAX_FLUSH_DELAY_MS passes)
+};
+// How receivers and the writer talk to the kernel
+enum class IoEngine {
+    Syscalls,  // recvmsg()/recvmmsg() and writev()
+    Uring      // io_uring: multishot recvmsg and batched writev submissions
+};
+
+inline const char* io_engine_name(IoEngine engine) {
+    return engine == IoEngine::Uring ? "io_uring" : "syscalls";
+}
+
+// io_uring engine: submission queue size per ring (enough for a commit to
+// current.log plus every session file and its indexes), and the provided buffers
+// each receiver's multishot recvmsg fills (power of two)
+constexpr unsigned int URING_ENTRIES = 128;
+constexpr unsigned int URING_RECV_BUFFERS = 256;
+constexpr uint16_t URING_BUFFER_GROUP = 0;
+constexpr int URING_WRITE_RETRIES = 3;  // Failed io_uring_enter() calls in a row before the writer gives up the ring
+
+constexpr unsigned int MAX_RECV_BATCH = 256;
+constexpr int BATCH_HISTOGRAM_BUCKETS = 9;  // 1, 2-3, 4-7, ... 256
+
+struct ServerConfig {
+    int port = UDP_PORT;
+    std::string log_dir = LOG_DIR;
+    
+    // Receiver threads, each with its own SO_REUSEPORT socket on the same port
+    unsigned int receivers = 1;
+    
+    // Local ingest: a Unix-domain datagram socket path and a POSIX
+    // shared-memory ring name (empty = off)
+    std::string unix_path;
+    std::string shm_name;
+    uint32_t shm_slots = DEFAULT_SHM_SLOTS;
+    
+    // SO_RCVBUF limits for the adaptive receive buffer (min == max disables growth)
+    int rcvbuf_min = DEFAULT_RCVBUF_MIN;
+    int rcvbuf_max = DEFAULT_RCVBUF_MAX;
+    
+    // Capacity of the receiver -> writer ring (power of two); --queue-memory
+    // derives it from a byte budget instead
+    size_t queue_slots = DEFAULT_QUEUE_SLOTS;
+    
+    // What to drop when the ring fills up
+    OverloadPolicy overload_policy = OverloadPolicy::DropNewest;
+    std::vector<SampleRule> sample_rules;
+    unsigned int sample_default = DEFAULT_SAMPLE_KEEP_EVERY;
+    
+    // Timeline for records unpacked from batches
+    BatchClock batch_clock = BatchClock::Server;
+    
+    // Bytes of buffered fragments the writer may hold while reassembling
+    size_t reassembly_memory = DEFAULT_REASSEMBLY_MEMORY;
+    
+    // Sessions with no lines from their client for this long are ended (0 = never)
+    unsigned int session_idle_seconds = DEFAULT_SESSION_IDLE_SECONDS;
+    
+    // Session index spacing: an entry every index_lines lines or index_ms of
+    // line time (both 0 = no index files)
+    unsigned int index_lines = DEFAULT_INDEX_LINES;
+    unsigned int index_ms = DEFAULT_INDEX_MS;
+    
+    // Lines per block of the session term index (0 = no .terms files)
+    unsigned int term_block_lines = DEFAULT_TERM_BLOCK_LINES;
+    
+    // Encoding of session files; current.log and the sinks are always text
+    LogFormat session_format = LogFormat::Text;
+    
+    // current.log and session files are rotated once they reach
+    // rotate_bytes or are rotate_seconds old (0 = no limit); closed files
+    // are compressed in the background if compress is set
+    uint64_t rotate_bytes = 0;
+    unsigned int rotate_seconds = 0;
+    bool compress = false;
+    
+    // When the writer's group-commit buffer is written out
+    FlushMode flush_mode = FlushMode::Immediate;
+    unsigned long flush_value = 0;
+    
+    // Where each line's timestamp comes from
+    TimestampSource timestamps = TimestampSource::User;
+    
+    // Requested I/O engine; io_uring falls back to syscalls if unavailable
+    IoEngine io_engine = IoEngine::Syscalls;
+    
+    // Prometheus endpoint on 127.0.0.1 (0 = off), and seconds between
+    // summary lines in server.log (0 = none)
+    int metrics_port = 0;
+    unsigned int stats_interval_seconds = DEFAULT_STATS_INTERVAL_SECONDS;
+    
+    // Extra outputs fed with every line written to current.log, and the
+    // queue each one gets
+    std::vector<SinkSpec> sinks;
+    size_t sink_queue_bytes = DEFAULT_SINK_QUEUE_BYTES;
+    
+    // Datagrams pulled per recvmmsg() call (1 = classic recvfrom loop)
+#ifdef HAVE_RECVMMSG
+    unsigned int recv_batch = 32;
+#else
+    unsigned int recv_batch = 1;
+#endif
+};
+
+/**
+ * Heap allocation accounting.
+ *
+ * The global operator new is replaced so the shutdown statistics can show
+ * how many allocations the receiver and writer threads made while handling
+ * messages. Threads opt in through t_count_allocations; session setup and
+ * other one-off work pauses counting with AllocationCountPause.
+ * The replacements are kept out of line so the compiler never pairs an
+ * inlined malloc/free with a new/delete expression.
+ */
+std::atomic<uint64_t> g_hot_path_allocations{0};
+thread_local bool t_count_allocations = false;
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    if (t_count_allocations) {
+        g_hot_path_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+class AllocationCountPause {
+public:
+    AllocationCountPause() : previous(t_count_allocations) { t_count_allocations = false; }
+    ~AllocationCountPause() { t_count_allocations = previous; }
 private:
-    // Server state
-    std::atomic<bool> running{false};
-    std::atomic<bool> session_active{false};
-    int socket_fd{-1};
+    bool previous;
+};
+
+/**
+ * Fixed-capacity line formatter writing straight into a ring slot.
+ * Appends past the capacity are truncated rather than reallocated.
+ */
+class LineBuilder {
+public:
+    LineBuilder(char* buffer, size_t capacity) : data(buffer), capacity(capacity) {}
+    
+    void append(const char* text, size_t count) {
+        count = std::min(count, capacity - length);
+        memcpy(data + length, text, count);
+        length += count;
+    }
     
-    // Session management
-    std::string session_guid;
-    std::string current_log_file;
-    std::mutex session_mutex;
+    void append(std::string_view text) {
+        append(text.data(), text.size());
+    }
     
-    // File handling
-    std::ofstream log_file;
-    std::mutex file_mutex;
+    void append(char c) {
+        if (length < capacity) {
+            data[length++] = c;
+        }
+    }
     
-    // Message queue for async writing
-    std::queue<std::string> message_queue;
-    std::mutex queue_mutex;
-    std::condition_variable queue_cv;
+    void append_number(uint64_t value) {
+        char digits[20];
+        int count = 0;
+        do {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (count > 0) {
+            append(digits[--count]);
+        }
+    }
     
-    // Threads
-    std::thread receiver_thread;
-    std::thread writer_thread;
+    // Left-justified field, padded with spaces to width (like std::left << std::setw)
+    void append_padded(std::string_view text, size_t width) {
+        append(text);
+        for (size_t i = text.size(); i < width; i++) {
+            append(' ');
+        }
+    }
     
-    // Statistics
-    std::atomic<uint64_t> messages_received{0};
-    std::atomic<uint64_t> bytes_received{0};
-    std::atomic<uint64_t> sessions_created{0};
+    size_t size() const {
+        return length;
+    }
     
 private:
-    // Server log for tracking server events
-    std::ofstream server_log;
-    std::ofstream current_log_file_stream;
+    char* data;
+    size_t capacity;
+    size_t length{0};
+};
+
+// Splits "SOURCE|MESSAGE"; records without a delimiter come from "UNKNOWN"
+static void split_record(std::string_view record, std::string_view& source, std::string_view& content) {
+    source = "UNKNOWN";
+    content = record;
+    size_t delimiter_pos = record.find('|');
+    if (delimiter_pos != std::string_view::npos) {
+        source = record.substr(0, delimiter_pos);
+        content = record.substr(delimiter_pos + 1);
+    }
+}
+
+// "HH:MM:SS.uuuuuu [SOURCE] [IP] " ahead of every log line's content
+static void append_line_prefix(LineBuilder& line, const char* timestamp, std::string_view source,
+                               const char* client_ip) {
+    line.append(timestamp, TIMESTAMP_LENGTH);
+    line.append(" [");
+    line.append_padded(source, SOURCE_COLUMN_WIDTH);
+    line.append("] [");
+    line.append(client_ip);
+    line.append("] ");
+}
+
+// The parts of a line that structured session formats encode on their own;
+// the views point into the line's text or the record it came from
+struct LineFields {
+    std::chrono::system_clock::time_point time;
+    uint32_t client_addr{0};  // IPv4, network byte order; 0 = the server itself
+    std::string_view source;
+    std::string_view message;
+};
+
+/**
+ * Bounded multi-producer ring of preallocated line slots.
+ *
+ * Producers claim a slot by advancing tail with a CAS, format the line
+ * directly into it and publish it by bumping the slot's sequence number
+ * (Vyukov's bounded queue). Slots are taken in claim order by advancing
+ * head with a CAS and handed back by advancing the sequence a full lap.
+ * The writer is the normal consumer; under the drop-oldest policy a
+ * producer facing a full ring also takes (and discards) the oldest line,
+ * which is why head is advanced with a CAS rather than a plain store. head and tail
+ * live on their own cache lines, and every slot starts on a cache line, so
+ * producers and the consumer never share a line they write to.
+ */
+enum class SlotKind : uint8_t {
+    Line,            // Formatted log line
+    NewSession,      // CMD|NEW_SESSION, handled by the writer in queue order
+    EndSession,      // CMD|END_SESSION: ends the sender's own session
+    EndAllSessions,  // Server shutdown
+    Fragment         // Raw slice of a fragmented record, reassembled by the writer
+};
+
+// Where a queued record came from; sender_id/sequence are only set for framed datagrams
+struct RecordOrigin {
+    uint32_t client_addr{0};  // IPv4, network byte order
+    uint32_t client_port{0};  // Plain datagrams: UDP source port or a local transport's
+    uint32_t sender_id{0};
+    uint32_t sequence{0};
+    bool framed{false};
+};
+
+struct FragmentPosition {
+    uint32_t message_id{0};
+    uint16_t index{0};
+    uint16_t count{0};
+};
+
+// kind is atomic because a producer evicting under drop-oldest inspects the
+// oldest slot before it owns it
+struct alignas(CACHE_LINE_SIZE) LogSlot {
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<SlotKind> kind{SlotKind::Line};
+    uint16_t source{0};  // SourceTable index (lines only)
+    uint16_t source_length{0};   // Unpadded source name at SOURCE_OFFSET in line (lines only)
+    uint16_t message_offset{0};  // Where the message starts in line (lines only)
+    RecordOrigin origin;
+    FragmentPosition fragment;                          // Fragment slots only
+    std::chrono::system_clock::time_point received_at;  // Line time, or the fragment's arrival
+    std::chrono::system_clock::time_point enqueued_at;  // Line and fragment slots
+    uint32_t length{0};
+    char line[LINE_CAPACITY];
+};
+
+class LogRing {
+public:
+    explicit LogRing(size_t capacity)
+        : slots(new LogSlot[capacity]), mask(capacity - 1) {
+        for (size_t i = 0; i < capacity; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
     
-    void log_server_event(const std::string& event) {
-        auto now = std::chrono::system_clock::now();
-        auto time_t = std::chrono::system_clock::to_time_t(now);
+    // Producer: reserve the next slot, or nullptr when the ring is full
+    LogSlot* claim() {
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            LogSlot& slot = slots[pos & mask];
+            uint64_t seq = slot.sequence.load(std::memory_order_acquire);
+            int64_t diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    return &slot;
+                }
+            } else if (diff < 0) {
+                return nullptr;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    // Producer: make a claimed slot visible to the consumer
+    void publish(LogSlot* slot) {
+        uint64_t seq = slot->sequence.load(std::memory_order_relaxed);
+        slot->sequence.store(seq + 1, std::memory_order_release);
+    }
+    
+    // Consumer: take the next published slot in claim order, or nullptr
+    LogSlot* take() {
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            LogSlot& slot = slots[pos & mask];
+            uint64_t seq = slot.sequence.load(std::memory_order_acquire);
+            int64_t diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    return &slot;
+                }
+            } else if (diff < 0) {
+                return nullptr;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    // Producer (drop-oldest): take the oldest slot if it is a published
+    // line or fragment; control slots are never evicted
+    LogSlot* take_oldest_line() {
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        LogSlot& slot = slots[pos & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+            return nullptr;
+        }
+        SlotKind kind = slot.kind.load(std::memory_order_relaxed);
+        if (kind != SlotKind::Line && kind != SlotKind::Fragment) {
+            return nullptr;
+        }
+        if (!head.compare_exchange_strong(pos, pos + 1, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return &slot;
+    }
+    
+    // Consumer: return a taken slot to the producers
+    void release(LogSlot* slot) {
+        uint64_t seq = slot->sequence.load(std::memory_order_relaxed);
+        slot->sequence.store(seq + mask, std::memory_order_release);
+    }
+    
+    // True if the next slot in claim order has not been published yet
+    bool empty() const {
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        return slots[pos & mask].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+    
+    // Approximate number of claimed slots not yet taken
+    size_t size() const {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        return t > h ? static_cast<size_t>(t - h) : 0;
+    }
+    
+    size_t capacity() const {
+        return mask + 1;
+    }
+    
+private:
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head{0};
+    alignas(CACHE_LINE_SIZE) std::unique_ptr<LogSlot[]> slots;
+    size_t mask;
+};
+
+/**
+ * Wakes the writer thread when it is parked waiting for lines.
+ * Uses an eventfd on Linux and a non-blocking pipe elsewhere; either way
+ * the writer can poll() it with a timeout.
+ */
+class Doorbell {
+public:
+    Doorbell() {
+#if defined(__linux__)
+        read_fd = write_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+        int fds[2];
+        if (pipe(fds) == 0) {
+            read_fd = fds[0];
+            write_fd = fds[1];
+            fcntl(read_fd, F_SETFL, O_NONBLOCK);
+            fcntl(write_fd, F_SETFL, O_NONBLOCK);
+        }
+#endif
+    }
+    
+    ~Doorbell() {
+        if (read_fd >= 0) close(read_fd);
+        if (write_fd >= 0 && write_fd != read_fd) close(write_fd);
+    }
+    
+    Doorbell(const Doorbell&) = delete;
+    Doorbell& operator=(const Doorbell&) = delete;
+    
+    void ring() {
+#if defined(__linux__)
+        uint64_t one = 1;
+        ssize_t ignored = write(write_fd, &one, sizeof(one));
+#else
+        char one = 1;
+        ssize_t ignored = write(write_fd, &one, sizeof(one));
+#endif
+        (void)ignored;
+    }
+    
+    // Block until rung or timeout; consumes any pending rings
+    void wait(int timeout_ms) {
+        struct pollfd pfd{};
+        pfd.fd = read_fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, timeout_ms) > 0) {
+            char drain[64];
+            while (read(read_fd, drain, sizeof(drain)) > 0) {
+            }
+        }
+    }
+    
+private:
+    int read_fd{-1};
+    int write_fd{-1};
+};
+
+// Drops the first written bytes from an iovec array; returns the entries left
+static int advance_iov(struct iovec*& iov, int count, size_t written) {
+    while (count > 0 && written >= iov->iov_len) {
+        written -= iov->iov_len;
+        iov++;
+        count--;
+    }
+    if (count > 0) {
+        iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+        iov->iov_len -= written;
+    }
+    return count;
+}
+
+// Writes the whole iovec array, retrying after short writes and EINTR
+static bool writev_all(int fd, struct iovec* iov, int count, uint64_t& syscalls) {
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, std::min(count, IOV_MAX));
+        syscalls++;
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        count = advance_iov(iov, count, written);
+    }
+    return true;
+}
+
+// One file's share of a group commit
+struct FileWrite {
+    int fd;
+    struct iovec* iov;
+    int count;
+    int error;  // errno of a failed write, 0 on success
+};
+
+static bool write_all(int fd, const std::string& text) {
+    struct iovec iov{const_cast<char*>(text.data()), text.size()};
+    uint64_t ignored = 0;
+    return writev_all(fd, &iov, 1, ignored);
+}
+
+/**
+ * Group-commit buffer for the writer thread.
+ *
+ * Lines are appended, newline-terminated unless told otherwise (binary
+ * session records carry their own length), into preallocated contiguous
+ * chunks; a commit hands the filled chunks to writev() as one iovec array,
+ * so each file costs a single syscall per batch no matter how many lines
+ * it holds. Session files use fewer, smaller chunks than current.log.
+ */
+class WriteBatch {
+public:
+    explicit WriteBatch(size_t chunk_size = COMMIT_CHUNK_SIZE, size_t chunk_count = COMMIT_CHUNKS)
+        : chunk_size(chunk_size), chunk_count(std::min(chunk_count, COMMIT_CHUNKS)) {
+        for (size_t i = 0; i < this->chunk_count; i++) {
+            chunks[i].reset(new char[chunk_size]);
+            used[i] = 0;
+        }
+    }
+    
+    // Returns false when the line does not fit and the batch must be committed first
+    bool append(const char* line, size_t length, bool newline = true) {
+        size_t needed = length + (newline ? 1 : 0);
+        if (used[current] + needed > chunk_size) {
+            if (current + 1 >= chunk_count) {
+                return false;
+            }
+            current++;
+        }
+        if (pending_lines == 0) {
+            first_line_time = std::chrono::steady_clock::now();
+        }
+        char* out = chunks[current].get() + used[current];
+        memcpy(out, line, length);
+        if (newline) out[length] = '\n';
+        used[current] += needed;
+        pending_bytes += needed;
+        pending_lines++;
+        return true;
+    }
+    
+    // Fills iov (COMMIT_CHUNKS entries) with the pending chunks; returns the count
+    int gather(struct iovec* iov) const {
+        int count = 0;
+        for (size_t i = 0; i <= current; i++) {
+            if (used[i] == 0) continue;
+            iov[count].iov_base = chunks[i].get();
+            iov[count].iov_len = used[i];
+            count++;
+        }
+        return count;
+    }
+    
+    void clear() {
+        for (size_t i = 0; i <= current; i++) {
+            used[i] = 0;
+        }
+        current = 0;
+        pending_bytes = 0;
+        pending_lines = 0;
+    }
+    
+    bool empty() const { return pending_lines == 0; }
+    size_t bytes() const { return pending_bytes; }
+    size_t lines() const { return pending_lines; }
+    std::chrono::steady_clock::time_point oldest() const { return first_line_time; }
+    
+private:
+    std::unique_ptr<char[]> chunks[COMMIT_CHUNKS];
+    size_t used[COMMIT_CHUNKS];
+    size_t chunk_size;
+    size_t chunk_count;
+    size_t current{0};
+    size_t pending_bytes{0};
+    size_t pending_lines{0};
+    std::chrono::steady_clock::time_point first_line_time;
+};
+
+/**
+ * Notices when current.log is deleted or renamed away (rotation, rm, an
+ * editor's save) so the writer can reopen it and tail -F keeps following.
+ *
+ * On Linux an inotify watch on the log directory reports unlink/rename of
+ * the file name, so checking costs one non-blocking read per commit and no
+ * stat() at all. Elsewhere, or if inotify is unavailable, the path's inode
+ * is compared with the open descriptor's at a coarse interval.
+ */
+class LogFileWatcher {
+public:
+    LogFileWatcher(const std::string& dir, const std::string& name)
+        : directory(dir), file_name(name), path(dir + "/" + name) {
+#if defined(__linux__)
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        rearm();
+#endif
+    }
+    
+    ~LogFileWatcher() {
+        if (inotify_fd >= 0) close(inotify_fd);
+    }
+    
+    LogFileWatcher(const LogFileWatcher&) = delete;
+    LogFileWatcher& operator=(const LogFileWatcher&) = delete;
+    
+    // True if fd no longer refers to the file at the watched path
+    bool replaced(int fd) {
+        if (fd < 0) return true;
+#if defined(__linux__)
+        if (watch_descriptor >= 0) {
+            return drain_events();
+        }
+#endif
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_check < std::chrono::milliseconds(LOG_FILE_CHECK_INTERVAL_MS)) {
+            return false;
+        }
+        last_check = now;
         
-        if (!server_log.is_open()) {
-            server_log.open(SERVER_LOG, std::ios::out | std::ios::app);
+        struct stat open_stat, path_stat;
+        if (fstat(fd, &open_stat) != 0 || stat(path.c_str(), &path_stat) != 0) {
+            return true;
+        }
+        return open_stat.st_ino != path_stat.st_ino || open_stat.st_dev != path_stat.st_dev;
+    }
+    
+    // Forgets changes the writer made itself (rotating current.log); call
+    // once the new file is open
+    void acknowledge() {
+#if defined(__linux__)
+        if (watch_descriptor >= 0) {
+            drain_events();
+        }
+#endif
+    }
+    
+    // Re-establish the directory watch after the directory was recreated
+    void rearm() {
+#if defined(__linux__)
+        if (inotify_fd >= 0 && watch_descriptor < 0) {
+            watch_descriptor = inotify_add_watch(inotify_fd, directory.c_str(),
+                IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF);
+        }
+#endif
+    }
+    
+private:
+#if defined(__linux__)
+    bool drain_events() {
+        bool changed = false;
+        alignas(struct inotify_event) char buffer[4096];
+        
+        while (true) {
+            ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+            if (length <= 0) break;
+            
+            for (char* p = buffer; p < buffer + length; ) {
+                auto* event = reinterpret_cast<struct inotify_event*>(p);
+                if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                    // The directory itself went away; the writer recreates it
+                    changed = true;
+                    if (event->mask & IN_IGNORED) {
+                        watch_descriptor = -1;
+                    }
+                } else if (event->len > 0 && file_name == event->name) {
+                    changed = true;
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        return changed;
+    }
+    
+    int watch_descriptor{-1};
+#endif
+    
+    int inotify_fd{-1};
+    std::string directory;
+    std::string file_name;
+    std::string path;
+    std::chrono::steady_clock::time_point last_check{};
+};
+
+/**
+ * Framed datagrams the server itself discarded before the writer saw them
+ * (ring full, drop-oldest eviction, sampling), counted per sender.
+ *
+ * The writer never sees their sequence numbers, so SenderTable counts them
+ * in its gaps; reports subtract these counts so that "lost" is only what
+ * the network lost. Receivers count into it concurrently: an entry is
+ * claimed with a CAS and published with a release store, like SourceTable.
+ */
+class LocalDropTable {
+public:
+    LocalDropTable() : entries(new Entry[SENDER_TABLE_CAPACITY]) {}
+    
+    void add(uint32_t client_addr, uint32_t sender_id) {
+        Entry* entry = find(make_key(client_addr, sender_id), true);
+        if (entry) {
+            entry->dropped.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            untracked.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    
+    uint64_t dropped(uint32_t client_addr, uint32_t sender_id) const {
+        const Entry* entry = const_cast<LocalDropTable*>(this)->find(make_key(client_addr, sender_id), false);
+        return entry ? entry->dropped.load(std::memory_order_relaxed) : 0;
+    }
+    
+    std::atomic<uint64_t> untracked{0};  // Table full: dropped but not attributed to a sender
+    
+private:
+    static constexpr uint32_t EMPTY = 0;
+    static constexpr uint32_t FILLING = 1;
+    static constexpr uint32_t READY = 2;
+    
+    struct Entry {
+        std::atomic<uint32_t> state{EMPTY};
+        uint64_t key{0};
+        std::atomic<uint64_t> dropped{0};
+    };
+    
+    static uint64_t make_key(uint32_t client_addr, uint32_t sender_id) {
+        return (static_cast<uint64_t>(client_addr) << 32) | sender_id;
+    }
+    
+    Entry* find(uint64_t key, bool insert) {
+        size_t mask = SENDER_TABLE_CAPACITY - 1;
+        size_t index = (key * 0x9E3779B97F4A7C15ull) >> 54 & mask;
+        for (size_t probe = 0; probe < SENDER_TABLE_CAPACITY; probe++) {
+            Entry& entry = entries[(index + probe) & mask];
+            uint32_t state = entry.state.load(std::memory_order_acquire);
+            if (state == EMPTY) {
+                if (!insert || count.load(std::memory_order_relaxed) >= SENDER_TABLE_CAPACITY * 3 / 4) {
+                    return nullptr;
+                }
+                if (entry.state.compare_exchange_strong(state, FILLING, std::memory_order_acquire)) {
+                    entry.key = key;
+                    count.fetch_add(1, std::memory_order_relaxed);
+                    entry.state.store(READY, std::memory_order_release);
+                    return &entry;
+                }
+            }
+            while (state == FILLING) {
+                std::this_thread::yield();
+                state = entry.state.load(std::memory_order_acquire);
+            }
+            if (entry.key == key) return &entry;
+        }
+        return nullptr;
+    }
+    
+    std::unique_ptr<Entry[]> entries;
+    std::atomic<size_t> count{0};
+};
+
+/**
+ * Loss, duplicate and reorder accounting for framed-protocol senders.
+ *
+ * A fixed-size open-addressing table keyed by (client address, sender ID)
+ * holds, per sender, the highest sequence number seen and a bitmap of the
+ * SEQUENCE_WINDOW numbers below it. A forward jump counts the skipped
+ * numbers as lost; a late arrival inside the window that was not seen yet
+ * is reclassified from lost to reordered, and one already seen is a
+ * duplicate. Only the writer thread uses it, so it needs no locking and
+ * never allocates after construction.
+ */
+struct SenderSequence {
+    uint64_t key{0};
+    bool used{false};
+    uint32_t highest{0};
+    uint64_t window{0};  // Bit i set: sequence (highest - i) was received
+    uint64_t received{0};
+    uint64_t lost{0};
+    uint64_t duplicates{0};
+    uint64_t reordered{0};
+    uint64_t late{0};      // Older than the window; cannot tell duplicate from reorder
+    uint64_t restarts{0};
+    uint64_t local_drops_base{0};  // LocalDropTable count when this table first saw the sender
+};
+
+class SenderTable {
+public:
+    explicit SenderTable(const LocalDropTable* local_drops = nullptr)
+        : entries(SENDER_TABLE_CAPACITY), local_drops(local_drops) {}
+    
+    void record(uint32_t client_addr, uint32_t sender_id, uint32_t sequence) {
+        SenderSequence* sender = find(client_addr, sender_id);
+        if (!sender) {
+            untracked++;
+            return;
+        }
+        
+        if (sender->received == 0 && sender->lost == 0) {
+            start(*sender, sequence);
+            return;
+        }
+        
+        int32_t ahead = static_cast<int32_t>(sequence - sender->highest);
+        if (ahead > 0) {
+            if (static_cast<uint32_t>(ahead) > SEQUENCE_RESET_JUMP) {
+                sender->restarts++;
+                start(*sender, sequence);
+                return;
+            }
+            sender->window = static_cast<uint32_t>(ahead) >= SEQUENCE_WINDOW ? 0 : sender->window << ahead;
+            sender->window |= 1;
+            sender->lost += ahead - 1;
+            sender->highest = sequence;
+            sender->received++;
+            return;
+        }
+        
+        // Distance back from the highest sequence, computed unsigned so
+        // that ahead == INT32_MIN cannot overflow
+        uint32_t behind = sender->highest - sequence;
+        if (behind < SEQUENCE_WINDOW) {
+            uint64_t bit = 1ull << behind;
+            if (sender->window & bit) {
+                sender->duplicates++;
+            } else {
+                sender->window |= bit;
+                sender->reordered++;
+                sender->received++;
+                if (sender->lost > 0) sender->lost--;
+            }
+        } else if (behind > SEQUENCE_RESET_JUMP) {
+            sender->restarts++;
+            start(*sender, sequence);
+        } else {
+            sender->late++;
+            sender->received++;
+            if (sender->lost > 0) sender->lost--;
+        }
+    }
+    
+    void clear() {
+        for (auto& entry : entries) {
+            entry = SenderSequence();
+        }
+        count = 0;
+        untracked = 0;
+    }
+    
+    template <typename Fn>
+    void for_each(Fn fn) const {
+        for (const auto& entry : entries) {
+            if (entry.used) fn(entry);
+        }
+    }
+    
+    size_t size() const { return count; }
+    uint64_t untracked_datagrams() const { return untracked; }
+    
+    // Datagrams of this sender the server dropped since the table first saw it
+    uint64_t dropped_locally(const SenderSequence& sender) const {
+        if (!local_drops) return 0;
+        uint64_t dropped = local_drops->dropped(static_cast<uint32_t>(sender.key >> 32),
+                                                static_cast<uint32_t>(sender.key));
+        return dropped - std::min(dropped, sender.local_drops_base);
+    }
+    
+private:
+    static uint64_t make_key(uint32_t client_addr, uint32_t sender_id) {
+        return (static_cast<uint64_t>(client_addr) << 32) | sender_id;
+    }
+    
+    SenderSequence* find(uint32_t client_addr, uint32_t sender_id) {
+        uint64_t key = make_key(client_addr, sender_id);
+        size_t mask = entries.size() - 1;
+        size_t index = (key * 0x9E3779B97F4A7C15ull) >> 54 & mask;
+        for (size_t probe = 0; probe < entries.size(); probe++) {
+            SenderSequence& entry = entries[(index + probe) & mask];
+            if (entry.used && entry.key == key) return &entry;
+            if (!entry.used) {
+                if (count >= entries.size() * 3 / 4) return nullptr;  // Keep probes short
+                entry.used = true;
+                entry.key = key;
+                entry.local_drops_base = local_drops ? local_drops->dropped(client_addr, sender_id) : 0;
+                count++;
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+    
+    static void start(SenderSequence& sender, uint32_t sequence) {
+        sender.highest = sequence;
+        sender.window = 1;
+        sender.received++;
+    }
+    
+    std::vector<SenderSequence> entries;
+    const LocalDropTable* local_drops;
+    size_t count{0};
+    uint64_t untracked{0};
+};
+
+/**
+ * Message sources ("iOS", "JS", ...) interned for overload accounting.
+ *
+ * Receivers look sources up on every datagram, so the table is lock-free
+ * and never allocates: a new source claims an empty entry with a CAS,
+ * copies its name and publishes it with a release store; lookups that meet
+ * an entry being filled wait for it. Sources beyond SOURCE_TABLE_CAPACITY
+ * (or past 3/4 load) share the overflow entry "*". Each entry carries its
+ * sampling rate and a drop counter the writer summarizes periodically.
+ */
+struct alignas(CACHE_LINE_SIZE) SourceEntry {
+    std::atomic<uint32_t> state{0};
+    uint32_t length{0};
+    char name[SOURCE_NAME_CAPACITY];
+    unsigned int keep_every{1};          // Keep 1 in keep_every lines while sampling
+    std::atomic<uint64_t> sampled{0};    // Lines seen while sampling
+    std::atomic<uint64_t> dropped{0};
+    uint64_t dropped_reported{0};        // Writer thread only
+    
+    std::string_view source() const {
+        return std::string_view(name, length);
+    }
+};
+
+class SourceTable {
+public:
+    static constexpr uint16_t OVERFLOW_INDEX = SOURCE_TABLE_CAPACITY;
+    
+    SourceTable(const std::vector<SampleRule>& rules, unsigned int default_keep_every)
+        : rules(rules), default_keep_every(default_keep_every) {
+        SourceEntry& overflow = entries[OVERFLOW_INDEX];
+        overflow.name[0] = '*';
+        overflow.length = 1;
+        overflow.keep_every = default_keep_every;
+        overflow.state.store(READY, std::memory_order_relaxed);
+    }
+    
+    uint16_t find_or_add(std::string_view source) {
+        source = source.substr(0, SOURCE_NAME_CAPACITY);
+        uint32_t hash = 2166136261u;  // FNV-1a
+        for (char c : source) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
+        
+        size_t mask = SOURCE_TABLE_CAPACITY - 1;
+        for (size_t probe = 0; probe < SOURCE_TABLE_CAPACITY; probe++) {
+            size_t index = (hash + probe) & mask;
+            SourceEntry& entry = entries[index];
+            uint32_t state = entry.state.load(std::memory_order_acquire);
+            if (state == EMPTY) {
+                if (count.load(std::memory_order_relaxed) >= SOURCE_TABLE_CAPACITY * 3 / 4) {
+                    return OVERFLOW_INDEX;  // Keep probes short
+                }
+                if (entry.state.compare_exchange_strong(state, FILLING, std::memory_order_acquire)) {
+                    memcpy(entry.name, source.data(), source.size());
+                    entry.length = static_cast<uint32_t>(source.size());
+                    entry.keep_every = keep_every_for(source);
+                    count.fetch_add(1, std::memory_order_relaxed);
+                    entry.state.store(READY, std::memory_order_release);
+                    return static_cast<uint16_t>(index);
+                }
+            }
+            while (state == FILLING) {
+                std::this_thread::yield();
+                state = entry.state.load(std::memory_order_acquire);
+            }
+            if (entry.source() == source) {
+                return static_cast<uint16_t>(index);
+            }
+        }
+        return OVERFLOW_INDEX;
+    }
+    
+    SourceEntry& operator[](uint16_t index) {
+        return entries[index];
+    }
+    
+    // True if this line survives sampling (1 in keep_every per source)
+    bool sample(uint16_t index) {
+        SourceEntry& entry = entries[index];
+        if (entry.keep_every <= 1) return true;
+        return entry.sampled.fetch_add(1, std::memory_order_relaxed) % entry.keep_every == 0;
+    }
+    
+    template <typename Fn>
+    void for_each(Fn fn) {
+        for (auto& entry : entries) {
+            if (entry.state.load(std::memory_order_acquire) == READY) fn(entry);
+        }
+    }
+    
+private:
+    static constexpr uint32_t EMPTY = 0;
+    static constexpr uint32_t FILLING = 1;
+    static constexpr uint32_t READY = 2;
+    
+    unsigned int keep_every_for(std::string_view source) const {
+        for (const auto& rule : rules) {
+            if (rule.source == source) return rule.keep_every;
+        }
+        return default_keep_every;
+    }
+    
+    std::array<SourceEntry, SOURCE_TABLE_CAPACITY + 1> entries{};
+    std::atomic<size_t> count{0};
+    std::vector<SampleRule> rules;
+    unsigned int default_keep_every;
+};
+
+/**
+ * Writer-side reassembly of fragmented records.
+ *
+ * Fragments travel through the ring like lines, so only the writer thread
+ * touches this table and it needs no locking. Up to MAX_PENDING_MESSAGES
+ * records are assembled at once, keyed by (client address, sender ID,
+ * message ID). Buffered fragment bytes are capped at the configured limit:
+ * the oldest incomplete records are discarded to make room, as are records
+ * still incomplete after REASSEMBLY_TIMEOUT. The keys of recently finished
+ * records are remembered so that late or duplicate fragments are counted
+ * instead of starting a new record that can only time out.
+ */
+struct PendingMessage {
+    uint32_t client_addr{0};
+    uint32_t sender_id{0};
+    uint32_t message_id{0};
+    uint16_t count{0};
+    uint16_t received{0};
+    size_t bytes{0};
+    std::chrono::steady_clock::time_point started{};
+    std::chrono::system_clock::time_point received_at{};  // First fragment's arrival
+    std::vector<std::string> fragments;
+    std::vector<bool> present;
+};
+
+struct MessageKey {
+    uint32_t client_addr{0};
+    uint32_t sender_id{0};
+    uint32_t message_id{0};
+    
+    bool operator==(const MessageKey& other) const {
+        return message_id == other.message_id && sender_id == other.sender_id &&
+               client_addr == other.client_addr;
+    }
+};
+
+enum class DiscardReason {
+    Timeout,
+    MemoryLimit,
+    TableFull,
+    Shutdown
+};
+
+inline const char* discard_reason_name(DiscardReason reason) {
+    switch (reason) {
+        case DiscardReason::Timeout: return "timed out";
+        case DiscardReason::MemoryLimit: return "reassembly memory limit";
+        case DiscardReason::TableFull: return "too many messages in flight";
+        case DiscardReason::Shutdown: return "server shutdown";
+    }
+    return "unknown";
+}
+
+class ReassemblyTable {
+public:
+    explicit ReassemblyTable(size_t memory_limit) : memory_limit(memory_limit) {}
+    
+    // Adds one fragment; returns true and moves the record into complete
+    // once every fragment has arrived. Records given up on to stay within
+    // the limits are passed to discard(message, reason).
+    template <typename Discard>
+    bool add(const RecordOrigin& origin, const FragmentPosition& position, const char* data, size_t length,
+             std::chrono::system_clock::time_point received_at, PendingMessage& complete, Discard discard) {
+        MessageKey key{origin.client_addr, origin.sender_id, position.message_id};
+        size_t index = find(key);
+        if (index == pending.size()) {
+            if (recently_finished(key)) {
+                stale++;
+                return false;
+            }
+            if (pending.size() >= MAX_PENDING_MESSAGES) {
+                discard_front(DiscardReason::TableFull, discard);
+                index--;
+            }
+            pending.emplace_back();
+            PendingMessage& message = pending.back();
+            message.client_addr = key.client_addr;
+            message.sender_id = key.sender_id;
+            message.message_id = key.message_id;
+            message.count = position.count;
+            message.started = std::chrono::steady_clock::now();
+            message.received_at = received_at;
+            message.fragments.resize(position.count);
+            message.present.resize(position.count, false);
+        }
+        
+        if (pending[index].count != position.count) {
+            inconsistent++;
+            return false;
+        }
+        if (pending[index].present[position.index]) {
+            stale++;
+            return false;
+        }
+        
+        // Make room under the memory cap, oldest records first
+        while (buffered + length > memory_limit) {
+            bool self = index == 0;
+            discard_front(DiscardReason::MemoryLimit, discard);
+            if (self) return false;
+            index--;
+        }
+        
+        PendingMessage& message = pending[index];
+        message.fragments[position.index].assign(data, length);
+        message.present[position.index] = true;
+        message.received++;
+        message.bytes += length;
+        buffered += length;
+        if (message.received < message.count) {
+            return false;
+        }
+        
+        buffered -= message.bytes;
+        remember_finished(key);
+        complete = std::move(message);
+        pending.erase(pending.begin() + index);
+        completed++;
+        return true;
+    }
+    
+    // Discards records that have waited longer than REASSEMBLY_TIMEOUT
+    template <typename Discard>
+    void expire(std::chrono::steady_clock::time_point now, Discard discard) {
+        while (!pending.empty() && now - pending.front().started >= REASSEMBLY_TIMEOUT) {
+            discard_front(DiscardReason::Timeout, discard);
+        }
+    }
+    
+    // Discards everything still pending (server shutdown)
+    template <typename Discard>
+    void discard_all(Discard discard) {
+        while (!pending.empty()) {
+            discard_front(DiscardReason::Shutdown, discard);
+        }
+    }
+    
+    bool empty() const { return pending.empty(); }
+    
+    uint64_t completed{0};
+    uint64_t timed_out{0};
+    uint64_t evicted{0};       // Memory limit or too many records in flight
+    uint64_t stale{0};         // Duplicates, or fragments of already finished records
+    uint64_t inconsistent{0};  // Fragment count disagrees with earlier fragments
+    
+private:
+    size_t find(const MessageKey& key) const {
+        for (size_t i = 0; i < pending.size(); i++) {
+            const PendingMessage& message = pending[i];
+            if (MessageKey{message.client_addr, message.sender_id, message.message_id} == key) {
+                return i;
+            }
+        }
+        return pending.size();
+    }
+    
+    bool recently_finished(const MessageKey& key) const {
+        for (const auto& finished_key : finished) {
+            if (finished_key == key) return true;
+        }
+        return false;
+    }
+    
+    void remember_finished(const MessageKey& key) {
+        finished[finished_next] = key;
+        finished_next = (finished_next + 1) % finished.size();
+    }
+    
+    // Records are kept in arrival order, so the front is the oldest
+    template <typename Discard>
+    void discard_front(DiscardReason reason, Discard& discard) {
+        PendingMessage& message = pending.front();
+        if (reason == DiscardReason::Timeout) {
+            timed_out++;
+        } else if (reason != DiscardReason::Shutdown) {
+            evicted++;
+        }
+        discard(message, reason);
+        remember_finished(MessageKey{message.client_addr, message.sender_id, message.message_id});
+        buffered -= message.bytes;
+        pending.erase(pending.begin());
+    }
+    
+    std::vector<PendingMessage> pending;
+    std::array<MessageKey, MAX_PENDING_MESSAGES> finished{};
+    size_t finished_next{0};
+    size_t buffered{0};
+    size_t memory_limit;
+};
+
+/**
+ * One client's session: its own file, group-commit buffer, counters and
+ * framed-sender accounting. A session belongs to the client that sent
+ * CMD|NEW_SESSION, identified by address and sender ID, or by address
+ * and source port for plain datagrams (sender ID 0). Sessions are created, written and ended only by the writer
+ * thread, so the session table needs no locking.
+ */
+enum class SessionEndReason {
+    ClientRequest,
+    Replaced,    // The same client started a new session
+    IdleTimeout,
+    Evicted,     // Session table full; the least recently active one makes room
+    Shutdown
+};
+
+inline const char* session_end_reason_name(SessionEndReason reason) {
+    switch (reason) {
+        case SessionEndReason::ClientRequest: return "client request";
+        case SessionEndReason::Replaced: return "replaced by a new session from the same client";
+        case SessionEndReason::IdleTimeout: return "idle timeout";
+        case SessionEndReason::Evicted: return "evicted (too many sessions)";
+        case SessionEndReason::Shutdown: return "server shutdown";
+    }
+    return "unknown";
+}
+
+struct Session {
+    explicit Session(const LocalDropTable* local_drops)
+        : batch(SESSION_CHUNK_SIZE, SESSION_CHUNKS), senders(local_drops) {}
+    
+    uint32_t client_addr{0};  // IPv4, network byte order
+    uint32_t client_port{0};  // Plain clients only (RecordOrigin)
+    uint32_t sender_id{0};
+    std::string guid;
+    std::string path;
+    std::string path_stem;  // path of the first part without its extension
+    unsigned int part{1};
+    int fd{-1};
+    uint64_t file_bytes{0};  // Written to the current part
+    std::chrono::steady_clock::time_point file_opened{};
+    WriteBatch batch;
+    SenderTable senders;  // Framed-protocol senders whose lines went to this session
+    uint64_t lines_written{0};
+    uint64_t records{0};  // Last number given to a JSON or binary record
+    uint64_t kernel_drops_start{0};
+    uint64_t queue_drops_start{0};
+    std::chrono::steady_clock::time_point last_active{};
+    
+    // Sidecar index (path + LOG_INDEX_SUFFIX); entries wait here for the
+    // commit that writes their lines
+    int index_fd{-1};
+    LogIndexBuilder index;
+    char index_pending[INDEX_PENDING_ENTRIES * LOG_INDEX_ENTRY_SIZE];
+    size_t index_pending_bytes{0};
+    
+    // Term index (path + LOG_TERMS_SUFFIX); finished blocks wait in
+    // terms.output() for the next commit
+    int terms_fd{-1};
+    LogTermIndexBuilder terms;
+};
+
+/**
+ * Per-receiver socket state. Only the owning receiver thread touches it
+ * while running (the metrics thread only snapshots enqueue_latency);
+ * stop() reads it after the thread has been joined.
+ */
+struct ReceiverState {
+    unsigned int index{0};
+    int fd{-1};
+    bool local{false};  // Unix-domain socket: no peer address, lines show 127.0.0.1
+    
+    // SO_RXQ_OVFL reports a cumulative per-socket drop counter
+    uint32_t kernel_drop_counter{0};
+    uint64_t kernel_drops{0};
+    
+    // Adaptive SO_RCVBUF: bytes (plus per-datagram overhead) per burst window
+    int rcvbuf_requested{0};
+    uint64_t window_cost{0};
+    uint64_t peak_window_cost{0};
+    uint64_t drops_at_last_adjust{0};
+    std::chrono::steady_clock::time_point window_start{};
+    std::chrono::steady_clock::time_point last_adjust{};
+    std::chrono::steady_clock::time_point last_growth{};
+    
+    // Receive -> enqueue latency of this receiver's lines
+    HdrHistogram enqueue_latency;
+};
+
+// Receive -> enqueue timing on the producer threads: each records into its
+// own histogram, from the arrival of the datagram it is handling (kernel
+// receive time if there is one)
+thread_local HdrHistogram* t_enqueue_latency = nullptr;
+thread_local std::chrono::system_clock::time_point t_datagram_arrival{};
+
+inline uint64_t elapsed_ns(std::chrono::system_clock::time_point from, std::chrono::system_clock::time_point to) {
+    return to > from ? std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count() : 0;
+}
+
+// Ancillary data buffer with the alignment CMSG_* macros expect
+struct ControlBuffer {
+    alignas(struct cmsghdr) char data[CONTROL_BUFFER_SIZE];
+};
+
+class UDPLogServer {
+private:
+    ServerConfig config;
+    
+    // Server state
+    std::atomic<bool> running{false};
+    std::vector<std::unique_ptr<ReceiverState>> receivers;
+    std::string current_log_path;
+    std::string server_log_path;
+    
+    // Session management. Session commands travel through the ring as
+    // control slots, so everything below is owned by the writer thread.
+    // Sessions are kept in start order; the last one is the newest.
+    std::vector<std::unique_ptr<Session>> sessions;
+    std::chrono::steady_clock::time_point writer_now{};  // Start of the current drain pass
+    std::chrono::steady_clock::time_point last_session_reap{};
+    
+    // One-entry routing cache: the session the last looked-up sender's lines go to
+    uint32_t routed_addr{0};
+    uint32_t routed_port{0};
+    uint32_t routed_sender{0};
+    Session* routed_session{nullptr};
+    bool route_valid{false};
+    
+    // File handling: session files and current.log are plain append-mode
+    // descriptors fed by the writer's group-commit batches
+    WriteBatch write_batch;
+    std::vector<char> encode_buffer;  // One JSON or binary session record at a time
+    LocalDropTable local_drops;
+    SenderTable sender_table{&local_drops};  // Framed-protocol senders seen since startup
+    ReassemblyTable reassembly;
+    
+    // Per-source overload accounting; the summary cursor is writer-only
+    SourceTable sources;
+    uint16_t fragment_source;  // Drops of fragments are reported under "(fragment)"
+    uint64_t drops_summarized{0};
+    std::chrono::steady_clock::time_point last_drop_summary{};
+    
+    // Lock-free handoff from receivers to the writer. The writer only needs
+    // a wakeup when it has drained the ring and parked itself.
+    LogRing ring;
+    Doorbell writer_doorbell;
+    std::atomic<bool> writer_parked{false};
+    std::atomic<bool> receivers_stopped{false};
+    
+    // Threads
+    std::vector<std::thread> receiver_threads;
+    std::thread writer_thread;
+    std::thread shm_thread;
+    
+    // I/O engine actually in use (io_uring only if the kernel supports it).
+    // With io_uring the writer submits its commits through its own ring.
+    IoEngine io_engine{IoEngine::Syscalls};
+#ifdef HAVE_IO_URING
+    std::unique_ptr<IoUring> writer_uring;
+#endif
+    
+    // Shared-memory ingest ring (--shm); the reader thread is its only consumer
+    ShmRingHeader* shm_ring{nullptr};
+    size_t shm_ring_bytes{0};
+    
+    // Shared "HH:MM:SS" cache for line timestamps (lock-free for readers)
+    TimestampCache timestamp_cache;
+    
+    // Statistics
+    std::atomic<uint64_t> messages_received{0};
+    std::atomic<uint64_t> bytes_received{0};
+    std::atomic<uint64_t> sessions_created{0};
+    std::atomic<uint64_t> queue_full_drops{0};  // All overload drops, any policy
+    std::atomic<uint64_t> evicted_lines{0};
+    std::atomic<uint64_t> sampled_lines{0};
+    std::atomic<uint64_t> kernel_drops{0};
+    std::atomic<uint64_t> framed_datagrams{0};
+    std::atomic<uint64_t> malformed_frames{0};
+    std::atomic<uint64_t> fragments_received{0};
+    std::atomic<uint64_t> batched_datagrams{0};
+    std::atomic<uint64_t> missing_kernel_timestamps{0};
+    std::atomic<uint64_t> shm_datagrams{0};
+    std::atomic<uint64_t> shm_abandoned{0};
+    std::atomic<uint64_t> shm_parks{0};
+    std::atomic<uint64_t> rcvbuf_adjustments{0};
+    std::atomic<uint64_t> writer_wakeups{0};
+    std::atomic<uint64_t> commits{0};
+    std::atomic<uint64_t> lines_written{0};
+    std::atomic<uint64_t> failed_lines{0};  // Lines a write error kept out of current.log or a session file
+    std::atomic<uint64_t> write_syscalls{0};
+    std::atomic<uint64_t> active_sessions{0};
+    
+    // Stage latencies in ns (log_metrics.h). Receive -> enqueue lives in
+    // each ReceiverState (and shm_enqueue_latency); the rest are recorded by
+    // the writer: queue wait until it takes a line, and from then until the
+    // commit holding the line has been written, plus each commit's write
+    // time and line count.
+    HdrHistogram shm_enqueue_latency;
+    HdrHistogram queue_latency;
+    HdrHistogram flush_latency;
+    HdrHistogram commit_latency;
+    HdrHistogram commit_lines;
+    
+    // Writer passes with lines in the pending commit: when each pass took its
+    // first line, and how many it appended (writer-only)
+    struct PassLines {
+        std::chrono::system_clock::time_point taken_at;
+        uint64_t lines;
+    };
+    std::array<PassLines, COMMIT_PASS_GROUPS> pending_passes{};
+    size_t pending_pass_count{0};
+    uint64_t writer_pass{0};
+    uint64_t pending_pass_id{0};
+    
+    // Metrics endpoint and server.log summaries
+    std::thread metrics_thread;
+    int metrics_fd{-1};
+    
+    // Extra outputs (--sink); the writer pushes each commit to all of them
+    std::vector<std::unique_ptr<SinkRunner>> sinks;
+    
+    // Files closed by rotation or session end go to the compressor
+    // (--compress); the writer only hands over their paths
+    std::unique_ptr<LogCompressor> compressor;
+    std::atomic<uint64_t> rotations{0};
+    
+    // Batched receive statistics: receive calls and datagrams per call (log2 buckets)
+    std::atomic<uint64_t> recv_calls{0};
+    std::atomic<uint64_t> recv_datagrams{0};
+    std::array<std::atomic<uint64_t>, BATCH_HISTOGRAM_BUCKETS> batch_histogram{};
+    
+private:
+    // Server log for tracking server events
+    std::ofstream server_log;
+    int current_log_fd{-1};
+    uint64_t current_log_bytes{0};  // Written since it was opened
+    std::chrono::steady_clock::time_point current_log_opened{};
+    std::unique_ptr<LogFileWatcher> current_log_watcher;
+    std::atomic<uint64_t> current_log_reopens{0};
+    std::mutex server_log_mutex;  // The metrics thread writes summaries
+    
+    void log_server_event(const std::string& event) {
+        std::lock_guard<std::mutex> lock(server_log_mutex);
+        auto now = std::chrono::system_clock::now();
+        auto time_t = std::chrono::system_clock::to_time_t(now);
+        
+        if (!server_log.is_open()) {
+            server_log.open(server_log_path, std::ios::out | std::ios::app);
+        }
+        
+        server_log << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S") 
+                   << " | " << event << std::endl;
+        server_log.flush();
+    }
+    
+public:
+    explicit UDPLogServer(const ServerConfig& cfg = ServerConfig())
+        : config(cfg), reassembly(cfg.reassembly_memory), sources(cfg.sample_rules, cfg.sample_default),
+          fragment_source(sources.find_or_add("(fragment)")), ring(cfg.queue_slots) {
+        current_log_path = config.log_dir + "/" + CURRENT_LOG;
+        server_log_path = config.log_dir + "/" + SERVER_LOG;
+        
+        // Create log directory if it doesn't exist
+        std::filesystem::create_directories(config.log_dir);
+        
+        // Open server log
+        server_log.open(server_log_path, std::ios::out | std::ios::app);
+        log_server_event("Server instance created");
+        
+        // Open current.log for immediate writing
+        current_log_fd = open(current_log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        current_log_opened = std::chrono::steady_clock::now();
+        current_log_watcher = std::make_unique<LogFileWatcher>(config.log_dir, CURRENT_LOG);
+        std::ostringstream header;
+        header << "=== UDP Log Server Started ===" << std::endl;
+        header << "Timestamp: " << get_timestamp() << std::endl;
+        header << "Waiting for messages on port " << config.port << std::endl;
+        header << "==============================" << std::endl;
+        write_current_log(header.str());
+    }
+    
+    ~UDPLogServer() {
+        log_server_event("Server instance destroyed");
+        {
+            std::lock_guard<std::mutex> lock(server_log_mutex);
+            if (server_log.is_open()) {
+                server_log.close();
+            }
+        }
+        if (current_log_fd >= 0) {
+            close(current_log_fd);
+            current_log_fd = -1;
+        }
+        stop();
+    }
+    
+    bool start() {
+        // One socket per receiver thread; with several receivers the kernel
+        // spreads clients across them by flow hash (SO_REUSEPORT)
+        for (unsigned int i = 0; i < config.receivers; i++) {
+            auto receiver = std::make_unique<ReceiverState>();
+            receiver->index = i;
+            receiver->fd = open_socket(config.receivers > 1);
+            if (receiver->fd < 0) {
+                close_sockets();
+                return false;
+            }
+            set_receive_buffer(*receiver, config.rcvbuf_min);
+            receiver->window_start = receiver->last_adjust = std::chrono::steady_clock::now();
+            receivers.push_back(std::move(receiver));
+        }
+        if (!config.unix_path.empty()) {
+            auto receiver = std::make_unique<ReceiverState>();
+            receiver->index = static_cast<unsigned int>(receivers.size());
+            receiver->local = true;
+            receiver->fd = open_unix_socket();
+            if (receiver->fd < 0) {
+                close_sockets();
+                return false;
+            }
+            set_receive_buffer(*receiver, config.rcvbuf_min);
+            receiver->window_start = receiver->last_adjust = std::chrono::steady_clock::now();
+            receivers.push_back(std::move(receiver));
+        }
+        if (!config.shm_name.empty() && !create_shm_ring()) {
+            close_sockets();
+            return false;
+        }
+        if (config.metrics_port > 0 && (metrics_fd = open_metrics_socket()) < 0) {
+            close_sockets();
+            close_shm_ring();
+            return false;
+        }
+        if (!start_sinks()) {
+            close_sockets();
+            close_shm_ring();
+            if (metrics_fd >= 0) {
+                close(metrics_fd);
+                metrics_fd = -1;
+            }
+            return false;
+        }
+        io_engine = resolve_io_engine();
+        
+        running = true;
+        receivers_stopped = false;
+        
+        // Start worker threads
+        for (auto& receiver : receivers) {
+            receiver_threads.emplace_back(&UDPLogServer::receive_loop, this, receiver.get());
+        }
+        if (shm_ring) {
+            shm_thread = std::thread(&UDPLogServer::shm_loop, this);
+        }
+        if (config.compress) {
+            compressor = std::make_unique<LogCompressor>();
+            compressor->start();
+        }
+        writer_thread = std::thread(&UDPLogServer::write_loop, this);
+        if (metrics_fd >= 0 || config.stats_interval_seconds > 0) {
+            metrics_thread = std::thread(&UDPLogServer::metrics_loop, this);
+        }
+        
+        std::cout << "UDP Log Server started on port " << config.port << std::endl;
+        std::cout << "Log directory: " << config.log_dir << std::endl;
+        if (!config.unix_path.empty()) {
+            std::cout << "Unix datagram socket: " << config.unix_path << std::endl;
+        }
+        if (shm_ring) {
+            std::cout << "Shared-memory ring: " << config.shm_name << " (" << config.shm_slots << " slots, "
+                      << shm_ring_bytes / 1024 << " KB)" << std::endl;
+        }
+        if (config.receivers > 1) {
+            std::cout << "Receiver threads: " << config.receivers << " (SO_REUSEPORT)" << std::endl;
+        }
+        if (io_engine == IoEngine::Uring) {
+            std::cout << "I/O engine: io_uring (multishot recvmsg into " << URING_RECV_BUFFERS
+                      << " provided buffers per receiver, batched writes)" << std::endl;
+        } else if (config.recv_batch > 1) {
+            std::cout << "Batched receive: up to " << config.recv_batch << " datagrams per recvmmsg()" << std::endl;
+        }
+#ifdef HAVE_KERNEL_TIMESTAMPS
+        if (config.timestamps == TimestampSource::Kernel) {
+            std::cout << "Line timestamps: kernel receive time (" << KERNEL_TIMESTAMP_NAME << ")" << std::endl;
+        }
+#endif
+        std::cout << "Queue: " << ring.capacity() << " lines ("
+                  << ring.capacity() * sizeof(LogSlot) / 1024 << " KB), overload policy "
+                  << overload_policy_name(config.overload_policy) << std::endl;
+        if (config.session_idle_seconds > 0) {
+            std::cout << "Sessions: one per client, up to " << MAX_SESSIONS << ", ended after "
+                      << config.session_idle_seconds << " s idle" << std::endl;
+        } else {
+            std::cout << "Sessions: one per client, up to " << MAX_SESSIONS << std::endl;
+        }
+        if (config.session_format != LogFormat::Text) {
+            std::cout << "Session format: " << log_format_name(config.session_format)
+                      << " (no session index or term index)" << std::endl;
+        } else if (config.index_lines > 0 || config.index_ms > 0) {
+            std::cout << "Session index: an entry every " << config.index_lines << " lines or "
+                      << config.index_ms << " ms (0 = off)" << std::endl;
+        }
+        if (config.term_block_lines > 0 && config.session_format == LogFormat::Text) {
+            std::cout << "Term index: Bloom filters and postings per " << config.term_block_lines
+                      << "-line block" << std::endl;
+        }
+        for (auto& sink : sinks) {
+            std::cout << "Sink: " << sink->name() << " (" << config.sink_queue_bytes / 1024 << " KB queue)"
+                      << std::endl;
+        }
+        if (config.rotate_bytes > 0 || config.rotate_seconds > 0) {
+            std::cout << "Rotation: current.log and session files at ";
+            if (config.rotate_bytes > 0) std::cout << config.rotate_bytes << " bytes";
+            if (config.rotate_bytes > 0 && config.rotate_seconds > 0) std::cout << " or ";
+            if (config.rotate_seconds > 0) std::cout << config.rotate_seconds << " s";
+            std::cout << std::endl;
+        }
+        if (compressor) {
+            std::cout << "Compression: closed files to " << LOG_COMPRESSED_SUFFIX << " ("
+                      << LOG_COMPRESS_BLOCK_SIZE / 1024 << " KB blocks) on an idle-priority thread" << std::endl;
+        }
+        if (metrics_fd >= 0) {
+            std::cout << "Metrics: http://127.0.0.1:" << config.metrics_port << "/metrics" << std::endl;
+        }
+        if (config.stats_interval_seconds > 0) {
+            std::cout << "Stats summary: every " << config.stats_interval_seconds << " s in " << SERVER_LOG
+                      << std::endl;
+        }
+        std::cout << "Waiting for NEW_SESSION command..." << std::endl;
+        std::cout << "Press Ctrl+C to stop server" << std::endl;
+        
+        return true;
+    }
+    
+    void stop() {
+        if (!running) return;
+        
+        std::cout << "\nStopping server..." << std::endl;
+        running = false;
+        if (metrics_thread.joinable()) {
+            metrics_thread.join();
+        }
+        if (metrics_fd >= 0) {
+            close(metrics_fd);
+            metrics_fd = -1;
+        }
+        
+        // Wait for threads to finish; the writer drains the ring once
+        // every receiver has stopped producing
+        for (auto& thread : receiver_threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+        receiver_threads.clear();
+        if (shm_thread.joinable()) {
+            shm_thread.join();
+        }
+        
+        // End every open session after the last queued line
+        enqueue_control(SlotKind::EndAllSessions);
+        receivers_stopped = true;
+        writer_doorbell.ring();
+        if (writer_thread.joinable()) {
+            writer_thread.join();
+        }
+        stop_sinks();
+        if (compressor) {
+            if (compressor->queued > 0) {
+                std::cout << "Compressing " << compressor->queued << " closed log files..." << std::endl;
+            }
+            compressor->stop();
+        }
+        
+        std::cout << "Server stopped. Statistics:" << std::endl;
+        std::cout << "  Total sessions: " << sessions_created << std::endl;
+        std::cout << "  Messages received: " << messages_received << std::endl;
+        std::cout << "  Bytes received: " << bytes_received << std::endl;
+#ifdef SO_RXQ_OVFL
+        std::cout << "  Dropped (kernel socket buffer): " << kernel_drops << std::endl;
+#else
+        std::cout << "  Dropped (kernel socket buffer): not reported on this platform" << std::endl;
+#endif
+        std::cout << "  Dropped (queue overload, " << overload_policy_name(config.overload_policy) << "): "
+                  << queue_full_drops << " (" << evicted_lines << " evicted, " << sampled_lines
+                  << " sampled out)" << std::endl;
+        std::cout << "  Framed datagrams: " << framed_datagrams
+                  << " (" << malformed_frames << " malformed)" << std::endl;
+        if (batched_datagrams > 0) {
+            std::cout << "  Batched datagrams: " << batched_datagrams << std::endl;
+        }
+        if (shm_ring) {
+            std::cout << "  Shared-memory ring: " << shm_datagrams << " datagrams, "
+                      << shm_ring->dropped.load() << " dropped (ring full), " << shm_abandoned
+                      << " abandoned slots, " << shm_parks << " reader parks, "
+                      << shm_ring->wakeups.load() << " producer wakeups" << std::endl;
+        }
+        if (fragments_received > 0) {
+            std::cout << "  Fragmented records: " << reassembly.completed << " reassembled from "
+                      << fragments_received << " fragments, " << reassembly.timed_out << " timed out, "
+                      << reassembly.evicted << " evicted, " << reassembly.stale << " stale fragments"
+                      << std::endl;
+        }
+        if (config.timestamps == TimestampSource::Kernel) {
+            std::cout << "  Datagrams without a kernel timestamp: " << missing_kernel_timestamps << std::endl;
+        }
+        std::cout << "  Writer wakeups: " << writer_wakeups << std::endl;
+        uint64_t messages = messages_received;
+        if (messages > 0) {
+            std::cout << "  Syscalls per 10k messages (" << io_engine_name(io_engine) << "): "
+                      << std::fixed << std::setprecision(1) << recv_calls * 10000.0 / messages << " receive, "
+                      << write_syscalls * 10000.0 / messages << " write" << std::endl;
+            std::cout.unsetf(std::ios::floatfield);
+        }
+        std::cout << "  Group commits: " << commits << " (" << lines_written << " lines, "
+                  << write_syscalls << " write syscalls";
+        if (lines_written > 0) {
+            std::cout << ", " << std::fixed << std::setprecision(4)
+                      << static_cast<double>(write_syscalls) / lines_written << " per line";
+            std::cout.unsetf(std::ios::floatfield);
+        }
+        std::cout << ")" << std::endl;
+        if (failed_lines > 0) {
+            std::cout << "  Lines lost to write errors: " << failed_lines << std::endl;
+        }
+        auto sample = std::make_unique<MetricsSample>();
+        sample_metrics(*sample);
+        std::string latency;
+        append_stage_summary(latency, "receive->enqueue", sample->enqueue);
+        append_stage_summary(latency, "enqueue->write", sample->queue);
+        append_stage_summary(latency, "write->flush", sample->flush);
+        append_stage_summary(latency, "commit write", sample->commit);
+        std::cout << "  Latency: " << latency.substr(2) << std::endl;
+        std::cout << "  current.log reopens: " << current_log_reopens << std::endl;
+        if (config.rotate_bytes > 0 || config.rotate_seconds > 0) {
+            std::cout << "  Rotations: " << rotations << std::endl;
+        }
+        if (compressor) {
+            uint64_t in = compressor->bytes_in;
+            std::cout << "  Compressed: " << compressor->files << " files, " << in << " -> " << compressor->bytes_out
+                      << " bytes";
+            if (in > 0) {
+                std::cout << " (" << std::fixed << std::setprecision(1)
+                          << 100.0 * compressor->bytes_out / in << "%)";
+                std::cout.unsetf(std::ios::floatfield);
+            }
+            std::cout << ", " << compressor->failures << " failed" << std::endl;
+        }
+        print_sink_statistics();
+        uint64_t allocations = g_hot_path_allocations;
+        std::cout << "  Heap allocations (receive/write path): " << allocations;
+        if (recv_datagrams > 0) {
+            std::cout << " (" << std::fixed << std::setprecision(3)
+                      << static_cast<double>(allocations) / recv_datagrams << " per datagram)";
+            std::cout.unsetf(std::ios::floatfield);
+        }
+        std::cout << std::endl;
+        std::cout << "  Timestamp cache refreshes: " << timestamp_cache.refreshes() << std::endl;
+        print_batch_statistics();
+        print_receive_buffer_statistics();
+        write_sender_report(std::cout, sender_table);
+        
+        // Close sockets
+        close_sockets();
+        close_shm_ring();
+    }
+    
+    bool is_running() const {
+        return running;
+    }
+    
+private:
+    int open_socket(bool reuse_port) {
+        // Create UDP socket
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
+            return -1;
+        }
+        
+        // Allow socket reuse
+        int reuse = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
+            std::cerr << "Failed to set SO_REUSEADDR: " << strerror(errno) << std::endl;
+            close(fd);
+            return -1;
+        }
+        
+#ifdef HAVE_REUSEPORT_BALANCING
+        if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+            std::cerr << "Failed to set SO_REUSEPORT: " << strerror(errno) << std::endl;
+            close(fd);
+            return -1;
+        }
+#else
+        (void)reuse_port;
+#endif
+        
+        // Bind to port
+        struct sockaddr_in server_addr{};
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_addr.s_addr = INADDR_ANY;
+        server_addr.sin_port = htons(config.port);
+        
+        if (bind(fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+            std::cerr << "Failed to bind to port " << config.port << ": " << strerror(errno) << std::endl;
+            close(fd);
+            return -1;
+        }
+        
+        configure_receive_socket(fd);
+        return fd;
+    }
+    
+    // Local producers reach the same receive path through a Unix-domain
+    // datagram socket. Unlike UDP, a full socket blocks the sender instead
+    // of dropping datagrams.
+    int open_unix_socket() {
+        struct sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (config.unix_path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "Unix socket path too long: " << config.unix_path << std::endl;
+            return -1;
+        }
+        memcpy(addr.sun_path, config.unix_path.c_str(), config.unix_path.size() + 1);
+        
+        // Remove a socket left behind by an earlier run, but nothing else
+        struct stat info;
+        if (lstat(addr.sun_path, &info) == 0) {
+            if (!S_ISSOCK(info.st_mode)) {
+                std::cerr << config.unix_path << " exists and is not a socket" << std::endl;
+                return -1;
+            }
+            unlink(addr.sun_path);
+        }
+        
+        int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            std::cerr << "Failed to create Unix socket: " << strerror(errno) << std::endl;
+            return -1;
+        }
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            std::cerr << "Failed to bind " << config.unix_path << ": " << strerror(errno) << std::endl;
+            close(fd);
+            return -1;
+        }
+        
+        configure_receive_socket(fd);
+        return fd;
+    }
+    
+    void configure_receive_socket(int fd) {
+        // Set receive timeout to allow periodic checking of running flag
+        struct timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = 100000; // 100ms timeout
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        
+#ifdef SO_RXQ_OVFL
+        // Ask the kernel to attach its socket-buffer overflow counter to
+        // every datagram so drops before recvmsg() become visible
+        int enable = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable)) < 0) {
+            std::cerr << "Failed to set SO_RXQ_OVFL: " << strerror(errno) << std::endl;
+        }
+#endif
+        
+#ifdef HAVE_KERNEL_TIMESTAMPS
+        // Stamp each datagram when the kernel queues it, so line times are
+        // not skewed by how long it waited for a receiver thread
+        if (config.timestamps == TimestampSource::Kernel) {
+            int timestamps = 1;
+            if (setsockopt(fd, SOL_SOCKET, KERNEL_TIMESTAMP_OPTION, &timestamps, sizeof(timestamps)) < 0) {
+                std::cerr << "Failed to set " << KERNEL_TIMESTAMP_NAME << ": " << strerror(errno) << std::endl;
+            }
+        }
+#endif
+    }
+    
+    void close_sockets() {
+        for (auto& receiver : receivers) {
+            close(receiver->fd);
+            if (receiver->local) {
+                unlink(config.unix_path.c_str());
+            }
+        }
+        receivers.clear();
+    }
+    
+    // Creates the shared-memory object and initializes the ring; producers
+    // refuse to map it until the magic is stored. An object left behind by a
+    // server that is gone is replaced; one whose owner is alive is not.
+    bool create_shm_ring() {
+        int fd = shm_open(config.shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno == EEXIST) {
+            pid_t owner = shm_ring_owner(config.shm_name.c_str());
+            if (owner > 0) {
+                std::cerr << "Shared memory " << config.shm_name << " is in use by process " << owner
+                          << "; not taking it over" << std::endl;
+                return false;
+            }
+            shm_unlink(config.shm_name.c_str());
+            fd = shm_open(config.shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        }
+        if (fd < 0) {
+            std::cerr << "Failed to create shared memory " << config.shm_name << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        size_t bytes = shm_ring_size(config.shm_slots);
+        void* mapping = MAP_FAILED;
+        if (ftruncate(fd, static_cast<off_t>(bytes)) == 0) {
+            mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Failed to map shared memory " << config.shm_name << ": " << strerror(errno) << std::endl;
+            shm_unlink(config.shm_name.c_str());
+            return false;
+        }
+        
+        auto* header = new (mapping) ShmRingHeader();
+        header->version = SHM_RING_VERSION;
+        header->slot_size = sizeof(ShmSlot);
+        header->capacity = config.shm_slots;
+        header->owner_pid = static_cast<int32_t>(getpid());
+        ShmSlot* slots = shm_ring_slots(header);
+        for (uint32_t i = 0; i < config.shm_slots; i++) {
+            new (&slots[i]) ShmSlot();
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        header->magic.store(SHM_RING_MAGIC, std::memory_order_release);
+        
+        shm_ring = header;
+        shm_ring_bytes = bytes;
+        return true;
+    }
+    
+    // The live server holding an existing ring, or 0 if its owner is gone or
+    // it is not a ring of this layout
+    static pid_t shm_ring_owner(const char* name) {
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0) return 0;
+        struct stat info;
+        void* mapping = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(ShmRingHeader)) {
+            mapping = mmap(nullptr, sizeof(ShmRingHeader), PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (mapping == MAP_FAILED) return 0;
+        
+        auto* header = static_cast<const ShmRingHeader*>(mapping);
+        pid_t owner = 0;
+        if (header->magic.load(std::memory_order_acquire) == SHM_RING_MAGIC &&
+            header->version == SHM_RING_VERSION && header->owner_pid > 0) {
+            owner = header->owner_pid;
+        }
+        munmap(mapping, sizeof(ShmRingHeader));
+        if (owner > 0 && kill(owner, 0) != 0 && errno == ESRCH) {
+            owner = 0;
+        }
+        return owner;
+    }
+    
+    // Producers that still have the ring mapped keep their mapping; new
+    // ones can no longer open it
+    void close_shm_ring() {
+        if (!shm_ring) return;
+        munmap(shm_ring, shm_ring_bytes);
+        shm_unlink(config.shm_name.c_str());
+        shm_ring = nullptr;
+    }
+    
+    // A sink that cannot be opened fails startup, except a TCP forwarder,
+    // which keeps retrying from its own thread
+    bool start_sinks() {
+        for (const auto& spec : config.sinks) {
+            auto sink = make_sink(spec, config.sink_queue_bytes);
+            std::string error;
+            if (!sink->start(error)) {
+                std::cerr << "Sink " << sink->name() << ": " << error << std::endl;
+                stop_sinks();
+                return false;
+            }
+            if (!error.empty()) {
+                std::cerr << "Sink " << sink->name() << ": " << error << " (retrying)" << std::endl;
+            }
+            sinks.push_back(std::move(sink));
+        }
+        return true;
+    }
+    
+    // Each sink writes out what it has queued before its thread exits
+    void stop_sinks() {
+        for (auto& sink : sinks) {
+            sink->stop();
+        }
+    }
+    
+    void print_sink_statistics() {
+        for (auto& sink : sinks) {
+            std::cout << "  Sink " << sink->name() << ": " << sink->queued_lines << " lines queued, "
+                      << sink->written_bytes << " bytes written, " << sink->dropped_lines
+                      << " lines dropped (queue full), " << sink->lost_bytes << " bytes lost ("
+                      << sink->write_errors << " write errors), " << sink->reopens << " reopens" << std::endl;
+        }
+    }
+    
+    // The metrics endpoint is for local scrapers only: it listens on the
+    // loopback address, never on INADDR_ANY
+    int open_metrics_socket() {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            std::cerr << "Failed to create metrics socket: " << strerror(errno) << std::endl;
+            return -1;
+        }
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        
+        struct sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(config.metrics_port);
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+            std::cerr << "Failed to listen on 127.0.0.1:" << config.metrics_port << " for metrics: "
+                      << strerror(errno) << std::endl;
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    
+    // io_uring only if it was asked for and the kernel can create a ring
+    // with the opcodes the engine uses
+    IoEngine resolve_io_engine() {
+        if (config.io_engine != IoEngine::Uring) {
+            return IoEngine::Syscalls;
+        }
+#ifdef HAVE_IO_URING
+        IoUring probe;
+        if (!probe.init(2)) {
+            std::cerr << "io_uring unavailable (" << strerror(errno) << "), using the syscall engine" << std::endl;
+            return IoEngine::Syscalls;
+        }
+        if (!probe.supports({IORING_OP_RECVMSG, IORING_OP_WRITEV})) {
+            std::cerr << "io_uring lacks recvmsg/writev support, using the syscall engine" << std::endl;
+            return IoEngine::Syscalls;
+        }
+        return IoEngine::Uring;
+#else
+        std::cerr << "io_uring not available on this platform, using the syscall engine" << std::endl;
+        return IoEngine::Syscalls;
+#endif
+    }
+    
+    // Requests a receive buffer size; SO_RCVBUFFORCE (privileged) may exceed
+    // net.core.rmem_max, plain SO_RCVBUF is capped by it
+    void set_receive_buffer(ReceiverState& receiver, int bytes) {
+#ifdef SO_RCVBUFFORCE
+        if (setsockopt(receiver.fd, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof(bytes)) < 0)
+#endif
+        {
+            setsockopt(receiver.fd, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+        }
+        receiver.rcvbuf_requested = bytes;
+    }
+    
+    static int actual_receive_buffer(int fd) {
+        int size = 0;
+        socklen_t length = sizeof(size);
+        getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, &length);
+        return size;
+    }
+    
+    void print_receive_buffer_statistics() {
+        std::cout << "  Receive buffers (SO_RCVBUF, " << rcvbuf_adjustments << " adjustments):" << std::endl;
+        for (auto& receiver : receivers) {
+            std::cout << "    " << (receiver->local ? "unix receiver " : "receiver ") << receiver->index
+                      << ": requested " << receiver->rcvbuf_requested
+                      << ", kernel " << actual_receive_buffer(receiver->fd)
+                      << ", drops " << receiver->kernel_drops << std::endl;
+        }
+    }
+    
+    // Reads the SO_RXQ_OVFL counter and the kernel receive timestamp (left
+    // untouched if absent) from a received datagram's ancillary data
+    void process_control_data(ReceiverState& receiver, struct msghdr& msg,
+                              std::chrono::system_clock::time_point& received_at) {
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET) continue;
+#if defined(SO_TIMESTAMPNS)
+            if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                struct timespec ts;
+                memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                received_at = std::chrono::system_clock::time_point(std::chrono::duration_cast<
+                    std::chrono::system_clock::duration>(std::chrono::seconds(ts.tv_sec) +
+                                                         std::chrono::nanoseconds(ts.tv_nsec)));
+                continue;
+            }
+#elif defined(SO_TIMESTAMP)
+            if (cmsg->cmsg_type == SCM_TIMESTAMP) {
+                struct timeval tv;
+                memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+                received_at = std::chrono::system_clock::time_point(std::chrono::duration_cast<
+                    std::chrono::system_clock::duration>(std::chrono::seconds(tv.tv_sec) +
+                                                         std::chrono::microseconds(tv.tv_usec)));
+                continue;
+            }
+#endif
+#ifdef SO_RXQ_OVFL
+            if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+                uint32_t counter;
+                memcpy(&counter, CMSG_DATA(cmsg), sizeof(counter));
+                uint32_t delta = counter - receiver.kernel_drop_counter;
+                if (delta > 0 && delta < (1u << 31)) {
+                    receiver.kernel_drop_counter = counter;
+                    receiver.kernel_drops += delta;
+                    kernel_drops.fetch_add(delta, std::memory_order_relaxed);
+                }
+            }
+#else
+            (void)receiver;
+#endif
+        }
+    }
+    
+    // Tracks the busiest BURST_WINDOW and, once per RCVBUF_ADJUST_INTERVAL,
+    // grows SO_RCVBUF (within the configured limits) so the socket can hold
+    // two such bursts, or doubles it if the kernel dropped datagrams
+    void track_receive_burst(ReceiverState& receiver, unsigned int datagrams, size_t bytes) {
+        auto now = std::chrono::steady_clock::now();
+        receiver.window_cost += bytes + datagrams * RCVBUF_DATAGRAM_OVERHEAD;
+        if (now - receiver.window_start < BURST_WINDOW) {
+            return;
+        }
+        receiver.peak_window_cost = std::max(receiver.peak_window_cost, receiver.window_cost);
+        receiver.window_cost = 0;
+        receiver.window_start = now;
+        
+        if (now - receiver.last_adjust < RCVBUF_ADJUST_INTERVAL) {
+            return;
+        }
+        
+        // Small increments are not worth a setsockopt(): grow by at least
+        // RCVBUF_MIN_GROWTH_PERCENT (up to the ceiling), and only after the
+        // cooldown unless the kernel has dropped datagrams meanwhile
+        uint64_t current = static_cast<uint64_t>(receiver.rcvbuf_requested);
+        bool dropping = receiver.kernel_drops > receiver.drops_at_last_adjust;
+        uint64_t target = receiver.peak_window_cost * 2;
+        if (dropping) {
+            target = std::max<uint64_t>(target, current * 2);
+        }
+        bool grow = target > current && (dropping || now - receiver.last_growth >= RCVBUF_GROWTH_COOLDOWN);
+        target = std::max<uint64_t>(target, current + current * RCVBUF_MIN_GROWTH_PERCENT / 100);
+        target = std::min<uint64_t>(target, config.rcvbuf_max);
+        
+        if (grow && target > current) {
+            AllocationCountPause pause;
+            set_receive_buffer(receiver, static_cast<int>(target));
+            rcvbuf_adjustments.fetch_add(1, std::memory_order_relaxed);
+            receiver.last_growth = now;
+            std::ostringstream event;
+            event << "Receiver " << receiver.index << ": SO_RCVBUF grown to " << target
+                  << " bytes (peak burst " << receiver.peak_window_cost << " bytes/"
+                  << BURST_WINDOW.count() << " ms, kernel drops " << receiver.kernel_drops << ")";
+            log_server_event(event.str());
+        }
+        
+        receiver.peak_window_cost = 0;
+        receiver.drops_at_last_adjust = receiver.kernel_drops;
+        receiver.last_adjust = now;
+    }
+    
+    std::string generate_guid() {
+        std::random_device rd;
+        std::mt19937 gen(rd());
+        std::uniform_int_distribution<> dis(0, 15);
+        
+        const char* hex_chars = "0123456789abcdef";
+        std::string guid;
+        
+        for (int i = 0; i < 32; i++) {
+            if (i == 8 || i == 12 || i == 16 || i == 20) {
+                guid += '-';
+            }
+            guid += hex_chars[dis(gen)];
+        }
+        
+        return guid;
+    }
+    
+    // Runs on the writer thread when a NewSession control slot is drained.
+    // A client that already has a session gets a fresh one; other clients'
+    // sessions are left alone unless the table is full.
+    void start_new_session(const RecordOrigin& origin) {
+        Session* previous = find_own_session(origin.client_addr, origin.client_port, origin.sender_id);
+        if (previous) {
+            end_session(previous, SessionEndReason::Replaced);
+        } else if (sessions.size() >= MAX_SESSIONS) {
+            auto idlest = std::min_element(sessions.begin(), sessions.end(),
+                [](const std::unique_ptr<Session>& a, const std::unique_ptr<Session>& b) {
+                    return a->last_active < b->last_active;
+                });
+            end_session(idlest->get(), SessionEndReason::Evicted);
+        }
+        
+        auto session = std::make_unique<Session>(&local_drops);
+        session->client_addr = origin.client_addr;
+        session->client_port = origin.client_port;
+        session->sender_id = origin.sender_id;
+        session->guid = generate_guid();
+        session->last_active = std::chrono::steady_clock::now();
+        sessions_created++;
+        
+        // Create new log file
+        auto now = std::chrono::system_clock::now();
+        auto time_t = std::chrono::system_clock::to_time_t(now);
+        struct tm* tm_info = std::localtime(&time_t);
+        
+        std::ostringstream filename;
+        filename << config.log_dir << "/session_";
+        filename << std::put_time(tm_info, "%Y%m%d_%H%M%S");
+        filename << "_" << session->guid.substr(0, 8);
+        
+        session->path_stem = filename.str();
+        session->path = session->path_stem + log_format_extension(config.session_format);
+        link_unified_stream(session->path);
+        
+        // Open new log file
+        open_session_file(*session);
+        session->kernel_drops_start = kernel_drops;
+        session->queue_drops_start = queue_full_drops;
+        
+        // Write header
+        std::ostringstream header;
+        header << "========================================" << std::endl;
+        header << "UDP Log Session Started" << std::endl;
+        header << "Session ID: " << session->guid << std::endl;
+        header << "Client: " << describe_client(*session) << std::endl;
+        header << "Time: " << std::put_time(tm_info, "%Y-%m-%d %H:%M:%S") << std::endl;
+        header << "Port: " << config.port << std::endl;
+        header << "Line timestamps: "
+               << (config.timestamps == TimestampSource::Kernel ? "kernel receive time" : "server clock at processing")
+               << std::endl;
+        header << "========================================" << std::endl;
+        header << std::endl;
+        if (session->fd >= 0) {
+            write_session_text(*session, header.str(), now);
+            if (config.session_format == LogFormat::Text) {
+                open_session_indexes(*session, now, header.str());
+            }
+        }
+        
+        std::cout << "\n=== NEW SESSION STARTED ===" << std::endl;
+        std::cout << "Session ID: " << session->guid << std::endl;
+        std::cout << "Client: " << describe_client(*session) << std::endl;
+        std::cout << "Log file: " << session->path << std::endl;
+        std::cout << "Symlink: unified_stream.log" << std::endl;
+        std::cout << "Open sessions: " << sessions.size() + 1 << std::endl;
+        std::cout << std::endl;
+        
+        sessions.push_back(std::move(session));
+        route_valid = false;
+    }
+    
+    // Points the convenience symlink at the newest session's file
+    static void link_unified_stream(const std::string& path) {
+        std::error_code link_error;
+        std::filesystem::remove("unified_stream.log", link_error);
+        std::filesystem::create_symlink(path, "unified_stream.log", link_error);
+        if (link_error) {
+            std::cerr << "Failed to create unified_stream.log symlink: " << link_error.message() << std::endl;
+        }
+    }
+    
+    void open_session_file(Session& session) {
+        session.fd = open(session.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (session.fd < 0) {
+            std::cerr << "Failed to open session log " << session.path << ": " << strerror(errno) << std::endl;
+        }
+        session.file_bytes = 0;
+        session.file_opened = std::chrono::steady_clock::now();
+    }
+    
+    // Creates the session's time index and term index; both start
+    // counting after the header text
+    void open_session_indexes(Session& session, std::chrono::system_clock::time_point started,
+                              const std::string& header) {
+        size_t header_lines = std::count(header.begin(), header.end(), '\n');
+        if (config.index_lines > 0 || config.index_ms > 0) {
+            session.index_fd = open_sidecar(session.path + LOG_INDEX_SUFFIX);
+        }
+        if (session.index_fd >= 0) {
+            char index_header[LOG_INDEX_HEADER_SIZE];
+            int64_t start_us = std::chrono::duration_cast<std::chrono::microseconds>(started.time_since_epoch()).count();
+            session.index.start(start_us, config.index_lines, config.index_ms, index_header);
+            session.index.skip(header.size(), header_lines);
+            write_all(session.index_fd, std::string(index_header, sizeof(index_header)));
+        }
+        
+        if (config.term_block_lines > 0) {
+            session.terms_fd = open_sidecar(session.path + LOG_TERMS_SUFFIX);
+        }
+        if (session.terms_fd >= 0) {
+            session.terms.start(config.term_block_lines);
+            session.terms.skip(header.size(), header_lines);
+        }
+    }
+    
+    // Writes a session header or footer: as it is to a text session, and
+    // otherwise as one SERVER record per line, leaving out blank lines and
+    // rules. A binary file starts with its file header.
+    void write_session_text(Session& session, const std::string& text, std::chrono::system_clock::time_point time) {
+        if (config.session_format == LogFormat::Text) {
+            write_all(session.fd, text);
+            session.file_bytes += text.size();
+            return;
+        }
+        bool binary = config.session_format == LogFormat::Binary;
+        std::string encoded;
+        if (binary && session.file_bytes == 0) {
+            encoded.resize(binary_log_header_size(session.guid));
+            write_binary_log_header(session.guid, encoded.data());
+        }
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t end = std::min(text.find('\n', start), text.size());
+            std::string_view line(text.data() + start, end - start);
+            start = end + 1;
+            if (line.find_first_not_of('=') == std::string_view::npos) continue;
+            
+            LogRecord record = make_record(session, {time, 0, "SERVER", line});
+            size_t offset = encoded.size();
+            encoded.resize(offset + (binary ? binary_record_size(record) : json_line_capacity(record) + 1));
+            size_t length = binary ? encode_binary_record(record, encoded.data() + offset)
+                                   : encode_json_line(record, encoded.data() + offset);
+            if (!binary) encoded[offset + length++] = '\n';
+            encoded.resize(offset + length);
+        }
+        write_all(session.fd, encoded);
+        session.file_bytes += encoded.size();
+    }
+    
+    // The next JSON or binary record of session
+    static LogRecord make_record(Session& session, const LineFields& fields) {
+        LogRecord record;
+        record.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(fields.time.time_since_epoch()).count();
+        record.number = ++session.records;
+        record.client_addr = fields.client_addr;
+        record.source = fields.source;
+        record.session = session.guid;
+        record.message = fields.message;
+        return record;
+    }
+    
+    static int open_sidecar(const std::string& path) {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::cerr << "Failed to open session index " << path << ": " << strerror(errno) << std::endl;
+        }
+        return fd;
+    }
+    
+    // Writes buffered index data outside a commit (time index buffer full,
+    // or session end)
+    void flush_session_indexes(Session& session) {
+        uint64_t syscalls = 0;
+        if (session.index_pending_bytes > 0) {
+            struct iovec iov{session.index_pending, session.index_pending_bytes};
+            writev_all(session.index_fd, &iov, 1, syscalls);
+            session.index_pending_bytes = 0;
+        }
+        std::vector<char>& terms = session.terms.output();
+        if (!terms.empty()) {
+            struct iovec iov{terms.data(), terms.size()};
+            writev_all(session.terms_fd, &iov, 1, syscalls);
+            terms.clear();
+        }
+        write_syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+    }
+    
+    // Runs on the writer thread: for an EndSession control slot, for idle
+    // or evicted sessions, and for every open session at shutdown
+    void end_session(Session* session, SessionEndReason reason) {
+        // The session's pending lines go out before its footer
+        commit_batch();
+        
+        if (session->fd >= 0) {
+            auto now = std::chrono::system_clock::now();
+            auto time_t = std::chrono::system_clock::to_time_t(now);
+            
+            std::ostringstream footer;
+            footer << std::endl;
+            footer << "========================================" << std::endl;
+            footer << "Session Ended" << std::endl;
+            footer << "Session ID: " << session->guid << std::endl;
+            footer << "Client: " << describe_client(*session) << std::endl;
+            footer << "Time: " << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S") << std::endl;
+            footer << "Reason: " << session_end_reason_name(reason) << std::endl;
+            footer << "Messages: " << session->lines_written << std::endl;
+            // Server-wide losses while this session was open: datagrams the
+            // kernel discarded before recvmsg() and lines the full ring rejected
+            footer << "Kernel drops: " << (kernel_drops - session->kernel_drops_start) << std::endl;
+            footer << "Queue drops: " << (queue_full_drops - session->queue_drops_start) << std::endl;
+            write_sender_report(footer, session->senders);
+            footer << "========================================" << std::endl;
+            write_session_text(*session, footer.str(), now);
+        }
+        close_session_files(*session);
+        
+        std::cout << "\n=== SESSION ENDED ===" << std::endl;
+        std::cout << "Session ID: " << session->guid << std::endl;
+        std::cout << "Client: " << describe_client(*session) << std::endl;
+        std::cout << "Log file: " << session->path << std::endl;
+        std::cout << "Reason: " << session_end_reason_name(reason) << std::endl;
+        std::cout << std::endl;
+        
+        sessions.erase(std::find_if(sessions.begin(), sessions.end(),
+                                    [session](const std::unique_ptr<Session>& s) { return s.get() == session; }));
+        route_valid = false;
+    }
+    
+    // Closes the session's current file and indexes (after its footer) and
+    // queues the file for compression
+    void close_session_files(Session& session) {
+        bool written = session.fd >= 0;
+        if (written) {
+            close(session.fd);
+            session.fd = -1;
+        }
+        if (session.terms_fd >= 0) {
+            session.terms.finish();
+        }
+        flush_session_indexes(session);
+        if (session.index_fd >= 0) {
+            close(session.index_fd);
+            session.index_fd = -1;
+        }
+        if (session.terms_fd >= 0) {
+            close(session.terms_fd);
+            session.terms_fd = -1;
+        }
+        if (written && compressor) {
+            compressor->enqueue(session.path);
+        }
+    }
+    
+    bool rotation_due(uint64_t bytes, std::chrono::steady_clock::time_point opened) const {
+        return (config.rotate_bytes > 0 && bytes >= config.rotate_bytes) ||
+               (config.rotate_seconds > 0 && writer_now - opened >= std::chrono::seconds(config.rotate_seconds));
+    }
+    
+    // Runs after each writer pass: rotates current.log and any session file
+    // over --rotate-size or --rotate-age, once their pending lines are out
+    void rotate_due_files() {
+        if (config.rotate_bytes == 0 && config.rotate_seconds == 0) return;
+        bool current_due = current_log_fd >= 0 && rotation_due(current_log_bytes, current_log_opened);
+        bool session_due = false;
+        for (auto& session : sessions) {
+            session_due = session_due || (session->fd >= 0 && rotation_due(session->file_bytes, session->file_opened));
+        }
+        if (!current_due && !session_due) return;
+        
+        AllocationCountPause pause;
+        commit_batch();
+        if (current_due) {
+            rotate_current_log();
+        }
+        for (auto& session : sessions) {
+            if (session->fd >= 0 && rotation_due(session->file_bytes, session->file_opened)) {
+                rotate_session(*session);
+            }
+        }
+    }
+    
+    // Continues the session in its next part, FILE.partNNN.log: the closed
+    // part gets a footer naming its successor, and the new one its own
+    // header, indexes and (binary) file header
+    void rotate_session(Session& session) {
+        std::string previous = session.path;
+        char part[16];
+        snprintf(part, sizeof(part), ".part%03u", session.part + 1);
+        std::string next = session.path_stem + part + log_format_extension(config.session_format);
+        auto now = std::chrono::system_clock::now();
+        auto time_t = std::chrono::system_clock::to_time_t(now);
+        
+        std::ostringstream footer;
+        footer << std::endl;
+        footer << "========================================" << std::endl;
+        footer << "Session Continued" << std::endl;
+        footer << "Session ID: " << session.guid << std::endl;
+        footer << "Time: " << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S") << std::endl;
+        footer << "Next part: " << std::filesystem::path(next).filename().string() << std::endl;
+        footer << "========================================" << std::endl;
+        write_session_text(session, footer.str(), now);
+        close_session_files(session);
+        
+        session.part++;
+        session.path = next;
+        open_session_file(session);
+        if (sessions.back().get() == &session) {
+            link_unified_stream(session.path);
+        }
+        rotations.fetch_add(1, std::memory_order_relaxed);
+        if (session.fd < 0) return;
+        
+        std::ostringstream header;
+        header << "========================================" << std::endl;
+        header << "UDP Log Session Continued" << std::endl;
+        header << "Session ID: " << session.guid << std::endl;
+        header << "Client: " << describe_client(session) << std::endl;
+        header << "Time: " << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S") << std::endl;
+        header << "Part: " << session.part << std::endl;
+        header << "Previous part: " << std::filesystem::path(previous).filename().string() << std::endl;
+        header << "========================================" << std::endl;
+        header << std::endl;
+        write_session_text(session, header.str(), now);
+        if (config.session_format == LogFormat::Text) {
+            open_session_indexes(session, now, header.str());
+        }
+    }
+    
+    // Renames current.log to current_YYYYMMDD_HHMMSS[_N].log and starts a
+    // new one; tail -F follows the new file as after any other rotation
+    void rotate_current_log() {
+        auto time_t = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", std::localtime(&time_t));
+        std::string rotated;
+        for (unsigned int n = 0; rotated.empty() || std::filesystem::exists(rotated) ||
+                                 std::filesystem::exists(rotated + LOG_COMPRESSED_SUFFIX); n++) {
+            rotated = config.log_dir + "/current_" + stamp + (n > 0 ? "_" + std::to_string(n) : "") + ".log";
+        }
+        
+        close_current_log();
+        if (rename(current_log_path.c_str(), rotated.c_str()) != 0) {
+            std::cerr << "Failed to rotate " << current_log_path << ": " << strerror(errno) << std::endl;
+            rotated.clear();
+        }
+        current_log_fd = open(current_log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        current_log_bytes = 0;
+        current_log_opened = std::chrono::steady_clock::now();
+        current_log_watcher->acknowledge();  // Our own rename is not a reason to reopen
+        rotations.fetch_add(1, std::memory_order_relaxed);
+        if (current_log_fd >= 0) {
+            std::ostringstream header;
+            header << "=== Log File Rotated ===" << std::endl;
+            header << "Timestamp: " << get_timestamp() << std::endl;
+            if (!rotated.empty()) {
+                header << "Previous: " << std::filesystem::path(rotated).filename().string() << std::endl;
+            }
+            header << "===================" << std::endl;
+            write_current_log(header.str());
+        }
+        if (!rotated.empty() && compressor) {
+            compressor->enqueue(rotated);
+        }
+    }
+    
+    // Ends sessions whose client has sent nothing for --session-idle seconds
+    void reap_idle_sessions() {
+        if (config.session_idle_seconds == 0 || writer_now - last_session_reap < SESSION_REAP_INTERVAL) return;
+        last_session_reap = writer_now;
+        
+        auto limit = std::chrono::seconds(config.session_idle_seconds);
+        for (size_t i = 0; i < sessions.size(); ) {
+            if (writer_now - sessions[i]->last_active >= limit) {
+                AllocationCountPause pause;
+                end_session(sessions[i].get(), SessionEndReason::IdleTimeout);
+            } else {
+                i++;
+            }
+        }
+    }
+    
+    // The session started by exactly this client, if any
+    Session* find_own_session(uint32_t client_addr, uint32_t client_port, uint32_t sender_id) {
+        for (auto& session : sessions) {
+            if (session->client_addr == client_addr && session->client_port == client_port &&
+                session->sender_id == sender_id) {
+                return session.get();
+            }
+        }
+        return nullptr;
+    }
+    
+    // The sender's own session, else the newest one started from the same
+    // address (a client mixing plain and framed datagrams or sockets, or
+    // another local producer)
+    Session* find_client_session(uint32_t client_addr, uint32_t client_port, uint32_t sender_id) {
+        Session* session = find_own_session(client_addr, client_port, sender_id);
+        for (auto it = sessions.rbegin(); !session && it != sessions.rend(); ++it) {
+            if ((*it)->client_addr == client_addr) session = it->get();
+        }
+        return session;
+    }
+    
+    // Where a record's line goes: the client's session (see
+    // find_client_session), or none, leaving the line to current.log alone.
+    // A line keeps the session it lands in from going idle.
+    Session* route_line(uint32_t client_addr, uint32_t client_port, uint32_t sender_id) {
+        if (route_valid && routed_addr == client_addr && routed_port == client_port &&
+            routed_sender == sender_id) {
+            if (routed_session) {
+                routed_session->last_active = writer_now;
+            }
+            return routed_session;
+        }
+        
+        Session* routed = find_client_session(client_addr, client_port, sender_id);
+        if (routed) {
+            routed->last_active = writer_now;
+        }
+        
+        routed_addr = client_addr;
+        routed_port = client_port;
+        routed_sender = sender_id;
+        routed_session = routed;
+        route_valid = true;
+        return routed;
+    }
+    
+    static std::string describe_client(const Session& session) {
+        char client_ip[INET_ADDRSTRLEN];
+        struct in_addr addr;
+        addr.s_addr = session.client_addr;
+        inet_ntop(AF_INET, &addr, client_ip, INET_ADDRSTRLEN);
+        if (session.sender_id == 0) {
+            if (session.client_port == UNIX_CLIENT_PORT) return std::string(client_ip) + " (Unix socket)";
+            if (session.client_port == SHM_CLIENT_PORT) return std::string(client_ip) + " (shared memory)";
+            return std::string(client_ip) + ":" + std::to_string(session.client_port);
+        }
+        char sender[16];
+        snprintf(sender, sizeof(sender), "%08x", session.sender_id);
+        return std::string(client_ip) + " sender " + sender;
+    }
+    
+    // Per-sender loss accounting for framed-protocol clients
+    void write_sender_report(std::ostream& out, const SenderTable& table) {
+        if (table.size() == 0) return;
+        
+        out << "Framed senders: " << table.size() << std::endl;
+        table.for_each([&out, &table](const SenderSequence& sender) {
+            char client_ip[INET_ADDRSTRLEN];
+            struct in_addr addr;
+            addr.s_addr = static_cast<uint32_t>(sender.key >> 32);
+            inet_ntop(AF_INET, &addr, client_ip, INET_ADDRSTRLEN);
+            
+            // Gaps the server caused itself are not network loss
+            uint64_t dropped = table.dropped_locally(sender);
+            uint64_t lost = sender.lost - std::min(sender.lost, dropped);
+            uint64_t expected = sender.received + lost;
+            double loss_rate = expected > 0 ? 100.0 * lost / expected : 0.0;
+            
+            out << "  " << client_ip << " sender " << std::hex << std::setw(8) << std::setfill('0')
+                << static_cast<uint32_t>(sender.key) << std::dec << std::setfill(' ')
+                << ": received " << sender.received
+                << ", lost " << lost
+                << " (" << std::fixed << std::setprecision(2) << loss_rate << "%)"
+                << ", duplicates " << sender.duplicates
+                << ", reordered " << sender.reordered;
+            out.unsetf(std::ios::floatfield);
+            if (dropped > 0) out << ", dropped by server " << dropped;
+            if (sender.late > 0) out << ", late " << sender.late;
+            if (sender.restarts > 0) out << ", restarts " << sender.restarts;
+            out << std::endl;
+        });
+        if (table.untracked_datagrams() > 0) {
+            out << "  (sender table full: " << table.untracked_datagrams()
+                << " datagrams not tracked)" << std::endl;
+        }
+        uint64_t unattributed = local_drops.untracked.load(std::memory_order_relaxed);
+        if (unattributed > 0) {
+            out << "  (" << unattributed << " datagrams dropped by the server from untracked senders)" << std::endl;
+        }
+    }
+    
+    std::string get_timestamp() {
+        char timestamp[TIMESTAMP_LENGTH];
+        timestamp_cache.format(timestamp, std::chrono::system_clock::now());
+        return std::string(timestamp, TIMESTAMP_LENGTH);
+    }
+    
+    void print_batch_statistics() {
+        uint64_t calls = recv_calls;
+        if (calls == 0) return;
+        
+        std::cout << "  Receive calls: " << calls << " (avg "
+                  << std::fixed << std::setprecision(2)
+                  << static_cast<double>(recv_datagrams) / calls
+                  << " datagrams/call)" << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+        
+        std::cout << "  Datagrams per call:" << std::endl;
+        for (int b = 0; b < BATCH_HISTOGRAM_BUCKETS; b++) {
+            uint64_t count = batch_histogram[b];
+            if (count == 0) continue;
+            unsigned int low = 1u << b;
+            unsigned int high = (1u << (b + 1)) - 1;
+            std::ostringstream range;
+            if (low == high) {
+                range << low;
+            } else {
+                range << low << "-" << high;
+            }
+            std::cout << "    " << std::right << std::setw(7) << range.str() << ": " << count << std::endl;
+        }
+    }
+    
+    void record_receive_call(unsigned int datagrams) {
+        recv_calls.fetch_add(1, std::memory_order_relaxed);
+        recv_datagrams.fetch_add(datagrams, std::memory_order_relaxed);
+        
+        int bucket = 0;
+        while (bucket < BATCH_HISTOGRAM_BUCKETS - 1 && (datagrams >> (bucket + 1)) != 0) {
+            bucket++;
+        }
+        batch_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    // Counters and merged stage histograms at one point in time
+    struct MetricsSample {
+        uint64_t messages{0};
+        uint64_t bytes{0};
+        uint64_t lines{0};
+        uint64_t commits{0};
+        uint64_t kernel_drops{0};
+        uint64_t queue_drops{0};
+        uint64_t shm_drops{0};
+        uint64_t malformed{0};
+        uint64_t sink_drops{0};  // Lines, summed over sinks
+        HistogramSnapshot enqueue;
+        HistogramSnapshot queue;
+        HistogramSnapshot flush;
+        HistogramSnapshot commit;
+        HistogramSnapshot commit_lines;
+    };
+    
+    // Safe while running: receivers is not resized between start() and
+    // stop(), and stop() joins this thread first
+    void sample_metrics(MetricsSample& sample) {
+        sample.messages = messages_received.load(std::memory_order_relaxed);
+        sample.bytes = bytes_received.load(std::memory_order_relaxed);
+        sample.lines = lines_written.load(std::memory_order_relaxed);
+        sample.commits = commits.load(std::memory_order_relaxed);
+        sample.kernel_drops = kernel_drops.load(std::memory_order_relaxed);
+        sample.queue_drops = queue_full_drops.load(std::memory_order_relaxed);
+        sample.shm_drops = shm_ring ? shm_ring->dropped.load(std::memory_order_relaxed) : 0;
+        sample.malformed = malformed_frames.load(std::memory_order_relaxed);
+        sample.sink_drops = 0;
+        for (auto& sink : sinks) {
+            sample.sink_drops += sink->dropped_lines.load(std::memory_order_relaxed);
+        }
+        sample.enqueue = HistogramSnapshot();
+        for (auto& receiver : receivers) {
+            sample.enqueue.add(receiver->enqueue_latency);
+        }
+        sample.enqueue.add(shm_enqueue_latency);
+        sample.queue = HistogramSnapshot();
+        sample.queue.add(queue_latency);
+        sample.flush = HistogramSnapshot();
+        sample.flush.add(flush_latency);
+        sample.commit = HistogramSnapshot();
+        sample.commit.add(commit_latency);
+        sample.commit_lines = HistogramSnapshot();
+        sample.commit_lines.add(commit_lines);
+    }
+    
+    // Serves the metrics endpoint and writes a summary line to server.log
+    // every stats interval, until stop()
+    void metrics_loop() {
+        auto interval = std::chrono::seconds(config.stats_interval_seconds);
+        auto last_summary = std::chrono::steady_clock::now();
+        auto previous = std::make_unique<MetricsSample>();
+        auto current = std::make_unique<MetricsSample>();
+        sample_metrics(*previous);
+        
+        while (running) {
+            if (metrics_fd >= 0) {
+                struct pollfd listener{metrics_fd, POLLIN, 0};
+                if (poll(&listener, 1, METRICS_POLL_MS) > 0) {
+                    serve_metrics_request();
+                }
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(METRICS_POLL_MS));
+            }
+            
+            auto now = std::chrono::steady_clock::now();
+            if (config.stats_interval_seconds == 0 || now - last_summary < interval) continue;
+            sample_metrics(*current);
+            double seconds = std::chrono::duration<double>(now - last_summary).count();
+            log_server_event(format_stats_summary(*previous, *current, seconds));
+            std::swap(previous, current);
+            last_summary = now;
+        }
+    }
+    
+    // "Stats 60s: ..." for server.log: rates and drops over the interval,
+    // the queue right now, and per-stage latency percentiles
+    std::string format_stats_summary(const MetricsSample& before, const MetricsSample& after, double seconds) {
+        uint64_t kernel = after.kernel_drops - before.kernel_drops;
+        uint64_t queue = after.queue_drops - before.queue_drops;
+        uint64_t shm = after.shm_drops - before.shm_drops;
+        uint64_t malformed = after.malformed - before.malformed;
+        uint64_t commit_count = after.commits - before.commits;
+        uint64_t lines = after.lines - before.lines;
+        
+        char text[512];
+        snprintf(text, sizeof(text),
+                 "Stats %.0fs: %.0f msg/s, %.2f MB/s, dropped %llu (kernel %llu, queue %llu, shm %llu, "
+                 "malformed %llu), queue %zu/%zu, sessions %llu, %.1f commits/s (avg %.1f lines)",
+                 seconds, (after.messages - before.messages) / seconds,
+                 (after.bytes - before.bytes) / seconds / (1024 * 1024),
+                 static_cast<unsigned long long>(kernel + queue + shm + malformed),
+                 static_cast<unsigned long long>(kernel), static_cast<unsigned long long>(queue),
+                 static_cast<unsigned long long>(shm), static_cast<unsigned long long>(malformed),
+                 ring.size(), ring.capacity(),
+                 static_cast<unsigned long long>(active_sessions.load(std::memory_order_relaxed)),
+                 commit_count / seconds, commit_count > 0 ? static_cast<double>(lines) / commit_count : 0.0);
+        std::string summary = text;
+        if (!sinks.empty()) {
+            summary += ", sink drops " + std::to_string(after.sink_drops - before.sink_drops);
+        }
+        append_stage_summary(summary, "receive->enqueue", after.enqueue.since(before.enqueue));
+        append_stage_summary(summary, "enqueue->write", after.queue.since(before.queue));
+        append_stage_summary(summary, "write->flush", after.flush.since(before.flush));
+        append_stage_summary(summary, "commit write", after.commit.since(before.commit));
+        return summary;
+    }
+    
+    static void append_stage_summary(std::string& summary, const char* stage, const HistogramSnapshot& latency) {
+        summary += "; ";
+        summary += stage;
+        if (latency.count == 0) {
+            summary += " -";
+            return;
+        }
+        summary += " p50 " + format_duration_ns(latency.percentile(0.5));
+        summary += " p99 " + format_duration_ns(latency.percentile(0.99));
+        summary += " max " + format_duration_ns(latency.max());
+    }
+    
+    // One request per connection: GET /metrics gets the Prometheus text
+    // format, anything else a 404
+    void serve_metrics_request() {
+        int client = accept(metrics_fd, nullptr, nullptr);
+        if (client < 0) return;
+        fcntl(client, F_SETFD, FD_CLOEXEC);
+        struct timeval timeout{1, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        
+        // Only the request line matters, but read the headers so closing
+        // the socket does not reset the connection
+        char request[METRICS_REQUEST_SIZE];
+        size_t used = 0;
+        while (used < sizeof(request) - 1) {
+            ssize_t n = recv(client, request + used, sizeof(request) - 1 - used, 0);
+            if (n <= 0) break;
+            used += n;
+            request[used] = '\0';
+            if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+        }
+        std::string_view request_line(request, used);
+        request_line = request_line.substr(0, request_line.find_first_of("\r\n"));
+        
+        std::string body;
+        const char* status = "200 OK";
+        if (request_line.rfind("GET /metrics ", 0) == 0 || request_line.rfind("GET /metrics?", 0) == 0 ||
+            request_line == "GET /metrics") {
+            body = format_prometheus_metrics();
+        } else {
+            status = "404 Not Found";
+            body = "Not found; metrics are at /metrics\n";
+        }
+        
+        std::ostringstream response;
+        response << "HTTP/1.1 " << status << "\r\n"
+                 << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                 << "Content-Length: " << body.size() << "\r\n"
+                 << "Connection: close\r\n\r\n"
+                 << body;
+        write_all(client, response.str());
+        close(client);
+    }
+    
+    std::string format_prometheus_metrics() {
+        auto sample = std::make_unique<MetricsSample>();
+        sample_metrics(*sample);
+        std::string out;
+        out.reserve(32 * 1024);
+        
+        append_prometheus_header(out, "udp_log_messages_received_total", "counter", "Log records received.");
+        append_prometheus_value(out, "udp_log_messages_received_total", "", sample->messages);
+        append_prometheus_header(out, "udp_log_bytes_received_total", "counter", "Bytes of log records received.");
+        append_prometheus_value(out, "udp_log_bytes_received_total", "", sample->bytes);
+        append_prometheus_header(out, "udp_log_lines_written_total", "counter", "Lines written to current.log.");
+        append_prometheus_value(out, "udp_log_lines_written_total", "", sample->lines);
+        append_prometheus_header(out, "udp_log_write_failed_lines_total", "counter",
+                                 "Lines not written to current.log or a session file because the write failed.");
+        append_prometheus_value(out, "udp_log_write_failed_lines_total", "", failed_lines.load());
+        append_prometheus_header(out, "udp_log_commits_total", "counter", "Group commits by the writer.");
+        append_prometheus_value(out, "udp_log_commits_total", "", sample->commits);
+        append_prometheus_header(out, "udp_log_write_syscalls_total", "counter", "Write syscalls by the writer.");
+        append_prometheus_value(out, "udp_log_write_syscalls_total", "", write_syscalls.load());
+        append_prometheus_header(out, "udp_log_receive_calls_total", "counter", "Receive syscalls.");
+        append_prometheus_value(out, "udp_log_receive_calls_total", "", recv_calls.load());
+        append_prometheus_header(out, "udp_log_sessions_created_total", "counter", "Sessions started.");
+        append_prometheus_value(out, "udp_log_sessions_created_total", "", sessions_created.load());
+        
+        // Overload drops are split by policy action; queue_full_drops counts all of them
+        uint64_t evicted = evicted_lines.load();
+        uint64_t sampled = sampled_lines.load();
+        append_prometheus_header(out, "udp_log_dropped_total", "counter", "Records dropped, by cause.");
+        append_prometheus_value(out, "udp_log_dropped_total", "cause=\"kernel\"", sample->kernel_drops);
+        append_prometheus_value(out, "udp_log_dropped_total", "cause=\"queue_full\"",
+                                sample->queue_drops - std::min(sample->queue_drops, evicted + sampled));
+        append_prometheus_value(out, "udp_log_dropped_total", "cause=\"queue_evicted\"", evicted);
+        append_prometheus_value(out, "udp_log_dropped_total", "cause=\"queue_sampled\"", sampled);
+        append_prometheus_value(out, "udp_log_dropped_total", "cause=\"shm_ring_full\"", sample->shm_drops);
+        append_prometheus_value(out, "udp_log_dropped_total", "cause=\"malformed\"", sample->malformed);
+        
+        if (!sinks.empty()) {
+            append_prometheus_header(out, "udp_log_sink_written_bytes_total", "counter", "Bytes written by each sink.");
+            for (auto& sink : sinks) {
+                append_prometheus_value(out, "udp_log_sink_written_bytes_total", prometheus_label("sink", sink->name()),
+                                        sink->written_bytes.load());
+            }
+            append_prometheus_header(out, "udp_log_sink_dropped_lines_total", "counter",
+                                     "Lines a sink missed because its queue was full.");
+            for (auto& sink : sinks) {
+                append_prometheus_value(out, "udp_log_sink_dropped_lines_total",
+                                        prometheus_label("sink", sink->name()), sink->dropped_lines.load());
+            }
+            append_prometheus_header(out, "udp_log_sink_lost_bytes_total", "counter",
+                                     "Bytes a sink failed to write.");
+            for (auto& sink : sinks) {
+                append_prometheus_value(out, "udp_log_sink_lost_bytes_total", prometheus_label("sink", sink->name()),
+                                        sink->lost_bytes.load());
+            }
+            append_prometheus_header(out, "udp_log_sink_queue_bytes", "gauge", "Bytes queued for each sink.");
+            for (auto& sink : sinks) {
+                append_prometheus_value(out, "udp_log_sink_queue_bytes", prometheus_label("sink", sink->name()),
+                                        sink->queued_bytes());
+            }
+        }
+        
+        append_prometheus_header(out, "udp_log_rotations_total", "counter",
+                                 "current.log and session files closed by rotation.");
+        append_prometheus_value(out, "udp_log_rotations_total", "", rotations.load());
+        if (compressor) {
+            append_prometheus_header(out, "udp_log_compressed_files_total", "counter",
+                                     "Closed log files compressed, by result.");
+            append_prometheus_value(out, "udp_log_compressed_files_total", "result=\"ok\"", compressor->files.load());
+            append_prometheus_value(out, "udp_log_compressed_files_total", "result=\"failed\"",
+                                    compressor->failures.load());
+            append_prometheus_header(out, "udp_log_compressed_bytes_total", "counter",
+                                     "Bytes read and written by the compressor.");
+            append_prometheus_value(out, "udp_log_compressed_bytes_total", "direction=\"in\"",
+                                    compressor->bytes_in.load());
+            append_prometheus_value(out, "udp_log_compressed_bytes_total", "direction=\"out\"",
+                                    compressor->bytes_out.load());
+            append_prometheus_header(out, "udp_log_compress_queue_files", "gauge", "Closed files waiting for compression.");
+            append_prometheus_value(out, "udp_log_compress_queue_files", "", compressor->queued.load());
+        }
+        
+        append_prometheus_header(out, "udp_log_queue_depth", "gauge", "Lines queued for the writer.");
+        append_prometheus_value(out, "udp_log_queue_depth", "", ring.size());
+        append_prometheus_header(out, "udp_log_queue_capacity", "gauge", "Capacity of the writer queue.");
+        append_prometheus_value(out, "udp_log_queue_capacity", "", ring.capacity());
+        append_prometheus_header(out, "udp_log_active_sessions", "gauge", "Open sessions.");
+        append_prometheus_value(out, "udp_log_active_sessions", "", active_sessions.load());
+        
+        append_prometheus_header(out, "udp_log_latency_seconds", "histogram",
+                                 "Per-line latency of each ingest stage.");
+        append_prometheus_histogram(out, "udp_log_latency_seconds", "stage=\"receive_enqueue\"", sample->enqueue,
+                                    LATENCY_BOUNDS, 1e9);
+        append_prometheus_histogram(out, "udp_log_latency_seconds", "stage=\"enqueue_write\"", sample->queue,
+                                    LATENCY_BOUNDS, 1e9);
+        append_prometheus_histogram(out, "udp_log_latency_seconds", "stage=\"write_flush\"", sample->flush,
+                                    LATENCY_BOUNDS, 1e9);
+        append_prometheus_header(out, "udp_log_commit_write_seconds", "histogram",
+                                 "Time to write one group commit.");
+        append_prometheus_histogram(out, "udp_log_commit_write_seconds", "", sample->commit, LATENCY_BOUNDS, 1e9);
+        append_prometheus_header(out, "udp_log_commit_lines", "histogram", "Lines per group commit.");
+        append_prometheus_histogram(out, "udp_log_commit_lines", "", sample->commit_lines, BATCH_SIZE_BOUNDS, 1);
+        
+        // Receive batches keep their log2 buckets: 1, 2-3, 4-7, ...
+        append_prometheus_header(out, "udp_log_receive_batch_datagrams", "histogram",
+                                 "Datagrams per receive call.");
+        uint64_t cumulative = 0;
+        for (int b = 0; b < BATCH_HISTOGRAM_BUCKETS - 1; b++) {
+            cumulative += batch_histogram[b].load(std::memory_order_relaxed);
+            append_prometheus_value(out, "udp_log_receive_batch_datagrams_bucket",
+                                    "le=\"" + std::to_string((1u << (b + 1)) - 1) + "\"", cumulative);
+        }
+        uint64_t calls = cumulative + batch_histogram[BATCH_HISTOGRAM_BUCKETS - 1].load(std::memory_order_relaxed);
+        append_prometheus_value(out, "udp_log_receive_batch_datagrams_bucket", "le=\"+Inf\"", calls);
+        append_prometheus_value(out, "udp_log_receive_batch_datagrams_sum", "", recv_datagrams.load());
+        append_prometheus_value(out, "udp_log_receive_batch_datagrams_count", "", calls);
+        return out;
+    }
+    
+    // One instance runs per receiver socket. All receivers feed the single
+    // ring, so current.log and the session file see lines in the order
+    // their slots were claimed; SO_REUSEPORT keeps each client flow on one
+    // socket, which preserves every client's own arrival order.
+    void receive_loop(ReceiverState* receiver) {
+        t_enqueue_latency = &receiver->enqueue_latency;
+#ifdef HAVE_IO_URING
+        if (io_engine == IoEngine::Uring && receive_loop_uring(*receiver)) {
+            return;
+        }
+#endif
+#ifdef HAVE_RECVMMSG
+        if (config.recv_batch > 1) {
+            receive_loop_batched(*receiver);
+            return;
+        }
+#endif
+        char buffer[BUFFER_SIZE];
+        struct sockaddr_in client_addr = local_client_address();
+        ControlBuffer control;
+        struct iovec iov{buffer, BUFFER_SIZE - 1};
+        
+        t_count_allocations = true;
+        while (running) {
+            struct msghdr msg{};
+            msg.msg_name = receiver->local ? nullptr : &client_addr;
+            msg.msg_namelen = receiver->local ? 0 : sizeof(client_addr);
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.data;
+            msg.msg_controllen = sizeof(control.data);
+            
+            // Receive UDP packet
+            ssize_t bytes = recvmsg(receiver->fd, &msg, 0);
+            
+            if (bytes < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                    // Timeout - check if still running
+                    track_receive_burst(*receiver, 0, 0);
+                    continue;
+                }
+                std::cerr << "Receive error: " << strerror(errno) << std::endl;
+                continue;
+            }
+            
+            if (bytes == 0) continue;
+            
+            std::chrono::system_clock::time_point received_at{};
+            record_receive_call(1);
+            process_control_data(*receiver, msg, received_at);
+            track_receive_burst(*receiver, 1, bytes);
+            handle_datagram(buffer, bytes, client_addr, client_port(*receiver, client_addr), received_at);
+        }
+    }
+    
+#ifdef HAVE_RECVMMSG
+    // Pulls up to config.recv_batch datagrams per syscall into preallocated buffers.
+    // MSG_WAITFORONE blocks (up to SO_RCVTIMEO) for the first datagram only, then
+    // takes whatever else is already queued without waiting.
+    void receive_loop_batched(ReceiverState& receiver) {
+        const unsigned int batch = config.recv_batch;
+        std::vector<std::array<char, BUFFER_SIZE>> buffers(batch);
+        std::vector<struct iovec> iovecs(batch);
+        std::vector<struct sockaddr_in> addrs(batch, local_client_address());
+        std::vector<ControlBuffer> controls(batch);
+        std::vector<struct mmsghdr> msgs(batch);
+        
+        for (unsigned int i = 0; i < batch; i++) {
+            iovecs[i].iov_base = buffers[i].data();
+            iovecs[i].iov_len = BUFFER_SIZE - 1;
+        }
+        
+        t_count_allocations = true;
+        while (running) {
+            for (unsigned int i = 0; i < batch; i++) {
+                msgs[i].msg_hdr = {};
+                msgs[i].msg_hdr.msg_name = receiver.local ? nullptr : &addrs[i];
+                msgs[i].msg_hdr.msg_namelen = receiver.local ? 0 : sizeof(addrs[i]);
+                msgs[i].msg_hdr.msg_iov = &iovecs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+                msgs[i].msg_hdr.msg_control = controls[i].data;
+                msgs[i].msg_hdr.msg_controllen = sizeof(controls[i].data);
+                msgs[i].msg_len = 0;
+            }
+            
+            int count = recvmmsg(receiver.fd, msgs.data(), batch, MSG_WAITFORONE, nullptr);
+            
+            if (count < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                    // Timeout - check if still running
+                    track_receive_burst(receiver, 0, 0);
+                    continue;
+                }
+                std::cerr << "Receive error: " << strerror(errno) << std::endl;
+                continue;
+            }
+            
+            if (count == 0) continue;
+            
+            record_receive_call(count);
+            size_t batch_bytes = 0;
+            for (int i = 0; i < count; i++) {
+                // Each datagram carries its own timestamp, so batching does
+                // not collapse arrival times to the recvmmsg() return
+                std::chrono::system_clock::time_point received_at{};
+                process_control_data(receiver, msgs[i].msg_hdr, received_at);
+                batch_bytes += msgs[i].msg_len;
+                if (msgs[i].msg_len == 0) continue;
+                handle_datagram(buffers[i].data(), msgs[i].msg_len, addrs[i], client_port(receiver, addrs[i]),
+                                received_at);
+            }
+            track_receive_burst(receiver, count, batch_bytes);
+        }
+    }
+#endif
+    
+#ifdef HAVE_IO_URING
+    // One multishot recvmsg stays armed on the socket and the kernel fills
+    // buffers from a provided-buffer ring, so a single io_uring_enter()
+    // waits for the first datagram and collects every other one that has
+    // arrived meanwhile. Each buffer holds an io_uring_recvmsg_out header,
+    // the sender address, the ancillary data and the payload. Returns false,
+    // without having consumed a datagram, if the ring cannot be set up or
+    // the kernel rejects multishot receives; the caller then falls back to
+    // recvmsg()/recvmmsg().
+    bool receive_loop_uring(ReceiverState& receiver) {
+        const socklen_t name_space = receiver.local ? 0 : sizeof(struct sockaddr_in);
+        const size_t payload_offset = sizeof(struct io_uring_recvmsg_out) + name_space + CONTROL_BUFFER_SIZE;
+        IoUring uring;
+        if (!uring.init(URING_ENTRIES) ||
+            !uring.setup_buffer_ring(URING_BUFFER_GROUP, URING_RECV_BUFFERS, payload_offset + BUFFER_SIZE - 1)) {
+            std::cerr << "Receiver " << receiver.index << ": io_uring setup failed (" << strerror(errno)
+                      << "), using recvmsg()" << std::endl;
+            return false;
+        }
+        
+        // Tells the kernel how much name and control space to reserve at
+        // the front of every buffer
+        struct msghdr request{};
+        request.msg_namelen = name_space;
+        request.msg_controllen = CONTROL_BUFFER_SIZE;
+        struct sockaddr_in client_addr = local_client_address();
+        
+        bool armed = false;
+        bool delivered = false;
+        t_count_allocations = true;
+        while (running) {
+            // A full queue holds entries a failed io_uring_enter() left
+            // behind; submitting them below makes room to arm next time
+            struct io_uring_sqe* sqe = armed ? nullptr : uring.get_sqe();
+            if (sqe) {
+                sqe->opcode = IORING_OP_RECVMSG;
+                sqe->fd = receiver.fd;
+                sqe->addr = reinterpret_cast<uint64_t>(&request);
+                sqe->len = 1;
+                sqe->ioprio = IORING_RECV_MULTISHOT;
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->buf_group = uring.group();
+                armed = true;
+            }
+            
+            // 100ms timeout to allow periodic checking of running flag
+            int error = uring.submit_and_wait(1, 100);
+            if (error != 0) {
+                if (error != EINTR) std::cerr << "io_uring_enter error: " << strerror(error) << std::endl;
+                continue;
+            }
+            
+            unsigned int datagrams = 0;
+            size_t bytes = 0;
+            bool unsupported = false;
+            uring.for_each_completion([&](const struct io_uring_cqe& cqe) {
+                if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                    armed = false;  // Multishot ended, e.g. all buffers in use: re-arm
+                }
+                if (cqe.res < 0) {
+                    if (cqe.res == -EINVAL && !delivered) {
+                        unsupported = true;
+                    } else if (cqe.res != -ENOBUFS) {
+                        std::cerr << "Receive error: " << strerror(-cqe.res) << std::endl;
+                    }
+                    return;
+                }
+                if (!(cqe.flags & IORING_CQE_F_BUFFER)) return;
+                delivered = true;
+                
+                uint16_t id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                char* buffer = uring.buffer(id);
+                const auto* out = reinterpret_cast<const struct io_uring_recvmsg_out*>(buffer);
+                size_t used = static_cast<size_t>(cqe.res);
+                size_t length = used > payload_offset ? std::min<size_t>(out->payloadlen, used - payload_offset) : 0;
+                if (!receiver.local && out->namelen >= sizeof(client_addr)) {
+                    memcpy(&client_addr, buffer + sizeof(*out), sizeof(client_addr));
+                }
+                
+                struct msghdr msg{};
+                msg.msg_control = buffer + sizeof(*out) + name_space;
+                msg.msg_controllen = out->controllen;
+                std::chrono::system_clock::time_point received_at{};
+                process_control_data(receiver, msg, received_at);
+                if (length > 0) {
+                    handle_datagram(buffer + payload_offset, length, client_addr, client_port(receiver, client_addr),
+                                    received_at);
+                }
+                datagrams++;
+                bytes += length;
+                uring.recycle_buffer(id);
+            });
+            uring.publish_buffers();
+            
+            if (unsupported) {
+                std::cerr << "Receiver " << receiver.index
+                          << ": kernel lacks multishot recvmsg, using recvmsg()" << std::endl;
+                return false;
+            }
+            if (datagrams > 0) {
+                record_receive_call(datagrams);
+            }
+            track_receive_burst(receiver, datagrams, bytes);
+        }
+        return true;
+    }
+#endif
+    
+    // Local producers have no IP address; their lines and sender reports show loopback
+    static struct sockaddr_in local_client_address() {
+        struct sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return addr;
+    }
+    
+    static uint32_t client_port(const ReceiverState& receiver, const struct sockaddr_in& client_addr) {
+        return receiver.local ? UNIX_CLIENT_PORT : ntohs(client_addr.sin_port);
+    }
+    
+    // Drains the shared-memory ring. Every slot is one datagram and goes
+    // through handle_datagram() like one read from a socket, so commands,
+    // frames and formatting are identical. After SHM_IDLE_SPINS empty polls
+    // the thread parks on the ring's futex until a producer wakes it.
+    void shm_loop() {
+        ShmRingHeader& header = *shm_ring;
+        ShmSlot* slots = shm_ring_slots(shm_ring);
+        // Producers can write the header: index with the capacity that sized
+        // the mapping, and stay detached if the header disagrees with it
+        const uint64_t mask = config.shm_slots - 1;
+        if (header.capacity != config.shm_slots || header.slot_size != sizeof(ShmSlot)) {
+            std::cerr << "Shared-memory ring " << config.shm_name << " header was overwritten (capacity "
+                      << header.capacity << ", expected " << config.shm_slots << "); not reading it" << std::endl;
+            return;
+        }
+        const struct sockaddr_in client_addr = local_client_address();
+        uint64_t head = header.head.load(std::memory_order_relaxed);
+        unsigned int idle = 0;
+        uint64_t stalled_head = UINT64_MAX;
+        std::chrono::steady_clock::time_point stalled_since{};
+        
+        t_enqueue_latency = &shm_enqueue_latency;
+        t_count_allocations = true;
+        while (running) {
+            ShmSlot& slot = slots[head & mask];
+            uint64_t seq = slot.sequence.load(std::memory_order_acquire);
+            
+            // Published, and no stale producer is still registered in it
+            if (seq == head + 1 && slot.writers.load(std::memory_order_acquire) == 0) {
+                size_t length = std::min<size_t>(slot.length, SHM_SLOT_DATA_SIZE);
+                if (length > 0) {
+                    shm_datagrams.fetch_add(1, std::memory_order_relaxed);
+                    handle_datagram(slot.data, length, client_addr, SHM_CLIENT_PORT, std::chrono::system_clock::now());
+                }
+                slot.sequence.store(head + mask + 1, std::memory_order_release);
+                header.head.store(++head, std::memory_order_relaxed);
+                idle = 0;
+                continue;
+            }
+            
+            // Claimed but not published, or published with a producer still
+            // registered: wait, and give the slot up if that never ends (the
+            // producer may have died mid-write). The abandoning CAS is
+            // seq_cst to pair with a producer's registration.
+            if (seq == head + 1 || (seq == head && header.tail.load(std::memory_order_relaxed) > head)) {
+                auto now = std::chrono::steady_clock::now();
+                if (stalled_head != head) {
+                    stalled_head = head;
+                    stalled_since = now;
+                } else if (now - stalled_since > std::chrono::milliseconds(SHM_STALL_TIMEOUT_MS)) {
+                    slot.writers.store(0, std::memory_order_relaxed);  // Before anyone can claim it again
+                    if (slot.sequence.compare_exchange_strong(seq, head + mask + 1, std::memory_order_seq_cst)) {
+                        shm_abandoned.fetch_add(1, std::memory_order_relaxed);
+                        header.head.store(++head, std::memory_order_relaxed);
+                        continue;
+                    }
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            
+            if (++idle < SHM_IDLE_SPINS) {
+                std::this_thread::yield();
+                continue;
+            }
+            header.consumer_parked.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+                shm_ring_wait(shm_ring, SHM_PARK_TIMEOUT_MS);
+                shm_parks.fetch_add(1, std::memory_order_relaxed);
+            }
+            header.consumer_parked.store(0, std::memory_order_relaxed);
+            idle = 0;
+        }
+    }
+    
+    // received_at is the kernel receive time, or zero to read the clock here
+    void handle_datagram(char* buffer, ssize_t bytes, const struct sockaddr_in& client_addr,
+                         uint32_t client_port, std::chrono::system_clock::time_point received_at) {
+        t_datagram_arrival = received_at != std::chrono::system_clock::time_point{}
+            ? received_at : std::chrono::system_clock::now();
+        RecordOrigin origin;
+        origin.client_addr = client_addr.sin_addr.s_addr;
+        origin.client_port = client_port;
+        
+        // Framed datagrams carry a sender ID and sequence number ahead of
+        // the usual "SOURCE|MESSAGE" record
+        const char* record = buffer;
+        size_t record_length = bytes;
+        if (is_framed(buffer, bytes)) {
+            FrameHeader header;
+            FragmentHeader fragment;
+            if (!parse_frame_header(buffer, bytes, header) ||
+                (header.type == FrameType::Fragment && !parse_fragment_header(buffer, bytes, fragment))) {
+                malformed_frames.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            framed_datagrams.fetch_add(1, std::memory_order_relaxed);
+            origin.framed = true;
+            origin.client_port = 0;  // The sender ID names the client, whichever socket it uses
+            origin.sender_id = header.sender_id;
+            origin.sequence = header.sequence;
+            if (header.type == FrameType::Fragment) {
+                size_t offset = FRAME_HEADER_SIZE + FRAGMENT_HEADER_SIZE;
+                enqueue_fragment(buffer + offset, bytes - offset, origin, fragment, received_at);
+                bytes_received += bytes;
+                return;
+            }
+            if (header.type == FrameType::Batch) {
+                unpack_batch(buffer, bytes, origin, client_addr, received_at);
+                return;
+            }
+            record += FRAME_HEADER_SIZE;
+            record_length -= FRAME_HEADER_SIZE;
+        }
+        
+        if (!handle_record(record, record_length, bytes, origin, client_addr, received_at)) {
+            note_local_drop(origin);
+        }
+    }
+    
+    // Every record of a batch becomes its own line. Its time is the batch's
+    // arrival minus the record's client-side age, so lines keep their
+    // logging times without depending on the client's clock offset
+    // (--batch-clock client uses the client's clock outright).
+    void unpack_batch(const char* buffer, size_t bytes, RecordOrigin origin,
+                      const struct sockaddr_in& client_addr, std::chrono::system_clock::time_point received_at) {
+        BatchReader reader(buffer, bytes);
+        auto sent_at = config.batch_clock == BatchClock::Client
+            ? std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                  std::chrono::microseconds(reader.send_time_us())))
+            : resolve_receive_time(received_at);
+        
+        // The batch's sequence number rides on the first record that makes it
+        // into the ring, so dropping the records ahead of it loses nothing
+        RecordOrigin sequenced = origin;
+        BatchRecord record;
+        while (reader.next(record)) {
+            auto line_time = sent_at - std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                std::chrono::microseconds(record.age_us));
+            if (handle_record(record.data, record.length, BATCH_ENTRY_HEADER_SIZE + record.length, sequenced,
+                              client_addr, line_time)) {
+                sequenced.framed = false;
+            }
+        }
+        if (sequenced.framed) {
+            note_local_drop(origin);  // Every record dropped (or none at all)
+        }
+        batched_datagrams.fetch_add(1, std::memory_order_relaxed);
+        if (reader.truncated()) {
+            malformed_frames.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    
+    // Queues one "SOURCE|MESSAGE" record: a session command, or a formatted
+    // line. bytes is what the record cost on the wire. Returns false if the
+    // overload policy dropped it.
+    bool handle_record(const char* record, size_t record_length, size_t bytes, const RecordOrigin& origin,
+                       const struct sockaddr_in& client_addr, std::chrono::system_clock::time_point received_at) {
+        // Parse message format: "SOURCE|MESSAGE" in place; like the old
+        // C-string handling, anything after an embedded NUL is ignored
+        std::string_view source;
+        std::string_view content;
+        split_record(std::string_view(record, strnlen(record, record_length)), source, content);
+        
+        // Handle special commands: queued behind the lines already received
+        // so the writer switches files at exactly this point in the stream
+        if (source == "CMD") {
+            if (content == "NEW_SESSION") {
+                enqueue_control(SlotKind::NewSession, origin);
+                return true;
+            } else if (content == "END_SESSION") {
+                enqueue_control(SlotKind::EndSession, origin);
+                return true;
+            }
+        }
+        
+        // Update statistics (always count messages)
+        messages_received++;
+        bytes_received += bytes;
+        
+        // Under sampling, a ring past the watermark keeps only 1 in N lines
+        // per source, so storms from one source do not crowd out the rest
+        uint16_t source_index = sources.find_or_add(source);
+        if (config.overload_policy == OverloadPolicy::Sample &&
+            ring.size() * 100 >= ring.capacity() * SAMPLE_WATERMARK_PERCENT &&
+            !sources.sample(source_index)) {
+            sampled_lines.fetch_add(1, std::memory_order_relaxed);
+            record_overload_drop(source_index);
+            return false;
+        }
+        
+        // Get client IP
+        char client_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
+        
+        // Format the log line directly into a ring slot
+        LogSlot* slot = claim_line_slot();
+        if (!slot) {
+            record_overload_drop(source_index);
+            return false;
+        }
+        
+        char timestamp[TIMESTAMP_LENGTH];
+        auto line_time = resolve_receive_time(received_at);
+        timestamp_cache.format(timestamp, line_time);
+        
+        slot->kind.store(SlotKind::Line, std::memory_order_relaxed);
+        slot->source = source_index;
+        slot->origin = origin;
+        slot->received_at = line_time;
+        LineBuilder line(slot->line, LINE_CAPACITY);
+        append_line_prefix(line, timestamp, source, client_ip);
+        slot->source_length = static_cast<uint16_t>(std::min(source.size(), line.size() - SOURCE_OFFSET));
+        slot->message_offset = static_cast<uint16_t>(line.size());
+        line.append(content);
+        
+        slot->length = static_cast<uint32_t>(line.size());
+        publish_slot(slot);
+        return true;
+    }
+    
+    // Kernel receive time if there is one, otherwise when handle_datagram()
+    // got the datagram
+    std::chrono::system_clock::time_point resolve_receive_time(std::chrono::system_clock::time_point received_at) {
+        if (received_at == std::chrono::system_clock::time_point{}) {
+            if (config.timestamps == TimestampSource::Kernel) {
+                missing_kernel_timestamps.fetch_add(1, std::memory_order_relaxed);
+            }
+            received_at = t_datagram_arrival;
+        }
+        return received_at;
+    }
+    
+    // Hands a line or fragment slot to the writer, stamped for the queue
+    // wait and timed from the datagram's arrival
+    void publish_slot(LogSlot* slot) {
+        auto now = std::chrono::system_clock::now();
+        slot->enqueued_at = now;
+        if (t_enqueue_latency) {
+            t_enqueue_latency->record(elapsed_ns(t_datagram_arrival, now));
+        }
+        ring.publish(slot);
+        wake_writer();
+    }
+    
+    // Fragments are queued raw, in stream order; the writer reassembles them
+    void enqueue_fragment(const char* data, size_t length, const RecordOrigin& origin,
+                          const FragmentHeader& fragment, std::chrono::system_clock::time_point received_at) {
+        fragments_received.fetch_add(1, std::memory_order_relaxed);
+        LogSlot* slot = claim_line_slot();
+        if (!slot) {
+            record_overload_drop(fragment_source);
+            note_local_drop(origin);
+            return;
+        }
+        
+        slot->kind.store(SlotKind::Fragment, std::memory_order_relaxed);
+        slot->source = fragment_source;
+        slot->origin = origin;
+        slot->fragment.message_id = fragment.message_id;
+        slot->fragment.index = fragment.index;
+        slot->fragment.count = fragment.count;
+        slot->received_at = resolve_receive_time(received_at);
+        memcpy(slot->line, data, length);
+        slot->length = static_cast<uint32_t>(length);
+        publish_slot(slot);
+    }
+    
+    // Claims a slot for a new line. When the ring is full, drop-oldest evicts
+    // the oldest queued line; the other policies drop the new one.
+    LogSlot* claim_line_slot() {
+        LogSlot* slot = ring.claim();
+        if (slot || config.overload_policy != OverloadPolicy::DropOldest) {
+            return slot;
+        }
+        
+        // Other producers may grab the freed slot first, so retry a few times
+        for (int attempt = 0; attempt < 4 && !slot; attempt++) {
+            LogSlot* oldest = ring.take_oldest_line();
+            if (!oldest) break;  // Oldest slot is a control event or still being written
+            evicted_lines.fetch_add(1, std::memory_order_relaxed);
+            record_overload_drop(oldest->source);
+            note_local_drop(oldest->origin);
+            ring.release(oldest);
+            slot = ring.claim();
+        }
+        return slot;
+    }
+    
+    void record_overload_drop(uint16_t source_index) {
+        queue_full_drops.fetch_add(1, std::memory_order_relaxed);
+        sources[source_index].dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    // A dropped record that carried a framed sequence number takes it along:
+    // count it for the sender so the loss report can tell it from network loss
+    void note_local_drop(const RecordOrigin& origin) {
+        if (origin.framed) {
+            local_drops.add(origin.client_addr, origin.sender_id);
+        }
+    }
+    
+    // Control events are never dropped: wait for a free slot if the ring is full
+    void enqueue_control(SlotKind kind, const RecordOrigin& origin = RecordOrigin()) {
+        LogSlot* slot;
+        while ((slot = ring.claim()) == nullptr) {
+            std::this_thread::yield();
+        }
+        slot->kind.store(kind, std::memory_order_relaxed);
+        slot->origin = origin;
+        slot->length = 0;
+        ring.publish(slot);
+        wake_writer();
+    }
+    
+    // Ring the doorbell only if the writer has parked on an empty ring.
+    // The fence pairs with the one in park_writer(): either the writer sees
+    // the published slot, or this thread sees writer_parked set.
+    void wake_writer() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (writer_parked.load(std::memory_order_relaxed) &&
+            writer_parked.exchange(false, std::memory_order_acq_rel)) {
+            writer_doorbell.ring();
+        }
+    }
+    
+    void park_writer(int timeout_ms) {
+        writer_parked.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring.empty() && !receivers_stopped) {
+            // Producers ring on empty -> non-empty; the timeout covers a
+            // pending batch coming due under the interval/bytes policies
+            writer_doorbell.wait(timeout_ms);
+            writer_wakeups.fetch_add(1, std::memory_order_relaxed);
+        }
+        writer_parked.store(false, std::memory_order_relaxed);
+    }
+    
+    // Lines are appended to write_batch as they are drained from the ring
+    // and reach the files only when the flush policy commits the batch.
+    // Session control slots are handled here too, in queue order, so the
+    // file-system work of a session switch never runs on a receiver thread.
+    void write_loop() {
+#ifdef HAVE_IO_URING
+        if (io_engine == IoEngine::Uring) {
+            writer_uring = std::make_unique<IoUring>();
+            if (!writer_uring->init(URING_ENTRIES)) {
+                std::cerr << "Writer: io_uring setup failed (" << strerror(errno) << "), using writev()" << std::endl;
+                writer_uring.reset();
+            }
+        }
+#endif
+        t_count_allocations = true;
+        while (true) {
+            writer_now = std::chrono::steady_clock::now();
+            writer_pass++;
+            for (size_t n = 0; n < WRITER_BATCH; n++) {
+                LogSlot* slot = ring.take();
+                if (!slot) break;
+                
+                SlotKind kind = slot->kind.load(std::memory_order_relaxed);
+                std::chrono::system_clock::time_point taken_at{};
+                if (kind == SlotKind::Line || kind == SlotKind::Fragment) {
+                    taken_at = std::chrono::system_clock::now();
+                    queue_latency.record(elapsed_ns(slot->enqueued_at, taken_at));
+                }
+                Session* session = kind == SlotKind::Line || slot->origin.framed
+                    ? route_line(slot->origin.client_addr, slot->origin.client_port, slot->origin.sender_id)
+                    : nullptr;
+                if (slot->origin.framed) {
+                    sender_table.record(slot->origin.client_addr, slot->origin.sender_id,
+                                        slot->origin.sequence);
+                    if (session) {
+                        session->senders.record(slot->origin.client_addr, slot->origin.sender_id,
+                                                slot->origin.sequence);
+                    }
+                }
+                
+                if (kind == SlotKind::Fragment) {
+                    add_fragment(*slot);
+                    ring.release(slot);
+                    continue;
+                }
+                if (kind != SlotKind::Line) {
+                    RecordOrigin origin = slot->origin;
+                    ring.release(slot);
+                    handle_control(kind, origin);
+                    continue;
+                }
+                
+                LineFields fields{slot->received_at, slot->origin.client_addr,
+                                  std::string_view(slot->line + SOURCE_OFFSET, slot->source_length),
+                                  std::string_view(slot->line + slot->message_offset,
+                                                   slot->length - slot->message_offset)};
+                append_to_batch(slot->line, slot->length, fields, session);
+                ring.release(slot);
+                count_pending_line(taken_at);
+            }
+            
+            if (!reassembly.empty()) {
+                reassembly.expire(std::chrono::steady_clock::now(),
+                                  [this](const PendingMessage& message, DiscardReason reason) {
+                                      write_discard_notice(message, reason);
+                                  });
+            }
+            write_drop_summary(false);
+            if (commit_due()) {
+                commit_batch();
+            }
+            rotate_due_files();
+            reap_idle_sessions();
+            active_sessions.store(sessions.size(), std::memory_order_relaxed);
+            
+            if (ring.empty()) {
+                if (receivers_stopped) break;
+                park_writer(park_timeout_ms());
+            }
         }
         
-        server_log << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S") 
-                   << " | " << event << std::endl;
-        server_log.flush();
+        // Final flush
+        reassembly.discard_all([this](const PendingMessage& message, DiscardReason reason) {
+            write_discard_notice(message, reason);
+        });
+        write_drop_summary(true);
+        commit_batch();
     }
     
-public:
-    UDPLogServer() {
-        // Create log directory if it doesn't exist
-        std::filesystem::create_directories(LOG_DIR);
-        
-        // Open server log
-        server_log.open(SERVER_LOG, std::ios::out | std::ios::app);
-        log_server_event("Server instance created");
+    void handle_control(SlotKind kind, const RecordOrigin& origin) {
+        // Lines batched before the command (and the drops among them)
+        // belong to the previous session
+        write_drop_summary(true);
+        commit_batch();
         
-        // Open current.log for immediate writing
-        current_log_file_stream.open(CURRENT_LOG, std::ios::out | std::ios::trunc);
-        current_log_file_stream << "=== UDP Log Server Started ===" << std::endl;
-        current_log_file_stream << "Timestamp: " << get_timestamp() << std::endl;
-        current_log_file_stream << "Waiting for messages on port " << UDP_PORT << std::endl;
-        current_log_file_stream << "==============================" << std::endl;
-        current_log_file_stream.flush();
+        AllocationCountPause pause;
+        if (kind == SlotKind::NewSession) {
+            start_new_session(origin);
+        } else if (kind == SlotKind::EndSession) {
+            // A framed sender only ends its own session; a plain client may
+            // send the command from another socket than NEW_SESSION came from
+            Session* session = origin.framed
+                ? find_own_session(origin.client_addr, origin.client_port, origin.sender_id)
+                : find_client_session(origin.client_addr, origin.client_port, origin.sender_id);
+            if (session) {
+                end_session(session, SessionEndReason::ClientRequest);
+            }
+        } else if (kind == SlotKind::EndAllSessions) {
+            while (!sessions.empty()) {
+                end_session(sessions.front().get(), SessionEndReason::Shutdown);
+            }
+        }
     }
     
-    ~UDPLogServer() {
-        log_server_event("Server instance destroyed");
-        if (server_log.is_open()) {
-            server_log.close();
+    // Appends a "[SERVER]" line listing the lines dropped per source since
+    // the previous summary. Written at most every DROP_SUMMARY_INTERVAL,
+    // or at session boundaries and shutdown when forced.
+    void write_drop_summary(bool force) {
+        uint64_t total = queue_full_drops.load(std::memory_order_relaxed);
+        if (total == drops_summarized) return;
+        auto now = std::chrono::steady_clock::now();
+        if (!force && now - last_drop_summary < DROP_SUMMARY_INTERVAL) return;
+        drops_summarized = total;
+        
+        char per_source[LINE_CAPACITY];
+        LineBuilder list(per_source, sizeof(per_source));
+        uint64_t dropped = 0;
+        sources.for_each([&](SourceEntry& entry) {
+            uint64_t count = entry.dropped.load(std::memory_order_relaxed);
+            if (count == entry.dropped_reported) return;
+            list.append(' ');
+            list.append(entry.source());
+            list.append('=');
+            list.append_number(count - entry.dropped_reported);
+            dropped += count - entry.dropped_reported;
+            entry.dropped_reported = count;
+        });
+        if (dropped == 0) return;
+        
+        char text[LINE_CAPACITY];
+        char timestamp[TIMESTAMP_LENGTH];
+        auto time = std::chrono::system_clock::now();
+        timestamp_cache.format(timestamp, time);
+        LineBuilder line(text, sizeof(text));
+        line.append(timestamp, TIMESTAMP_LENGTH);
+        line.append(" [");
+        line.append_padded("SERVER", SOURCE_COLUMN_WIDTH);
+        line.append("] [local] ");
+        size_t message_offset = line.size();
+        line.append("Overload (");
+        line.append(overload_policy_name(config.overload_policy));
+        line.append("): dropped ");
+        line.append_number(dropped);
+        line.append(" lines");
+        if (last_drop_summary != std::chrono::steady_clock::time_point{}) {
+            line.append(" in the last ");
+            line.append_number(std::chrono::duration_cast<std::chrono::milliseconds>(now - last_drop_summary).count());
+            line.append(" ms");
         }
-        if (current_log_file_stream.is_open()) {
-            current_log_file_stream.close();
+        line.append(':');
+        line.append(per_source, list.size());
+        last_drop_summary = now;
+        LineFields fields{time, 0, "SERVER", std::string_view(text + message_offset, line.size() - message_offset)};
+        
+        // Drops are server-wide, so every open session gets the summary
+        for (auto& session : sessions) {
+            append_to_session(*session, text, line.size(), fields);
         }
-        stop();
+        append_to_current(text, line.size());
     }
     
-    bool start() {
-        // Create UDP socket
-        socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
-        if (socket_fd < 0) {
-            std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
-            return false;
-        }
-        
-        // Allow socket reuse
-        int reuse = 1;
-        if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
-            std::cerr << "Failed to set SO_REUSEADDR: " << strerror(errno) << std::endl;
-            close(socket_fd);
-            return false;
+    void add_fragment(const LogSlot& slot) {
+        PendingMessage complete;
+        if (reassembly.add(slot.origin, slot.fragment, slot.line, slot.length, slot.received_at, complete,
+                           [this](const PendingMessage& message, DiscardReason reason) {
+                               write_discard_notice(message, reason);
+                           })) {
+            write_reassembled(complete);
         }
-        
-        // Bind to port
-        struct sockaddr_in server_addr{};
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_addr.s_addr = INADDR_ANY;
-        server_addr.sin_port = htons(UDP_PORT);
-        
-        if (bind(socket_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-            std::cerr << "Failed to bind to port " << UDP_PORT << ": " << strerror(errno) << std::endl;
-            close(socket_fd);
-            return false;
+    }
+    
+    // Formats a reassembled record like any other line, stamped with the
+    // arrival time of its first fragment
+    void write_reassembled(const PendingMessage& message) {
+        std::string record;
+        record.reserve(message.bytes);
+        for (const auto& fragment : message.fragments) {
+            record += fragment;
         }
         
-        // Set receive timeout to allow periodic checking of running flag
-        struct timeval tv;
-        tv.tv_sec = 0;
-        tv.tv_usec = 100000; // 100ms timeout
-        setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-        
-        running = true;
+        std::string_view source;
+        std::string_view content;
+        split_record(std::string_view(record.data(), strnlen(record.data(), record.size())), source, content);
         
-        // Start worker threads
-        receiver_thread = std::thread(&UDPLogServer::receive_loop, this);
-        writer_thread = std::thread(&UDPLogServer::write_loop, this);
+        char timestamp[TIMESTAMP_LENGTH];
+        timestamp_cache.format(timestamp, message.received_at);
+        char client_ip[INET_ADDRSTRLEN];
+        struct in_addr addr;
+        addr.s_addr = message.client_addr;
+        inet_ntop(AF_INET, &addr, client_ip, INET_ADDRSTRLEN);
         
-        std::cout << "UDP Log Server started on port " << UDP_PORT << std::endl;
-        std::cout << "Log directory: " << LOG_DIR << std::endl;
-        std::cout << "Waiting for NEW_SESSION command..." << std::endl;
-        std::cout << "Press Ctrl+C to stop server" << std::endl;
+        char prefix[LINE_CAPACITY];
+        LineBuilder line(prefix, sizeof(prefix));
+        append_line_prefix(line, timestamp, source, client_ip);
         
-        return true;
+        std::string text;
+        text.reserve(line.size() + content.size());
+        text.append(prefix, line.size());
+        text.append(content);
+        messages_received.fetch_add(1, std::memory_order_relaxed);
+        LineFields fields{message.received_at, message.client_addr, source, content};
+        append_to_batch(text.data(), text.size(), fields, route_line(message.client_addr, 0, message.sender_id));
     }
     
-    void stop() {
-        if (!running) return;
-        
-        std::cout << "\nStopping server..." << std::endl;
-        running = false;
+    // A "[SERVER]" line in place of a record that could not be reassembled
+    void write_discard_notice(const PendingMessage& message, DiscardReason reason) {
+        char timestamp[TIMESTAMP_LENGTH];
+        auto time = std::chrono::system_clock::now();
+        timestamp_cache.format(timestamp, time);
+        char client_ip[INET_ADDRSTRLEN];
+        struct in_addr addr;
+        addr.s_addr = message.client_addr;
+        inet_ntop(AF_INET, &addr, client_ip, INET_ADDRSTRLEN);
         
-        // End any active session
-        if (session_active) {
-            end_session();
+        char text[LINE_CAPACITY];
+        LineBuilder line(text, sizeof(text));
+        append_line_prefix(line, timestamp, "SERVER", client_ip);
+        char detail[160];
+        int length = snprintf(detail, sizeof(detail),
+                              "Discarded incomplete message %u from sender %08x: %u of %u fragments (%s)",
+                              message.message_id, message.sender_id, message.received, message.count,
+                              discard_reason_name(reason));
+        std::string_view notice(detail, std::min(static_cast<size_t>(std::max(length, 0)), sizeof(detail) - 1));
+        line.append(notice);
+        LineFields fields{time, message.client_addr, "SERVER", notice};
+        append_to_batch(text, line.size(), fields, route_line(message.client_addr, 0, message.sender_id));
+    }
+    
+    // Queues one line for current.log and, if session is set, for that
+    // session's file. The session copy is always queued first, so a session
+    // batch never holds lines the current.log batch lacks and the flush
+    // policy only has to watch write_batch.
+    void append_to_batch(const char* text, size_t length, const LineFields& fields, Session* session) {
+        if (session) {
+            append_to_session(*session, text, length, fields);
         }
-        
-        // Wake up writer thread
-        queue_cv.notify_all();
-        
-        // Wait for threads to finish
-        if (receiver_thread.joinable()) {
-            receiver_thread.join();
+        append_to_current(text, length);
+    }
+    
+    // A line too large for a commit chunk is written on its own right after
+    // what is already pending. JSON and binary sessions get the line's
+    // fields encoded instead of its text.
+    void append_to_session(Session& session, const char* text, size_t length, const LineFields& fields) {
+        bool newline = true;
+        switch (config.session_format) {
+            case LogFormat::Text:
+                break;
+            case LogFormat::JsonLines: {
+                LogRecord record = make_record(session, fields);
+                encode_buffer.resize(std::max(encode_buffer.size(), json_line_capacity(record)));
+                length = encode_json_line(record, encode_buffer.data());
+                text = encode_buffer.data();
+                break;
+            }
+            case LogFormat::Binary: {
+                LogRecord record = make_record(session, fields);
+                encode_buffer.resize(std::max(encode_buffer.size(), binary_record_size(record)));
+                length = encode_binary_record(record, encode_buffer.data());
+                text = encode_buffer.data();
+                newline = false;
+                break;
+            }
         }
-        if (writer_thread.joinable()) {
-            writer_thread.join();
+        if (session.index_fd >= 0) {
+            if (session.index_pending_bytes == sizeof(session.index_pending)) {
+                flush_session_indexes(session);
+            }
+            if (session.index.add_line(text, length, session.index_pending + session.index_pending_bytes)) {
+                session.index_pending_bytes += LOG_INDEX_ENTRY_SIZE;
+            }
+        }
+        if (session.terms_fd >= 0) {
+            session.terms.add_line(text, length);
         }
+        if (session.batch.append(text, length, newline)) return;
+        commit_batch();
+        if (session.batch.append(text, length, newline)) return;
         
-        // Close socket
-        if (socket_fd >= 0) {
-            close(socket_fd);
-            socket_fd = -1;
+        if (session.fd >= 0 && write_line_now(session.fd, text, length, newline) == 0) {
+            session.file_bytes += length + (newline ? 1 : 0);
+            session.lines_written++;
+        } else {
+            failed_lines.fetch_add(1, std::memory_order_relaxed);
+            struct iovec line[2] = {{const_cast<char*>(text), length}, {const_cast<char*>("\n"), newline ? 1u : 0u}};
+            resync_session(session, line, 2);
         }
+    }
+    
+    void append_to_current(const char* text, size_t length) {
+        if (write_batch.append(text, length)) return;
+        commit_batch();
+        if (write_batch.append(text, length)) return;
         
-        std::cout << "Server stopped. Statistics:" << std::endl;
-        std::cout << "  Total sessions: " << sessions_created << std::endl;
-        std::cout << "  Messages received: " << messages_received << std::endl;
-        std::cout << "  Bytes received: " << bytes_received << std::endl;
+        ensure_current_log_open();
+        struct iovec line[2] = {{const_cast<char*>(text), length}, {const_cast<char*>("\n"), 1}};
+        for (auto& sink : sinks) {
+            sink->push(line, 2, 1);
+        }
+        int error = write_line_now(current_log_fd, text, length);
+        if (error != 0) {
+            std::cerr << "ERROR: Cannot write " << length << "-byte line to "
+                      << current_log_path << ": " << strerror(error) << std::endl;
+            failed_lines.fetch_add(1, std::memory_order_relaxed);
+            close_current_log();
+        } else {
+            current_log_bytes += length + 1;
+            lines_written.fetch_add(1, std::memory_order_relaxed);
+        }
+        commits.fetch_add(1, std::memory_order_relaxed);
     }
     
-    bool is_running() const {
-        return running;
+    // Returns 0 or the errno of the failed write
+    int write_line_now(int fd, const char* text, size_t length, bool newline = true) {
+        uint64_t syscalls = 0;
+        struct iovec iov[2] = {{const_cast<char*>(text), length}, {const_cast<char*>("\n"), 1}};
+        FileWrite write{fd, iov, newline ? 2 : 1, 0};
+        write_files(&write, 1, syscalls);
+        write_syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+        return write.error;
     }
     
-private:
-    std::string generate_guid() {
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(0, 15);
-        
-        const char* hex_chars = "0123456789abcdef";
-        std::string guid;
-        
-        for (int i = 0; i < 32; i++) {
-            if (i == 8 || i == 12 || i == 16 || i == 20) {
-                guid += '-';
-            }
-            guid += hex_chars[dis(gen)];
+    // Lines taken in the same writer pass share one entry; the flush latency
+    // of each is measured from when its pass took its first line
+    void count_pending_line(std::chrono::system_clock::time_point taken_at) {
+        if (pending_pass_count > 0 &&
+            (pending_pass_id == writer_pass || pending_pass_count == pending_passes.size())) {
+            pending_passes[pending_pass_count - 1].lines++;
+            return;
         }
-        
-        return guid;
+        pending_passes[pending_pass_count++] = {taken_at, 1};
+        pending_pass_id = writer_pass;
     }
     
-    void start_new_session() {
-        std::lock_guard<std::mutex> lock(session_mutex);
+    bool commit_due() const {
+        if (write_batch.empty()) return false;
         
-        // End current session if active
-        if (session_active) {
-            end_session_internal();
+        switch (config.flush_mode) {
+            case FlushMode::Immediate:
+                return true;
+            case FlushMode::Interval:
+                return std::chrono::steady_clock::now() - write_batch.oldest() >=
+                       std::chrono::milliseconds(config.flush_value);
+            case FlushMode::Bytes:
+                return write_batch.bytes() >= config.flush_value ||
+                       std::chrono::steady_clock::now() - write_batch.oldest() >=
+                       std::chrono::milliseconds(MAX_FLUSH_DELAY_MS);
         }
+        return true;
+    }
+    
+    // How long the writer may sleep before the pending batch becomes due
+    int park_timeout_ms() const {
+        if (write_batch.empty()) return 100;
         
-        // Generate new GUID
-        session_guid = generate_guid();
-        sessions_created++;
-        
-        // Create new log file
-        auto now = std::chrono::system_clock::now();
-        auto time_t = std::chrono::system_clock::to_time_t(now);
-        struct tm* tm_info = std::localtime(&time_t);
-        
-        std::ostringstream filename;
-        filename << LOG_DIR << "/session_";
-        filename << std::put_time(tm_info, "%Y%m%d_%H%M%S");
-        filename << "_" << session_guid.substr(0, 8) << ".log";
+        long limit = config.flush_mode == FlushMode::Interval
+            ? static_cast<long>(config.flush_value) : MAX_FLUSH_DELAY_MS;
+        auto age = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - write_batch.oldest()).count();
+        return static_cast<int>(std::max(1L, std::min(100L, limit - static_cast<long>(age))));
+    }
+    
+    // Writes the pending batches: one writev() to current.log and one to
+    // each session file (and its indexes) with pending data, or all of them
+    // in one io_uring submission
+    void commit_batch() {
+        if (write_batch.empty()) return;
         
-        current_log_file = filename.str();
+        ensure_current_log_open();
         
-        // Delete old session file if requested
-        if (std::filesystem::exists("unified_stream.log")) {
-            std::filesystem::remove("unified_stream.log");
+        struct iovec iov[3 * MAX_SESSIONS + 1][COMMIT_CHUNKS];
+        FileWrite writes[3 * MAX_SESSIONS + 1];
+        writes[0] = {current_log_fd, iov[0], write_batch.gather(iov[0]), 0};
+        for (auto& sink : sinks) {
+            sink->push(iov[0], writes[0].count, write_batch.lines());
         }
-        
-        // Create symlink to current session for convenience
-        std::filesystem::remove("unified_stream.log");
-        std::filesystem::create_symlink(current_log_file, "unified_stream.log");
-        
-        // Open new log file
-        {
-            std::lock_guard<std::mutex> file_lock(file_mutex);
-            if (log_file.is_open()) {
-                log_file.close();
+        int files = 1;
+        int session_writes[MAX_SESSIONS];  // Index in writes of each session's log write, or -1
+        for (size_t s = 0; s < sessions.size(); s++) {
+            auto& session = sessions[s];
+            session_writes[s] = -1;
+            if (!session->batch.empty() && session->fd >= 0) {
+                writes[files] = {session->fd, iov[files], session->batch.gather(iov[files]), 0};
+                session_writes[s] = files;
+                files++;
+            }
+            if (session->index_pending_bytes > 0) {
+                iov[files][0] = {session->index_pending, session->index_pending_bytes};
+                writes[files] = {session->index_fd, iov[files], 1, 0};
+                files++;
+            }
+            std::vector<char>& terms = session->terms.output();
+            if (!terms.empty()) {
+                iov[files][0] = {terms.data(), terms.size()};
+                writes[files] = {session->terms_fd, iov[files], 1, 0};
+                files++;
             }
-            log_file.open(current_log_file, std::ios::out | std::ios::trunc);
-            
-            // Write header
-            log_file << "========================================" << std::endl;
-            log_file << "UDP Log Session Started" << std::endl;
-            log_file << "Session ID: " << session_guid << std::endl;
-            log_file << "Time: " << std::put_time(tm_info, "%Y-%m-%d %H:%M:%S") << std::endl;
-            log_file << "Port: " << UDP_PORT << std::endl;
-            log_file << "========================================" << std::endl;
-            log_file << std::endl;
-            log_file.flush();
+        }
+        uint64_t syscalls = 0;
+        auto write_start = std::chrono::system_clock::now();
+        write_files(writes, files, syscalls);
+        auto write_end = std::chrono::system_clock::now();
+        commit_latency.record(elapsed_ns(write_start, write_end));
+        commit_lines.record(write_batch.lines());
+        for (size_t i = 0; i < pending_pass_count; i++) {
+            flush_latency.record(elapsed_ns(pending_passes[i].taken_at, write_end), pending_passes[i].lines);
+        }
+        pending_pass_count = 0;
+        if (writes[0].error != 0) {
+            std::cerr << "ERROR: Cannot write " << write_batch.lines() << " lines to "
+                      << current_log_path << ": " << strerror(writes[0].error) << std::endl;
+            failed_lines.fetch_add(write_batch.lines(), std::memory_order_relaxed);
+            close_current_log();  // Reopened, and its size recounted, by the next commit
+        } else {
+            current_log_bytes += write_batch.bytes();
+            lines_written.fetch_add(write_batch.lines(), std::memory_order_relaxed);
+        }
+        for (size_t s = 0; s < sessions.size(); s++) {
+            auto& session = sessions[s];
+            int w = session_writes[s];
+            if (w >= 0 && writes[w].error != 0) {
+                // Part of the batch may have reached the file: take its size from there
+                std::cerr << "ERROR: Cannot write " << session->batch.lines() << " lines to " << session->path
+                          << ": " << strerror(writes[w].error) << std::endl;
+                failed_lines.fetch_add(session->batch.lines(), std::memory_order_relaxed);
+                resync_session(*session, iov[w], session->batch.gather(iov[w]));  // Unadvanced
+            } else if (w < 0 && !session->batch.empty()) {
+                failed_lines.fetch_add(session->batch.lines(), std::memory_order_relaxed);
+            } else {
+                session->lines_written += session->batch.lines();
+                session->file_bytes += session->batch.bytes();
+            }
+            session->batch.clear();
+            session->index_pending_bytes = 0;
+            session->terms.output().clear();
         }
         
-        session_active = true;
-        
-        std::cout << "\n=== NEW SESSION STARTED ===" << std::endl;
-        std::cout << "Session ID: " << session_guid << std::endl;
-        std::cout << "Log file: " << current_log_file << std::endl;
-        std::cout << "Symlink: unified_stream.log" << std::endl;
-        std::cout << std::endl;
+        commits.fetch_add(1, std::memory_order_relaxed);
+        write_syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+        write_batch.clear();
     }
     
-    void end_session() {
-        std::lock_guard<std::mutex> lock(session_mutex);
-        end_session_internal();
+    // After a failed write, bytes becomes the file's actual size
+    static void resync_file_bytes(int fd, uint64_t& bytes) {
+        struct stat info;
+        if (fd >= 0 && fstat(fd, &info) == 0) {
+            bytes = static_cast<uint64_t>(info.st_size);
+        }
     }
     
-    void end_session_internal() {
-        if (!session_active) return;
+    // After a failed write of the text in iov, of which the file may have
+    // taken a prefix: the session's size comes from the file, and its
+    // indexes continue from the end of that prefix. The builders had
+    // already counted all of the text.
+    void resync_session(Session& session, const struct iovec* iov, int count) {
+        uint64_t previous_bytes = session.file_bytes;
+        resync_file_bytes(session.fd, session.file_bytes);
+        if (session.index_fd < 0 && session.terms_fd < 0) return;
         
-        {
-            std::lock_guard<std::mutex> file_lock(file_mutex);
-            
-            if (log_file.is_open()) {
-                auto now = std::chrono::system_clock::now();
-                auto time_t = std::chrono::system_clock::to_time_t(now);
-                
-                log_file << std::endl;
-                log_file << "========================================" << std::endl;
-                log_file << "Session Ended" << std::endl;
-                log_file << "Session ID: " << session_guid << std::endl;
-                log_file << "Time: " << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S") << std::endl;
-                log_file << "Messages: " << messages_received << std::endl;
-                log_file << "========================================" << std::endl;
-                log_file.flush();
-                log_file.close();
-            }
+        uint64_t written = session.file_bytes > previous_bytes ? session.file_bytes - previous_bytes : 0;
+        uint64_t lost_lines = 0;
+        for (int i = 0; i < count; i++) {
+            const char* data = static_cast<const char*>(iov[i].iov_base);
+            size_t kept = static_cast<size_t>(std::min<uint64_t>(written, iov[i].iov_len));
+            lost_lines += std::count(data + kept, data + iov[i].iov_len, '\n');
+            written -= kept;
+        }
+        if (session.index_fd >= 0) {
+            session.index.resync(session.file_bytes, session.index.next_line() - lost_lines);
+        }
+        if (session.terms_fd >= 0) {
+            session.terms.resync(session.file_bytes, session.terms.next_line() - lost_lines);
         }
-        
-        session_active = false;
-        
-        std::cout << "\n=== SESSION ENDED ===" << std::endl;
-        std::cout << "Session ID: " << session_guid << std::endl;
-        std::cout << "Log file: " << current_log_file << std::endl;
-        std::cout << std::endl;
-        
-        session_guid.clear();
-        current_log_file.clear();
-        
-        // Reset message counter for new session
-        messages_received = 0;
-        bytes_received = 0;
     }
     
-    std::string get_timestamp() {
-        auto now = std::chrono::system_clock::now();
-        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
-            now.time_since_epoch()).count();
-        
-        auto microseconds = micros % 1000000;
-        
-        auto time_t = std::chrono::system_clock::to_time_t(now);
-        struct tm* tm_info = std::localtime(&time_t);
-        
-        std::ostringstream oss;
-        oss << std::put_time(tm_info, "%H:%M:%S");
-        oss << '.' << std::setfill('0') << std::setw(6) << microseconds;
-        
-        return oss.str();
+#ifdef HAVE_IO_URING
+    // Drops the writer's ring in the middle of a commit. Requests the kernel
+    // never took are written with writev() instead; the ones it took may
+    // already have written, so they are not repeated: their completions
+    // still arrive in the mapped ring (the kernel posts them without an
+    // io_uring_enter()), and the ring is only unmapped once they have.
+    template <typename Finish>
+    void abandon_writer_uring(FileWrite* writes, int outstanding, Finish& finish, uint64_t& syscalls) {
+        outstanding -= static_cast<int>(writer_uring->withdraw_unsubmitted([&](const struct io_uring_sqe& sqe) {
+            FileWrite& write = writes[sqe.user_data];
+            write.error = writev_all(write.fd, write.iov, write.count, syscalls) ? 0 : errno;
+        }));
+        while (outstanding > 0) {
+            unsigned arrived = writer_uring->for_each_completion(finish);
+            outstanding -= static_cast<int>(arrived);
+            if (arrived == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        writer_uring.reset();
     }
+#endif
     
-    void receive_loop() {
-        char buffer[BUFFER_SIZE];
-        struct sockaddr_in client_addr{};
-        socklen_t client_len = sizeof(client_addr);
-        
-        while (running) {
-            // Receive UDP packet
-            ssize_t bytes = recvfrom(socket_fd, buffer, BUFFER_SIZE - 1, 0,
-                                    (struct sockaddr*)&client_addr, &client_len);
-            
-            if (bytes < 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    // Timeout - check if still running
+    // Writes each file's iovecs in full. The syscall engine makes one
+    // writev() per file; io_uring submits all of them and waits for their
+    // completions in a single io_uring_enter(), finishing a short write
+    // with writev().
+    void write_files(FileWrite* writes, int count, uint64_t& syscalls) {
+#ifdef HAVE_IO_URING
+        if (writer_uring) {
+            int queued = 0;
+            for (int i = 0; i < count; i++) {
+                writes[i].error = writes[i].fd < 0 ? EBADF : 0;
+                if (writes[i].error != 0) continue;
+                struct io_uring_sqe* sqe = writer_uring->get_sqe();
+                if (!sqe) {
+                    if (!writev_all(writes[i].fd, writes[i].iov, writes[i].count, syscalls)) {
+                        writes[i].error = errno;
+                    }
                     continue;
                 }
-                std::cerr << "Receive error: " << strerror(errno) << std::endl;
-                continue;
+                sqe->opcode = IORING_OP_WRITEV;
+                sqe->fd = writes[i].fd;
+                sqe->addr = reinterpret_cast<uint64_t>(writes[i].iov);
+                sqe->len = static_cast<uint32_t>(std::min(writes[i].count, IOV_MAX));
+                sqe->off = static_cast<uint64_t>(-1);  // Current position; the files are O_APPEND
+                sqe->user_data = static_cast<uint64_t>(i);
+                writes[i].error = EINPROGRESS;  // Until its completion arrives
+                queued++;
             }
             
-            if (bytes == 0) continue;
-            
-            // Null terminate
-            buffer[bytes] = '\0';
-            
-            // Parse message format: "SOURCE|MESSAGE"
-            std::string message(buffer);
-            std::string source = "UNKNOWN";
-            std::string content = message;
-            
-            size_t delimiter_pos = message.find('|');
-            if (delimiter_pos != std::string::npos) {
-                source = message.substr(0, delimiter_pos);
-                content = message.substr(delimiter_pos + 1);
-            }
+            auto finish = [&](const struct io_uring_cqe& cqe) {
+                FileWrite& write = writes[cqe.user_data];
+                write.error = 0;
+                if (cqe.res < 0) {
+                    write.error = -cqe.res;
+                    return;
+                }
+                int left = advance_iov(write.iov, write.count, static_cast<size_t>(cqe.res));
+                if (left > 0 && !writev_all(write.fd, write.iov, left, syscalls)) {
+                    write.error = errno;
+                }
+            };
             
-            // Handle special commands
-            if (source == "CMD") {
-                if (content == "NEW_SESSION") {
-                    start_new_session();
-                    continue;
-                } else if (content == "END_SESSION") {
-                    end_session();
-                    continue;
+            // The requests point at the callers' iovecs: wait for all of them.
+            // Signals just retry; after URING_WRITE_RETRIES failed calls in a
+            // row the ring is given up and later commits use writev()
+            int completed = 0;
+            int failures = 0;
+            while (completed < queued) {
+                int error = writer_uring->submit_and_wait(queued - completed, 1000);
+                syscalls++;
+                if (error == EINTR) continue;
+                if (error != 0) {
+                    std::cerr << "io_uring_enter error: " << strerror(error) << std::endl;
+                    if (++failures < URING_WRITE_RETRIES) continue;
+                    std::cerr << "Writer: io_uring failed " << failures << " times in a row, using writev()"
+                              << std::endl;
+                    abandon_writer_uring(writes, queued - completed, finish, syscalls);
+                    return;
                 }
+                failures = 0;
+                completed += writer_uring->for_each_completion(finish);
             }
-            
-            // Update statistics (always count messages)
-            messages_received++;
-            bytes_received += bytes;
-            
-            // Get client IP
-            char client_ip[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-            
-            // Format log line
-            std::ostringstream log_line;
-            log_line << get_timestamp() 
-                    << " [" << std::left << std::setw(6) << source << "]"
-                    << " [" << client_ip << "]"
-                    << " " << content;
-            
-            // Queue for writing
-            {
-                std::lock_guard<std::mutex> lock(queue_mutex);
-                message_queue.push(log_line.str());
+            return;
+        }
+#endif
+        for (int i = 0; i < count; i++) {
+            writes[i].error = 0;
+            if (writes[i].fd < 0) {
+                writes[i].error = EBADF;
+            } else if (!writev_all(writes[i].fd, writes[i].iov, writes[i].count, syscalls)) {
+                writes[i].error = errno;
             }
-            queue_cv.notify_one();
         }
     }
     
-    void write_loop() {
-        while (running || !message_queue.empty()) {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            
-            // Wait for messages or shutdown
-            queue_cv.wait(lock, [this] {
-                return !message_queue.empty() || !running;
-            });
-            
-            // Process all queued messages
-            while (!message_queue.empty()) {
-                std::string message = message_queue.front();
-                message_queue.pop();
-                lock.unlock();
-                
-                // ALWAYS write to current.log (recreate if missing)
-                {
-                    std::lock_guard<std::mutex> file_lock(file_mutex);
-                    
-                    // Check if file exists, if not reopen
-                    if (!std::filesystem::exists(CURRENT_LOG)) {
-                        current_log_file_stream.close();
-                        current_log_file_stream.clear(); // Clear any error flags
-                        current_log_file_stream.open(CURRENT_LOG, std::ios::out | std::ios::app);
-                        if (current_log_file_stream.is_open()) {
-                            current_log_file_stream << "=== Log File Created ===" << std::endl;
-                            current_log_file_stream << "Timestamp: " << get_timestamp() << std::endl;
-                            current_log_file_stream << "===================" << std::endl;
-                        }
-                    }
-                    
-                    // Check if stream is good
-                    if (!current_log_file_stream.is_open() || !current_log_file_stream.good()) {
-                        current_log_file_stream.close();
-                        current_log_file_stream.clear(); // Clear any error flags
-                        current_log_file_stream.open(CURRENT_LOG, std::ios::out | std::ios::app);
-                    }
-                    
-                    if (current_log_file_stream.is_open()) {
-                        current_log_file_stream << message << std::endl;
-                        current_log_file_stream.flush();  // Always flush for immediate visibility
-                    } else {
-                        std::cerr << "ERROR: Cannot write to log file: " << message << std::endl;
-                    }
-                }
-                
-                // Also write to session file if session is active
-                if (session_active) {
-                    std::lock_guard<std::mutex> file_lock(file_mutex);
-                    if (log_file.is_open()) {
-                        log_file << message << std::endl;
-                        
-                        // Flush periodically for real-time viewing
-                        if (messages_received % 10 == 0) {
-                            log_file.flush();
-                        }
-                    }
-                }
-                
-                lock.lock();
-            }
+    // ALWAYS write to current.log (recreate if it was deleted or rotated away)
+    void ensure_current_log_open() {
+        if (!current_log_watcher->replaced(current_log_fd)) {
+            return;
         }
         
-        // Final flush
-        if (session_active) {
-            std::lock_guard<std::mutex> file_lock(file_mutex);
-            if (log_file.is_open()) {
-                log_file.flush();
-            }
+        AllocationCountPause pause;
+        close_current_log();
+        std::error_code ignored;
+        std::filesystem::create_directories(config.log_dir, ignored);
+        current_log_watcher->rearm();
+        current_log_fd = open(current_log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        current_log_bytes = 0;
+        current_log_opened = std::chrono::steady_clock::now();
+        current_log_reopens.fetch_add(1, std::memory_order_relaxed);
+        if (current_log_fd >= 0) {
+            std::ostringstream header;
+            header << "=== Log File Created ===" << std::endl;
+            header << "Timestamp: " << get_timestamp() << std::endl;
+            header << "===================" << std::endl;
+            write_current_log(header.str());
+        }
+    }
+    
+    void write_current_log(const std::string& text) {
+        write_all(current_log_fd, text);
+        current_log_bytes += text.size();
+    }
+    
+    void close_current_log() {
+        if (current_log_fd >= 0) {
+            close(current_log_fd);
+            current_log_fd = -1;
         }
     }
 };
@@ -502,14 +4460,379 @@ void signal_handler(int signal) {
     }
 }
 
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]" << std::endl;
+    std::cout << "  --port N         UDP port to listen on (default " << UDP_PORT << ")" << std::endl;
+    std::cout << "  --log-dir PATH   Directory for current.log, server.log and session files" << std::endl;
+    std::cout << "  --receivers N    Receiver threads sharing the port via SO_REUSEPORT, 1-"
+              << MAX_RECEIVERS << " (default 1)" << std::endl;
+    std::cout << "  --unix PATH      Also accept datagrams on a Unix-domain socket at PATH" << std::endl;
+    std::cout << "  --shm NAME       Also accept datagrams from a shared-memory ring, e.g. /udp_log" << std::endl;
+    std::cout << "  --shm-slots N    Shared-memory ring capacity, power of two (default "
+              << DEFAULT_SHM_SLOTS << ", " << sizeof(ShmSlot) << " bytes each)" << std::endl;
+    std::cout << "  --rcvbuf-min N   Initial SO_RCVBUF in bytes (default " << DEFAULT_RCVBUF_MIN << ")" << std::endl;
+    std::cout << "  --rcvbuf-max N   Adaptive SO_RCVBUF ceiling in bytes (default " << DEFAULT_RCVBUF_MAX << ")" << std::endl;
+    std::cout << "  --queue-slots N  Receiver -> writer ring capacity, power of two (default "
+              << DEFAULT_QUEUE_SLOTS << ")" << std::endl;
+    std::cout << "  --queue-memory N Byte budget for queued lines; sets --queue-slots to fit ("
+              << sizeof(LogSlot) << " bytes per line)" << std::endl;
+    std::cout << "  --overload P     When the queue is full: drop-newest (default), drop-oldest," << std::endl;
+    std::cout << "                   or sample (keep 1 in N lines per source above "
+              << SAMPLE_WATERMARK_PERCENT << "% full)" << std::endl;
+    std::cout << "  --sample RULES   Sampling rates, e.g. iOS=1,JS=10,*=5 (default *="
+              << DEFAULT_SAMPLE_KEEP_EVERY << ")" << std::endl;
+    std::cout << "  --batch-clock C  Times for batched records: server (arrival minus client-side" << std::endl;
+    std::cout << "                   age, default) or client (the client's clock)" << std::endl;
+    std::cout << "  --reassembly-memory N" << std::endl;
+    std::cout << "                   Byte cap on buffered fragments of large records (default "
+              << DEFAULT_REASSEMBLY_MEMORY << ")" << std::endl;
+    std::cout << "  --session-idle S End a session after S seconds without lines from its client" << std::endl;
+    std::cout << "                   (default " << DEFAULT_SESSION_IDLE_SECONDS << ", 0 = never)" << std::endl;
+    std::cout << "  --index-lines N  Session index entry every N lines (default " << DEFAULT_INDEX_LINES
+              << ", 0 = no line interval)" << std::endl;
+    std::cout << "  --index-ms MS    Session index entry every MS of line time (default " << DEFAULT_INDEX_MS
+              << ", 0 = no time interval;" << std::endl;
+    std::cout << "                   both 0 = no .idx files)" << std::endl;
+    std::cout << "  --term-block N   Lines per block of the session term index used by log_search" << std::endl;
+    std::cout << "                   (default " << DEFAULT_TERM_BLOCK_LINES << ", 0 = no .terms files)" << std::endl;
+    std::cout << "  --format F       Session file encoding: text (default), jsonl or binary; current.log" << std::endl;
+    std::cout << "                   and sinks stay text (.idx/.terms files are written for text only)" << std::endl;
+    std::cout << "  --rotate-size N  Rotate current.log and session files once they reach N bytes (default 0 = never)"
+              << std::endl;
+    std::cout << "  --rotate-age S   Rotate current.log and session files once they are S seconds old" << std::endl;
+    std::cout << "                   (default 0 = never); sessions continue in FILE.partNNN.log" << std::endl;
+    std::cout << "  --compress MODE  on: compress rotated and ended files to FILE" << LOG_COMPRESSED_SUFFIX
+              << " in the background" << std::endl;
+    std::cout << "                   (the offline tools read them directly); off (default)" << std::endl;
+    std::cout << "  --flush POLICY   When batched lines are written: immediate (default)," << std::endl;
+    std::cout << "                   interval:MS, or bytes:N (capped at " << MAX_FLUSH_DELAY_MS << " ms)" << std::endl;
+    std::cout << "  --recv-batch N   Datagrams per recvmmsg() call, 1-" << MAX_RECV_BATCH
+              << " (1 = one recvfrom() per datagram)" << std::endl;
+    std::cout << "  --io-engine E    syscalls (recvmsg/recvmmsg and writev, default) or io_uring" << std::endl;
+    std::cout << "                   (multishot receives and batched writes; falls back if unavailable)" << std::endl;
+    std::cout << "  --timestamps SRC Line timestamps: user (clock read while formatting, default)" << std::endl;
+    std::cout << "                   or kernel (datagram arrival time from the socket)" << std::endl;
+    std::cout << "  --sink SPEC      Also send every current.log line to file:PATH, stdout, tcp:HOST:PORT" << std::endl;
+    std::cout << "                   or rotate:PATH:BYTES[:KEEP] (repeatable; each has its own queue and thread)"
+              << std::endl;
+    std::cout << "  --sink-queue N   Queue bytes per sink; a sink that falls this far behind misses lines"
+              << std::endl;
+    std::cout << "                   (default " << DEFAULT_SINK_QUEUE_BYTES << ", at least "
+              << COMMIT_CHUNK_SIZE * COMMIT_CHUNKS << ")" << std::endl;
+    std::cout << "  --metrics-port N Serve Prometheus metrics at http://127.0.0.1:N/metrics (default 0 = off)"
+              << std::endl;
+    std::cout << "  --stats-interval S" << std::endl;
+    std::cout << "                   Seconds between rate, drop and latency summaries in " << SERVER_LOG
+              << " (default " << DEFAULT_STATS_INTERVAL_SECONDS << ", 0 = none)" << std::endl;
+    std::cout << "  --help           Show this message" << std::endl;
+}
+
+bool parse_flush_policy(const std::string& value, ServerConfig& config) {
+    if (value == "immediate") {
+        config.flush_mode = FlushMode::Immediate;
+        config.flush_value = 0;
+        return true;
+    }
+    
+    size_t colon = value.find(':');
+    if (colon == std::string::npos) return false;
+    std::string mode = value.substr(0, colon);
+    long amount = atol(value.c_str() + colon + 1);
+    if (amount <= 0) return false;
+    
+    if (mode == "interval") {
+        config.flush_mode = FlushMode::Interval;
+    } else if (mode == "bytes") {
+        config.flush_mode = FlushMode::Bytes;
+    } else {
+        return false;
+    }
+    config.flush_value = amount;
+    return true;
+}
+
+// "SOURCE=N[,SOURCE=N...]"; "*" sets the rate for sources without a rule
+bool parse_sample_rules(const std::string& value, ServerConfig& config) {
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos) end = value.size();
+        std::string rule = value.substr(start, end - start);
+        size_t equals = rule.find('=');
+        if (equals == std::string::npos || equals == 0) {
+            return false;
+        }
+        int keep_every = atoi(rule.c_str() + equals + 1);
+        if (keep_every < 1) {
+            return false;
+        }
+        std::string source = rule.substr(0, std::min(equals, SOURCE_NAME_CAPACITY));
+        if (source == "*") {
+            config.sample_default = keep_every;
+        } else {
+            config.sample_rules.push_back({source, static_cast<unsigned int>(keep_every)});
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+bool parse_args(int argc, char* argv[], ServerConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            exit(0);
+        }
+        
+        if (i + 1 >= argc) {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        
+        if (arg == "--port") {
+            int port = atoi(value.c_str());
+            if (port < 1 || port > 65535) {
+                std::cerr << "--port must be between 1 and 65535" << std::endl;
+                return false;
+            }
+            config.port = port;
+        } else if (arg == "--log-dir") {
+            config.log_dir = value;
+        } else if (arg == "--unix") {
+            config.unix_path = value;
+        } else if (arg == "--shm") {
+            // POSIX shared-memory names are "/name" with no further slashes
+            if (value.size() < 2 || value[0] != '/' || value.find('/', 1) != std::string::npos) {
+                std::cerr << "--shm must be a name like /udp_log" << std::endl;
+                return false;
+            }
+            config.shm_name = value;
+        } else if (arg == "--shm-slots") {
+            long slots = atol(value.c_str());
+            if (slots < 2 || slots > static_cast<long>(MAX_SHM_SLOTS) || (slots & (slots - 1)) != 0) {
+                std::cerr << "--shm-slots must be a power of two between 2 and " << MAX_SHM_SLOTS << std::endl;
+                return false;
+            }
+            config.shm_slots = static_cast<uint32_t>(slots);
+        } else if (arg == "--receivers") {
+            int receivers = atoi(value.c_str());
+            if (receivers < 1 || receivers > static_cast<int>(MAX_RECEIVERS)) {
+                std::cerr << "--receivers must be between 1 and " << MAX_RECEIVERS << std::endl;
+                return false;
+            }
+#ifndef HAVE_REUSEPORT_BALANCING
+            if (receivers > 1) {
+                std::cerr << "SO_REUSEPORT load balancing not available on this platform, using --receivers 1" << std::endl;
+                receivers = 1;
+            }
+#endif
+            config.receivers = receivers;
+        } else if (arg == "--rcvbuf-min" || arg == "--rcvbuf-max") {
+            long bytes = atol(value.c_str());
+            if (bytes < 4096 || bytes > (1L << 30)) {
+                std::cerr << arg << " must be between 4096 and " << (1L << 30) << std::endl;
+                return false;
+            }
+            (arg == "--rcvbuf-min" ? config.rcvbuf_min : config.rcvbuf_max) = static_cast<int>(bytes);
+        } else if (arg == "--queue-slots") {
+            long slots = atol(value.c_str());
+            if (slots < 2 || slots > static_cast<long>(MAX_QUEUE_SLOTS) || (slots & (slots - 1)) != 0) {
+                std::cerr << "--queue-slots must be a power of two between 2 and " << MAX_QUEUE_SLOTS << std::endl;
+                return false;
+            }
+            config.queue_slots = slots;
+        } else if (arg == "--queue-memory") {
+            long bytes = atol(value.c_str());
+            if (bytes < static_cast<long>(2 * sizeof(LogSlot))) {
+                std::cerr << "--queue-memory must be at least " << 2 * sizeof(LogSlot) << " bytes" << std::endl;
+                return false;
+            }
+            // Largest power-of-two ring that fits the budget
+            size_t slots = 2;
+            while (slots * 2 <= MAX_QUEUE_SLOTS && slots * 2 * sizeof(LogSlot) <= static_cast<size_t>(bytes)) {
+                slots *= 2;
+            }
+            config.queue_slots = slots;
+        } else if (arg == "--batch-clock") {
+            if (value == "server") {
+                config.batch_clock = BatchClock::Server;
+            } else if (value == "client") {
+                config.batch_clock = BatchClock::Client;
+            } else {
+                std::cerr << "--batch-clock must be server or client" << std::endl;
+                return false;
+            }
+        } else if (arg == "--reassembly-memory") {
+            long bytes = atol(value.c_str());
+            if (bytes < static_cast<long>(MAX_FRAGMENT_PAYLOAD)) {
+                std::cerr << "--reassembly-memory must be at least " << MAX_FRAGMENT_PAYLOAD << " bytes" << std::endl;
+                return false;
+            }
+            config.reassembly_memory = bytes;
+        } else if (arg == "--session-idle") {
+            long seconds = atol(value.c_str());
+            if (seconds < 0 || (seconds == 0 && value != "0") || seconds > INT_MAX / 1000) {
+                std::cerr << "--session-idle must be a number of seconds (0 = never)" << std::endl;
+                return false;
+            }
+            config.session_idle_seconds = static_cast<unsigned int>(seconds);
+        } else if (arg == "--index-lines" || arg == "--index-ms") {
+            long every = atol(value.c_str());
+            if (every < 0 || (every == 0 && value != "0") || every > UINT32_MAX) {
+                std::cerr << arg << " must be a non-negative number (0 = no interval)" << std::endl;
+                return false;
+            }
+            (arg == "--index-lines" ? config.index_lines : config.index_ms) = static_cast<unsigned int>(every);
+        } else if (arg == "--term-block") {
+            long lines = atol(value.c_str());
+            if (lines < 0 || (lines == 0 && value != "0") || lines > UINT32_MAX) {
+                std::cerr << "--term-block must be a number of lines (0 = no term index)" << std::endl;
+                return false;
+            }
+            config.term_block_lines = static_cast<unsigned int>(lines);
+        } else if (arg == "--format") {
+            if (!parse_log_format(value, config.session_format)) {
+                std::cerr << "--format must be text, jsonl or binary" << std::endl;
+                return false;
+            }
+        } else if (arg == "--rotate-size") {
+            long long bytes = atoll(value.c_str());
+            if (bytes < 0 || (bytes == 0 && value != "0")) {
+                std::cerr << "--rotate-size must be a number of bytes (0 = never)" << std::endl;
+                return false;
+            }
+            config.rotate_bytes = static_cast<uint64_t>(bytes);
+        } else if (arg == "--rotate-age") {
+            long seconds = atol(value.c_str());
+            if (seconds < 0 || (seconds == 0 && value != "0") || seconds > INT_MAX) {
+                std::cerr << "--rotate-age must be a number of seconds (0 = never)" << std::endl;
+                return false;
+            }
+            config.rotate_seconds = static_cast<unsigned int>(seconds);
+        } else if (arg == "--compress") {
+            if (value == "on") {
+                config.compress = true;
+            } else if (value == "off") {
+                config.compress = false;
+            } else {
+                std::cerr << "--compress must be on or off" << std::endl;
+                return false;
+            }
+        } else if (arg == "--sink") {
+            SinkSpec spec;
+            std::string error;
+            if (!parse_sink_spec(value, spec, error)) {
+                std::cerr << "--sink " << value << ": " << error << std::endl;
+                return false;
+            }
+            config.sinks.push_back(spec);
+        } else if (arg == "--sink-queue") {
+            long long bytes = atoll(value.c_str());
+            if (bytes < static_cast<long long>(COMMIT_CHUNK_SIZE * COMMIT_CHUNKS)) {
+                std::cerr << "--sink-queue must be at least " << COMMIT_CHUNK_SIZE * COMMIT_CHUNKS
+                          << " bytes (one full commit)" << std::endl;
+                return false;
+            }
+            config.sink_queue_bytes = static_cast<size_t>(bytes);
+        } else if (arg == "--metrics-port") {
+            int port = atoi(value.c_str());
+            if (port < 0 || port > 65535 || (port == 0 && value != "0")) {
+                std::cerr << "--metrics-port must be between 1 and 65535 (0 = off)" << std::endl;
+                return false;
+            }
+            config.metrics_port = port;
+        } else if (arg == "--stats-interval") {
+            long seconds = atol(value.c_str());
+            if (seconds < 0 || (seconds == 0 && value != "0") || seconds > INT_MAX) {
+                std::cerr << "--stats-interval must be a number of seconds (0 = no summaries)" << std::endl;
+                return false;
+            }
+            config.stats_interval_seconds = static_cast<unsigned int>(seconds);
+        } else if (arg == "--overload") {
+            if (value == "drop-newest") {
+                config.overload_policy = OverloadPolicy::DropNewest;
+            } else if (value == "drop-oldest") {
+                config.overload_policy = OverloadPolicy::DropOldest;
+            } else if (value == "sample") {
+                config.overload_policy = OverloadPolicy::Sample;
+            } else {
+                std::cerr << "--overload must be drop-newest, drop-oldest or sample" << std::endl;
+                return false;
+            }
+        } else if (arg == "--sample") {
+            if (!parse_sample_rules(value, config)) {
+                std::cerr << "--sample must be SOURCE=N[,SOURCE=N...] with N >= 1" << std::endl;
+                return false;
+            }
+        } else if (arg == "--flush") {
+            if (!parse_flush_policy(value, config)) {
+                std::cerr << "--flush must be immediate, interval:MS or bytes:N" << std::endl;
+                return false;
+            }
+        } else if (arg == "--recv-batch") {
+            int batch = atoi(value.c_str());
+            if (batch < 1 || batch > static_cast<int>(MAX_RECV_BATCH)) {
+                std::cerr << "--recv-batch must be between 1 and " << MAX_RECV_BATCH << std::endl;
+                return false;
+            }
+#ifndef HAVE_RECVMMSG
+            if (batch > 1) {
+                std::cerr << "recvmmsg() not available on this platform, using --recv-batch 1" << std::endl;
+                batch = 1;
+            }
+#endif
+            config.recv_batch = batch;
+        } else if (arg == "--io-engine") {
+            if (value == "syscalls") {
+                config.io_engine = IoEngine::Syscalls;
+            } else if (value == "io_uring") {
+                config.io_engine = IoEngine::Uring;
+            } else {
+                std::cerr << "--io-engine must be syscalls or io_uring" << std::endl;
+                return false;
+            }
+        } else if (arg == "--timestamps") {
+            if (value == "user") {
+                config.timestamps = TimestampSource::User;
+            } else if (value == "kernel") {
+#ifdef HAVE_KERNEL_TIMESTAMPS
+                config.timestamps = TimestampSource::Kernel;
+#else
+                std::cerr << "Kernel receive timestamps not available on this platform, using --timestamps user" << std::endl;
+#endif
+            } else {
+                std::cerr << "--timestamps must be user or kernel" << std::endl;
+                return false;
+            }
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    
+    if (config.rcvbuf_max < config.rcvbuf_min) {
+        config.rcvbuf_max = config.rcvbuf_min;
+    }
+    return true;
+}
+
 int main(int argc, char* argv[]) {
+    ServerConfig config;
+    if (!parse_args(argc, argv, config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    
     // Set up signal handlers
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
     signal(SIGPIPE, SIG_IGN); // Ignore broken pipe
     
     // Create and start server
-    UDPLogServer server;
+    UDPLogServer server(config);
     g_server = &server;
     
     if (!server.start()) {